@@ -0,0 +1,486 @@
+/* ethereum-columnar.c
+ * Columnar export of discovery messages, for offline analytics.
+ * Copyright 2018, ConsenSys AG.
+ *
+ * Wireshark - Network traffic analyzer
+ * By Gerald Combs <gerald@wireshark.org>
+ * Copyright 1998, Gerald Combs.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "config.h"
+
+#include <string.h>
+
+#include <glib/gstdio.h>
+
+#include "ethereum-columnar.h"
+
+#define COLUMNAR_MAGIC "ETHCOLS"
+#define COLUMNAR_VERSION 1
+#define COLUMNAR_HEADER_LEN 16
+#define COLUMNAR_TRAILER_LEN 12
+
+// Upper bound on the rows of a row group accepted by the reader, so that corrupt files don't exhaust the memory.
+#define COLUMNAR_MAX_GROUP_ROWS (16 * 1024 * 1024)
+
+// Value types of the columns.
+typedef enum column_type {
+  COLUMN_U8 = 1,
+  COLUMN_U16 = 2,
+  COLUMN_U32 = 3,
+  COLUMN_I64 = 4,
+  COLUMN_ADDR = 5
+} column_type_e;
+
+// Encodings of the columns.
+typedef enum column_encoding {
+  COLUMN_DELTA = 1,
+  COLUMN_VARINT = 2,
+  COLUMN_DICT = 3
+} column_encoding_e;
+
+// Describes a column of an export file.
+typedef struct column_desc {
+  const gchar *name;
+  guint8 type;      // column_type_e
+  guint8 encoding;  // column_encoding_e
+} column_desc_t;
+
+// The columns, in the order of ethereum_columnar_column_e. Frame numbers and timestamps grow from row to row;
+// sequence numbers are per conversation, and conversations interleave, so they aren't delta-encoded.
+static const column_desc_t columns[ETHEREUM_COLUMNAR_COLUMNS] = {
+    {"frame", COLUMN_U32, COLUMN_DELTA},
+    {"ts", COLUMN_I64, COLUMN_DELTA},
+    {"src_addr", COLUMN_ADDR, COLUMN_DICT},
+    {"src_port", COLUMN_U16, COLUMN_VARINT},
+    {"dst_addr", COLUMN_ADDR, COLUMN_DICT},
+    {"dst_port", COLUMN_U16, COLUMN_VARINT},
+    {"type", COLUMN_U8, COLUMN_VARINT},
+    {"seq", COLUMN_U32, COLUMN_VARINT},
+    {"seqtype", COLUMN_U32, COLUMN_VARINT},
+    {"rt", COLUMN_I64, COLUMN_VARINT},
+    {"node_count", COLUMN_U32, COLUMN_VARINT}
+};
+
+static void put_be32(guint8 *p, guint32 v) {
+  p[0] = (guint8) (v >> 24);
+  p[1] = (guint8) (v >> 16);
+  p[2] = (guint8) (v >> 8);
+  p[3] = (guint8) v;
+}
+
+static void put_be64(guint8 *p, guint64 v) {
+  put_be32(p, (guint32) (v >> 32));
+  put_be32(p + 4, (guint32) v);
+}
+
+static guint32 get_be32(const guint8 *p) {
+  return ((guint32) p[0] << 24) | ((guint32) p[1] << 16) | ((guint32) p[2] << 8) | p[3];
+}
+
+static guint64 get_be64(const guint8 *p) {
+  return ((guint64) get_be32(p) << 32) | get_be32(p + 4);
+}
+
+/**
+ * Maps signed values to unsigned ones of about the same magnitude: 0, -1, 1, -2... => 0, 1, 2, 3...
+ */
+static guint64 zigzag(gint64 v) {
+  return ((guint64) v << 1) ^ (v < 0 ? G_MAXUINT64 : 0);
+}
+
+static gint64 unzigzag(guint64 v) {
+  return (gint64) ((v >> 1) ^ (v & 1 ? G_MAXUINT64 : 0));
+}
+
+/**
+ * Appends a LEB128 varint.
+ */
+static void put_varint(GByteArray *out, guint64 v) {
+  guint8 buf[10];
+  guint len = 0;
+
+  while (v >= 0x80) {
+    buf[len++] = (guint8) (v | 0x80);
+    v >>= 7;
+  }
+  buf[len++] = (guint8) v;
+  g_byte_array_append(out, buf, len);
+}
+
+/**
+ * Reads a LEB128 varint.
+ *
+ * @return TRUE if successful; FALSE if the varint is truncated or overlong.
+ */
+static gboolean get_varint(const guint8 **p, const guint8 *end, guint64 *v) {
+  guint shift;
+
+  *v = 0;
+  for (shift = 0; shift < 64 && *p < end; shift += 7) {
+    guint8 b = *(*p)++;
+    *v |= (guint64) (b & 0x7f) << shift;
+    if (!(b & 0x80)) {
+      return TRUE;
+    }
+  }
+  return FALSE;
+}
+
+static guint addr_hash(gconstpointer key) {
+  const guint8 *p = (const guint8 *) key;
+  guint h = 2166136261u;
+  guint i;
+
+  for (i = 0; i < ETHEREUM_COLUMNAR_ADDR_LEN; i++) {
+    h = (h ^ p[i]) * 16777619u;
+  }
+  return h;
+}
+
+static gboolean addr_equal(gconstpointer a, gconstpointer b) {
+  return memcmp(a, b, ETHEREUM_COLUMNAR_ADDR_LEN) == 0;
+}
+
+/**
+ * Returns the address column of the current row group, for either the source or the destination.
+ */
+static guint8 *addr_column(const ethereum_columnar_writer_t *writer, guint column) {
+  return writer->addrs + (column == ETHEREUM_COLUMNAR_DST_ADDR ? (gsize) writer->group_rows : 0) *
+                         ETHEREUM_COLUMNAR_ADDR_LEN;
+}
+
+/**
+ * Encodes a column of the current row group into the scratch buffer.
+ */
+static void encode_column(ethereum_columnar_writer_t *writer, guint column) {
+  const gint64 *values = writer->values + (gsize) column * writer->group_rows;
+  GByteArray *out = writer->scratch;
+  gint64 prev = 0;
+  guint i;
+
+  g_byte_array_set_size(out, 0);
+  switch (columns[column].encoding) {
+    case COLUMN_DELTA:
+      for (i = 0; i < writer->len; i++) {
+        put_varint(out, zigzag((gint64) ((guint64) values[i] - (guint64) prev)));
+        prev = values[i];
+      }
+      break;
+    case COLUMN_VARINT:
+      for (i = 0; i < writer->len; i++) {
+        put_varint(out, zigzag(values[i]));
+      }
+      break;
+    case COLUMN_DICT: {
+      const guint8 *addrs = addr_column(writer, column);
+      gint64 *indexes = writer->values + (gsize) column * writer->group_rows;
+      guint distinct = 0;
+
+      // Number the distinct addresses in order of first appearance, then write them out in that order.
+      g_hash_table_remove_all(writer->dict);
+      for (i = 0; i < writer->len; i++) {
+        const guint8 *addr = addrs + (gsize) i * ETHEREUM_COLUMNAR_ADDR_LEN;
+        gpointer index = g_hash_table_lookup(writer->dict, addr);
+        if (!index) {
+          index = GUINT_TO_POINTER(++distinct);
+          g_hash_table_insert(writer->dict, (gpointer) addr, index);
+        }
+        indexes[i] = GPOINTER_TO_UINT(index) - 1;
+      }
+      put_varint(out, distinct);
+      for (i = 0, distinct = 0; i < writer->len; i++) {
+        if (indexes[i] == (gint64) distinct) {
+          g_byte_array_append(out, addrs + (gsize) i * ETHEREUM_COLUMNAR_ADDR_LEN, ETHEREUM_COLUMNAR_ADDR_LEN);
+          distinct++;
+        }
+      }
+      for (i = 0; i < writer->len; i++) {
+        put_varint(out, (guint64) indexes[i]);
+      }
+      break;
+    }
+  }
+}
+
+/**
+ * Encodes the current row group and writes it out.
+ */
+static gboolean write_group(ethereum_columnar_writer_t *writer) {
+  guint8 header[4];
+  guint column;
+
+  put_be32(header, writer->len);
+  if (fwrite(header, sizeof(header), 1, writer->file) != 1) {
+    return FALSE;
+  }
+  for (column = 0; column < ETHEREUM_COLUMNAR_COLUMNS; column++) {
+    encode_column(writer, column);
+    put_be32(header, writer->scratch->len);
+    if (fwrite(header, sizeof(header), 1, writer->file) != 1 ||
+        fwrite(writer->scratch->data, 1, writer->scratch->len, writer->file) != writer->scratch->len) {
+      return FALSE;
+    }
+  }
+  writer->groups++;
+  writer->len = 0;
+  return TRUE;
+}
+
+gboolean ethereum_columnar_writer_open(ethereum_columnar_writer_t *writer, const gchar *path, guint group_rows) {
+  guint8 header[COLUMNAR_HEADER_LEN];
+  gboolean ok;
+  guint column;
+
+  memset(writer, 0, sizeof(*writer));
+  writer->file = strcmp(path, "-") == 0 ? stdout : g_fopen(path, "wb");
+  if (!writer->file) {
+    return FALSE;
+  }
+
+  memset(header, 0, sizeof(header));
+  memcpy(header, COLUMNAR_MAGIC, sizeof(COLUMNAR_MAGIC));
+  put_be32(header + 8, COLUMNAR_VERSION);
+  put_be32(header + 12, ETHEREUM_COLUMNAR_COLUMNS);
+  ok = fwrite(header, sizeof(header), 1, writer->file) == 1;
+  for (column = 0; ok && column < ETHEREUM_COLUMNAR_COLUMNS; column++) {
+    guint8 desc[3] = {columns[column].type, columns[column].encoding, (guint8) strlen(columns[column].name)};
+    ok = fwrite(desc, sizeof(desc), 1, writer->file) == 1 &&
+         fwrite(columns[column].name, desc[2], 1, writer->file) == 1;
+  }
+  if (!ok) {
+    if (writer->file != stdout) {
+      fclose(writer->file);
+    }
+    writer->file = NULL;
+    return FALSE;
+  }
+
+  writer->group_rows = group_rows ? group_rows : ETHEREUM_COLUMNAR_GROUP_ROWS;
+  writer->values = g_new(gint64, (gsize) writer->group_rows * ETHEREUM_COLUMNAR_COLUMNS);
+  writer->addrs = (guint8 *) g_malloc((gsize) writer->group_rows * 2 * ETHEREUM_COLUMNAR_ADDR_LEN);
+  writer->scratch = g_byte_array_new();
+  writer->dict = g_hash_table_new(addr_hash, addr_equal);
+  return TRUE;
+}
+
+gboolean ethereum_columnar_writer_add(ethereum_columnar_writer_t *writer, const ethereum_columnar_row_t *row) {
+  gint64 *values = writer->values + writer->len;
+  gsize stride = writer->group_rows;
+
+  values[ETHEREUM_COLUMNAR_FRAME * stride] = row->frame;
+  values[ETHEREUM_COLUMNAR_TS * stride] = row->ts;
+  values[ETHEREUM_COLUMNAR_SRC_PORT * stride] = row->src_port;
+  values[ETHEREUM_COLUMNAR_DST_PORT * stride] = row->dst_port;
+  values[ETHEREUM_COLUMNAR_TYPE * stride] = row->type;
+  values[ETHEREUM_COLUMNAR_SEQ * stride] = row->seq;
+  values[ETHEREUM_COLUMNAR_SEQTYPE * stride] = row->seqtype;
+  values[ETHEREUM_COLUMNAR_RT * stride] = row->rt;
+  values[ETHEREUM_COLUMNAR_NODE_COUNT * stride] = row->node_count;
+  memcpy(addr_column(writer, ETHEREUM_COLUMNAR_SRC_ADDR) + (gsize) writer->len * ETHEREUM_COLUMNAR_ADDR_LEN,
+         row->src_addr, ETHEREUM_COLUMNAR_ADDR_LEN);
+  memcpy(addr_column(writer, ETHEREUM_COLUMNAR_DST_ADDR) + (gsize) writer->len * ETHEREUM_COLUMNAR_ADDR_LEN,
+         row->dst_addr, ETHEREUM_COLUMNAR_ADDR_LEN);
+
+  writer->rows++;
+  if (++writer->len == writer->group_rows) {
+    return write_group(writer);
+  }
+  return TRUE;
+}
+
+gboolean ethereum_columnar_writer_close(ethereum_columnar_writer_t *writer) {
+  guint8 trailer[4 + COLUMNAR_TRAILER_LEN];
+  gboolean ok = TRUE;
+
+  if (!writer->file) {
+    return FALSE;
+  }
+  if (writer->len > 0) {
+    ok = write_group(writer);
+  }
+
+  put_be32(trailer, 0);
+  put_be64(trailer + 4, writer->rows);
+  put_be32(trailer + 12, writer->groups);
+  ok = ok && fwrite(trailer, sizeof(trailer), 1, writer->file) == 1;
+  if (writer->file == stdout) {
+    ok = fflush(stdout) == 0 && ok;
+  } else {
+    ok = fclose(writer->file) == 0 && ok;
+  }
+
+  g_free(writer->values);
+  g_free(writer->addrs);
+  g_byte_array_free(writer->scratch, TRUE);
+  g_hash_table_destroy(writer->dict);
+  memset(writer, 0, sizeof(*writer));
+  return ok;
+}
+
+gboolean ethereum_columnar_reader_open(ethereum_columnar_reader_t *reader, const gchar *path) {
+  guint8 header[COLUMNAR_HEADER_LEN];
+  guint column;
+
+  memset(reader, 0, sizeof(*reader));
+  reader->file = g_fopen(path, "rb");
+  if (!reader->file) {
+    return FALSE;
+  }
+  if (fread(header, sizeof(header), 1, reader->file) != 1 ||
+      memcmp(header, COLUMNAR_MAGIC, sizeof(COLUMNAR_MAGIC)) != 0 ||
+      get_be32(header + 8) != COLUMNAR_VERSION ||
+      get_be32(header + 12) != ETHEREUM_COLUMNAR_COLUMNS) {
+    ethereum_columnar_reader_close(reader);
+    return FALSE;
+  }
+  for (column = 0; column < ETHEREUM_COLUMNAR_COLUMNS; column++) {
+    guint8 desc[3];
+    gchar name[256];
+    if (fread(desc, sizeof(desc), 1, reader->file) != 1 ||
+        (desc[2] > 0 && fread(name, desc[2], 1, reader->file) != 1) ||
+        desc[0] != columns[column].type || desc[1] != columns[column].encoding ||
+        desc[2] != strlen(columns[column].name) || memcmp(name, columns[column].name, desc[2]) != 0) {
+      ethereum_columnar_reader_close(reader);
+      return FALSE;
+    }
+  }
+  return TRUE;
+}
+
+/**
+ * Decodes a column of a row group into the rows.
+ */
+static gboolean decode_column(guint column, const guint8 *p, const guint8 *end, GArray *rows) {
+  ethereum_columnar_row_t *row;
+  const guint8 *dict = NULL;
+  guint64 v, distinct = 0;
+  gint64 value, prev = 0;
+  guint i;
+
+  if (columns[column].encoding == COLUMN_DICT) {
+    if (!get_varint(&p, end, &distinct) || distinct > (guint64) (end - p) / ETHEREUM_COLUMNAR_ADDR_LEN) {
+      return FALSE;
+    }
+    dict = p;
+    p += distinct * ETHEREUM_COLUMNAR_ADDR_LEN;
+  }
+  for (i = 0; i < rows->len; i++) {
+    if (!get_varint(&p, end, &v)) {
+      return FALSE;
+    }
+    row = &g_array_index(rows, ethereum_columnar_row_t, i);
+    if (columns[column].encoding == COLUMN_DICT) {
+      if (v >= distinct) {
+        return FALSE;
+      }
+      memcpy(column == ETHEREUM_COLUMNAR_SRC_ADDR ? row->src_addr : row->dst_addr,
+             dict + v * ETHEREUM_COLUMNAR_ADDR_LEN, ETHEREUM_COLUMNAR_ADDR_LEN);
+      continue;
+    }
+    value = unzigzag(v);
+    if (columns[column].encoding == COLUMN_DELTA) {
+      value = (gint64) ((guint64) prev + (guint64) value);
+      prev = value;
+    }
+    switch (column) {
+      case ETHEREUM_COLUMNAR_FRAME:
+        row->frame = (guint32) value;
+        break;
+      case ETHEREUM_COLUMNAR_TS:
+        row->ts = value;
+        break;
+      case ETHEREUM_COLUMNAR_SRC_PORT:
+        row->src_port = (guint16) value;
+        break;
+      case ETHEREUM_COLUMNAR_DST_PORT:
+        row->dst_port = (guint16) value;
+        break;
+      case ETHEREUM_COLUMNAR_TYPE:
+        row->type = (guint8) value;
+        break;
+      case ETHEREUM_COLUMNAR_SEQ:
+        row->seq = (guint32) value;
+        break;
+      case ETHEREUM_COLUMNAR_SEQTYPE:
+        row->seqtype = (guint32) value;
+        break;
+      case ETHEREUM_COLUMNAR_RT:
+        row->rt = value;
+        break;
+      case ETHEREUM_COLUMNAR_NODE_COUNT:
+        row->node_count = (guint32) value;
+        break;
+      default:
+        return FALSE;
+    }
+  }
+  return p == end;
+}
+
+gboolean ethereum_columnar_reader_next(ethereum_columnar_reader_t *reader, GArray *rows) {
+  guint8 header[4], trailer[COLUMNAR_TRAILER_LEN];
+  guint32 count, len;
+  guint column;
+
+  if (reader->done || fread(header, sizeof(header), 1, reader->file) != 1) {
+    return FALSE;
+  }
+  count = get_be32(header);
+  if (count == 0) {
+    if (fread(trailer, sizeof(trailer), 1, reader->file) != 1) {
+      return FALSE;
+    }
+    reader->rows = get_be64(trailer);
+    reader->groups = get_be32(trailer + 8);
+    reader->done = TRUE;
+    return FALSE;
+  }
+  if (count > COLUMNAR_MAX_GROUP_ROWS) {
+    return FALSE;
+  }
+
+  g_array_set_size(rows, count);
+  memset(rows->data, 0, (gsize) count * sizeof(ethereum_columnar_row_t));
+  for (column = 0; column < ETHEREUM_COLUMNAR_COLUMNS; column++) {
+    if (fread(header, sizeof(header), 1, reader->file) != 1) {
+      return FALSE;
+    }
+    len = get_be32(header);
+    // A value takes at least one byte, and at most 10 bytes, or 16 bytes and a varint for addresses.
+    if (len < count || len > (guint64) count * (10 + ETHEREUM_COLUMNAR_ADDR_LEN) + 10) {
+      return FALSE;
+    }
+    if (len > reader->buf_len) {
+      reader->buf = (guint8 *) g_realloc(reader->buf, len);
+      reader->buf_len = len;
+    }
+    if (fread(reader->buf, 1, len, reader->file) != len ||
+        !decode_column(column, reader->buf, reader->buf + len, rows)) {
+      return FALSE;
+    }
+  }
+  return TRUE;
+}
+
+void ethereum_columnar_reader_close(ethereum_columnar_reader_t *reader) {
+  if (reader->file) {
+    fclose(reader->file);
+  }
+  g_free(reader->buf);
+  memset(reader, 0, sizeof(*reader));
+}
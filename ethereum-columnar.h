@@ -0,0 +1,161 @@
+/* ethereum-columnar.h
+ * Columnar export of discovery messages, for offline analytics.
+ * Copyright 2018, ConsenSys AG.
+ *
+ * Wireshark - Network traffic analyzer
+ * By Gerald Combs <gerald@wireshark.org>
+ * Copyright 1998, Gerald Combs.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __ETHEREUM_COLUMNAR_H__
+#define __ETHEREUM_COLUMNAR_H__
+
+#include <stdio.h>
+#include <glib.h>
+
+/*
+ * File layout. Integers in headers are in network byte order; everything is written sequentially, so that the
+ * output may be a pipe.
+ *
+ *  - Header: the magic "ETHCOLS\0", a 32-bit version, and a 32-bit column count.
+ *  - Column descriptors: per column, its type, its encoding and its name (a length byte, then the bytes).
+ *  - Row groups: a 32-bit row count, then per column a 32-bit length and the encoded values of the rows.
+ *  - Trailer: a zero row count, then the 64-bit total of rows and the 32-bit number of row groups.
+ *
+ * Column encodings, within a row group:
+ *  - Delta: the difference of each value from the previous one (from 0 for the first), zigzag-encoded as a
+ *    LEB128 varint. Frame numbers and timestamps mostly take one or two bytes.
+ *  - Varint: each value zigzag-encoded as a LEB128 varint.
+ *  - Dictionary: the number of distinct values as a varint, the distinct values in order of first appearance,
+ *    then the index of each value as a varint.
+ */
+
+// Length in bytes of an address: an IPv6 or IPv4-mapped address.
+#define ETHEREUM_COLUMNAR_ADDR_LEN 16
+
+// Default number of rows per row group.
+#define ETHEREUM_COLUMNAR_GROUP_ROWS 65536
+
+// The columns of an export file, in order.
+typedef enum ethereum_columnar_column {
+  ETHEREUM_COLUMNAR_FRAME,
+  ETHEREUM_COLUMNAR_TS,
+  ETHEREUM_COLUMNAR_SRC_ADDR,
+  ETHEREUM_COLUMNAR_SRC_PORT,
+  ETHEREUM_COLUMNAR_DST_ADDR,
+  ETHEREUM_COLUMNAR_DST_PORT,
+  ETHEREUM_COLUMNAR_TYPE,
+  ETHEREUM_COLUMNAR_SEQ,
+  ETHEREUM_COLUMNAR_SEQTYPE,
+  ETHEREUM_COLUMNAR_RT,
+  ETHEREUM_COLUMNAR_NODE_COUNT,
+  ETHEREUM_COLUMNAR_COLUMNS
+} ethereum_columnar_column_e;
+
+// A discovery message.
+typedef struct ethereum_columnar_row {
+  guint32 frame;
+  gint64 ts;                                   // The capture time, in nanoseconds since the epoch.
+  guint8 src_addr[ETHEREUM_COLUMNAR_ADDR_LEN];
+  guint16 src_port;
+  guint8 dst_addr[ETHEREUM_COLUMNAR_ADDR_LEN];
+  guint16 dst_port;
+  guint8 type;                                 // The packet type.
+  guint32 seq;                                 // The sequence number of the message in its conversation.
+  guint32 seqtype;                             // The sequence number among the messages of its type.
+  gint64 rt;                                   // The response time in nanoseconds, or -1 if unknown.
+  guint32 node_count;                          // The number of advertised nodes (NODES and TOPIC_NODES).
+} ethereum_columnar_row_t;
+
+// Writes an export file: the rows are buffered column by column, and each row group is encoded and written out
+// once full, so that the memory footprint is bounded whatever the size of the capture.
+typedef struct ethereum_columnar_writer {
+  FILE *file;
+  guint group_rows;                  // The maximum number of rows per row group.
+  guint len;                         // The number of rows in the current row group.
+  guint64 rows;
+  guint32 groups;
+  gint64 *values;                    // The integer columns of the current row group, column after column.
+  guint8 *addrs;                     // The address columns of the current row group, source then destination.
+  GByteArray *scratch;               // The encoded column being written.
+  GHashTable *dict;                  // Address => index in the dictionary of the column being encoded.
+} ethereum_columnar_writer_t;
+
+// An export file open for reading.
+typedef struct ethereum_columnar_reader {
+  FILE *file;
+  guint8 *buf;                       // The encoded columns of the current row group.
+  guint buf_len;
+  guint64 rows;                      // The total of rows, once the trailer is read.
+  guint32 groups;                    // The number of row groups, once the trailer is read.
+  gboolean done;                     // The trailer was read.
+} ethereum_columnar_reader_t;
+
+/**
+ * Creates an export file, and writes its header out.
+ *
+ * @param writer The writer to initialize.
+ * @param path The path of the file; "-" for the standard output.
+ * @param group_rows The maximum number of rows per row group; 0 for the default.
+ * @return TRUE if the file was created; FALSE otherwise.
+ */
+gboolean ethereum_columnar_writer_open(ethereum_columnar_writer_t *writer, const gchar *path, guint group_rows);
+
+/**
+ * Adds a row to an export file, writing the current row group out if it is full.
+ *
+ * @param writer The writer.
+ * @param row The row.
+ * @return TRUE if successful; FALSE upon a write error.
+ */
+gboolean ethereum_columnar_writer_add(ethereum_columnar_writer_t *writer, const ethereum_columnar_row_t *row);
+
+/**
+ * Writes the last row group and the trailer out, and closes an export file.
+ *
+ * @param writer The writer.
+ * @return TRUE if the file is complete; FALSE upon a write error.
+ */
+gboolean ethereum_columnar_writer_close(ethereum_columnar_writer_t *writer);
+
+/**
+ * Opens an export file, and checks its header and columns.
+ *
+ * @param reader The reader to initialize.
+ * @param path The path of the file.
+ * @return TRUE if the file has the expected columns; FALSE otherwise.
+ */
+gboolean ethereum_columnar_reader_open(ethereum_columnar_reader_t *reader, const gchar *path);
+
+/**
+ * Reads and decodes the next row group of an export file.
+ *
+ * @param reader The reader.
+ * @param rows The array of ethereum_columnar_row_t to replace with the rows of the group.
+ * @return TRUE if a row group was read; FALSE at the end of the file, or if it is truncated or corrupt (in which
+ *         case reader->done is FALSE).
+ */
+gboolean ethereum_columnar_reader_next(ethereum_columnar_reader_t *reader, GArray *rows);
+
+/**
+ * Closes an export file.
+ *
+ * @param reader The reader.
+ */
+void ethereum_columnar_reader_close(ethereum_columnar_reader_t *reader);
+
+#endif //__ETHEREUM_COLUMNAR_H__
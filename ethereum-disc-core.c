@@ -0,0 +1,191 @@
+/* ethereum-disc-core.c
+ * Protocol-level rules of the discovery protocol shared by the dissector and the standalone tools: datagram
+ * layout and checks, request/response correlation, and the negative heuristics cache. Depends on GLib only.
+ * Copyright 2018, ConsenSys AG.
+ *
+ * Wireshark - Network traffic analyzer
+ * By Gerald Combs <gerald@wireshark.org>
+ * Copyright 1998, Gerald Combs.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "config.h"
+
+#include <string.h>
+
+#include "ethereum-disc-core.h"
+#include "ethereum-rlp.h"
+
+#define NSECS_PER_SEC G_GINT64_CONSTANT(1000000000)
+
+gboolean ethereum_disc_check_header(const guint8 *buf, guint len, gboolean *is_discv5) {
+  guint packet_type;
+
+  // Check length.
+  if (len < MIN_ETHDEVP2PDISCO_LEN || len > MAX_ETHDEVP2PDISCO_LEN) {
+    return FALSE;
+  }
+
+  // https://github.com/ethereum/go-ethereum/blob/c4712bf96bc1bae4a5ad4600e9719e4a74bde7d5/p2p/discv5/udp.go#L149
+  *is_discv5 = memcmp(buf, ETHEREUM_DISCV5_ID_STR, strlen(ETHEREUM_DISCV5_ID_STR)) == 0;
+  if (*is_discv5) {
+    packet_type = buf[ETHEREUM_DISCV5_PACKET_TYPE_IDX];
+    return packet_type >= PING && packet_type <= TOPIC_NODES;
+  }
+  packet_type = buf[ETHEREUM_DISC_PACKET_TYPE_IDX];
+  return packet_type >= PING && packet_type <= NODES;
+}
+
+gboolean ethereum_disc_valid_payload(const guint8 *buf, guint len, guint offset) {
+  rlp_element_t rlp;
+
+  if (offset >= len) {
+    return FALSE;
+  }
+  // Top-level list spanning the entire packet; next offset should be zero, to mark the end of the packet.
+  if (!rlp_next_ptr(buf + offset, len - offset, 0, &rlp) || rlp.type != LIST || rlp.next_offset > 0) {
+    return FALSE;
+  }
+  return rlp_validate_ptr(buf + offset, len - offset, ETHEREUM_DISC_MAX_RLP_DEPTH, ETHEREUM_DISC_MAX_RLP_ELEMENTS);
+}
+
+gboolean ethereum_disc_valid_truncated_payload(const guint8 *buf, guint len, guint reported_len, guint offset) {
+  rlp_element_t rlp;
+
+  // Only the header of the list is read, so it is decoded against the reported length.
+  if (offset >= len || rlp_prefix_table[buf[offset]].header_len > len - offset) {
+    return FALSE;
+  }
+  return rlp_next_ptr(buf, reported_len, offset, &rlp) && rlp.type == LIST && rlp.next_offset == 0;
+}
+
+/**
+ * Checks whether a pending request was issued more than the given number of seconds ago.
+ *
+ * @param p The pending request.
+ * @param now The current time, in nanoseconds since the epoch.
+ * @param secs The number of seconds.
+ * @return TRUE if the request is older; FALSE otherwise.
+ */
+static gboolean pending_older_than(const ethereum_disc_pending_t *p, gint64 now, gint64 secs) {
+  return now - p->time > secs * NSECS_PER_SEC;
+}
+
+/**
+ * Returns the home slot of a key in a pending request table.
+ */
+static guint pending_home(guint64 key) {
+  return (guint) ((key * G_GUINT64_CONSTANT(0x9e3779b97f4a7c15)) >> 32);
+}
+
+void ethereum_disc_pending_add(ethereum_disc_pending_t *table, gint64 now, guint32 frame, packet_type_e type,
+                               guint64 key) {
+  ethereum_disc_pending_t *slot = NULL, *free_slot = NULL, *oldest = NULL;
+  guint home = pending_home(key), i;
+
+  for (i = 0; i < ETHEREUM_DISC_PENDING_PROBES; i++) {
+    ethereum_disc_pending_t *p = &table[(home + i) & (ETHEREUM_DISC_PENDING_SLOTS - 1)];
+    if (p->key == key && p->type == type) {
+      slot = p;
+      break;
+    }
+    if (p->key == 0 || pending_older_than(p, now, ETHEREUM_DISC_PENDING_TTL)) {
+      if (!free_slot) {
+        free_slot = p;
+      }
+    } else if (!oldest || p->time < oldest->time) {
+      oldest = p;
+    }
+  }
+  if (!slot) {
+    slot = free_slot ? free_slot : oldest;
+  }
+  slot->key = key;
+  slot->type = (guint8) type;
+  slot->time = now;
+  slot->frame = frame;
+  slot->nodes = 0;
+}
+
+ethereum_disc_pending_t *ethereum_disc_pending_find(ethereum_disc_pending_t *table, gint64 now, packet_type_e type,
+                                                    guint64 key) {
+  guint home, i;
+
+  if (!table || key == 0) {
+    return NULL;
+  }
+  home = pending_home(key);
+  for (i = 0; i < ETHEREUM_DISC_PENDING_PROBES; i++) {
+    ethereum_disc_pending_t *p = &table[(home + i) & (ETHEREUM_DISC_PENDING_SLOTS - 1)];
+    if (p->key == key && p->type == type) {
+      return pending_older_than(p, now, ETHEREUM_DISC_PENDING_TTL) ? NULL : p;
+    }
+  }
+  return NULL;
+}
+
+ethereum_disc_pending_t *ethereum_disc_pending_find_findnode(ethereum_disc_pending_t *table, gint64 now) {
+  ethereum_disc_pending_t *oldest = NULL;
+  guint i;
+
+  if (!table) {
+    return NULL;
+  }
+  for (i = 0; i < ETHEREUM_DISC_PENDING_SLOTS; i++) {
+    ethereum_disc_pending_t *p = &table[i];
+    if (p->key == 0 || (p->type != FIND_NODE && p->type != FIND_NODEHASH)) {
+      continue;
+    }
+    if (p->nodes > 0) {
+      if (!pending_older_than(p, now, ETHEREUM_DISC_NODES_CHUNK_WINDOW)) {
+        return p;
+      }
+    } else if (!pending_older_than(p, now, ETHEREUM_DISC_PENDING_TTL) && (!oldest || p->time < oldest->time)) {
+      oldest = p;
+    }
+  }
+  return oldest;
+}
+
+void ethereum_disc_pending_add_nodes(ethereum_disc_pending_t *req, guint nodes) {
+  req->nodes = (guint8) MIN(req->nodes + MAX(nodes, 1), ETHEREUM_DISC_BUCKET_SIZE);
+  if (req->nodes >= ETHEREUM_DISC_BUCKET_SIZE) {
+    req->key = 0;
+  }
+}
+
+gboolean ethereum_disc_neg_cache_skip(const ethereum_disc_neg_entry_t *cache, guint32 flow_key) {
+  const ethereum_disc_neg_entry_t *neg = &cache[flow_key & (ETHEREUM_DISC_NEG_CACHE_SIZE - 1)];
+  return neg->key == flow_key && neg->rejections >= ETHEREUM_DISC_NEG_CACHE_THRESHOLD;
+}
+
+void ethereum_disc_neg_cache_update(ethereum_disc_neg_entry_t *cache, guint32 flow_key, gboolean rejected) {
+  ethereum_disc_neg_entry_t *neg = &cache[flow_key & (ETHEREUM_DISC_NEG_CACHE_SIZE - 1)];
+
+  if (!rejected) {
+    if (neg->key == flow_key) {
+      neg->key = 0;
+    }
+    return;
+  }
+  if (neg->key != flow_key) {
+    neg->key = flow_key;
+    neg->rejections = 0;
+  }
+  if (neg->rejections < ETHEREUM_DISC_NEG_CACHE_THRESHOLD) {
+    neg->rejections++;
+  }
+}
@@ -0,0 +1,187 @@
+/* ethereum-disc-core.h
+ * Protocol-level rules of the discovery protocol shared by the dissector and the standalone tools: datagram
+ * layout and checks, request/response correlation, and the negative heuristics cache. Depends on GLib only.
+ * Copyright 2018, ConsenSys AG.
+ *
+ * Wireshark - Network traffic analyzer
+ * By Gerald Combs <gerald@wireshark.org>
+ * Copyright 1998, Gerald Combs.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __ETHEREUM_DISC_CORE_H__
+#define __ETHEREUM_DISC_CORE_H__
+
+#include <glib.h>
+
+#define MIN_ETHDEVP2PDISCO_LEN 98
+#define MAX_ETHDEVP2PDISCO_LEN 1280
+
+#define ETHEREUM_DISC_HASH_LEN 32
+#define ETHEREUM_DISC_SIGNATURE_LEN 65
+#define ETHEREUM_DISC_PACKET_TYPE_IDX 97
+#define ETHEREUM_DISC_PACKET_DATA_START 98
+#define ETHEREUM_DISCV5_ID_STR "temporary discovery v5"
+#define ETHEREUM_DISCV5_PACKET_TYPE_IDX 87  // ETHEREUM_DISC_SIGNATURE_LEN + 22 (strlen(ETHEREUM_DISCV5_ID_STR))
+#define ETHEREUM_DISCV5_PACKET_DATA_START 88
+
+// Bounds on the RLP structure of a packet payload; anything beyond these is not discovery traffic.
+#define ETHEREUM_DISC_MAX_RLP_DEPTH 8
+#define ETHEREUM_DISC_MAX_RLP_ELEMENTS 256
+
+// Negative heuristics cache: number of slots (a power of 2), and number of rejections after which a
+// flow is no longer evaluated.
+#define ETHEREUM_DISC_NEG_CACHE_SIZE 4096
+#define ETHEREUM_DISC_NEG_CACHE_THRESHOLD 8
+
+// Per-conversation pending request table: number of slots (a power of 2), and number of slots probed
+// from the home slot of a key.
+#define ETHEREUM_DISC_PENDING_SLOTS 32
+#define ETHEREUM_DISC_PENDING_PROBES 8
+
+// Seconds after which an unanswered request expires (the expiration used by the clients).
+#define ETHEREUM_DISC_PENDING_TTL 20
+
+// Seconds after a FIND_NODE within which further NODES packets are treated as the continuation of a
+// response split across packets, and the number of nodes after which the response is complete.
+#define ETHEREUM_DISC_NODES_CHUNK_WINDOW 1
+#define ETHEREUM_DISC_BUCKET_SIZE 16
+
+// Ethereum discovery protocol packet types.
+typedef enum packet_type {
+  UNKNOWN = 0x00,   // initialization value
+  PING = 0x01,
+  PONG = 0x02,
+  FIND_NODE = 0x03,
+  NODES = 0x04,
+  FIND_NODEHASH = 0x05,
+  TOPIC_REGISTER = 0x06,
+  TOPIC_QUERY = 0x07,
+  TOPIC_NODES = 0x08,
+} packet_type_e;
+
+// A request awaiting its response, in the per-conversation pending request table.
+typedef struct ethereum_disc_pending {
+  guint64 key;     // The request key (a prefix of the PING hash or of the FIND_NODE target); 0 if the slot is free.
+  gint64 time;     // The time of the request, in nanoseconds since the epoch.
+  guint32 frame;   // The frame number of the request, if any.
+  guint8 type;     // The request packet type.
+  guint8 nodes;    // The number of nodes received so far in response (FIND_NODE only).
+} ethereum_disc_pending_t;
+
+// A slot of the negative heuristics cache, tracking a UDP flow that failed the heuristics.
+typedef struct ethereum_disc_neg_entry {
+  guint32 key;         // The flow key; 0 if the slot is empty.
+  guint32 rejections;  // The number of times the flow was rejected, saturating at the threshold.
+} ethereum_disc_neg_entry_t;
+
+/**
+ * Performs the cheap checks on a datagram: length, protocol version and packet type.
+ *
+ * @param buf The UDP payload, at least as long as the header of a discovery v4 message.
+ * @param len The length of the datagram.
+ * @param is_discv5 Set to TRUE if this is a discovery v5 datagram.
+ * @return TRUE if the datagram passes the checks; FALSE otherwise.
+ */
+gboolean ethereum_disc_check_header(const guint8 *buf, guint len, gboolean *is_discv5);
+
+/**
+ * Checks that the payload of a discovery packet is a single RLP list spanning the rest of the datagram,
+ * and that its whole nested structure is well-formed and within the bounds of a discovery message.
+ * Runs in linear time and doesn't allocate.
+ *
+ * @param buf The UDP payload.
+ * @param len The length of the payload.
+ * @param offset The offset at which the packet payload starts.
+ * @return TRUE if the payload is valid; FALSE otherwise.
+ */
+gboolean ethereum_disc_valid_payload(const guint8 *buf, guint len, guint offset);
+
+/**
+ * Checks the payload of a discovery packet truncated by the capture, as far as it was captured: the header of its
+ * top level list must be captured, and the list must span the rest of the datagram as it was sent.
+ *
+ * @param buf The captured part of the UDP payload.
+ * @param len The captured length of the payload.
+ * @param reported_len The length of the payload as it was sent.
+ * @param offset The offset at which the packet payload starts.
+ * @return TRUE if the captured part of the payload is valid; FALSE otherwise.
+ */
+gboolean ethereum_disc_valid_truncated_payload(const guint8 *buf, guint len, guint reported_len, guint offset);
+
+/**
+ * Records a request in a pending request table. A retransmission of a request with the same key replaces
+ * it. Expired requests are overwritten; if all the probed slots are live, the oldest request is evicted.
+ *
+ * @param table The table, of ETHEREUM_DISC_PENDING_SLOTS slots.
+ * @param now The time of the request, in nanoseconds since the epoch.
+ * @param frame The frame number of the request.
+ * @param type The request type.
+ * @param key The request key, not 0.
+ */
+void ethereum_disc_pending_add(ethereum_disc_pending_t *table, gint64 now, guint32 frame, packet_type_e type,
+                               guint64 key);
+
+/**
+ * Looks up a live pending request by key.
+ *
+ * @param table The table, or NULL if no request was recorded yet.
+ * @param now The current time, in nanoseconds since the epoch.
+ * @param type The request type.
+ * @param key The request key.
+ * @return The pending request, or NULL if not found or expired.
+ */
+ethereum_disc_pending_t *ethereum_disc_pending_find(ethereum_disc_pending_t *table, gint64 now, packet_type_e type,
+                                                    guint64 key);
+
+/**
+ * Finds the FIND_NODE request that a NODES packet responds to, since NODES doesn't echo the target: the request
+ * whose response is in progress if any, or the oldest live request.
+ *
+ * @param table The table, or NULL if no request was recorded yet.
+ * @param now The current time, in nanoseconds since the epoch.
+ * @return The pending request, or NULL if none matches.
+ */
+ethereum_disc_pending_t *ethereum_disc_pending_find_findnode(ethereum_disc_pending_t *table, gint64 now);
+
+/**
+ * Records that a NODES packet answered a FIND_NODE request; the request completes once a bucket of nodes
+ * was received.
+ *
+ * @param req The pending request.
+ * @param nodes The number of nodes of the packet.
+ */
+void ethereum_disc_pending_add_nodes(ethereum_disc_pending_t *req, guint nodes);
+
+/**
+ * Checks whether a flow was rejected by the heuristics so many times that it isn't evaluated anymore.
+ *
+ * @param cache The cache, of ETHEREUM_DISC_NEG_CACHE_SIZE slots.
+ * @param flow_key The key of the flow, the same for both directions.
+ * @return TRUE if the flow is to be skipped; FALSE otherwise.
+ */
+gboolean ethereum_disc_neg_cache_skip(const ethereum_disc_neg_entry_t *cache, guint32 flow_key);
+
+/**
+ * Records the verdict of the heuristics on a flow. Colliding flows evict each other.
+ *
+ * @param cache The cache, of ETHEREUM_DISC_NEG_CACHE_SIZE slots.
+ * @param flow_key The key of the flow, the same for both directions.
+ * @param rejected TRUE if the heuristics rejected the flow.
+ */
+void ethereum_disc_neg_cache_update(ethereum_disc_neg_entry_t *cache, guint32 flow_key, gboolean rejected);
+
+#endif //__ETHEREUM_DISC_CORE_H__
@@ -0,0 +1,236 @@
+/* ethereum-graph.c
+ * Directed graph of which Ethereum nodes advertised which others, with deduplicated edges.
+ * Copyright 2018, ConsenSys AG.
+ *
+ * Wireshark - Network traffic analyzer
+ * By Gerald Combs <gerald@wireshark.org>
+ * Copyright 1998, Gerald Combs.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "config.h"
+
+#include <string.h>
+
+#include <wsutil/inet_addr.h>
+
+#include "ethereum-graph.h"
+
+#define GRAPH_MIN_CAPACITY 1024
+
+#define VERTEX(graph, i) (&g_array_index((graph)->vertices, ethereum_graph_vertex_t, i))
+#define EDGE(graph, i) (&g_array_index((graph)->edges, ethereum_graph_edge_t, i))
+
+// Tells whether the element at an index matches a key.
+typedef gboolean (*index_equal_func)(const ethereum_graph_t *graph, guint32 index, gconstpointer key);
+
+/**
+ * Finds the slot of a key in an index, i.e. either its slot or the free slot where it belongs.
+ */
+static guint32 index_find(const ethereum_graph_index_t *index, guint32 hash, index_equal_func equal,
+                          const ethereum_graph_t *graph, gconstpointer key) {
+  guint32 mask = index->capacity - 1;
+  guint32 i = hash & mask;
+  guint64 slot;
+
+  while ((slot = index->slots[i]) != 0) {
+    if ((guint32) (slot >> 32) == hash && equal(graph, (guint32) slot - 1, key)) {
+      break;
+    }
+    i = (i + 1) & mask;
+  }
+  return i;
+}
+
+/**
+ * Makes room for another element in an index, keeping it at most 3/4 full; the slots are rehashed from the
+ * hashes they hold.
+ */
+static void index_reserve(ethereum_graph_index_t *index) {
+  guint32 capacity, i, j;
+  guint64 *slots;
+
+  if ((guint64) (index->count + 1) * 4 <= (guint64) index->capacity * 3) {
+    return;
+  }
+  capacity = index->capacity ? index->capacity * 2 : GRAPH_MIN_CAPACITY;
+  slots = g_new0(guint64, capacity);
+  for (i = 0; i < index->capacity; i++) {
+    guint64 slot = index->slots[i];
+    if (!slot) {
+      continue;
+    }
+    for (j = (guint32) (slot >> 32) & (capacity - 1); slots[j]; j = (j + 1) & (capacity - 1)) {
+    }
+    slots[j] = slot;
+  }
+  g_free(index->slots);
+  index->slots = slots;
+  index->capacity = capacity;
+}
+
+static gboolean vertex_equal(const ethereum_graph_t *graph, guint32 index, gconstpointer key) {
+  const ethereum_graph_vertex_t *a = VERTEX(graph, index);
+  const ethereum_graph_vertex_t *b = (const ethereum_graph_vertex_t *) key;
+  return a->len == b->len && memcmp(a->key, b->key, a->len) == 0;
+}
+
+static gboolean edge_equal(const ethereum_graph_t *graph, guint32 index, gconstpointer key) {
+  const ethereum_graph_edge_t *a = EDGE(graph, index);
+  const ethereum_graph_edge_t *b = (const ethereum_graph_edge_t *) key;
+  return a->src == b->src && a->dst == b->dst;
+}
+
+/**
+ * Hashes bytes (FNV-1a). The result is never 0.
+ */
+static guint32 hash_bytes(const guint8 *data, guint len) {
+  guint32 h = 2166136261U;
+  guint i;
+  for (i = 0; i < len; i++) {
+    h = (h ^ data[i]) * 16777619U;
+  }
+  return h ? h : 1;
+}
+
+void ethereum_graph_init(ethereum_graph_t *graph) {
+  memset(graph, 0, sizeof(*graph));
+  graph->vertices = g_array_new(FALSE, FALSE, sizeof(ethereum_graph_vertex_t));
+  graph->edges = g_array_new(FALSE, FALSE, sizeof(ethereum_graph_edge_t));
+}
+
+void ethereum_graph_clear(ethereum_graph_t *graph) {
+  g_array_free(graph->vertices, TRUE);
+  g_array_free(graph->edges, TRUE);
+  g_free(graph->vertex_index.slots);
+  g_free(graph->edge_index.slots);
+  ethereum_graph_init(graph);
+}
+
+guint32 ethereum_graph_vertex(ethereum_graph_t *graph, const guint8 *key, guint8 len) {
+  ethereum_graph_vertex_t vertex;
+  guint32 hash = hash_bytes(key, len);
+  guint32 i;
+
+  memset(&vertex, 0, sizeof(vertex));
+  memcpy(vertex.key, key, len);
+  vertex.len = len;
+
+  index_reserve(&graph->vertex_index);
+  i = index_find(&graph->vertex_index, hash, vertex_equal, graph, &vertex);
+  if (!graph->vertex_index.slots[i]) {
+    g_array_append_vals(graph->vertices, &vertex, 1);
+    graph->vertex_index.slots[i] = ((guint64) hash << 32) | graph->vertices->len;
+    graph->vertex_index.count++;
+  }
+  return (guint32) graph->vertex_index.slots[i] - 1;
+}
+
+void ethereum_graph_add_edge(ethereum_graph_t *graph, guint32 src, guint32 dst, const nstime_t *ts) {
+  ethereum_graph_edge_t edge, *e;
+  guint32 hash = (src * 0x9e3779b1U) ^ (dst * 0x85ebca6bU);
+  guint32 i;
+
+  hash = hash ? hash : 1;
+  memset(&edge, 0, sizeof(edge));
+  edge.src = src;
+  edge.dst = dst;
+
+  index_reserve(&graph->edge_index);
+  i = index_find(&graph->edge_index, hash, edge_equal, graph, &edge);
+  if (!graph->edge_index.slots[i]) {
+    edge.first_seen = *ts;
+    g_array_append_vals(graph->edges, &edge, 1);
+    graph->edge_index.slots[i] = ((guint64) hash << 32) | graph->edges->len;
+    graph->edge_index.count++;
+  }
+  e = EDGE(graph, (guint32) graph->edge_index.slots[i] - 1);
+  e->count++;
+  e->last_seen = *ts;
+}
+
+/**
+ * Formats the label of a vertex: the node ID in hex, or the endpoint as address:port.
+ */
+static const gchar *vertex_label(const ethereum_graph_vertex_t *vertex, gchar *buf, gsize len) {
+  static const guint8 v4_mapped[12] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xff, 0xff};
+  gchar addr[WS_INET6_ADDRSTRLEN];
+  guint i;
+
+  if (vertex->len == ETHEREUM_GRAPH_NODE_ID_LEN) {
+    for (i = 0; i < ETHEREUM_GRAPH_NODE_ID_LEN && 2 * i + 2 < len; i++) {
+      g_snprintf(buf + 2 * i, 3, "%02x", vertex->key[i]);
+    }
+    return buf;
+  }
+  if (memcmp(vertex->key, v4_mapped, sizeof(v4_mapped)) == 0) {
+    ws_inet_ntop4(vertex->key + 12, addr, sizeof(addr));
+    g_snprintf(buf, (gulong) len, "%s:%u", addr, (vertex->key[16] << 8) | vertex->key[17]);
+  } else {
+    ws_inet_ntop6(vertex->key, addr, sizeof(addr));
+    g_snprintf(buf, (gulong) len, "[%s]:%u", addr, (vertex->key[16] << 8) | vertex->key[17]);
+  }
+  return buf;
+}
+
+static void write_edge_list(const ethereum_graph_t *graph, FILE *out) {
+  gchar src[2 * ETHEREUM_GRAPH_NODE_ID_LEN + 1], dst[2 * ETHEREUM_GRAPH_NODE_ID_LEN + 1];
+  guint i;
+
+  fprintf(out, "# source target count first_seen last_seen\n");
+  for (i = 0; i < graph->edges->len; i++) {
+    const ethereum_graph_edge_t *e = EDGE(graph, i);
+    fprintf(out, "%s %s %u %ld.%09d %ld.%09d\n",
+            vertex_label(VERTEX(graph, e->src), src, sizeof(src)),
+            vertex_label(VERTEX(graph, e->dst), dst, sizeof(dst)), e->count,
+            (long) e->first_seen.secs, e->first_seen.nsecs, (long) e->last_seen.secs, e->last_seen.nsecs);
+  }
+}
+
+static void write_graphml(const ethereum_graph_t *graph, FILE *out) {
+  gchar label[2 * ETHEREUM_GRAPH_NODE_ID_LEN + 1];
+  guint i;
+
+  fprintf(out, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+               "<graphml xmlns=\"http://graphml.graphdrawing.org/xmlns\">\n"
+               "  <key id=\"label\" for=\"node\" attr.name=\"label\" attr.type=\"string\"/>\n"
+               "  <key id=\"kind\" for=\"node\" attr.name=\"kind\" attr.type=\"string\"/>\n"
+               "  <key id=\"count\" for=\"edge\" attr.name=\"count\" attr.type=\"long\"/>\n"
+               "  <key id=\"first_seen\" for=\"edge\" attr.name=\"first_seen\" attr.type=\"double\"/>\n"
+               "  <key id=\"last_seen\" for=\"edge\" attr.name=\"last_seen\" attr.type=\"double\"/>\n"
+               "  <graph id=\"ethereum-discovery\" edgedefault=\"directed\">\n");
+  for (i = 0; i < graph->vertices->len; i++) {
+    const ethereum_graph_vertex_t *v = VERTEX(graph, i);
+    fprintf(out, "    <node id=\"n%u\"><data key=\"label\">%s</data><data key=\"kind\">%s</data></node>\n", i,
+            vertex_label(v, label, sizeof(label)), v->len == ETHEREUM_GRAPH_NODE_ID_LEN ? "node_id" : "endpoint");
+  }
+  for (i = 0; i < graph->edges->len; i++) {
+    const ethereum_graph_edge_t *e = EDGE(graph, i);
+    fprintf(out, "    <edge source=\"n%u\" target=\"n%u\"><data key=\"count\">%u</data>"
+                 "<data key=\"first_seen\">%ld.%09d</data><data key=\"last_seen\">%ld.%09d</data></edge>\n",
+            e->src, e->dst, e->count,
+            (long) e->first_seen.secs, e->first_seen.nsecs, (long) e->last_seen.secs, e->last_seen.nsecs);
+  }
+  fprintf(out, "  </graph>\n</graphml>\n");
+}
+
+void ethereum_graph_write(const ethereum_graph_t *graph, FILE *out, ethereum_graph_format_e format) {
+  if (format == ETHEREUM_GRAPH_GRAPHML) {
+    write_graphml(graph, out);
+  } else {
+    write_edge_list(graph, out);
+  }
+}
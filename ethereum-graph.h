@@ -0,0 +1,117 @@
+/* ethereum-graph.h
+ * Directed graph of which Ethereum nodes advertised which others, with deduplicated edges.
+ * Copyright 2018, ConsenSys AG.
+ *
+ * Wireshark - Network traffic analyzer
+ * By Gerald Combs <gerald@wireshark.org>
+ * Copyright 1998, Gerald Combs.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __ETHEREUM_GRAPH_H__
+#define __ETHEREUM_GRAPH_H__
+
+#include <stdio.h>
+#include <glib.h>
+#include <wsutil/nstime.h>
+
+// Length in bytes of a vertex identified by node ID.
+#define ETHEREUM_GRAPH_NODE_ID_LEN 64
+
+// Length in bytes of a vertex identified by endpoint: an IPv6 (or IPv4-mapped) address and a big-endian port.
+#define ETHEREUM_GRAPH_ENDPOINT_LEN 18
+
+// The export formats of a graph.
+typedef enum ethereum_graph_format {
+  ETHEREUM_GRAPH_EDGE_LIST,
+  ETHEREUM_GRAPH_GRAPHML
+} ethereum_graph_format_e;
+
+// A vertex: a node ID, or the endpoint of a node whose ID is unknown.
+typedef struct ethereum_graph_vertex {
+  guint8 key[ETHEREUM_GRAPH_NODE_ID_LEN];
+  guint8 len;  // ETHEREUM_GRAPH_NODE_ID_LEN or ETHEREUM_GRAPH_ENDPOINT_LEN.
+} ethereum_graph_vertex_t;
+
+// A directed edge, from an advertiser to the node it advertised.
+typedef struct ethereum_graph_edge {
+  guint32 src;
+  guint32 dst;
+  guint32 count;        // The number of times the advertisement was seen.
+  nstime_t first_seen;
+  nstime_t last_seen;
+} ethereum_graph_edge_t;
+
+// An open addressing set of indices, each slot holding the hash of an element in the upper half and its index
+// + 1 in the lower half.
+typedef struct ethereum_graph_index {
+  guint64 *slots;
+  guint32 capacity;
+  guint32 count;
+} ethereum_graph_index_t;
+
+// A graph with interned vertices and deduplicated edges, in insertion order.
+typedef struct ethereum_graph {
+  GArray *vertices;               // ethereum_graph_vertex_t
+  GArray *edges;                  // ethereum_graph_edge_t
+  ethereum_graph_index_t vertex_index;
+  ethereum_graph_index_t edge_index;
+} ethereum_graph_t;
+
+/**
+ * Initializes an empty graph.
+ *
+ * @param graph The graph.
+ */
+void ethereum_graph_init(ethereum_graph_t *graph);
+
+/**
+ * Empties a graph, releasing its memory.
+ *
+ * @param graph The graph.
+ */
+void ethereum_graph_clear(ethereum_graph_t *graph);
+
+/**
+ * Interns a vertex.
+ *
+ * @param graph The graph.
+ * @param key The node ID or endpoint of the vertex.
+ * @param len ETHEREUM_GRAPH_NODE_ID_LEN or ETHEREUM_GRAPH_ENDPOINT_LEN.
+ * @return The index of the vertex.
+ */
+guint32 ethereum_graph_vertex(ethereum_graph_t *graph, const guint8 *key, guint8 len);
+
+/**
+ * Records an edge, adding it if it is new.
+ *
+ * @param graph The graph.
+ * @param src The index of the source vertex.
+ * @param dst The index of the destination vertex.
+ * @param ts The time the edge was seen.
+ */
+void ethereum_graph_add_edge(ethereum_graph_t *graph, guint32 src, guint32 dst, const nstime_t *ts);
+
+/**
+ * Writes a graph out, in a single pass over the vertices and edges.
+ *
+ * @param graph The graph.
+ * @param out The stream to write to.
+ * @param format The format.
+ */
+void ethereum_graph_write(const ethereum_graph_t *graph, FILE *out, ethereum_graph_format_e format);
+
+#endif //__ETHEREUM_GRAPH_H__
@@ -0,0 +1,306 @@
+/* ethereum-hashindex.c
+ * Index of the discovery messages of a capture by message hash, for correlating captures taken at several
+ * vantage points.
+ * Copyright 2018, ConsenSys AG.
+ *
+ * Wireshark - Network traffic analyzer
+ * By Gerald Combs <gerald@wireshark.org>
+ * Copyright 1998, Gerald Combs.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <glib/gstdio.h>
+
+#include "ethereum-hashindex.h"
+
+#define HASHINDEX_MAGIC "ETHHIDX"
+#define HASHINDEX_VERSION 1
+#define HASHINDEX_HEADER_LEN 64
+#define HASHINDEX_RUN_HEADER_LEN 8
+
+// Number of records read at once by a cursor.
+#define HASHINDEX_CURSOR_RECORDS 1024
+
+// Offsets of the fields of an encoded record; the sort key comes first.
+#define RECORD_KEY 0
+#define RECORD_TS 16
+#define RECORD_SRC_ADDR 24
+#define RECORD_DST_ADDR 40
+#define RECORD_SRC_PORT 56
+#define RECORD_DST_PORT 58
+#define RECORD_TYPE 60
+
+// Offsets of the fields of the header.
+#define HEADER_MAGIC 0
+#define HEADER_VERSION 8
+#define HEADER_RECORD_LEN 12
+#define HEADER_RECORDS 16
+#define HEADER_RUNS 24
+#define HEADER_LOCAL_ADDR 32
+#define HEADER_HAS_LOCAL_ADDR 48
+
+static void put_be16(guint8 *p, guint16 v) {
+  p[0] = (guint8) (v >> 8);
+  p[1] = (guint8) v;
+}
+
+static void put_be32(guint8 *p, guint32 v) {
+  put_be16(p, (guint16) (v >> 16));
+  put_be16(p + 2, (guint16) v);
+}
+
+static void put_be64(guint8 *p, guint64 v) {
+  put_be32(p, (guint32) (v >> 32));
+  put_be32(p + 4, (guint32) v);
+}
+
+static guint16 get_be16(const guint8 *p) {
+  return (guint16) ((p[0] << 8) | p[1]);
+}
+
+static guint32 get_be32(const guint8 *p) {
+  return ((guint32) get_be16(p) << 16) | get_be16(p + 2);
+}
+
+static guint64 get_be64(const guint8 *p) {
+  return ((guint64) get_be32(p) << 32) | get_be32(p + 4);
+}
+
+/**
+ * Seeks to an absolute offset, beyond 2 GB too.
+ */
+static gboolean seek_to(FILE *file, gint64 offset) {
+#ifdef _WIN32
+  return _fseeki64(file, offset, SEEK_SET) == 0;
+#else
+  return fseeko(file, (off_t) offset, SEEK_SET) == 0;
+#endif
+}
+
+static int compare_records(const void *a, const void *b) {
+  return memcmp(a, b, ETHEREUM_HASHINDEX_SORT_LEN);
+}
+
+/**
+ * Sorts the current run and writes it out.
+ */
+static gboolean write_run(ethereum_hashindex_writer_t *writer) {
+  guint8 header[HASHINDEX_RUN_HEADER_LEN];
+
+  qsort(writer->buf, writer->len, ETHEREUM_HASHINDEX_RECORD_LEN, compare_records);
+  put_be64(header, writer->len);
+  if (fwrite(header, sizeof(header), 1, writer->file) != 1 ||
+      fwrite(writer->buf, ETHEREUM_HASHINDEX_RECORD_LEN, writer->len, writer->file) != writer->len) {
+    return FALSE;
+  }
+  writer->runs++;
+  writer->len = 0;
+  return TRUE;
+}
+
+gboolean ethereum_hashindex_writer_open(ethereum_hashindex_writer_t *writer, const gchar *path, guint run_records) {
+  guint8 header[HASHINDEX_HEADER_LEN];
+
+  memset(writer, 0, sizeof(*writer));
+  writer->file = g_fopen(path, "wb");
+  if (!writer->file) {
+    return FALSE;
+  }
+  // The header is written again with the counts upon closing.
+  memset(header, 0, sizeof(header));
+  if (fwrite(header, sizeof(header), 1, writer->file) != 1) {
+    fclose(writer->file);
+    writer->file = NULL;
+    return FALSE;
+  }
+  writer->run_records = run_records ? run_records : ETHEREUM_HASHINDEX_RUN_RECORDS;
+  writer->buf = (guint8 *) g_malloc((gsize) writer->run_records * ETHEREUM_HASHINDEX_RECORD_LEN);
+  return TRUE;
+}
+
+gboolean ethereum_hashindex_writer_add(ethereum_hashindex_writer_t *writer, const ethereum_hashindex_record_t *record) {
+  guint8 *p = writer->buf + (gsize) writer->len * ETHEREUM_HASHINDEX_RECORD_LEN;
+  guint i;
+
+  memset(p, 0, ETHEREUM_HASHINDEX_RECORD_LEN);
+  memcpy(p + RECORD_KEY, record->key, ETHEREUM_HASHINDEX_KEY_LEN);
+  put_be64(p + RECORD_TS, record->ts);
+  memcpy(p + RECORD_SRC_ADDR, record->src_addr, ETHEREUM_HASHINDEX_ADDR_LEN);
+  memcpy(p + RECORD_DST_ADDR, record->dst_addr, ETHEREUM_HASHINDEX_ADDR_LEN);
+  put_be16(p + RECORD_SRC_PORT, record->src_port);
+  put_be16(p + RECORD_DST_PORT, record->dst_port);
+  p[RECORD_TYPE] = record->type;
+
+  // The capturing host is one end of every message: it's whichever end of the first message appears the most.
+  if (writer->records == 0) {
+    memcpy(writer->candidates[0], record->src_addr, ETHEREUM_HASHINDEX_ADDR_LEN);
+    memcpy(writer->candidates[1], record->dst_addr, ETHEREUM_HASHINDEX_ADDR_LEN);
+  }
+  for (i = 0; i < 2; i++) {
+    if (memcmp(writer->candidates[i], record->src_addr, ETHEREUM_HASHINDEX_ADDR_LEN) == 0 ||
+        memcmp(writer->candidates[i], record->dst_addr, ETHEREUM_HASHINDEX_ADDR_LEN) == 0) {
+      writer->candidate_hits[i]++;
+    }
+  }
+
+  writer->records++;
+  if (++writer->len == writer->run_records) {
+    return write_run(writer);
+  }
+  return TRUE;
+}
+
+gboolean ethereum_hashindex_writer_close(ethereum_hashindex_writer_t *writer) {
+  guint8 header[HASHINDEX_HEADER_LEN];
+  gboolean ok = TRUE;
+  guint local;
+
+  if (!writer->file) {
+    return FALSE;
+  }
+  if (writer->len > 0) {
+    ok = write_run(writer);
+  }
+
+  memset(header, 0, sizeof(header));
+  memcpy(header + HEADER_MAGIC, HASHINDEX_MAGIC, sizeof(HASHINDEX_MAGIC));
+  put_be32(header + HEADER_VERSION, HASHINDEX_VERSION);
+  put_be32(header + HEADER_RECORD_LEN, ETHEREUM_HASHINDEX_RECORD_LEN);
+  put_be64(header + HEADER_RECORDS, writer->records);
+  put_be64(header + HEADER_RUNS, writer->runs);
+  // When both ends appear equally (e.g. a capture of a single exchange), the capturing host is unknown.
+  if (writer->candidate_hits[0] != writer->candidate_hits[1]) {
+    local = writer->candidate_hits[0] > writer->candidate_hits[1] ? 0 : 1;
+    memcpy(header + HEADER_LOCAL_ADDR, writer->candidates[local], ETHEREUM_HASHINDEX_ADDR_LEN);
+    header[HEADER_HAS_LOCAL_ADDR] = 1;
+  }
+  ok = ok && seek_to(writer->file, 0) && fwrite(header, sizeof(header), 1, writer->file) == 1;
+  ok = fclose(writer->file) == 0 && ok;
+
+  g_free(writer->buf);
+  writer->file = NULL;
+  writer->buf = NULL;
+  return ok;
+}
+
+gboolean ethereum_hashindex_open(ethereum_hashindex_t *index, const gchar *path) {
+  guint8 header[HASHINDEX_HEADER_LEN];
+  ethereum_hashindex_run_t run;
+  guint64 runs, records = 0, i;
+  gint64 offset = HASHINDEX_HEADER_LEN;
+
+  memset(index, 0, sizeof(*index));
+  index->file = g_fopen(path, "rb");
+  if (!index->file) {
+    return FALSE;
+  }
+  if (fread(header, sizeof(header), 1, index->file) != 1 ||
+      memcmp(header + HEADER_MAGIC, HASHINDEX_MAGIC, sizeof(HASHINDEX_MAGIC)) != 0 ||
+      get_be32(header + HEADER_VERSION) != HASHINDEX_VERSION ||
+      get_be32(header + HEADER_RECORD_LEN) != ETHEREUM_HASHINDEX_RECORD_LEN) {
+    ethereum_hashindex_close(index);
+    return FALSE;
+  }
+  index->records = get_be64(header + HEADER_RECORDS);
+  runs = get_be64(header + HEADER_RUNS);
+  memcpy(index->local_addr, header + HEADER_LOCAL_ADDR, ETHEREUM_HASHINDEX_ADDR_LEN);
+  index->has_local_addr = header[HEADER_HAS_LOCAL_ADDR] != 0;
+
+  // Walk the run headers.
+  index->runs = g_array_new(FALSE, FALSE, sizeof(ethereum_hashindex_run_t));
+  for (i = 0; i < runs; i++) {
+    guint8 run_header[HASHINDEX_RUN_HEADER_LEN];
+    if (!seek_to(index->file, offset) || fread(run_header, sizeof(run_header), 1, index->file) != 1) {
+      ethereum_hashindex_close(index);
+      return FALSE;
+    }
+    run.offset = offset + HASHINDEX_RUN_HEADER_LEN;
+    run.count = get_be64(run_header);
+    g_array_append_val(index->runs, run);
+    offset = run.offset + (gint64) (run.count * ETHEREUM_HASHINDEX_RECORD_LEN);
+    records += run.count;
+  }
+  if (records != index->records) {
+    ethereum_hashindex_close(index);
+    return FALSE;
+  }
+  return TRUE;
+}
+
+void ethereum_hashindex_close(ethereum_hashindex_t *index) {
+  if (index->file) {
+    fclose(index->file);
+  }
+  if (index->runs) {
+    g_array_free(index->runs, TRUE);
+  }
+  memset(index, 0, sizeof(*index));
+}
+
+void ethereum_hashindex_cursor_init(ethereum_hashindex_cursor_t *cursor, ethereum_hashindex_t *index, guint run) {
+  const ethereum_hashindex_run_t *r = &g_array_index(index->runs, ethereum_hashindex_run_t, run);
+
+  cursor->index = index;
+  cursor->offset = r->offset;
+  cursor->remaining = r->count;
+  cursor->buf = (guint8 *) g_malloc(HASHINDEX_CURSOR_RECORDS * ETHEREUM_HASHINDEX_RECORD_LEN);
+  cursor->pos = 0;
+  cursor->len = 0;
+}
+
+const guint8 *ethereum_hashindex_cursor_peek(ethereum_hashindex_cursor_t *cursor) {
+  guint n;
+
+  if (cursor->pos < cursor->len) {
+    return cursor->buf + (gsize) cursor->pos * ETHEREUM_HASHINDEX_RECORD_LEN;
+  }
+  if (cursor->remaining == 0) {
+    return NULL;
+  }
+  n = (guint) MIN(cursor->remaining, HASHINDEX_CURSOR_RECORDS);
+  if (!seek_to(cursor->index->file, cursor->offset) ||
+      fread(cursor->buf, ETHEREUM_HASHINDEX_RECORD_LEN, n, cursor->index->file) != n) {
+    cursor->remaining = 0;
+    return NULL;
+  }
+  cursor->offset += (gint64) n * ETHEREUM_HASHINDEX_RECORD_LEN;
+  cursor->remaining -= n;
+  cursor->pos = 0;
+  cursor->len = n;
+  return cursor->buf;
+}
+
+void ethereum_hashindex_cursor_clear(ethereum_hashindex_cursor_t *cursor) {
+  g_free(cursor->buf);
+  cursor->buf = NULL;
+  cursor->pos = cursor->len = 0;
+  cursor->remaining = 0;
+}
+
+void ethereum_hashindex_decode(const guint8 *buf, ethereum_hashindex_record_t *record) {
+  memcpy(record->key, buf + RECORD_KEY, ETHEREUM_HASHINDEX_KEY_LEN);
+  record->ts = get_be64(buf + RECORD_TS);
+  memcpy(record->src_addr, buf + RECORD_SRC_ADDR, ETHEREUM_HASHINDEX_ADDR_LEN);
+  memcpy(record->dst_addr, buf + RECORD_DST_ADDR, ETHEREUM_HASHINDEX_ADDR_LEN);
+  record->src_port = get_be16(buf + RECORD_SRC_PORT);
+  record->dst_port = get_be16(buf + RECORD_DST_PORT);
+  record->type = buf[RECORD_TYPE];
+}
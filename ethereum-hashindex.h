@@ -0,0 +1,182 @@
+/* ethereum-hashindex.h
+ * Index of the discovery messages of a capture by message hash, for correlating captures taken at several
+ * vantage points.
+ * Copyright 2018, ConsenSys AG.
+ *
+ * Wireshark - Network traffic analyzer
+ * By Gerald Combs <gerald@wireshark.org>
+ * Copyright 1998, Gerald Combs.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __ETHEREUM_HASHINDEX_H__
+#define __ETHEREUM_HASHINDEX_H__
+
+#include <stdio.h>
+#include <glib.h>
+
+// Length in bytes of the prefix of the message hash identifying a message.
+#define ETHEREUM_HASHINDEX_KEY_LEN 16
+
+// Length in bytes of an address: an IPv6 or IPv4-mapped address.
+#define ETHEREUM_HASHINDEX_ADDR_LEN 16
+
+// Length in bytes of an encoded record.
+#define ETHEREUM_HASHINDEX_RECORD_LEN 64
+
+// Length in bytes of the sort key of an encoded record: the message key and the time.
+#define ETHEREUM_HASHINDEX_SORT_LEN (ETHEREUM_HASHINDEX_KEY_LEN + 8)
+
+// Default number of records per run, i.e. 64 MB of records buffered by a writer.
+#define ETHEREUM_HASHINDEX_RUN_RECORDS (1024 * 1024)
+
+// A message seen in a capture.
+typedef struct ethereum_hashindex_record {
+  guint8 key[ETHEREUM_HASHINDEX_KEY_LEN];   // The prefix of the message hash.
+  guint64 ts;                               // The capture time, in nanoseconds since the epoch.
+  guint8 src_addr[ETHEREUM_HASHINDEX_ADDR_LEN];
+  guint8 dst_addr[ETHEREUM_HASHINDEX_ADDR_LEN];
+  guint16 src_port;
+  guint16 dst_port;
+  guint8 type;                              // The packet type.
+} ethereum_hashindex_record_t;
+
+// Writes an index file: the records are buffered, and written out as runs sorted by key and time whenever the
+// buffer is full, so that the memory footprint is bounded whatever the size of the capture. Everything is
+// written in network byte order, so that index files can be moved across hosts.
+typedef struct ethereum_hashindex_writer {
+  FILE *file;
+  guint8 *buf;                                        // The encoded records of the current run.
+  guint len;                                          // The number of records in the current run.
+  guint run_records;                                  // The maximum number of records per run.
+  guint64 records;
+  guint64 runs;
+  guint8 candidates[2][ETHEREUM_HASHINDEX_ADDR_LEN];  // The addresses of the first record.
+  guint64 candidate_hits[2];                          // The number of records each of them appears in.
+} ethereum_hashindex_writer_t;
+
+// A run of an index file.
+typedef struct ethereum_hashindex_run {
+  gint64 offset;   // The offset of the first record in the file.
+  guint64 count;
+} ethereum_hashindex_run_t;
+
+// An index file open for reading.
+typedef struct ethereum_hashindex {
+  FILE *file;
+  guint64 records;
+  guint8 local_addr[ETHEREUM_HASHINDEX_ADDR_LEN];  // The address of the capturing host, inferred by the writer.
+  gboolean has_local_addr;
+  GArray *runs;                                    // ethereum_hashindex_run_t
+} ethereum_hashindex_t;
+
+// A cursor over the records of a run, in order. The cursors of an index share its file, and seek before every
+// (buffered) read.
+typedef struct ethereum_hashindex_cursor {
+  ethereum_hashindex_t *index;
+  gint64 offset;       // The offset of the next record to read from the file.
+  guint64 remaining;   // The number of records left to read from the file.
+  guint8 *buf;
+  guint pos;           // The position of the current record in the buffer.
+  guint len;           // The number of records in the buffer.
+} ethereum_hashindex_cursor_t;
+
+/**
+ * Creates an index file.
+ *
+ * @param writer The writer to initialize.
+ * @param path The path of the file, which must be seekable.
+ * @param run_records The maximum number of records per run; 0 for the default.
+ * @return TRUE if the file was created; FALSE otherwise.
+ */
+gboolean ethereum_hashindex_writer_open(ethereum_hashindex_writer_t *writer, const gchar *path, guint run_records);
+
+/**
+ * Adds a record to an index file, writing the current run out if it is full.
+ *
+ * @param writer The writer.
+ * @param record The record.
+ * @return TRUE if successful; FALSE upon a write error.
+ */
+gboolean ethereum_hashindex_writer_add(ethereum_hashindex_writer_t *writer, const ethereum_hashindex_record_t *record);
+
+/**
+ * Writes the last run and the header out, and closes an index file.
+ *
+ * @param writer The writer.
+ * @return TRUE if the file is complete; FALSE upon a write error.
+ */
+gboolean ethereum_hashindex_writer_close(ethereum_hashindex_writer_t *writer);
+
+/**
+ * Opens an index file, locating its runs.
+ *
+ * @param index The index to initialize.
+ * @param path The path of the file.
+ * @return TRUE if the file is a complete index file; FALSE otherwise.
+ */
+gboolean ethereum_hashindex_open(ethereum_hashindex_t *index, const gchar *path);
+
+/**
+ * Closes an index file.
+ *
+ * @param index The index.
+ */
+void ethereum_hashindex_close(ethereum_hashindex_t *index);
+
+/**
+ * Initializes a cursor on the first record of a run.
+ *
+ * @param cursor The cursor.
+ * @param index The index.
+ * @param run The index of the run.
+ */
+void ethereum_hashindex_cursor_init(ethereum_hashindex_cursor_t *cursor, ethereum_hashindex_t *index, guint run);
+
+/**
+ * Returns the encoded record under a cursor, reading the next records from the file if needed. Encoded records
+ * compare by key then time with memcmp() over ETHEREUM_HASHINDEX_SORT_LEN bytes.
+ *
+ * @param cursor The cursor.
+ * @return The encoded record, or NULL at the end of the run or upon a read error.
+ */
+const guint8 *ethereum_hashindex_cursor_peek(ethereum_hashindex_cursor_t *cursor);
+
+/**
+ * Moves a cursor to the next record.
+ *
+ * @param cursor The cursor.
+ */
+static inline void ethereum_hashindex_cursor_next(ethereum_hashindex_cursor_t *cursor) {
+  cursor->pos++;
+}
+
+/**
+ * Releases the buffer of a cursor.
+ *
+ * @param cursor The cursor.
+ */
+void ethereum_hashindex_cursor_clear(ethereum_hashindex_cursor_t *cursor);
+
+/**
+ * Decodes an encoded record.
+ *
+ * @param buf The encoded record.
+ * @param record The record to fill in.
+ */
+void ethereum_hashindex_decode(const guint8 *buf, ethereum_hashindex_record_t *record);
+
+#endif //__ETHEREUM_HASHINDEX_H__
@@ -0,0 +1,115 @@
+/* ethereum-histogram.c
+ * Fixed-memory, log-bucketed histograms for latency percentiles.
+ * Copyright 2018, ConsenSys AG.
+ *
+ * Wireshark - Network traffic analyzer
+ * By Gerald Combs <gerald@wireshark.org>
+ * Copyright 1998, Gerald Combs.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "config.h"
+
+#include <string.h>
+
+#include "ethereum-histogram.h"
+
+/**
+ * Returns the position of the most significant bit set in a non-zero value.
+ */
+static guint msb64(guint64 value) {
+  guint pos = 0;
+  if (value >> 32) { value >>= 32; pos += 32; }
+  if (value >> 16) { value >>= 16; pos += 16; }
+  if (value >> 8) { value >>= 8; pos += 8; }
+  if (value >> 4) { value >>= 4; pos += 4; }
+  if (value >> 2) { value >>= 2; pos += 2; }
+  if (value >> 1) { pos += 1; }
+  return pos;
+}
+
+/**
+ * Returns the bucket of a value.
+ */
+static guint bucket_of(guint64 value) {
+  guint shift;
+  if (value < ETHEREUM_HIST_SUB_COUNT) {
+    return (guint) value;
+  }
+  // Keep the top ETHEREUM_HIST_SUB_BITS + 1 bits, i.e. a sub-bucket in [SUB_COUNT, 2 * SUB_COUNT).
+  shift = msb64(value) - ETHEREUM_HIST_SUB_BITS;
+  return shift * ETHEREUM_HIST_SUB_COUNT + (guint) (value >> shift);
+}
+
+/**
+ * Returns the largest value falling in a bucket.
+ */
+static guint64 bucket_upper_bound(guint bucket) {
+  guint shift;
+  guint64 sub;
+  if (bucket < 2 * ETHEREUM_HIST_SUB_COUNT) {
+    return bucket;
+  }
+  shift = bucket / ETHEREUM_HIST_SUB_COUNT - 1;
+  sub = bucket - shift * ETHEREUM_HIST_SUB_COUNT;
+  return ((sub + 1) << shift) - 1;
+}
+
+void ethereum_hist_reset(ethereum_hist_t *hist) {
+  memset(hist, 0, sizeof(*hist));
+}
+
+void ethereum_hist_add(ethereum_hist_t *hist, guint64 value) {
+  guint bucket;
+  value = MIN(value, ETHEREUM_HIST_MAX_VALUE);
+  bucket = bucket_of(value);
+  if (hist->buckets[bucket] == G_MAXUINT32) {
+    return;
+  }
+  hist->buckets[bucket]++;
+  hist->count++;
+  hist->max = MAX(hist->max, value);
+}
+
+void ethereum_hist_merge(ethereum_hist_t *hist, const ethereum_hist_t *other) {
+  guint i;
+  for (i = 0; i < ETHEREUM_HIST_BUCKETS; i++) {
+    // Saturate like ethereum_hist_add(): the values that don't fit aren't counted.
+    guint32 added = MIN(other->buckets[i], G_MAXUINT32 - hist->buckets[i]);
+    hist->buckets[i] += added;
+    hist->count += added;
+  }
+  hist->max = MAX(hist->max, other->max);
+}
+
+void ethereum_hist_percentiles(const ethereum_hist_t *hist, const gdouble *percentiles, guint n, guint64 *values) {
+  guint64 seen = 0, rank;
+  guint bucket = 0, i;
+
+  for (i = 0; i < n; i++) {
+    if (hist->count == 0) {
+      values[i] = 0;
+      continue;
+    }
+    // The rank of the percentile, between 1 and the number of values.
+    rank = (guint64) (percentiles[i] / 100.0 * (gdouble) hist->count + 0.999999);
+    rank = CLAMP(rank, 1, hist->count);
+    while (seen + hist->buckets[bucket] < rank) {
+      seen += hist->buckets[bucket++];
+    }
+    values[i] = MIN(bucket_upper_bound(bucket), hist->max);
+  }
+}
@@ -0,0 +1,84 @@
+/* ethereum-histogram.h
+ * Fixed-memory, log-bucketed histograms for latency percentiles.
+ * Copyright 2018, ConsenSys AG.
+ *
+ * Wireshark - Network traffic analyzer
+ * By Gerald Combs <gerald@wireshark.org>
+ * Copyright 1998, Gerald Combs.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __ETHEREUM_HISTOGRAM_H__
+#define __ETHEREUM_HISTOGRAM_H__
+
+#include <glib.h>
+
+// Number of significant bits kept for values beyond the linear range, i.e. a relative error of at most
+// 1 / 2^ETHEREUM_HIST_SUB_BITS.
+#define ETHEREUM_HIST_SUB_BITS 5
+
+// Number of bits of the largest value recorded; larger values are recorded as the largest one.
+#define ETHEREUM_HIST_MAX_BITS 40
+
+#define ETHEREUM_HIST_SUB_COUNT (1 << ETHEREUM_HIST_SUB_BITS)
+#define ETHEREUM_HIST_BUCKETS ((ETHEREUM_HIST_MAX_BITS - ETHEREUM_HIST_SUB_BITS + 1) * ETHEREUM_HIST_SUB_COUNT)
+#define ETHEREUM_HIST_MAX_VALUE ((G_GUINT64_CONSTANT(1) << ETHEREUM_HIST_MAX_BITS) - 1)
+
+// A histogram in the style of HdrHistogram: values below ETHEREUM_HIST_SUB_COUNT are counted exactly, and
+// every further power of 2 is split into ETHEREUM_HIST_SUB_COUNT linear buckets. The memory footprint is fixed,
+// whatever the number of values recorded.
+typedef struct ethereum_hist {
+  guint64 count;                           // The number of values recorded.
+  guint64 max;                             // The largest value recorded.
+  guint32 buckets[ETHEREUM_HIST_BUCKETS];
+} ethereum_hist_t;
+
+/**
+ * Empties a histogram.
+ *
+ * @param hist The histogram.
+ */
+void ethereum_hist_reset(ethereum_hist_t *hist);
+
+/**
+ * Records a value in a histogram.
+ *
+ * @param hist The histogram.
+ * @param value The value, capped to ETHEREUM_HIST_MAX_VALUE.
+ */
+void ethereum_hist_add(ethereum_hist_t *hist, guint64 value);
+
+/**
+ * Adds the values recorded in a histogram to another one, e.g. to combine histograms filled on several threads.
+ *
+ * @param hist The histogram to add the values to.
+ * @param other The histogram whose values are added.
+ */
+void ethereum_hist_merge(ethereum_hist_t *hist, const ethereum_hist_t *other);
+
+/**
+ * Computes several percentiles of the values recorded in a histogram, in a single pass over the buckets.
+ * Each percentile is reported as the upper bound of the bucket it falls in (but no more than the largest
+ * value recorded), so it is never underestimated.
+ *
+ * @param hist The histogram.
+ * @param percentiles The percentiles to compute, in ascending order, between 0 and 100.
+ * @param n The number of percentiles.
+ * @param values Set to the value of each percentile; 0 if the histogram is empty.
+ */
+void ethereum_hist_percentiles(const ethereum_hist_t *hist, const gdouble *percentiles, guint n, guint64 *values);
+
+#endif //__ETHEREUM_HISTOGRAM_H__
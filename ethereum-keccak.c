@@ -0,0 +1,183 @@
+/* ethereum-keccak.c
+ * Keccak-256, the hash function used throughout Ethereum.
+ * Copyright 2018, ConsenSys AG.
+ *
+ * Wireshark - Network traffic analyzer
+ * By Gerald Combs <gerald@wireshark.org>
+ * Copyright 1998, Gerald Combs.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "config.h"
+
+#include <string.h>
+
+#include "ethereum-keccak.h"
+
+// Keccak-256: a 1088-bit rate (17 lanes of 64 bits) over the 1600-bit state.
+#define KECCAK256_RATE 136
+#define KECCAK_ROUNDS 24
+
+#define ROL64(x, n) (((x) << (n)) | ((x) >> (64 - (n))))
+
+static const guint64 round_constants[KECCAK_ROUNDS] = {
+    G_GUINT64_CONSTANT(0x0000000000000001), G_GUINT64_CONSTANT(0x0000000000008082),
+    G_GUINT64_CONSTANT(0x800000000000808a), G_GUINT64_CONSTANT(0x8000000080008000),
+    G_GUINT64_CONSTANT(0x000000000000808b), G_GUINT64_CONSTANT(0x0000000080000001),
+    G_GUINT64_CONSTANT(0x8000000080008081), G_GUINT64_CONSTANT(0x8000000000008009),
+    G_GUINT64_CONSTANT(0x000000000000008a), G_GUINT64_CONSTANT(0x0000000000000088),
+    G_GUINT64_CONSTANT(0x0000000080008009), G_GUINT64_CONSTANT(0x000000008000000a),
+    G_GUINT64_CONSTANT(0x000000008000808b), G_GUINT64_CONSTANT(0x800000000000008b),
+    G_GUINT64_CONSTANT(0x8000000000008089), G_GUINT64_CONSTANT(0x8000000000008003),
+    G_GUINT64_CONSTANT(0x8000000000008002), G_GUINT64_CONSTANT(0x8000000000000080),
+    G_GUINT64_CONSTANT(0x000000000000800a), G_GUINT64_CONSTANT(0x800000008000000a),
+    G_GUINT64_CONSTANT(0x8000000080008081), G_GUINT64_CONSTANT(0x8000000000008080),
+    G_GUINT64_CONSTANT(0x0000000080000001), G_GUINT64_CONSTANT(0x8000000080008008)
+};
+
+/**
+ * Applies the Keccak-f[1600] permutation to a state. The lanes are kept in locals and every step is
+ * unrolled, so that the whole state stays in registers and the compiler is free to schedule (and, where
+ * the target allows, vectorise) the independent lane operations of each step.
+ *
+ * @param st The state, as 25 lanes indexed by x + 5 * y.
+ */
+static void keccak_f1600(guint64 st[25]) {
+  guint64 a00 = st[0], a01 = st[1], a02 = st[2], a03 = st[3], a04 = st[4];
+  guint64 a05 = st[5], a06 = st[6], a07 = st[7], a08 = st[8], a09 = st[9];
+  guint64 a10 = st[10], a11 = st[11], a12 = st[12], a13 = st[13], a14 = st[14];
+  guint64 a15 = st[15], a16 = st[16], a17 = st[17], a18 = st[18], a19 = st[19];
+  guint64 a20 = st[20], a21 = st[21], a22 = st[22], a23 = st[23], a24 = st[24];
+  guint64 c0, c1, c2, c3, c4, d0, d1, d2, d3, d4;
+  guint64 b00, b01, b02, b03, b04, b05, b06, b07, b08, b09, b10, b11, b12;
+  guint64 b13, b14, b15, b16, b17, b18, b19, b20, b21, b22, b23, b24;
+  guint round;
+
+  for (round = 0; round < KECCAK_ROUNDS; round++) {
+    // Theta.
+    c0 = a00 ^ a05 ^ a10 ^ a15 ^ a20;
+    c1 = a01 ^ a06 ^ a11 ^ a16 ^ a21;
+    c2 = a02 ^ a07 ^ a12 ^ a17 ^ a22;
+    c3 = a03 ^ a08 ^ a13 ^ a18 ^ a23;
+    c4 = a04 ^ a09 ^ a14 ^ a19 ^ a24;
+    d0 = c4 ^ ROL64(c1, 1);
+    d1 = c0 ^ ROL64(c2, 1);
+    d2 = c1 ^ ROL64(c3, 1);
+    d3 = c2 ^ ROL64(c4, 1);
+    d4 = c3 ^ ROL64(c0, 1);
+
+    // Rho and pi: lane (x, y) moves to (y, 2x + 3y), rotated by its offset.
+    b00 = a00 ^ d0;
+    b10 = ROL64(a01 ^ d1, 1);
+    b20 = ROL64(a02 ^ d2, 62);
+    b05 = ROL64(a03 ^ d3, 28);
+    b15 = ROL64(a04 ^ d4, 27);
+    b16 = ROL64(a05 ^ d0, 36);
+    b01 = ROL64(a06 ^ d1, 44);
+    b11 = ROL64(a07 ^ d2, 6);
+    b21 = ROL64(a08 ^ d3, 55);
+    b06 = ROL64(a09 ^ d4, 20);
+    b07 = ROL64(a10 ^ d0, 3);
+    b17 = ROL64(a11 ^ d1, 10);
+    b02 = ROL64(a12 ^ d2, 43);
+    b12 = ROL64(a13 ^ d3, 25);
+    b22 = ROL64(a14 ^ d4, 39);
+    b23 = ROL64(a15 ^ d0, 41);
+    b08 = ROL64(a16 ^ d1, 45);
+    b18 = ROL64(a17 ^ d2, 15);
+    b03 = ROL64(a18 ^ d3, 21);
+    b13 = ROL64(a19 ^ d4, 8);
+    b14 = ROL64(a20 ^ d0, 18);
+    b24 = ROL64(a21 ^ d1, 2);
+    b09 = ROL64(a22 ^ d2, 61);
+    b19 = ROL64(a23 ^ d3, 56);
+    b04 = ROL64(a24 ^ d4, 14);
+
+    // Chi and iota.
+    a00 = b00 ^ (~b01 & b02) ^ round_constants[round];
+    a01 = b01 ^ (~b02 & b03);
+    a02 = b02 ^ (~b03 & b04);
+    a03 = b03 ^ (~b04 & b00);
+    a04 = b04 ^ (~b00 & b01);
+    a05 = b05 ^ (~b06 & b07);
+    a06 = b06 ^ (~b07 & b08);
+    a07 = b07 ^ (~b08 & b09);
+    a08 = b08 ^ (~b09 & b05);
+    a09 = b09 ^ (~b05 & b06);
+    a10 = b10 ^ (~b11 & b12);
+    a11 = b11 ^ (~b12 & b13);
+    a12 = b12 ^ (~b13 & b14);
+    a13 = b13 ^ (~b14 & b10);
+    a14 = b14 ^ (~b10 & b11);
+    a15 = b15 ^ (~b16 & b17);
+    a16 = b16 ^ (~b17 & b18);
+    a17 = b17 ^ (~b18 & b19);
+    a18 = b18 ^ (~b19 & b15);
+    a19 = b19 ^ (~b15 & b16);
+    a20 = b20 ^ (~b21 & b22);
+    a21 = b21 ^ (~b22 & b23);
+    a22 = b22 ^ (~b23 & b24);
+    a23 = b23 ^ (~b24 & b20);
+    a24 = b24 ^ (~b20 & b21);
+  }
+
+  st[0] = a00; st[1] = a01; st[2] = a02; st[3] = a03; st[4] = a04;
+  st[5] = a05; st[6] = a06; st[7] = a07; st[8] = a08; st[9] = a09;
+  st[10] = a10; st[11] = a11; st[12] = a12; st[13] = a13; st[14] = a14;
+  st[15] = a15; st[16] = a16; st[17] = a17; st[18] = a18; st[19] = a19;
+  st[20] = a20; st[21] = a21; st[22] = a22; st[23] = a23; st[24] = a24;
+}
+
+/**
+ * Reads a little-endian lane.
+ */
+static inline guint64 load64_le(const guint8 *p) {
+  return (guint64) p[0] | ((guint64) p[1] << 8) | ((guint64) p[2] << 16) | ((guint64) p[3] << 24) |
+         ((guint64) p[4] << 32) | ((guint64) p[5] << 40) | ((guint64) p[6] << 48) | ((guint64) p[7] << 56);
+}
+
+void ethereum_keccak256(const guint8 *data, gsize len, guint8 *digest) {
+  guint64 st[25];
+  guint8 block[KECCAK256_RATE];
+  guint i;
+
+  memset(st, 0, sizeof(st));
+
+  // Absorb the full blocks straight from the input.
+  while (len >= KECCAK256_RATE) {
+    for (i = 0; i < KECCAK256_RATE / 8; i++) {
+      st[i] ^= load64_le(data + 8 * i);
+    }
+    keccak_f1600(st);
+    data += KECCAK256_RATE;
+    len -= KECCAK256_RATE;
+  }
+
+  // Pad the last block (Keccak padding: 0x01 ... 0x80) and absorb it.
+  memset(block, 0, sizeof(block));
+  memcpy(block, data, len);
+  block[len] |= 0x01;
+  block[KECCAK256_RATE - 1] |= 0x80;
+  for (i = 0; i < KECCAK256_RATE / 8; i++) {
+    st[i] ^= load64_le(block + 8 * i);
+  }
+  keccak_f1600(st);
+
+  // Squeeze the digest, which fits within the first block.
+  for (i = 0; i < ETHEREUM_KECCAK256_LEN; i++) {
+    digest[i] = (guint8) (st[i / 8] >> (8 * (i % 8)));
+  }
+}
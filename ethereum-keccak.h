@@ -0,0 +1,42 @@
+/* ethereum-keccak.h
+ * Keccak-256, the hash function used throughout Ethereum.
+ * Copyright 2018, ConsenSys AG.
+ *
+ * Wireshark - Network traffic analyzer
+ * By Gerald Combs <gerald@wireshark.org>
+ * Copyright 1998, Gerald Combs.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __ETHEREUM_KECCAK_H__
+#define __ETHEREUM_KECCAK_H__
+
+#include <glib.h>
+
+// Length in bytes of a Keccak-256 digest.
+#define ETHEREUM_KECCAK256_LEN 32
+
+/**
+ * Computes the Keccak-256 digest of a buffer. This is the original Keccak submission as used by Ethereum,
+ * which differs from the standardised SHA3-256 in its padding.
+ *
+ * @param data The buffer.
+ * @param len The length of the buffer.
+ * @param digest Set to the ETHEREUM_KECCAK256_LEN bytes of the digest.
+ */
+void ethereum_keccak256(const guint8 *data, gsize len, guint8 *digest);
+
+#endif //__ETHEREUM_KECCAK_H__
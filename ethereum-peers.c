@@ -0,0 +1,310 @@
+/* ethereum-peers.c
+ * Table of the Ethereum nodes seen in a capture file, keyed by node ID.
+ * Copyright 2018, ConsenSys AG.
+ *
+ * Wireshark - Network traffic analyzer
+ * By Gerald Combs <gerald@wireshark.org>
+ * Copyright 1998, Gerald Combs.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "config.h"
+
+#include <math.h>
+#include <string.h>
+
+#include "ethereum-peers.h"
+#include "ethereum-keccak.h"
+
+#define PEER_CHUNK_BITS 12
+#define PEER_CHUNK_SIZE (1 << PEER_CHUNK_BITS)
+#define PEER_MIN_CAPACITY 1024
+
+/**
+ * Hashes a node ID. Node IDs are public keys, i.e. uniformly distributed, so a few of their bytes will do;
+ * the multiplication spreads them over the whole word anyway. The result is never 0.
+ */
+static guint32 peer_hash(const guint8 *id) {
+  guint32 h;
+  memcpy(&h, id, sizeof(h));
+  h *= 0x9e3779b1U;
+  return h ? h : 1;
+}
+
+/**
+ * Hashes an endpoint (FNV-1a, then the MurmurHash3 finalizer, so that all the bits of the result are mixed, as the
+ * HyperLogLog sketch of advertisers needs).
+ */
+static guint32 endpoint_hash(const ethereum_peer_endpoint_t *ep) {
+  guint32 h = 2166136261U;
+  guint i;
+  for (i = 0; i < sizeof(ep->addr); i++) {
+    h = (h ^ ep->addr[i]) * 16777619U;
+  }
+  h = (h ^ (ep->udp_port & 0xff)) * 16777619U;
+  h = (h ^ (ep->udp_port >> 8)) * 16777619U;
+  h ^= h >> 16;
+  h *= 0x85ebca6bU;
+  h ^= h >> 13;
+  h *= 0xc2b2ae35U;
+  return h ^ (h >> 16);
+}
+
+/**
+ * Returns a register of the HyperLogLog sketch of advertisers of a node.
+ */
+static guint advertiser_register(const ethereum_peer_t *peer, guint i) {
+  return (peer->advertisers[i / 2] >> ((i % 2) * 4)) & 0xf;
+}
+
+/**
+ * Adds an advertiser to the HyperLogLog sketch of a node: the low bits of its hash select a register, which keeps
+ * the highest rank (position of the first set bit) of the other bits seen so far.
+ */
+static void add_advertiser(ethereum_peer_t *peer, const ethereum_peer_endpoint_t *advertiser) {
+  guint32 h = endpoint_hash(advertiser);
+  guint i = h & (ETHEREUM_PEER_ADVERTISER_REGISTERS - 1);
+  guint rank = 1;
+
+  for (h >>= 6; !(h & 1) && rank < 15; h >>= 1) {
+    rank++;
+  }
+  if (rank > advertiser_register(peer, i)) {
+    peer->advertisers[i / 2] = (guint8) ((peer->advertisers[i / 2] & ~(0xf << ((i % 2) * 4))) |
+                                         (rank << ((i % 2) * 4)));
+  }
+}
+
+/**
+ * Checks whether a node was advertised at an endpoint, among the endpoints it remembers: only the address and
+ * UDP port are significant.
+ */
+static gboolean peer_has_endpoint(const ethereum_peer_t *peer, const ethereum_peer_endpoint_t *ep) {
+  guint i;
+  for (i = 0; i < ETHEREUM_PEER_ENDPOINTS; i++) {
+    const ethereum_peer_endpoint_t *known = &peer->endpoints[i];
+    if (known->udp_port == ep->udp_port && memcmp(known->addr, ep->addr, sizeof(ep->addr)) == 0) {
+      return TRUE;
+    }
+  }
+  return FALSE;
+}
+
+static gboolean endpoint_equal(const ethereum_peer_endpoint_t *a, const ethereum_peer_endpoint_t *b) {
+  return memcmp(a->addr, b->addr, sizeof(a->addr)) == 0 && a->udp_port == b->udp_port && a->tcp_port == b->tcp_port;
+}
+
+static ethereum_peer_t *get_peer(const ethereum_peer_table_t *table, guint32 index) {
+  return &table->chunks[index >> PEER_CHUNK_BITS][index & (PEER_CHUNK_SIZE - 1)];
+}
+
+void ethereum_peer_table_init(ethereum_peer_table_t *table) {
+  memset(table, 0, sizeof(*table));
+}
+
+void ethereum_peer_table_clear(ethereum_peer_table_t *table) {
+  guint32 i;
+  for (i = 0; i < table->chunks_len; i++) {
+    g_free(table->chunks[i]);
+  }
+  g_free(table->chunks);
+  g_free(table->slots);
+  g_free(table->endpoint_slots);
+  ethereum_peer_table_init(table);
+}
+
+/**
+ * Finds the slot of a node ID, i.e. either its slot or the free slot where it belongs.
+ */
+static guint32 find_slot(const ethereum_peer_table_t *table, const guint8 *id, guint32 hash) {
+  guint32 mask = table->capacity - 1;
+  guint32 i = hash & mask;
+  guint64 slot;
+
+  while ((slot = table->slots[i]) != 0) {
+    if ((guint32) (slot >> 32) == hash &&
+        memcmp(get_peer(table, (guint32) slot - 1)->id, id, ETHEREUM_PEER_ID_LEN) == 0) {
+      break;
+    }
+    i = (i + 1) & mask;
+  }
+  return i;
+}
+
+/**
+ * Finds the endpoint slot of an endpoint, i.e. either the slot of a node that remembers it or the free slot where it
+ * belongs. The slots of the endpoints that nodes moved away from are never matched again.
+ */
+static guint32 find_endpoint_slot(const ethereum_peer_table_t *table, const ethereum_peer_endpoint_t *ep,
+                                  guint32 hash) {
+  guint32 mask = table->endpoint_capacity - 1;
+  guint32 i = hash & mask;
+  guint64 slot;
+
+  while ((slot = table->endpoint_slots[i]) != 0) {
+    if ((guint32) (slot >> 32) == hash && peer_has_endpoint(get_peer(table, (guint32) slot - 1), ep)) {
+      break;
+    }
+    i = (i + 1) & mask;
+  }
+  return i;
+}
+
+/**
+ * Doubles the number of slots of a slot array, rehashing from the hashes kept in the slots.
+ */
+static void grow_slot_array(guint64 **slots_ptr, guint32 *capacity_ptr) {
+  guint32 capacity = *capacity_ptr ? *capacity_ptr * 2 : PEER_MIN_CAPACITY;
+  guint64 *slots = g_new0(guint64, capacity);
+  guint32 i, j;
+
+  for (i = 0; i < *capacity_ptr; i++) {
+    guint64 slot = (*slots_ptr)[i];
+    if (!slot) {
+      continue;
+    }
+    for (j = (guint32) (slot >> 32) & (capacity - 1); slots[j]; j = (j + 1) & (capacity - 1)) {
+    }
+    slots[j] = slot;
+  }
+  g_free(*slots_ptr);
+  *slots_ptr = slots;
+  *capacity_ptr = capacity;
+}
+
+/**
+ * Indexes a node by the endpoint it was just advertised at, taking the endpoint over from any other node.
+ */
+static void index_endpoint(ethereum_peer_table_t *table, guint32 index, const ethereum_peer_endpoint_t *ep) {
+  guint32 hash = endpoint_hash(ep), i;
+
+  hash = hash ? hash : 1;
+  if ((guint64) (table->endpoint_count + 1) * 4 > (guint64) table->endpoint_capacity * 3) {
+    grow_slot_array(&table->endpoint_slots, &table->endpoint_capacity);
+  }
+  i = find_endpoint_slot(table, ep, hash);
+  if (!table->endpoint_slots[i]) {
+    table->endpoint_count++;
+  }
+  table->endpoint_slots[i] = ((guint64) hash << 32) | (index + 1);
+}
+
+ethereum_peer_t *ethereum_peer_table_lookup(const ethereum_peer_table_t *table, const guint8 *id) {
+  guint64 slot;
+
+  if (!table->count) {
+    return NULL;
+  }
+  slot = table->slots[find_slot(table, id, peer_hash(id))];
+  return slot ? get_peer(table, (guint32) slot - 1) : NULL;
+}
+
+ethereum_peer_t *ethereum_peer_table_lookup_endpoint(const ethereum_peer_table_t *table,
+                                                     const ethereum_peer_endpoint_t *endpoint) {
+  guint32 hash = endpoint_hash(endpoint);
+  guint64 slot;
+
+  if (!table->endpoint_count) {
+    return NULL;
+  }
+  slot = table->endpoint_slots[find_endpoint_slot(table, endpoint, hash ? hash : 1)];
+  return slot ? get_peer(table, (guint32) slot - 1) : NULL;
+}
+
+/**
+ * Adds a node to a table, in the given free slot.
+ */
+static ethereum_peer_t *add_peer(ethereum_peer_table_t *table, const guint8 *id, guint32 hash, guint32 i) {
+  guint32 index = table->count++;
+  guint32 chunk = index >> PEER_CHUNK_BITS;
+  ethereum_peer_t *peer;
+
+  if (chunk >= table->chunks_len) {
+    table->chunks = (ethereum_peer_t **) g_realloc(table->chunks, (chunk + 1) * sizeof(*table->chunks));
+    table->chunks[chunk] = g_new0(ethereum_peer_t, PEER_CHUNK_SIZE);
+    table->chunks_len = chunk + 1;
+  }
+  table->slots[i] = ((guint64) hash << 32) | (index + 1);
+  peer = get_peer(table, index);
+  memcpy(peer->id, id, ETHEREUM_PEER_ID_LEN);
+  return peer;
+}
+
+ethereum_peer_t *ethereum_peer_table_advertise(ethereum_peer_table_t *table, const guint8 *id, guint32 frame,
+                                               const nstime_t *ts, const ethereum_peer_endpoint_t *endpoint,
+                                               const ethereum_peer_endpoint_t *advertiser) {
+  guint32 hash = peer_hash(id);
+  ethereum_peer_t *peer;
+  guint32 i;
+
+  // Keep the table at most 3/4 full, so the probe sequences stay short.
+  if ((guint64) (table->count + 1) * 4 > (guint64) table->capacity * 3) {
+    grow_slot_array(&table->slots, &table->capacity);
+  }
+  i = find_slot(table, id, hash);
+  if (table->slots[i]) {
+    peer = get_peer(table, (guint32) table->slots[i] - 1);
+    if (!endpoint_equal(&peer->endpoints[0], endpoint)) {
+      memmove(&peer->endpoints[1], &peer->endpoints[0],
+              (ETHEREUM_PEER_ENDPOINTS - 1) * sizeof(ethereum_peer_endpoint_t));
+      peer->endpoints[0] = *endpoint;
+      peer->endpoints[0].first_frame = frame;
+      peer->endpoint_count++;
+      table->endpoint_changes++;
+    }
+  } else {
+    peer = add_peer(table, id, hash, i);
+    peer->first_frame = frame;
+    peer->first_seen = *ts;
+    peer->endpoints[0] = *endpoint;
+    peer->endpoints[0].first_frame = frame;
+    peer->endpoint_count = 1;
+  }
+  peer->last_frame = frame;
+  peer->last_seen = *ts;
+  peer->advertised++;
+  add_advertiser(peer, advertiser);
+  peer->last_advertiser = *advertiser;
+  peer->last_advertiser.first_frame = frame;
+  index_endpoint(table, (guint32) table->slots[i] - 1, endpoint);
+  return peer;
+}
+
+guint32 ethereum_peer_advertisers(const ethereum_peer_t *peer) {
+  const gdouble m = ETHEREUM_PEER_ADVERTISER_REGISTERS;
+  gdouble sum = 0.0, estimate;
+  guint zeros = 0, i, r;
+
+  for (i = 0; i < ETHEREUM_PEER_ADVERTISER_REGISTERS; i++) {
+    r = advertiser_register(peer, i);
+    sum += ldexp(1.0, -(int) r);
+    zeros += r == 0;
+  }
+  // HyperLogLog (alpha = 0.709 for 64 registers), with linear counting over the registers for small numbers.
+  estimate = 0.709 * m * m / sum;
+  if (estimate <= 2.5 * m && zeros > 0) {
+    estimate = m * log(m / zeros);
+  }
+  return (guint32) MIN(floor(estimate + 0.5), (gdouble) peer->advertised);
+}
+
+const guint8 *ethereum_peer_id_hash(ethereum_peer_t *peer) {
+  if (!peer->id_hashed) {
+    ethereum_keccak256(peer->id, ETHEREUM_PEER_ID_LEN, peer->id_hash);
+    peer->id_hashed = TRUE;
+  }
+  return peer->id_hash;
+}
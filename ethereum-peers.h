@@ -0,0 +1,145 @@
+/* ethereum-peers.h
+ * Table of the Ethereum nodes seen in a capture file, keyed by node ID.
+ * Copyright 2018, ConsenSys AG.
+ *
+ * Wireshark - Network traffic analyzer
+ * By Gerald Combs <gerald@wireshark.org>
+ * Copyright 1998, Gerald Combs.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __ETHEREUM_PEERS_H__
+#define __ETHEREUM_PEERS_H__
+
+#include <glib.h>
+#include <wsutil/nstime.h>
+
+// Length in bytes of a node ID, i.e. an uncompressed secp256k1 public key without its prefix.
+#define ETHEREUM_PEER_ID_LEN 64
+
+// Number of distinct endpoints remembered per node, most recent first.
+#define ETHEREUM_PEER_ENDPOINTS 2
+
+// Number of registers of the HyperLogLog sketch of the advertisers of a node (a power of 2), of 4 bits each;
+// the standard error of the estimates is about 13%.
+#define ETHEREUM_PEER_ADVERTISER_REGISTERS 64
+
+// An endpoint of a node: the IPv6 address (IPv4-mapped for IPv4) and ports.
+typedef struct ethereum_peer_endpoint {
+  guint8 addr[16];
+  guint16 udp_port;
+  guint16 tcp_port;
+  guint32 first_frame;  // The frame in which the endpoint was first seen.
+} ethereum_peer_endpoint_t;
+
+// The record of a node, i.e. about 260 bytes per node.
+typedef struct ethereum_peer {
+  guint8 id[ETHEREUM_PEER_ID_LEN];
+  guint32 first_frame;                                 // The frame in which the node was first advertised.
+  guint32 last_frame;                                  // The frame in which the node was last advertised.
+  nstime_t first_seen;
+  nstime_t last_seen;
+  guint32 advertised;                                  // The number of times the node was advertised.
+  guint8 advertisers[ETHEREUM_PEER_ADVERTISER_REGISTERS / 2];  // The HyperLogLog sketch of the advertisers.
+  guint32 endpoint_count;                              // The number of times the node changed endpoints, plus 1.
+  ethereum_peer_endpoint_t endpoints[ETHEREUM_PEER_ENDPOINTS];
+  ethereum_peer_endpoint_t last_advertiser;            // The endpoint of the node that last advertised it.
+  gboolean id_hashed;                                  // id_hash was computed.
+  guint8 id_hash[32];                                  // The Keccak-256 of the node ID, i.e. its Kademlia key.
+} ethereum_peer_t;
+
+// A table of nodes keyed by node ID, with open addressing (linear probing) over a slot array of 8 bytes per
+// slot, at most 3/4 full. The records are allocated in chunks and never move, so pointers to them remain
+// valid until the table is cleared; the memory footprint is about 280 bytes per node. A second slot array
+// indexes the nodes by advertised endpoint, i.e. address and UDP port.
+typedef struct ethereum_peer_table {
+  guint64 *slots;            // The hash of the node ID in the upper half, the record index + 1 in the lower half.
+  guint32 capacity;          // The number of slots, a power of 2.
+  guint32 count;             // The number of records.
+  guint64 *endpoint_slots;   // The hash of the endpoint in the upper half, the record index + 1 in the lower half.
+  guint32 endpoint_capacity; // The number of endpoint slots, a power of 2.
+  guint32 endpoint_count;    // The number of used endpoint slots, including those of endpoints nodes moved away from.
+  ethereum_peer_t **chunks;  // The records.
+  guint32 chunks_len;
+  guint32 endpoint_changes;  // The number of times a node was advertised with another endpoint than before.
+} ethereum_peer_table_t;
+
+/**
+ * Initializes an empty peer table.
+ *
+ * @param table The table.
+ */
+void ethereum_peer_table_init(ethereum_peer_table_t *table);
+
+/**
+ * Empties a peer table, releasing its memory.
+ *
+ * @param table The table.
+ */
+void ethereum_peer_table_clear(ethereum_peer_table_t *table);
+
+/**
+ * Looks up a node in a peer table.
+ *
+ * @param table The table.
+ * @param id The ETHEREUM_PEER_ID_LEN bytes of the node ID.
+ * @return The record of the node, or NULL if it is unknown.
+ */
+ethereum_peer_t *ethereum_peer_table_lookup(const ethereum_peer_table_t *table, const guint8 *id);
+
+/**
+ * Looks up the node last advertised at an endpoint.
+ *
+ * @param table The table.
+ * @param endpoint The endpoint; only the address and UDP port are significant.
+ * @return The record of the node, or NULL if no node known to the table was advertised at this endpoint.
+ */
+ethereum_peer_t *ethereum_peer_table_lookup_endpoint(const ethereum_peer_table_t *table,
+                                                     const ethereum_peer_endpoint_t *endpoint);
+
+/**
+ * Records the advertisement of a node in a peer table, adding the node if it is unknown.
+ *
+ * @param table The table.
+ * @param id The ETHEREUM_PEER_ID_LEN bytes of the node ID.
+ * @param frame The frame number of the advertisement.
+ * @param ts The time of the advertisement.
+ * @param endpoint The advertised endpoint of the node.
+ * @param advertiser The endpoint of the advertiser.
+ * @return The record of the node.
+ */
+ethereum_peer_t *ethereum_peer_table_advertise(ethereum_peer_table_t *table, const guint8 *id, guint32 frame,
+                                               const nstime_t *ts, const ethereum_peer_endpoint_t *endpoint,
+                                               const ethereum_peer_endpoint_t *advertiser);
+
+/**
+ * Estimates the number of distinct advertisers of a node.
+ *
+ * @param peer The record of the node.
+ * @return The estimate, within about 13% of the actual number, and never above the number of advertisements.
+ */
+guint32 ethereum_peer_advertisers(const ethereum_peer_t *peer);
+
+/**
+ * Returns the Keccak-256 of the ID of a node, i.e. its position in the Kademlia keyspace, computing it upon the
+ * first call only.
+ *
+ * @param peer The record of the node.
+ * @return The 32 bytes of the hash.
+ */
+const guint8 *ethereum_peer_id_hash(ethereum_peer_t *peer);
+
+#endif //__ETHEREUM_PEERS_H__
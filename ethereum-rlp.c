@@ -0,0 +1,196 @@
+/* ethereum-rlp.c
+ * RLP decoding over contiguous buffers, shared by the dissectors and the standalone tools.
+ * Copyright 2018, ConsenSys AG.
+ *
+ * Wireshark - Network traffic analyzer
+ * By Gerald Combs <gerald@wireshark.org>
+ * Copyright 1998, Gerald Combs.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "config.h"
+
+#include "ethereum-rlp.h"
+
+#define RLP_PREFIX_BYTE(n) { VALUE, 0, 0, 1 }
+#define RLP_PREFIX_STR(n) { VALUE, 1, 0, (n) }
+#define RLP_PREFIX_LONG_STR(n) { VALUE, 1 + (n), (n), 0 }
+#define RLP_PREFIX_LIST(n) { LIST, 1, 0, (n) }
+#define RLP_PREFIX_LONG_LIST(n) { LIST, 1 + (n), (n), 0 }
+#define RLP_PREFIX_X4(m, n) m(n), m((n) + 1), m((n) + 2), m((n) + 3)
+#define RLP_PREFIX_X16(m, n) RLP_PREFIX_X4(m, n), RLP_PREFIX_X4(m, (n) + 4), RLP_PREFIX_X4(m, (n) + 8), \
+                             RLP_PREFIX_X4(m, (n) + 12)
+
+// Precomputed classification of all 256 prefix bytes, replacing a chain of range comparisons.
+const rlp_prefix_info_t rlp_prefix_table[256] = {
+    // 0x00-0x7f: a single byte, whose value is itself.
+    RLP_PREFIX_X16(RLP_PREFIX_BYTE, 0x00), RLP_PREFIX_X16(RLP_PREFIX_BYTE, 0x10),
+    RLP_PREFIX_X16(RLP_PREFIX_BYTE, 0x20), RLP_PREFIX_X16(RLP_PREFIX_BYTE, 0x30),
+    RLP_PREFIX_X16(RLP_PREFIX_BYTE, 0x40), RLP_PREFIX_X16(RLP_PREFIX_BYTE, 0x50),
+    RLP_PREFIX_X16(RLP_PREFIX_BYTE, 0x60), RLP_PREFIX_X16(RLP_PREFIX_BYTE, 0x70),
+    // 0x80-0xb7: a value whose length is less or equal to 55 bytes.
+    RLP_PREFIX_X16(RLP_PREFIX_STR, 0), RLP_PREFIX_X16(RLP_PREFIX_STR, 16), RLP_PREFIX_X16(RLP_PREFIX_STR, 32),
+    RLP_PREFIX_X4(RLP_PREFIX_STR, 48), RLP_PREFIX_X4(RLP_PREFIX_STR, 52),
+    // 0xb8-0xbf: a value whose length is larger than 55 bytes (recursive length).
+    RLP_PREFIX_X4(RLP_PREFIX_LONG_STR, 1), RLP_PREFIX_X4(RLP_PREFIX_LONG_STR, 5),
+    // 0xc0-0xf7: a list whose byte length is less or equal to 55 bytes.
+    RLP_PREFIX_X16(RLP_PREFIX_LIST, 0), RLP_PREFIX_X16(RLP_PREFIX_LIST, 16), RLP_PREFIX_X16(RLP_PREFIX_LIST, 32),
+    RLP_PREFIX_X4(RLP_PREFIX_LIST, 48), RLP_PREFIX_X4(RLP_PREFIX_LIST, 52),
+    // 0xf8-0xff: a longer list.
+    RLP_PREFIX_X4(RLP_PREFIX_LONG_LIST, 1), RLP_PREFIX_X4(RLP_PREFIX_LONG_LIST, 5)
+};
+
+gboolean rlp_next_ptr(const guint8 *buf, guint len, guint offset, rlp_element_t *rlp) {
+  const rlp_prefix_info_t *info;
+  guint byte_length;
+
+  if (offset >= len) {
+    return FALSE;
+  }
+  info = &rlp_prefix_table[buf[offset]];
+  if (info->len_of_len > 4 || info->header_len > len - offset) {
+    // Unsupported length (over 32 bits), or truncated header.
+    return FALSE;
+  }
+  byte_length = info->short_len;
+  for (guint i = 1; i <= info->len_of_len; i++) {
+    byte_length = (byte_length << 8) | buf[offset + i];
+  }
+  offset += info->header_len;
+  if (byte_length > len - offset) {
+    // Truncated data.
+    return FALSE;
+  }
+  rlp->type = (rlp_type_t) info->type;
+  rlp->data_offset = offset;
+  rlp->byte_length = byte_length;
+  rlp->next_offset = offset + byte_length < len ? offset + byte_length : 0;
+  return TRUE;
+}
+
+gboolean rlp_validate_ptr(const guint8 *buf, guint len, guint max_depth, guint max_elements) {
+  guint ends[RLP_INDEX_MAX_DEPTH];
+  guint depth = 0;
+  guint count = 0;
+  guint offset = 0;
+  rlp_element_t rlp;
+
+  if (max_depth > RLP_INDEX_MAX_DEPTH) {
+    max_depth = RLP_INDEX_MAX_DEPTH;
+  }
+  while (offset < len) {
+    if (++count > max_elements) {
+      return FALSE;
+    }
+    // Decoding against the end of the enclosing list rejects children that overflow it.
+    if (!rlp_next_ptr(buf, depth > 0 ? ends[depth - 1] : len, offset, &rlp)) {
+      return FALSE;
+    }
+    if (rlp.type == LIST && rlp.byte_length > 0) {
+      if (depth == max_depth) {
+        return FALSE;
+      }
+      ends[depth++] = rlp.data_offset + rlp.byte_length;
+      offset = rlp.data_offset;
+    } else {
+      offset = rlp.data_offset + rlp.byte_length;
+    }
+    // Close all the lists that end at this offset.
+    while (depth > 0 && offset == ends[depth - 1]) {
+      depth--;
+    }
+  }
+  return TRUE;
+}
+
+gboolean rlp_index_walk(const guint8 *buf, rlp_next_func next, gpointer next_data, guint end, guint offset,
+                        guint capacity, rlp_index_t *idx) {
+  guint16 open[RLP_INDEX_MAX_DEPTH];
+  guint depth = 0;
+  rlp_element_t rlp;
+
+  for (;;) {
+    // Close all the lists that end at this offset.
+    while (depth > 0) {
+      rlp_index_entry_t *list = &idx->entries[open[depth - 1]];
+      guint list_end = list->data_offset + list->byte_length;
+      if (offset < list_end) {
+        break;
+      }
+      if (offset > list_end) {
+        // A child overflowed its enclosing list.
+        return FALSE;
+      }
+      list->next = (guint16) idx->count;
+      depth--;
+    }
+
+    if (offset >= end) {
+      break;
+    }
+    if (idx->count >= capacity) {
+      return FALSE;
+    }
+    if (buf ? !rlp_next_ptr(buf, end, offset, &rlp) : !next(next_data, offset, &rlp)) {
+      return FALSE;
+    }
+
+    // The element must fit within its enclosing list, or the buffer for top-level elements.
+    guint limit = depth > 0 ? idx->entries[open[depth - 1]].data_offset + idx->entries[open[depth - 1]].byte_length : end;
+    if (rlp.data_offset > limit || rlp.byte_length > limit - rlp.data_offset) {
+      return FALSE;
+    }
+
+    rlp_index_entry_t *e = &idx->entries[idx->count];
+    e->type = (guint8) rlp.type;
+    e->depth = (guint8) depth;
+    e->parent = depth > 0 ? open[depth - 1] : RLP_INDEX_NONE;
+    e->data_offset = rlp.data_offset;
+    e->byte_length = rlp.byte_length;
+    e->next = (guint16) (idx->count + 1);
+
+    if (rlp.type == LIST && rlp.byte_length > 0) {
+      // Descend into the list; its next index is patched when it is closed.
+      if (depth == RLP_INDEX_MAX_DEPTH) {
+        return FALSE;
+      }
+      open[depth++] = (guint16) idx->count;
+      offset = rlp.data_offset;
+    } else {
+      offset = rlp.data_offset + rlp.byte_length;
+    }
+    idx->count++;
+  }
+  return TRUE;
+}
+
+gboolean rlp_index_build_buf(const guint8 *buf, guint len, guint offset, rlp_index_entry_t *entries,
+                             guint capacity, rlp_index_t *idx) {
+  idx->count = 0;
+  idx->entries = entries;
+  if (offset >= len) {
+    return FALSE;
+  }
+  return rlp_index_walk(buf, NULL, NULL, len, offset, MIN(capacity, RLP_INDEX_MAX_ELEMENTS), idx);
+}
+
+guint rlp_index_child(const rlp_index_t *idx, guint list, guint n) {
+  guint el = rlp_index_first_child(idx, list);
+  while (n-- > 0 && el != RLP_INDEX_NONE) {
+    el = rlp_index_next_sibling(idx, el);
+  }
+  return el;
+}
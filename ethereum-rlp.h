@@ -0,0 +1,185 @@
+/* ethereum-rlp.h
+ * RLP decoding over contiguous buffers, shared by the dissectors and the standalone tools.
+ * Copyright 2018, ConsenSys AG.
+ *
+ * Wireshark - Network traffic analyzer
+ * By Gerald Combs <gerald@wireshark.org>
+ * Copyright 1998, Gerald Combs.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __ETHEREUM_RLP_H__
+#define __ETHEREUM_RLP_H__
+
+#include <glib.h>
+
+// RLP element types.
+typedef enum rlp_type {
+  VALUE,
+  LIST
+} rlp_type_t;
+
+// A struct that stores metadata about an RLP element
+typedef struct rlp_element {
+  rlp_type_t type;    // The element type
+  guint byte_length;  // The length in bytes of the payload of this element.
+  guint data_offset;  // The absolute offset in the buffer where the data actually starts within this element.
+  guint next_offset;  // The absolute offset in the buffer of the next element, or 0 iff end of buffer.
+} rlp_element_t;
+
+// Classification of an RLP prefix byte.
+typedef struct rlp_prefix_info {
+  guint8 type;        // The element type (rlp_type_t).
+  guint8 header_len;  // The number of bytes preceding the data (prefix and length bytes).
+  guint8 len_of_len;  // The number of big-endian length bytes following the prefix (long forms only).
+  guint8 short_len;   // The data length (short forms only).
+} rlp_prefix_info_t;
+
+// Precomputed classification of all 256 prefix bytes.
+extern const rlp_prefix_info_t rlp_prefix_table[256];
+
+/**
+ * Introspects an RLP element directly from a contiguous buffer, without going through the tvb accessors.
+ * Unlike rlp_next(), the whole element (header and data) is checked to lie within the buffer.
+ *
+ * @param buf The buffer.
+ * @param len The length of the buffer.
+ * @param offset The offset of the element to analyze.
+ * @param rlp The RLP element struct to update with the metadata.
+ * @return TRUE if the RLP introspection succeeded; FALSE if the element is truncated or unsupported.
+ */
+gboolean rlp_next_ptr(const guint8 *buf, guint len, guint offset, rlp_element_t *rlp);
+
+/**
+ * Validates the whole nested structure of an RLP payload in a single linear pass, without allocating.
+ * The buffer must consist of complete RLP elements, each of them lying within the bounds of its enclosing
+ * list, with at most max_depth levels of nested lists and max_elements elements overall.
+ *
+ * @param buf The buffer.
+ * @param len The length of the buffer.
+ * @param max_depth The maximum nesting depth of lists (capped to RLP_INDEX_MAX_DEPTH).
+ * @param max_elements The maximum number of elements.
+ * @return TRUE if the payload is well-formed; FALSE otherwise.
+ */
+gboolean rlp_validate_ptr(const guint8 *buf, guint len, guint max_depth, guint max_elements);
+
+// Sentinel returned by the RLP index accessors when the requested element does not exist.
+#define RLP_INDEX_NONE G_MAXUINT16
+
+// Maximum number of elements an RLP index can hold (element indices are stored in 16 bits).
+#define RLP_INDEX_MAX_ELEMENTS (G_MAXUINT16 - 1)
+
+// Maximum nesting depth of lists accepted by the RLP index builder.
+#define RLP_INDEX_MAX_DEPTH 32
+
+// A flattened RLP element, as stored in an RLP index.
+typedef struct rlp_index_entry {
+  guint32 data_offset;  // The absolute offset in the buffer where the data of this element starts.
+  guint32 byte_length;  // The length in bytes of the payload of this element.
+  guint16 parent;       // The index of the enclosing list, or RLP_INDEX_NONE for top-level elements.
+  guint16 next;         // The index following the subtree of this element (i.e. its next sibling, if any).
+  guint8 type;          // The element type (rlp_type_t).
+  guint8 depth;         // The nesting depth; 0 for top-level elements.
+} rlp_index_entry_t;
+
+// A whole RLP payload, decoded in a single pass into a flat array of elements in document order.
+// The first child of a list (if any) immediately follows it.
+typedef struct rlp_index {
+  rlp_index_entry_t *entries;
+  guint count;
+} rlp_index_t;
+
+// Decodes the element at an offset of a payload that isn't available as a contiguous buffer.
+typedef gboolean (*rlp_next_func)(gpointer data, guint offset, rlp_element_t *rlp);
+
+/**
+ * Walks an RLP payload and fills in an index whose entries are preallocated.
+ *
+ * Elements are decoded straight from memory when a contiguous buffer is provided; otherwise they are
+ * decoded by the callback (e.g. through the bounds-checked, exception-throwing tvb accessors).
+ *
+ * @param buf The contiguous payload bytes, or NULL.
+ * @param next The callback decoding an element, used when buf is NULL.
+ * @param next_data The data passed to the callback.
+ * @param end The length of the payload.
+ * @param offset The offset of the first element to index.
+ * @param capacity The number of preallocated entries.
+ * @param idx The index to populate, whose entries are preallocated.
+ * @return TRUE if the whole payload was indexed; FALSE otherwise.
+ */
+gboolean rlp_index_walk(const guint8 *buf, rlp_next_func next, gpointer next_data, guint end, guint offset,
+                        guint capacity, rlp_index_t *idx);
+
+/**
+ * Decodes all RLP elements of a contiguous buffer from the offset, in one pass, into a flat index whose
+ * entries are provided by the caller, so that they can be reused from one payload to the next. Every element
+ * is checked to lie within the bounds of its enclosing list and of the buffer.
+ *
+ * @param buf The buffer.
+ * @param len The length of the buffer.
+ * @param offset The offset of the first element to index.
+ * @param entries The entries to fill in.
+ * @param capacity The number of entries; payloads with more elements are rejected.
+ * @param idx The index to populate.
+ * @return TRUE if the whole payload was indexed; FALSE if it is not well-formed RLP.
+ */
+gboolean rlp_index_build_buf(const guint8 *buf, guint len, guint offset, rlp_index_entry_t *entries,
+                             guint capacity, rlp_index_t *idx);
+
+/**
+ * Returns the n-th child of a list in an RLP index.
+ *
+ * @param idx The RLP index.
+ * @param list The index of the list element.
+ * @param n The zero-based position of the child.
+ * @return The index of the child, or RLP_INDEX_NONE if there is no such child.
+ */
+guint rlp_index_child(const rlp_index_t *idx, guint list, guint n);
+
+/**
+ * Returns the first child of a list in an RLP index.
+ *
+ * @param idx The RLP index.
+ * @param el The index of the list element.
+ * @return The index of the first child, or RLP_INDEX_NONE if the element is not a list or is empty.
+ */
+static inline guint rlp_index_first_child(const rlp_index_t *idx, guint el) {
+  if (el >= idx->count || idx->entries[el].type != LIST || idx->entries[el].next == el + 1) {
+    return RLP_INDEX_NONE;
+  }
+  return el + 1;
+}
+
+/**
+ * Returns the next sibling of an element in an RLP index.
+ *
+ * @param idx The RLP index.
+ * @param el The index of the element.
+ * @return The index of the next sibling, or RLP_INDEX_NONE if this is the last element of its list.
+ */
+static inline guint rlp_index_next_sibling(const rlp_index_t *idx, guint el) {
+  guint next;
+  if (el >= idx->count) {
+    return RLP_INDEX_NONE;
+  }
+  next = idx->entries[el].next;
+  if (next >= idx->count || idx->entries[next].parent != idx->entries[el].parent) {
+    return RLP_INDEX_NONE;
+  }
+  return next;
+}
+
+#endif //__ETHEREUM_RLP_H__
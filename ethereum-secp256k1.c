@@ -0,0 +1,152 @@
+/* ethereum-secp256k1.c
+ * Public key recovery from secp256k1 signatures, as used to identify Ethereum nodes.
+ * Copyright 2018, ConsenSys AG.
+ *
+ * Wireshark - Network traffic analyzer
+ * By Gerald Combs <gerald@wireshark.org>
+ * Copyright 1998, Gerald Combs.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "config.h"
+
+#include <string.h>
+#include <wsutil/wsgcrypt.h>
+
+#include "ethereum-secp256k1.h"
+
+/**
+ * Writes an MPI as a 32-byte big-endian integer.
+ *
+ * @param mpi The MPI, lower than 2^256.
+ * @param out The 32-byte output.
+ * @return TRUE if successful; FALSE if the MPI doesn't fit.
+ */
+static gboolean mpi_to_bytes32(gcry_mpi_t mpi, guint8 *out) {
+  guint8 buf[32];
+  size_t written = 0;
+
+  if (gcry_mpi_print(GCRYMPI_FMT_USG, buf, sizeof(buf), &written, mpi) != 0 || written > sizeof(buf)) {
+    return FALSE;
+  }
+  memset(out, 0, sizeof(buf) - written);
+  memcpy(out + sizeof(buf) - written, buf, written);
+  return TRUE;
+}
+
+gboolean ethereum_secp256k1_recover(const guint8 *digest, const guint8 *sig, guint8 *pubkey) {
+  gcry_ctx_t ctx = NULL;
+  gcry_mpi_t p = NULL, n = NULL, r = NULL, s = NULL, e = NULL, y = NULL, y2 = NULL, exp = NULL;
+  gcry_mpi_t one = NULL, rinv = NULL, u1 = NULL, u2 = NULL, qx = NULL, qy = NULL;
+  gcry_mpi_point_t g = NULL, rp = NULL, q1 = NULL, q2 = NULL, q = NULL;
+  guint recid = sig[64];
+  gboolean ok = FALSE;
+
+  // Some signers add 27 to the recovery id; discovery packets use 0 and 1. Ids 2 and 3 (an x coordinate
+  // beyond the group order) are practically never produced, and not supported.
+  if (recid >= 27) {
+    recid -= 27;
+  }
+  if (recid > 1 || gcry_mpi_ec_new(&ctx, NULL, "secp256k1") != 0) {
+    return FALSE;
+  }
+
+  p = gcry_mpi_ec_get_mpi("p", ctx, 1);
+  n = gcry_mpi_ec_get_mpi("n", ctx, 1);
+  g = gcry_mpi_ec_get_point("g", ctx, 1);
+  if (!p || !n || !g ||
+      gcry_mpi_scan(&r, GCRYMPI_FMT_USG, sig, 32, NULL) != 0 ||
+      gcry_mpi_scan(&s, GCRYMPI_FMT_USG, sig + 32, 32, NULL) != 0 ||
+      gcry_mpi_scan(&e, GCRYMPI_FMT_USG, digest, 32, NULL) != 0) {
+    goto out;
+  }
+  if (gcry_mpi_cmp_ui(r, 0) == 0 || gcry_mpi_cmp(r, n) >= 0 ||
+      gcry_mpi_cmp_ui(s, 0) == 0 || gcry_mpi_cmp(s, n) >= 0) {
+    goto out;
+  }
+
+  // R = (r, y), with y^2 = r^3 + 7 and the parity of y given by the recovery id. As p = 3 mod 4, the square
+  // root is (r^3 + 7)^((p + 1) / 4).
+  y2 = gcry_mpi_new(0);
+  y = gcry_mpi_new(0);
+  exp = gcry_mpi_set_ui(NULL, 3);
+  gcry_mpi_powm(y2, r, exp, p);
+  gcry_mpi_add_ui(y2, y2, 7);
+  gcry_mpi_mod(y2, y2, p);
+  gcry_mpi_add_ui(exp, p, 1);
+  gcry_mpi_rshift(exp, exp, 2);
+  gcry_mpi_powm(y, y2, exp, p);
+  gcry_mpi_mulm(exp, y, y, p);
+  if (gcry_mpi_cmp(exp, y2) != 0) {
+    // r is not the x coordinate of a point on the curve.
+    goto out;
+  }
+  if ((guint) gcry_mpi_test_bit(y, 0) != (recid & 1)) {
+    gcry_mpi_sub(y, p, y);
+  }
+  one = gcry_mpi_set_ui(NULL, 1);
+  rp = gcry_mpi_point_set(NULL, r, y, one);
+
+  // Q = r^-1 (s R - e G) = u1 G + u2 R, with u1 = -e r^-1 and u2 = s r^-1 (mod n).
+  rinv = gcry_mpi_new(0);
+  u1 = gcry_mpi_new(0);
+  u2 = gcry_mpi_new(0);
+  if (!gcry_mpi_invm(rinv, r, n)) {
+    goto out;
+  }
+  gcry_mpi_mod(e, e, n);
+  gcry_mpi_subm(u1, n, e, n);
+  gcry_mpi_mulm(u1, u1, rinv, n);
+  gcry_mpi_mulm(u2, s, rinv, n);
+
+  q1 = gcry_mpi_point_new(0);
+  q2 = gcry_mpi_point_new(0);
+  q = gcry_mpi_point_new(0);
+  gcry_mpi_ec_mul(q1, u1, g, ctx);
+  gcry_mpi_ec_mul(q2, u2, rp, ctx);
+  gcry_mpi_ec_add(q, q1, q2, ctx);
+
+  qx = gcry_mpi_new(0);
+  qy = gcry_mpi_new(0);
+  if (gcry_mpi_ec_get_affine(qx, qy, q, ctx) != 0) {
+    // The point at infinity.
+    goto out;
+  }
+  ok = mpi_to_bytes32(qx, pubkey) && mpi_to_bytes32(qy, pubkey + 32);
+
+out:
+  gcry_mpi_release(p);
+  gcry_mpi_release(n);
+  gcry_mpi_release(r);
+  gcry_mpi_release(s);
+  gcry_mpi_release(e);
+  gcry_mpi_release(y);
+  gcry_mpi_release(y2);
+  gcry_mpi_release(exp);
+  gcry_mpi_release(one);
+  gcry_mpi_release(rinv);
+  gcry_mpi_release(u1);
+  gcry_mpi_release(u2);
+  gcry_mpi_release(qx);
+  gcry_mpi_release(qy);
+  gcry_mpi_point_release(g);
+  gcry_mpi_point_release(rp);
+  gcry_mpi_point_release(q1);
+  gcry_mpi_point_release(q2);
+  gcry_mpi_point_release(q);
+  gcry_ctx_release(ctx);
+  return ok;
+}
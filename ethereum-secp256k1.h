@@ -0,0 +1,46 @@
+/* ethereum-secp256k1.h
+ * Public key recovery from secp256k1 signatures, as used to identify Ethereum nodes.
+ * Copyright 2018, ConsenSys AG.
+ *
+ * Wireshark - Network traffic analyzer
+ * By Gerald Combs <gerald@wireshark.org>
+ * Copyright 1998, Gerald Combs.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __ETHEREUM_SECP256K1_H__
+#define __ETHEREUM_SECP256K1_H__
+
+#include <glib.h>
+
+// Length in bytes of a recoverable signature: r (32 bytes), s (32 bytes) and the recovery id (1 byte).
+#define ETHEREUM_SECP256K1_SIG_LEN 65
+
+// Length in bytes of an uncompressed public key without its 0x04 prefix (x and y), i.e. an Ethereum node ID.
+#define ETHEREUM_SECP256K1_PUBKEY_LEN 64
+
+/**
+ * Recovers the public key that produced a recoverable ECDSA signature over a digest.
+ * Safe to call from several threads at once.
+ *
+ * @param digest The 32-byte digest that was signed.
+ * @param sig The ETHEREUM_SECP256K1_SIG_LEN bytes of the signature.
+ * @param pubkey Set to the ETHEREUM_SECP256K1_PUBKEY_LEN bytes of the public key.
+ * @return TRUE if the public key was recovered; FALSE if the signature is invalid.
+ */
+gboolean ethereum_secp256k1_recover(const guint8 *digest, const guint8 *sig, guint8 *pubkey);
+
+#endif //__ETHEREUM_SECP256K1_H__
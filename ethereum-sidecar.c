@@ -0,0 +1,214 @@
+/* ethereum-sidecar.c
+ * Sidecar files persisting per-frame results derived by the Ethereum dissectors across capture reopenings.
+ * Copyright 2018, ConsenSys AG.
+ *
+ * Wireshark - Network traffic analyzer
+ * By Gerald Combs <gerald@wireshark.org>
+ * Copyright 1998, Gerald Combs.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "config.h"
+
+#include <string.h>
+
+#include "ethereum-sidecar.h"
+
+#define SIDECAR_MAGIC "ETHSCAR"
+#define SIDECAR_BYTE_ORDER 0x01020304
+
+// The header of a sidecar file, followed by the records sorted by frame number, in host byte order.
+typedef struct sidecar_header {
+  gchar magic[8];
+  guint32 version;
+  guint32 byte_order;  // SIDECAR_BYTE_ORDER, as written by the host.
+  guint8 identity[ETHEREUM_SIDECAR_IDENTITY_LEN];
+  gchar build[48];     // ETHEREUM_SIDECAR_BUILD, NUL-padded.
+  guint32 count;       // The number of records.
+  guint32 reserved;
+} sidecar_header_t;
+
+struct ethereum_sidecar {
+  gchar *path;
+  GMappedFile *mapped;                         // The sidecar file, or NULL if there was no valid one.
+  const ethereum_sidecar_record_t *records;    // The records of the sidecar file, sorted by frame number.
+  guint count;
+  GHashTable *added;                           // Frame number => records added since the file was loaded.
+  guint8 identity[ETHEREUM_SIDECAR_IDENTITY_LEN];
+};
+
+ethereum_sidecar_t *ethereum_sidecar_open(const gchar *dir, const guint8 *identity) {
+  ethereum_sidecar_t *sidecar = g_new0(ethereum_sidecar_t, 1);
+  const sidecar_header_t *header;
+  gchar name[2 * ETHEREUM_SIDECAR_IDENTITY_LEN + 16];
+  gsize len;
+  guint i;
+
+  for (i = 0; i < ETHEREUM_SIDECAR_IDENTITY_LEN; i++) {
+    g_snprintf(name + 2 * i, 3, "%02x", identity[i]);
+  }
+  g_strlcpy(name + 2 * ETHEREUM_SIDECAR_IDENTITY_LEN, ".ethdisc", sizeof(name) - 2 * ETHEREUM_SIDECAR_IDENTITY_LEN);
+  sidecar->path = g_build_filename(dir, name, NULL);
+  memcpy(sidecar->identity, identity, ETHEREUM_SIDECAR_IDENTITY_LEN);
+  sidecar->added = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, g_free);
+
+  sidecar->mapped = g_mapped_file_new(sidecar->path, FALSE, NULL);
+  if (!sidecar->mapped) {
+    return sidecar;
+  }
+
+  // Check the file was written by this version and build, on a host of the same byte order, for this capture
+  // file, and isn't truncated.
+  len = g_mapped_file_get_length(sidecar->mapped);
+  header = (const sidecar_header_t *) g_mapped_file_get_contents(sidecar->mapped);
+  if (len < sizeof(*header) || memcmp(header->magic, SIDECAR_MAGIC, sizeof(SIDECAR_MAGIC)) != 0 ||
+      header->version != ETHEREUM_SIDECAR_VERSION || header->byte_order != SIDECAR_BYTE_ORDER ||
+      strncmp(header->build, ETHEREUM_SIDECAR_BUILD, sizeof(header->build)) != 0 ||
+      memcmp(header->identity, identity, ETHEREUM_SIDECAR_IDENTITY_LEN) != 0 ||
+      len != sizeof(*header) + (gsize) header->count * sizeof(ethereum_sidecar_record_t)) {
+    g_mapped_file_unref(sidecar->mapped);
+    sidecar->mapped = NULL;
+    return sidecar;
+  }
+  sidecar->records = (const ethereum_sidecar_record_t *) (header + 1);
+  sidecar->count = header->count;
+  return sidecar;
+}
+
+/**
+ * Looks up the record of a frame among the records loaded from the sidecar file.
+ */
+static const ethereum_sidecar_record_t *lookup_loaded(const ethereum_sidecar_t *sidecar, guint32 frame) {
+  guint lo = 0, hi = sidecar->count;
+
+  while (lo < hi) {
+    guint mid = lo + (hi - lo) / 2;
+    if (sidecar->records[mid].frame < frame) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo < sidecar->count && sidecar->records[lo].frame == frame ? &sidecar->records[lo] : NULL;
+}
+
+const ethereum_sidecar_record_t *ethereum_sidecar_lookup(const ethereum_sidecar_t *sidecar, guint32 frame,
+                                                         const guint8 *check) {
+  const ethereum_sidecar_record_t *record;
+
+  record = (const ethereum_sidecar_record_t *) g_hash_table_lookup(sidecar->added, GUINT_TO_POINTER(frame));
+  if (!record) {
+    record = lookup_loaded(sidecar, frame);
+  }
+  return record && memcmp(record->check, check, ETHEREUM_SIDECAR_CHECK_LEN) == 0 ? record : NULL;
+}
+
+void ethereum_sidecar_add(ethereum_sidecar_t *sidecar, guint32 frame, const guint8 *check, guint32 flags,
+                          const guint8 *sender_id) {
+  const ethereum_sidecar_record_t *loaded;
+  ethereum_sidecar_record_t *record;
+
+  record = (ethereum_sidecar_record_t *) g_hash_table_lookup(sidecar->added, GUINT_TO_POINTER(frame));
+  if (!record) {
+    loaded = lookup_loaded(sidecar, frame);
+    if (loaded && memcmp(loaded->check, check, ETHEREUM_SIDECAR_CHECK_LEN) != 0) {
+      // A stale record, superseded below.
+      loaded = NULL;
+    } else if (loaded && (loaded->flags & flags) == flags) {
+      // Nothing new.
+      return;
+    }
+    record = g_new0(ethereum_sidecar_record_t, 1);
+    if (loaded) {
+      *record = *loaded;
+    }
+    record->frame = frame;
+    memcpy(record->check, check, ETHEREUM_SIDECAR_CHECK_LEN);
+    g_hash_table_insert(sidecar->added, GUINT_TO_POINTER(frame), record);
+  }
+  record->flags |= flags;
+  if (sender_id && (flags & ETHEREUM_SIDECAR_SENDER_VALID)) {
+    memcpy(record->sender_id, sender_id, sizeof(record->sender_id));
+  }
+}
+
+static gint compare_records(gconstpointer a, gconstpointer b) {
+  guint32 fa = ((const ethereum_sidecar_record_t *) a)->frame;
+  guint32 fb = ((const ethereum_sidecar_record_t *) b)->frame;
+  return fa < fb ? -1 : fa > fb;
+}
+
+/**
+ * Writes the loaded and the added records out to the sidecar file, replacing it atomically.
+ */
+static void write_sidecar(ethereum_sidecar_t *sidecar) {
+  GArray *records = g_array_sized_new(FALSE, FALSE, sizeof(ethereum_sidecar_record_t),
+                                      sidecar->count + g_hash_table_size(sidecar->added));
+  GHashTableIter iter;
+  gpointer value;
+  sidecar_header_t header;
+  gchar *contents;
+  gsize len;
+  guint i;
+
+  // The added records supersede the loaded ones of the same frames.
+  for (i = 0; i < sidecar->count; i++) {
+    if (!g_hash_table_lookup(sidecar->added, GUINT_TO_POINTER(sidecar->records[i].frame))) {
+      g_array_append_vals(records, &sidecar->records[i], 1);
+    }
+  }
+  g_hash_table_iter_init(&iter, sidecar->added);
+  while (g_hash_table_iter_next(&iter, NULL, &value)) {
+    g_array_append_vals(records, value, 1);
+  }
+  g_array_sort(records, compare_records);
+
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, SIDECAR_MAGIC, sizeof(SIDECAR_MAGIC));
+  header.version = ETHEREUM_SIDECAR_VERSION;
+  header.byte_order = SIDECAR_BYTE_ORDER;
+  memcpy(header.identity, sidecar->identity, ETHEREUM_SIDECAR_IDENTITY_LEN);
+  g_strlcpy(header.build, ETHEREUM_SIDECAR_BUILD, sizeof(header.build));
+  header.count = records->len;
+
+  len = sizeof(header) + (gsize) records->len * sizeof(ethereum_sidecar_record_t);
+  contents = (gchar *) g_malloc(len);
+  memcpy(contents, &header, sizeof(header));
+  memcpy(contents + sizeof(header), records->data, len - sizeof(header));
+
+  // The mapping must go before the file is replaced (on Windows in particular).
+  if (sidecar->mapped) {
+    g_mapped_file_unref(sidecar->mapped);
+    sidecar->mapped = NULL;
+    sidecar->records = NULL;
+    sidecar->count = 0;
+  }
+  g_file_set_contents(sidecar->path, contents, (gssize) len, NULL);
+  g_free(contents);
+  g_array_free(records, TRUE);
+}
+
+void ethereum_sidecar_close(ethereum_sidecar_t *sidecar) {
+  if (g_hash_table_size(sidecar->added) > 0) {
+    write_sidecar(sidecar);
+  }
+  if (sidecar->mapped) {
+    g_mapped_file_unref(sidecar->mapped);
+  }
+  g_hash_table_destroy(sidecar->added);
+  g_free(sidecar->path);
+  g_free(sidecar);
+}
@@ -0,0 +1,96 @@
+/* ethereum-sidecar.h
+ * Sidecar files persisting per-frame results derived by the Ethereum dissectors across capture reopenings.
+ * Copyright 2018, ConsenSys AG.
+ *
+ * Wireshark - Network traffic analyzer
+ * By Gerald Combs <gerald@wireshark.org>
+ * Copyright 1998, Gerald Combs.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __ETHEREUM_SIDECAR_H__
+#define __ETHEREUM_SIDECAR_H__
+
+#include <glib.h>
+
+// Version of the sidecar file format; files of other versions are ignored and rewritten. So are the files written
+// by another build of the checks, identified by ETHEREUM_SIDECAR_BUILD (the plugin version and a digest of the
+// sources of the cryptographic code, defined by CMake).
+#define ETHEREUM_SIDECAR_VERSION 2
+
+// Length in bytes of the identity of a capture file.
+#define ETHEREUM_SIDECAR_IDENTITY_LEN 16
+
+// Length in bytes of the check of a record, i.e. a prefix of the message hash of the frame.
+#define ETHEREUM_SIDECAR_CHECK_LEN 8
+
+// Record flags.
+#define ETHEREUM_SIDECAR_HASH_CHECKED 0x01    // The message hash was verified; the result is in HASH_VALID.
+#define ETHEREUM_SIDECAR_HASH_VALID 0x02
+#define ETHEREUM_SIDECAR_SENDER_CHECKED 0x04  // Sender recovery was attempted; the result is in SENDER_VALID.
+#define ETHEREUM_SIDECAR_SENDER_VALID 0x08    // The sender ID holds the recovered node ID.
+
+// The results derived for a frame. The check guards against a sidecar file matching another capture file.
+typedef struct ethereum_sidecar_record {
+  guint32 frame;
+  guint32 flags;
+  guint8 check[ETHEREUM_SIDECAR_CHECK_LEN];
+  guint8 sender_id[64];
+} ethereum_sidecar_record_t;
+
+// A sidecar file, loaded (memory-mapped) if it exists, along with the records added since.
+typedef struct ethereum_sidecar ethereum_sidecar_t;
+
+/**
+ * Opens the sidecar file of a capture file, and maps its records if it exists and is valid.
+ *
+ * @param dir The directory of the sidecar files.
+ * @param identity The ETHEREUM_SIDECAR_IDENTITY_LEN bytes identifying the capture file.
+ * @return The sidecar, which is empty if there is no valid sidecar file yet.
+ */
+ethereum_sidecar_t *ethereum_sidecar_open(const gchar *dir, const guint8 *identity);
+
+/**
+ * Looks up the record of a frame in a sidecar, among the loaded and the added records.
+ *
+ * @param sidecar The sidecar.
+ * @param frame The frame number.
+ * @param check The ETHEREUM_SIDECAR_CHECK_LEN bytes the record must match.
+ * @return The record, or NULL if there is none (or it doesn't match).
+ */
+const ethereum_sidecar_record_t *ethereum_sidecar_lookup(const ethereum_sidecar_t *sidecar, guint32 frame,
+                                                         const guint8 *check);
+
+/**
+ * Adds results to the record of a frame in a sidecar. They are written out when the sidecar is closed.
+ *
+ * @param sidecar The sidecar.
+ * @param frame The frame number.
+ * @param check The ETHEREUM_SIDECAR_CHECK_LEN bytes identifying the frame contents.
+ * @param flags The record flags to set.
+ * @param sender_id The recovered node ID, with ETHEREUM_SIDECAR_SENDER_VALID; NULL otherwise.
+ */
+void ethereum_sidecar_add(ethereum_sidecar_t *sidecar, guint32 frame, const guint8 *check, guint32 flags,
+                          const guint8 *sender_id);
+
+/**
+ * Closes a sidecar, writing the sidecar file out (atomically) if records were added.
+ *
+ * @param sidecar The sidecar.
+ */
+void ethereum_sidecar_close(ethereum_sidecar_t *sidecar);
+
+#endif //__ETHEREUM_SIDECAR_H__
@@ -22,49 +22,85 @@
  */
 
 #include "packet-ethereum.h"
+#include "packet-ethereum-disc.h"
+#include "ethereum-histogram.h"
+#include "ethereum-keccak.h"
+#include "ethereum-secp256k1.h"
+#include "ethereum-sidecar.h"
+#include "ethereum-peers.h"
+#include "ethereum-graph.h"
+#include "ethereum-columnar.h"
+#include "ethereum-hashindex.h"
 
-#include <epan/proto_data.h>
 #include <epan/tap.h>
 #include <epan/stats_tree.h>
 #include <epan/conversation.h>
+#include <epan/expert.h>
+#include <epan/prefs.h>
 #include <epan/srt_table.h>
+#include <epan/stat_tap_ui.h>
 #include <epan/exceptions.h>
 #include <epan/show_exception.h>
 #include <epan/to_str.h>
+#include <wsutil/pint.h>
+#include <wsutil/file_util.h>
 
-#define MIN_ETHDEVP2PDISCO_LEN 98
-#define MAX_ETHDEVP2PDISCO_LEN 1280
+#include <math.h>
 
-#define ETHEREUM_DISC_HASH_LEN 32
-#define ETHEREUM_DISC_SIGNATURE_LEN 65
-#define ETHEREUM_DISC_PACKET_TYPE_IDX 97
-#define ETHEREUM_DISC_PACKET_DATA_START 98
-#define ETHEREUM_DISCV5_ID_STR "temporary discovery v5"
-#define ETHEREUM_DISCV5_PACKET_TYPE_IDX 87  // ETHEREUM_DISC_SIGNATURE_LEN + 22 (strlen(ETHEREUM_DISCV5_ID_STR))
-#define ETHEREUM_DISCV5_PACKET_DATA_START 88
+// Seconds of inactivity after which a FIND_NODE for the same originator and target starts a new lookup session.
+#define ETHEREUM_DISC_LOOKUP_WINDOW 10
+
+// Frame side table: number of records per chunk (as a power of 2), and the bounds of the response times
+// a record can hold.
+#define ETHEREUM_DISC_FRAME_CHUNK_BITS 12
+#define ETHEREUM_DISC_FRAME_CHUNK_SIZE (1 << ETHEREUM_DISC_FRAME_CHUNK_BITS)
+#define ETHEREUM_DISC_FRAME_RT_MAX_SECS ((1 << 23) - 1)
+
+// Frame record flags.
+#define ETHEREUM_DISC_FRAME_HAS_RT 0x01        // The record holds a response time.
+#define ETHEREUM_DISC_FRAME_CONTINUATION 0x02  // The follow-up packet of a response split across several packets.
+#define ETHEREUM_DISC_FRAME_FIND_NODEHASH 0x04 // A NODES packet in response to a FIND_NODEHASH (rather than FIND_NODE).
+#define ETHEREUM_DISC_FRAME_HASH_CHECKED 0x08  // The message hash was verified; the result is in HASH_VALID.
+#define ETHEREUM_DISC_FRAME_HASH_VALID 0x10    // The message hash matches the message.
+
+// Duplicate detection set: initial number of slots (a power of 2), and number of messages after which the
+// set starts over in streaming mode.
+#define ETHEREUM_DISC_DUP_INITIAL_SLOTS 1024
+#define ETHEREUM_DISC_DUP_STREAM_MAX (1 << 18)
+
+// Memory budget of the sender recovery cache, in bytes.
+#define ETHEREUM_DISC_SENDER_CACHE_BUDGET (16 * 1024 * 1024)
+
+// Number of peers whose response times are tracked individually in the statistics tree.
+#define ETHEREUM_DISC_RT_PEERS 16
 
 // Subtrees.
 static int proto_ethereum = -1;
 static gint ett_ethereum_disc_toplevel = -1;
 static gint ett_ethereum_disc_packetdata = -1;
 static gint ett_ethereum_disc_nodes = -1;
+static gint ett_ethereum_disc_hash = -1;
+static gint ett_ethereum_disc_peer = -1;
+static gint ett_ethereum_disc_lookup = -1;
+
+static expert_field ei_ethereum_disc_hash_mismatch = EI_INIT;
+static expert_field ei_ethereum_disc_bad_signature = EI_INIT;
+static expert_field ei_ethereum_disc_duplicate = EI_INIT;
 
 static dissector_handle_t ethereum_disc_dtor_handle;
 
 static nstime_t unset_time;
 
-// Ethereum discovery protocol packet types.
-typedef enum packet_type {
-  UNKNOWN = 0x00,   // initialization value
-  PING = 0x01,
-  PONG = 0x02,
-  FIND_NODE = 0x03,
-  NODES = 0x04,
-  FIND_NODEHASH = 0x05,
-  TOPIC_REGISTER = 0x06,
-  TOPIC_QUERY = 0x07,
-  TOPIC_NODES = 0x08,
-} packet_type_e;
+// Preferences.
+static gboolean ethereum_disc_streaming = FALSE;
+static guint ethereum_disc_streaming_budget = 64;  // In megabytes.
+static guint ethereum_disc_streaming_ttl = 300;    // In seconds.
+static gboolean ethereum_disc_verify_hash = TRUE;
+static gboolean ethereum_disc_recover_sender = TRUE;
+static guint ethereum_disc_crypto_workers = 0;     // 0 to run the cryptographic checks inline.
+static const gchar *ethereum_disc_sidecar_dir = "";  // Empty to disable sidecar files.
+
+static ethereum_disc_neg_entry_t neg_cache[ETHEREUM_DISC_NEG_CACHE_SIZE];
 
 // Value strings: packet type <=> string representation.
 static const value_string packet_type_names[] = {
@@ -81,7 +117,27 @@ static const value_string packet_type_names[] = {
 
 // Message header/packet fields.
 static int hf_ethereum_disc_msg_hash = -1;
+static int hf_ethereum_disc_msg_hash_valid = -1;
 static int hf_ethereum_disc_msg_sig = -1;
+static int hf_ethereum_disc_sender_id = -1;
+static int hf_ethereum_disc_crypto_pending = -1;
+static int hf_ethereum_disc_duplicate_of = -1;
+static int hf_ethereum_disc_peer = -1;
+static int hf_ethereum_disc_peer_first_frame = -1;
+static int hf_ethereum_disc_peer_last_frame = -1;
+static int hf_ethereum_disc_peer_first_seen = -1;
+static int hf_ethereum_disc_peer_last_seen = -1;
+static int hf_ethereum_disc_peer_advertised = -1;
+static int hf_ethereum_disc_peer_advertisers = -1;
+static int hf_ethereum_disc_peer_endpoints = -1;
+static int hf_ethereum_disc_lookup = -1;
+static int hf_ethereum_disc_lookup_first_frame = -1;
+static int hf_ethereum_disc_lookup_hop = -1;
+static int hf_ethereum_disc_lookup_hops = -1;
+static int hf_ethereum_disc_lookup_requests = -1;
+static int hf_ethereum_disc_lookup_duration = -1;
+static int hf_ethereum_disc_lookup_unique_nodes = -1;
+static int hf_ethereum_disc_lookup_closest = -1;
 static int hf_ethereum_disc_packet = -1;
 static int hf_ethereum_disc_packet_type = -1;
 static int hf_ethereum_disc_seq = -1;
@@ -89,6 +145,7 @@ static int hf_ethereum_disc_seqtype = -1;
 static int hf_ethereum_disc_req_ref = -1;
 static int hf_ethereum_disc_res_ref = -1;
 static int hf_ethereum_disc_rt = -1;
+static int hf_ethereum_disc_evicted = -1;
 
 // PING packet.
 static int hf_ethereum_disc_ping_version = -1;
@@ -110,6 +167,9 @@ static int hf_ethereum_disc_pong_recipient_udp_port = -1;
 static int hf_ethereum_disc_pong_recipient_tcp_port = -1;
 static int hf_ethereum_disc_pong_ping_hash = -1;
 static int hf_ethereum_disc_pong_expiration = -1;
+static int hf_ethereum_disc_pong_topic_hash = -1;
+static int hf_ethereum_disc_pong_ticket_serial = -1;
+static int hf_ethereum_disc_pong_wait_period = -1;
 
 // FIND_NODE packet.
 static int hf_ethereum_disc_findnode_target = -1;
@@ -122,6 +182,7 @@ static int hf_ethereum_disc_nodes_nodes_ipv6 = -1;
 static int hf_ethereum_disc_nodes_nodes_udp_port = -1;
 static int hf_ethereum_disc_nodes_nodes_tcp_port = -1;
 static int hf_ethereum_disc_nodes_nodes_id = -1;
+static int hf_ethereum_disc_nodes_nodes_distance = -1;
 static int hf_ethereum_disc_nodes_expiration = -1;
 static int hf_ethereum_disc_nodes_length = -1;
 
@@ -139,25 +200,71 @@ static int hf_ethereum_disc_topic_register_pong = -1;
 
 // For tap.
 static int ethereum_tap = -1;
+static int expert_tap = -1;  // The tap of the expert infos, to tell whether anyone consumes them.
 
 static const gchar *st_str_packets = "Total packets";
 static const gchar *st_str_packet_types = "Packet types";
 static const gchar *st_str_packet_nodecount = "# of nodes returned in NODES";
+static const gchar *st_str_evicted = "Evicted conversation states (streaming mode)";
+static const gchar *st_str_duplicates = "Duplicate packets (not counted)";
+static const gchar *st_str_rt_percentiles = "Response time percentiles (us)";
+static const gchar *st_str_rt_peers = "Top peers";
+static const gchar *st_str_peer_rt = "Response times per peer (us)";
+static const gchar *st_str_node_ads = "Node advertisements";
+static const gchar *st_str_node_ids = "Distinct node IDs";
+static const gchar *st_str_node_moves = "Advertised with a new endpoint";
+static const gchar *st_str_distances = "Log distances of returned nodes to the FIND_NODE target";
+static const gchar *st_str_distance_peers = "Per responder";
 
 // Statistics nodes.
 static int st_node_packets = -1;
 static int st_node_packet_types = -1;
 static int st_node_packet_nodes_count = -1;
+static int st_node_rt_percentiles = -1;
+static int st_node_rt_peers = -1;
+static int st_node_peer_rt = -1;
+static int st_node_node_ads = -1;
+static int st_node_distances = -1;
+static int st_node_distance_peers = -1;
+
+// The buckets of log distances, by lower bound; in a healthy network, returned nodes share a long prefix with
+// the target, i.e. their distance is well below 256.
+static const guint16 distance_bucket_bounds[] = {0, 240, 244, 248, 252, 256};
+static const gchar *distance_bucket_names[] = {"< 240", "240-243", "244-247", "248-251", "252-255", "256"};
+
+// The request/response pairs whose response times are tracked, in the order of the SRT table rows.
+typedef enum rt_pair {
+  RT_PING_PONG,
+  RT_FIND_NODE_NODES,
+  RT_FIND_NODEHASH_NODES,
+  RT_TOPIC_QUERY_TOPIC_NODES,
+  RT_PAIRS
+} rt_pair_e;
+
+static const gchar *rt_pair_names[RT_PAIRS] = {
+    [RT_PING_PONG] = "PING->PONG",
+    [RT_FIND_NODE_NODES] = "FIND_NODE->NODES",
+    [RT_FIND_NODEHASH_NODES] = "FIND_NODEHASH->NODES",
+    [RT_TOPIC_QUERY_TOPIC_NODES] = "TOPIC_QUERY->TOPIC_NODES",
+};
 
-// The statistics struct handled by the Ethereum discovery tap.
-// Exportable as other dissectors can consume from our tap.
-typedef struct _ethereum_disc_stat {
-  gboolean is_request;
-  gboolean has_request;
-  packet_type_e packet_type;
-  guint node_count;
-  nstime_t rq_time;
-} ethereum_disc_stat_t;
+// The percentiles reported for each pair, in ascending order.
+static const gdouble rt_percentiles[] = {50.0, 90.0, 99.0, 99.9};
+static const gchar *rt_percentile_names[] = {"p50", "p90", "p99", "p99.9"};
+
+// A slot of the busiest peers in the statistics tree, holding the response times of a peer.
+typedef struct _ethereum_disc_rt_peer {
+  gchar name[64];                  // The address and port of the responding peer; empty if the slot is free.
+  int node;                        // The node of the slot in the statistics tree ("peer 1" and so on).
+  guint64 samples;                 // The number of responses of the peer, since the start of the capture.
+  ethereum_hist_t hists[RT_PAIRS]; // The response times recorded since the peer took the slot.
+} ethereum_disc_rt_peer_t;
+
+// Response time histograms of the statistics tree: overall, and for the peers with the most responses. The
+// number of responses of every peer is counted, keyed by name, so the slots go to the actual busiest peers.
+static ethereum_hist_t *rt_hists;
+static ethereum_disc_rt_peer_t *rt_peers;
+static GHashTable *rt_peer_counts;
 
 // The struct where we store state concerning a conversation between two parties.
 typedef struct _ethereum_disc_conv {
@@ -167,96 +274,752 @@ typedef struct _ethereum_disc_conv {
   guint32 findnode_count;
   guint32 topicquery_count;
   guint32 nodes_count;
-  guint32 last_ping_frame;
-  nstime_t last_ping_time;
-  guint32 last_findnode_frame;
-  nstime_t last_findnode_time;
+  guint32 last_ping_frame;   // Last PING without a hash (discovery v5), which can't be looked up by its hash.
+  gint64 last_ping_time;     // In nanoseconds since the epoch.
   guint32 last_topicquery_frame;
-  nstime_t last_topicquery_time;
-  wmem_map_t *corr;
+  gint64 last_topicquery_time;
+  ethereum_disc_pending_t *pending;  // Pending requests, allocated upon the first request.
 } ethereum_disc_conv_t;
 
-// Enhanced packet data, attached to the pinfo for rendering in header fields.
+// The state of a conversation in streaming mode, allocated in a single block and cached in the stream LRU
+// (keyed by the index of the conversation) instead of being attached to the conversation.
+typedef struct _ethereum_disc_stream_conv {
+  ethereum_lru_entry_t lru;
+  guint32 conv_index;  // The index of the conversation, i.e. the key in the LRU.
+  ethereum_disc_conv_t conv;
+  ethereum_disc_pending_t pending[ETHEREUM_DISC_PENDING_SLOTS];
+} ethereum_disc_stream_conv_t;
+
+// Conversation states in streaming mode.
+static ethereum_lru_t stream_convs;
+
+// The sender of a message, recovered from its signature, in the sender recovery cache.
+typedef struct _ethereum_disc_sender {
+  ethereum_lru_entry_t lru;
+  // The key in the cache: the signed digest, i.e. the Keccak-256 of the packet type and data, then the signature.
+  guint8 key[ETHEREUM_KECCAK256_LEN + ETHEREUM_DISC_SIGNATURE_LEN];
+  guint8 id[ETHEREUM_SECP256K1_PUBKEY_LEN];        // The node ID of the sender.
+  gboolean valid;                                  // FALSE if no node ID could be recovered.
+} ethereum_disc_sender_t;
+
+// Senders recovered from the signatures, keyed by signed digest and signature.
+static ethereum_lru_t sender_cache;
+
+// The number of graph taps; while there is one, NODES packets publish their sender and advertised nodes.
+static guint graph_taps = 0;
+
+// The nodes advertised in NODES packets across all conversations, keyed by node ID, so a node keeps a single
+// record through NAT rebinding and port changes. Filled in during the first pass (except in streaming mode).
+static ethereum_peer_table_t peer_table;
+
+// The messages seen in the capture, as an open addressing set of the 64-bit prefixes of their hashes (uniformly
+// distributed already), along with the first frame that carried them. Filled in during the first pass.
+static guint64 *dup_keys;   // 0 if the slot is free.
+static guint32 *dup_frames;
+static guint dup_mask;
+static guint dup_count;
+
+// A lookup session: the FIND_NODE requests of an originator for a target, each sent within the lookup window
+// of the previous request or response, as in the iterative Kademlia lookup.
+typedef struct _ethereum_disc_lookup {
+  guint32 number;                 // The number of the session in the capture.
+  guint32 first_frame;            // The frame number of the first request.
+  nstime_t start;                 // The time of the first request.
+  nstime_t end;                   // The time of the last request or response.
+  guint32 requests;               // The number of requests.
+  guint32 unique_nodes;           // The number of distinct nodes returned.
+  guint16 hops;                   // The largest hop of the requests.
+  guint16 closest;                // The smallest log distance to the target returned; G_MAXUINT16 if none.
+  wmem_map_t *nodes;              // The peer table records of the nodes returned.
+  wmem_map_t *hops_by_endpoint;   // The endpoints of the nodes returned => the hop of the request they answered.
+} ethereum_disc_lookup_t;
+
+// The key of the lookup session index.
+typedef struct _ethereum_disc_lookup_key {
+  ethereum_peer_endpoint_t originator;
+  guint8 target[ETHEREUM_KECCAK256_LEN];
+} ethereum_disc_lookup_key_t;
+
+// A FIND_NODE (or FIND_NODEHASH) request.
+typedef struct _ethereum_disc_findnode {
+  guint8 target[ETHEREUM_KECCAK256_LEN];  // The Keccak-256 of the target, i.e. its Kademlia key.
+  ethereum_disc_lookup_t *lookup;         // The lookup session.
+  guint16 hop;                            // The hop of the request in the session, from 1.
+} ethereum_disc_findnode_t;
+
+// The FIND_NODE requests, keyed by frame number, to measure how close the nodes returned in response are and
+// to follow the lookup sessions. Allocated in the file scope upon the first request.
+static wmem_map_t *findnodes;
+
+// The latest lookup session of each (originator, target) pair, and the number of sessions so far.
+static wmem_map_t *lookups;
+static guint32 lookup_count;
+
+// The sidecar of the capture file, holding the cryptographic checks of earlier openings; opened upon the
+// first discovery v4 packet.
+static ethereum_sidecar_t *sidecar;
+static gboolean sidecar_opened;
+
+// The result of the cryptographic checks of a frame, computed by the crypto workers. Only the dissector thread
+// allocates results and submits jobs; a worker fills in the fields of the result of its job, and then sets
+// ready, after which the result is read-only.
+typedef struct _ethereum_disc_crypto_result {
+  gint ready;                                      // Set (atomically) once the fields below are written.
+  gboolean submitted;                              // A job was submitted for the frame.
+  gboolean hash_valid;                             // The message hash matches the message.
+  gboolean sender_valid;                           // The sender was recovered from the signature.
+  guint8 sender_id[ETHEREUM_SECP256K1_PUBKEY_LEN];
+} ethereum_disc_crypto_result_t;
+
+// A job for the crypto workers: a copy of the datagram, as the frame data doesn't outlive the dissection.
+typedef struct _ethereum_disc_crypto_job {
+  ethereum_disc_crypto_result_t *result;
+  gboolean verify_hash;
+  gboolean recover_sender;
+  guint len;
+  guint8 data[];
+} ethereum_disc_crypto_job_t;
+
+// The crypto workers, started upon the first job, and the frame-indexed result table they fill in, in chunks
+// that never move once allocated.
+static GThreadPool *crypto_pool;
+static gint crypto_cancelled;  // Set while the workers are stopped, to drain the queued jobs without running them.
+static ethereum_disc_crypto_result_t **crypto_chunks;
+static guint crypto_chunks_len;
+
+// Enhanced packet data, kept in the frame side table for rendering in header fields.
+// Packed into 20 bytes, as there is one record per frame.
 typedef struct _ethereum_disc_enhanced_data {
-  guint32 seq;
-  guint seqtype;
-  nstime_t rt;
-  nstime_t rq_time;
+  guint32 seq;             // The sequence number in the conversation; 0 if the frame was not dissected yet.
+  guint32 seqtype;         // The sequence number of the packet type in the conversation.
+  guint32 peer_frame;      // The response to a request, or the request of a response; 0 if none.
+  gint32 rt_secs : 24;     // The response time, valid with ETHEREUM_DISC_FRAME_HAS_RT.
+  guint32 flags : 8;
+  gint32 rt_nsecs;
 } ethereum_disc_enhanced_data_t;
 
-// Represents a peer endpoint parsed from the discovery packets.
-typedef struct _endpoint {
-  guint32 ipv4_addr;
-  ws_in6_addr *ipv6_addr;
-  guint16 udp_port;
-  guint16 tcp_port;
-} ethereum_disc_endpoint_t;
+// The frame side table: chunks of records indexed by frame number, allocated upon the first discovery
+// frame falling in their range.
+static ethereum_disc_enhanced_data_t **frame_chunks;
+static guint frame_chunks_len;
+
+/**
+ * Retrieves the record of a frame in the frame side table, growing the table if needed.
+ *
+ * @param frame The frame number.
+ * @return The record of the frame, zeroed if the frame was not dissected yet.
+ */
+static ethereum_disc_enhanced_data_t *get_frame_data(guint32 frame) {
+  guint chunk = frame >> ETHEREUM_DISC_FRAME_CHUNK_BITS;
+
+  if (chunk >= frame_chunks_len) {
+    guint len = MAX(MAX(frame_chunks_len * 2, chunk + 1), 64);
+    frame_chunks = (ethereum_disc_enhanced_data_t **) wmem_realloc(wmem_file_scope(), frame_chunks,
+                                                                    len * sizeof(*frame_chunks));
+    memset(frame_chunks + frame_chunks_len, 0, (len - frame_chunks_len) * sizeof(*frame_chunks));
+    frame_chunks_len = len;
+  }
+  if (!frame_chunks[chunk]) {
+    frame_chunks[chunk] = wmem_alloc_array0(wmem_file_scope(), ethereum_disc_enhanced_data_t,
+                                            ETHEREUM_DISC_FRAME_CHUNK_SIZE);
+  }
+  return &frame_chunks[chunk][frame & (ETHEREUM_DISC_FRAME_CHUNK_SIZE - 1)];
+}
+
+/**
+ * Stores a response time in a frame record, saturating at the bounds of the record.
+ *
+ * @param efdata The frame record.
+ * @param rt The response time.
+ */
+static void efdata_set_rt(ethereum_disc_enhanced_data_t *efdata, const nstime_t *rt) {
+  if (rt->secs > ETHEREUM_DISC_FRAME_RT_MAX_SECS || rt->secs < -ETHEREUM_DISC_FRAME_RT_MAX_SECS) {
+    efdata->rt_secs = rt->secs > 0 ? ETHEREUM_DISC_FRAME_RT_MAX_SECS : -ETHEREUM_DISC_FRAME_RT_MAX_SECS;
+    efdata->rt_nsecs = 0;
+  } else {
+    efdata->rt_secs = (gint32) rt->secs;
+    efdata->rt_nsecs = rt->nsecs;
+  }
+  efdata->flags |= ETHEREUM_DISC_FRAME_HAS_RT;
+}
+
+/**
+ * Retrieves the response time stored in a frame record.
+ *
+ * @param efdata The frame record.
+ * @param rt Set to the response time.
+ * @return TRUE if the record holds a response time; FALSE otherwise.
+ */
+static gboolean efdata_get_rt(const ethereum_disc_enhanced_data_t *efdata, nstime_t *rt) {
+  if (!(efdata->flags & ETHEREUM_DISC_FRAME_HAS_RT)) {
+    return FALSE;
+  }
+  rt->secs = efdata->rt_secs;
+  rt->nsecs = efdata->rt_nsecs;
+  return TRUE;
+}
+
+/**
+ * Releases the duplicate detection set.
+ */
+static void reset_dup_set(void) {
+  g_free(dup_keys);
+  g_free(dup_frames);
+  dup_keys = NULL;
+  dup_frames = NULL;
+  dup_mask = 0;
+  dup_count = 0;
+}
+
+/**
+ * Doubles the number of slots of the duplicate detection set, or allocates it.
+ */
+static void grow_dup_set(void) {
+  guint64 *keys = dup_keys;
+  guint32 *frames = dup_frames;
+  guint len = dup_keys ? dup_mask + 1 : 0;
+  guint i, j;
+
+  dup_mask = len ? len * 2 - 1 : ETHEREUM_DISC_DUP_INITIAL_SLOTS - 1;
+  dup_keys = g_new0(guint64, dup_mask + 1);
+  dup_frames = g_new(guint32, dup_mask + 1);
+  for (i = 0; i < len; i++) {
+    if (keys[i]) {
+      for (j = (guint) keys[i] & dup_mask; dup_keys[j]; j = (j + 1) & dup_mask);
+      dup_keys[j] = keys[i];
+      dup_frames[j] = frames[i];
+    }
+  }
+  g_free(keys);
+  g_free(frames);
+}
+
+/**
+ * Looks up the first frame that carried a message, identified by its hash. During the first pass, the frame is
+ * recorded as such if the message was not seen yet.
+ *
+ * @param hash The message hash.
+ * @param frame The frame number.
+ * @param insert TRUE to record the message if it was not seen yet.
+ * @return The first frame that carried the message (the frame itself for a new message), or 0 if unknown.
+ */
+static guint32 get_original_frame(const guint8 *hash, guint32 frame, gboolean insert) {
+  guint64 key = pntoh64(hash);
+  guint i;
+
+  // 0 marks free slots.
+  key = key ? key : 1;
+  if (dup_keys) {
+    for (i = (guint) key & dup_mask; dup_keys[i]; i = (i + 1) & dup_mask) {
+      if (dup_keys[i] == key) {
+        return dup_frames[i];
+      }
+    }
+  }
+  if (!insert) {
+    return 0;
+  }
+
+  // In streaming mode, the set is bounded in memory by starting over; only nearby duplicates are detected.
+  if (ethereum_disc_streaming && dup_count >= ETHEREUM_DISC_DUP_STREAM_MAX) {
+    reset_dup_set();
+  }
+  if (!dup_keys || (dup_count + 1) * 4 > (dup_mask + 1) * 3) {
+    grow_dup_set();
+  }
+  for (i = (guint) key & dup_mask; dup_keys[i]; i = (i + 1) & dup_mask);
+  dup_keys[i] = key;
+  dup_frames[i] = frame;
+  dup_count++;
+  return frame;
+}
 
 // A function that handles a packet.
 typedef int(packet_processor)(tvbuff_t *,
                               proto_tree *,
                               packet_info *,
-                              rlp_element_t *,
+                              const ethereum_disc_msg_t *,
                               ethereum_disc_stat_t *,
                               ethereum_disc_conv_t *,
                               ethereum_disc_enhanced_data_t *);
 
 /**
- * Decodes an endpoint from the provided RLP elements and adds protocol tree items into the specified fields.
+ * Decodes a field of a message from an indexed RLP element.
+ *
+ * @param buf The captured bytes of the packet payload.
+ * @param captured The number of captured bytes.
+ * @param idx The RLP index of the packet payload.
+ * @param el The index of the element, or RLP_INDEX_NONE.
+ * @param f The field to fill in; left absent if the element doesn't exist.
+ */
+static void decode_field(const guint8 *buf, guint captured, const rlp_index_t *idx, guint el,
+                         ethereum_disc_field_t *f) {
+  const rlp_index_entry_t *e;
+  guint i;
+
+  memset(f, 0, sizeof(*f));
+  if (el == RLP_INDEX_NONE) {
+    return;
+  }
+  e = &idx->entries[el];
+  f->present = TRUE;
+  f->offset = e->data_offset;
+  f->length = e->byte_length;
+  // Truncated captures may lack the bytes of the field; it is still rendered, so the usual exception is raised.
+  if (e->data_offset > captured || e->byte_length > captured - e->data_offset) {
+    return;
+  }
+  f->data = buf + e->data_offset;
+  if (f->length <= sizeof(f->value)) {
+    for (i = 0; i < f->length; i++) {
+      f->value = (f->value << 8) | f->data[i];
+    }
+  }
+}
+
+/**
+ * Decodes a value, or a list of values.
  *
- * Fields are specified in this order:
- *  - IPv4 address, mutually exclusive group A.
- *  - IPv6 address, mutually exclusive group A.
- *  - UDP port.
- *  - TCP port (optional).
+ * @param buf The captured bytes of the packet payload.
+ * @param captured The number of captured bytes.
+ * @param idx The RLP index of the packet payload.
+ * @param el The index of the value or of the list.
+ * @param full FALSE to only count the values.
+ * @param values The values to fill in.
+ */
+static void decode_values(const guint8 *buf, guint captured, const rlp_index_t *idx, guint el, gboolean full,
+                          ethereum_disc_values_t *values) {
+  guint item, i;
+
+  if (idx->entries[el].type != LIST) {
+    values->count = 1;
+    if (full) {
+      values->items = wmem_new(wmem_packet_scope(), ethereum_disc_field_t);
+      decode_field(buf, captured, idx, el, values->items);
+    }
+    return;
+  }
+  for (item = rlp_index_first_child(idx, el); item != RLP_INDEX_NONE; item = rlp_index_next_sibling(idx, item)) {
+    values->count++;
+  }
+  if (!full || values->count == 0) {
+    return;
+  }
+  values->items = wmem_alloc_array(wmem_packet_scope(), ethereum_disc_field_t, values->count);
+  item = rlp_index_first_child(idx, el);
+  for (i = 0; i < values->count; i++, item = rlp_index_next_sibling(idx, item)) {
+    decode_field(buf, captured, idx, item, &values->items[i]);
+  }
+}
+
+// Kinds of the fields of a message schema.
+typedef enum schema_kind {
+  FIELD_VALUE,     // A single value.
+  FIELD_ADDRESS,   // An IP address, only present with 4 (IPv4) or 16 (IPv6) bytes.
+  FIELD_LIST,      // A value, or a list of values.
+  FIELD_RECORD,    // A list of fields, described by a schema of its own: an endpoint.
+  FIELD_NODES      // A list of node records; rendered by the processor, along with what the capture tells about them.
+} schema_kind_e;
+
+// Flags of the fields of a message schema.
+#define SCHEMA_OPTIONAL 0x01  // An empty value is the same as an absent one.
+
+// A field of a message schema. The fields of a schema are the children of a list, the top level list of the payload
+// for a message, in order; trailing fields may be missing.
+typedef struct _schema_field {
+  schema_kind_e kind;
+  guint flags;
+  gsize offset;                  // The offset of the decoded field in the message, or in the enclosing record.
+  const int *hf;                 // The protocol field (values, lists and IPv4 addresses).
+  const int *hf_ipv6;            // The protocol field of IPv6 addresses.
+  const struct _schema *record;  // The schema of the records (records and node lists).
+  guint encoding;
+} schema_field_t;
+
+// The schema of a message type, or of a record.
+typedef struct _schema {
+  const schema_field_t *fields;
+  guint count;
+} schema_t;
+
+#define SCHEMA_VALUE(member, hf, encoding, flags) \
+  {FIELD_VALUE, flags, offsetof(ethereum_disc_msg_t, member), &hf, NULL, NULL, encoding}
+#define SCHEMA_LIST(member, hf, encoding) \
+  {FIELD_LIST, 0, offsetof(ethereum_disc_msg_t, member), &hf, NULL, NULL, encoding}
+#define SCHEMA_RECORD(member, schema) \
+  {FIELD_RECORD, 0, offsetof(ethereum_disc_msg_t, member), NULL, NULL, &schema, 0}
+#define SCHEMA_NODES \
+  {FIELD_NODES, 0, 0, NULL, NULL, &node_schema, 0}
+#define SCHEMA(fields) {fields, G_N_ELEMENTS(fields)}
+
+// The fields of an endpoint at some offset of a record, whose protocol fields are named <hf>_ipv4, <hf>_ipv6,
+// <hf>_udp_port and <hf>_tcp_port.
+#define SCHEMA_ENDPOINT_FIELDS(base, hf) \
+  {FIELD_ADDRESS, 0, (base) + offsetof(ethereum_disc_endpoint_t, ip), &hf##_ipv4, &hf##_ipv6, NULL, ENC_BIG_ENDIAN}, \
+  {FIELD_VALUE, 0, (base) + offsetof(ethereum_disc_endpoint_t, udp), &hf##_udp_port, NULL, NULL, ENC_BIG_ENDIAN}, \
+  {FIELD_VALUE, SCHEMA_OPTIONAL, (base) + offsetof(ethereum_disc_endpoint_t, tcp), &hf##_tcp_port, NULL, NULL, \
+   ENC_BIG_ENDIAN}
+
+static const schema_field_t ping_sender_fields[] = {SCHEMA_ENDPOINT_FIELDS(0, hf_ethereum_disc_ping_sender)};
+static const schema_t ping_sender_schema = SCHEMA(ping_sender_fields);
+
+static const schema_field_t ping_recipient_fields[] = {SCHEMA_ENDPOINT_FIELDS(0, hf_ethereum_disc_ping_recipient)};
+static const schema_t ping_recipient_schema = SCHEMA(ping_recipient_fields);
+
+static const schema_field_t pong_recipient_fields[] = {SCHEMA_ENDPOINT_FIELDS(0, hf_ethereum_disc_pong_recipient)};
+static const schema_t pong_recipient_schema = SCHEMA(pong_recipient_fields);
+
+// A node record: the endpoint and the node ID.
+static const schema_field_t node_fields[] = {
+    SCHEMA_ENDPOINT_FIELDS(offsetof(ethereum_disc_node_t, endpoint), hf_ethereum_disc_nodes_nodes),
+    {FIELD_VALUE, 0, offsetof(ethereum_disc_node_t, id), &hf_ethereum_disc_nodes_nodes_id, NULL, NULL, ENC_BIG_ENDIAN}
+};
+static const schema_t node_schema = SCHEMA(node_fields);
+
+static const schema_field_t ping_schema[] = {
+    SCHEMA_VALUE(version, hf_ethereum_disc_ping_version, ENC_BIG_ENDIAN, 0),
+    SCHEMA_RECORD(from, ping_sender_schema),
+    SCHEMA_RECORD(to, ping_recipient_schema),
+    SCHEMA_VALUE(expiration, hf_ethereum_disc_ping_expiration, ENC_TIME_SECS | ENC_BIG_ENDIAN, 0)
+};
+
+static const schema_field_t ping_v5_schema[] = {
+    SCHEMA_VALUE(version, hf_ethereum_disc_ping_version, ENC_BIG_ENDIAN, 0),
+    SCHEMA_RECORD(from, ping_sender_schema),
+    SCHEMA_RECORD(to, ping_recipient_schema),
+    SCHEMA_VALUE(expiration, hf_ethereum_disc_ping_expiration, ENC_TIME_SECS | ENC_BIG_ENDIAN, 0),
+    SCHEMA_LIST(topics, hf_ethereum_disc_ping_topics, ENC_ASCII)
+};
+
+// Expiration on v5 pong is broken: https://github.com/ethereum/go-ethereum/issues/17468
+static const schema_field_t pong_schema[] = {
+    SCHEMA_RECORD(to, pong_recipient_schema),
+    SCHEMA_VALUE(ping_hash, hf_ethereum_disc_pong_ping_hash, ENC_BIG_ENDIAN, 0),
+    SCHEMA_VALUE(expiration, hf_ethereum_disc_pong_expiration, ENC_TIME_SECS | ENC_BIG_ENDIAN, 0)
+};
+
+// The PONG of discovery v5 also carries the ticket of the topics of the PING.
+static const schema_field_t pong_v5_schema[] = {
+    SCHEMA_RECORD(to, pong_recipient_schema),
+    SCHEMA_VALUE(ping_hash, hf_ethereum_disc_pong_ping_hash, ENC_BIG_ENDIAN, 0),
+    SCHEMA_VALUE(expiration, hf_ethereum_disc_pong_expiration, ENC_TIME_SECS | ENC_BIG_ENDIAN, 0),
+    SCHEMA_VALUE(topic_hash, hf_ethereum_disc_pong_topic_hash, ENC_NA, 0),
+    SCHEMA_VALUE(ticket_serial, hf_ethereum_disc_pong_ticket_serial, ENC_BIG_ENDIAN, 0),
+    SCHEMA_LIST(wait_periods, hf_ethereum_disc_pong_wait_period, ENC_BIG_ENDIAN)
+};
+
+// FIND_NODEHASH is identical to FIND_NODE, except the length of their target field is different (64 for the
+// former and 32 for the latter).
+static const schema_field_t findnode_schema[] = {
+    SCHEMA_VALUE(target, hf_ethereum_disc_findnode_target, ENC_BIG_ENDIAN, 0),
+    SCHEMA_VALUE(expiration, hf_ethereum_disc_findnode_expiration, ENC_TIME_SECS | ENC_BIG_ENDIAN, 0)
+};
+
+static const schema_field_t nodes_schema[] = {
+    SCHEMA_NODES,
+    SCHEMA_VALUE(expiration, hf_ethereum_disc_nodes_expiration, ENC_TIME_SECS | ENC_BIG_ENDIAN, 0)
+};
+
+static const schema_field_t topic_register_schema[] = {
+    SCHEMA_LIST(topics, hf_ethereum_disc_topic_register_topic, ENC_ASCII),
+    SCHEMA_VALUE(topic_idx, hf_ethereum_disc_topic_register_idx, ENC_BIG_ENDIAN, 0),
+    SCHEMA_VALUE(topic_pong, hf_ethereum_disc_topic_register_pong, ENC_BIG_ENDIAN, 0)
+};
+
+static const schema_field_t topic_query_schema[] = {
+    SCHEMA_LIST(topics, hf_ethereum_disc_topic_query_topic, ENC_ASCII),
+    SCHEMA_VALUE(expiration, hf_ethereum_disc_topic_query_expiration, ENC_TIME_SECS | ENC_BIG_ENDIAN,
+                 SCHEMA_OPTIONAL)
+};
+
+static const schema_field_t topic_nodes_schema[] = {
+    SCHEMA_VALUE(echo, hf_ethereum_disc_topic_nodes_echo, ENC_BIG_ENDIAN, 0),
+    SCHEMA_NODES
+};
+
+// Message schemas of discovery v4, by packet type.
+static const schema_t discv4_schemas[] = {
+    [PING] = SCHEMA(ping_schema),
+    [PONG] = SCHEMA(pong_schema),
+    [FIND_NODE] = SCHEMA(findnode_schema),
+    [NODES] = SCHEMA(nodes_schema)
+};
+
+// Message schemas of discovery v5, by packet type.
+static const schema_t discv5_schemas[] = {
+    [PING] = SCHEMA(ping_v5_schema),
+    [PONG] = SCHEMA(pong_v5_schema),
+    [FIND_NODE] = SCHEMA(findnode_schema),
+    [NODES] = SCHEMA(nodes_schema),
+    [FIND_NODEHASH] = SCHEMA(findnode_schema),
+    [TOPIC_REGISTER] = SCHEMA(topic_register_schema),
+    [TOPIC_QUERY] = SCHEMA(topic_query_schema),
+    [TOPIC_NODES] = SCHEMA(topic_nodes_schema)
+};
+
+/**
+ * Looks up the schema of a message type.
  *
- * @param packet_data The buffer.
- * @param disc_packet The tree onto which to add the tree items.
- * @param rlp The RLP element pointing to the list representing the endpoint.
- * @param fields The fields onto which to output the parsed data.
- * @return An endpoint struct.
+ * @param type The packet type.
+ * @param is_discv5 TRUE for discovery v5.
+ * @return The schema, or NULL if the packet type is unknown.
  */
-static ethereum_disc_endpoint_t decode_endpoint(tvbuff_t *packet_data,
-                                                proto_tree *disc_packet,
-                                                rlp_element_t *rlp,
-                                                const int *fields[4]) {
-  ethereum_disc_endpoint_t ret = { .ipv4_addr = 0, .ipv6_addr = NULL, .tcp_port = 0, .udp_port = 0 };
+static const schema_t *get_schema(guint type, gboolean is_discv5) {
+  const schema_t *schemas = is_discv5 ? discv5_schemas : discv4_schemas;
+  guint count = is_discv5 ? G_N_ELEMENTS(discv5_schemas) : G_N_ELEMENTS(discv4_schemas);
+  return type < count && schemas[type].fields ? &schemas[type] : NULL;
+}
 
-  // IP addr.
-  rlp_next(packet_data, rlp->data_offset, rlp);
-  if (rlp->byte_length == 4) {
-    ret.ipv4_addr = tvb_get_ipv4(packet_data, rlp->data_offset);
-    proto_tree_add_ipv4(disc_packet, *fields[0], packet_data, rlp->data_offset, rlp->byte_length, ret.ipv4_addr);
-  } else {
-    ws_in6_addr *addr = (ws_in6_addr *) wmem_alloc0(wmem_packet_scope(), sizeof(ws_in6_addr));
-    tvb_get_ipv6(packet_data, rlp->data_offset, addr);
-    ret.ipv6_addr = addr;
-    proto_tree_add_ipv6(disc_packet, *fields[1], packet_data, rlp->data_offset, rlp->byte_length, ret.ipv6_addr);
+/**
+ * Decodes the fields of a list by running a schema over its children, in a single pass.
+ *
+ * Unless fully decoded, only the values are decoded, and the values and nodes of lists are only counted: that is
+ * all the correlation needs.
+ *
+ * @param buf The captured bytes of the packet payload.
+ * @param captured The number of captured bytes.
+ * @param idx The RLP index of the packet payload.
+ * @param list The index of the list.
+ * @param schema The schema of the list.
+ * @param base The message or record to fill in.
+ * @param full TRUE to also decode the records, the lists of values and the node records.
+ */
+static void decode_record(const guint8 *buf, guint captured, const rlp_index_t *idx, guint list,
+                          const schema_t *schema, gpointer base, gboolean full) {
+  const schema_field_t *sf, *end = schema->fields + schema->count;
+  ethereum_disc_msg_t *msg = (ethereum_disc_msg_t *) base;
+  guint el, node, count = 0;
+
+  el = rlp_index_first_child(idx, list);
+  for (sf = schema->fields; sf < end && el != RLP_INDEX_NONE; sf++, el = rlp_index_next_sibling(idx, el)) {
+    gpointer dst = (guint8 *) base + sf->offset;
+    switch (sf->kind) {
+      case FIELD_VALUE:
+        if (!(sf->flags & SCHEMA_OPTIONAL) || idx->entries[el].byte_length > 0) {
+          decode_field(buf, captured, idx, el, (ethereum_disc_field_t *) dst);
+        }
+        break;
+      case FIELD_ADDRESS:
+        decode_field(buf, captured, idx, el, (ethereum_disc_field_t *) dst);
+        if (((ethereum_disc_field_t *) dst)->length != 4 && ((ethereum_disc_field_t *) dst)->length != 16) {
+          ((ethereum_disc_field_t *) dst)->present = FALSE;
+        }
+        break;
+      case FIELD_LIST:
+        decode_values(buf, captured, idx, el, full, (ethereum_disc_values_t *) dst);
+        break;
+      case FIELD_RECORD:
+        if (full) {
+          decode_record(buf, captured, idx, el, sf->record, dst, full);
+        }
+        break;
+      case FIELD_NODES:
+        // Up to the first malformed record.
+        for (node = rlp_index_first_child(idx, el); node != RLP_INDEX_NONE; node = rlp_index_next_sibling(idx, node)) {
+          if (idx->entries[node].type != LIST || idx->entries[node].byte_length == 0) {
+            break;
+          }
+          count++;
+        }
+        if (!full || count == 0) {
+          msg->node_count = count;
+          break;
+        }
+        msg->nodes = wmem_alloc_array0(wmem_packet_scope(), ethereum_disc_node_t, count);
+        for (node = rlp_index_first_child(idx, el); msg->node_count < count;
+             node = rlp_index_next_sibling(idx, node)) {
+          ethereum_disc_node_t *n = &msg->nodes[msg->node_count++];
+          decode_field(buf, captured, idx, node, &n->record);
+          decode_record(buf, captured, idx, node, sf->record, n, full);
+        }
+        break;
+    }
   }
+}
+
+/**
+ * Decodes a discovery message from the RLP index of its payload, once per dissection, by running the schema of
+ * its type over the children of the top level list. The message only refers to the packet data, and the node
+ * and value lists are the only allocations.
+ *
+ * @param tvb The buffer representing only the packet payload.
+ * @param idx The RLP index of the packet payload, whose first element is the top level list.
+ * @param type The packet type.
+ * @param is_discv5 TRUE if this is a discovery v5 message.
+ * @param schema The schema of the packet type.
+ * @param full TRUE to also decode the endpoints, the lists of values and the node records.
+ * @return The message, allocated from the packet scope.
+ */
+static ethereum_disc_msg_t *decode_msg(tvbuff_t *tvb, const rlp_index_t *idx, packet_type_e type,
+                                       gboolean is_discv5, const schema_t *schema, gboolean full) {
+  ethereum_disc_msg_t *msg = wmem_new0(wmem_packet_scope(), ethereum_disc_msg_t);
+  guint captured = tvb_captured_length(tvb);
+
+  msg->type = type;
+  msg->is_discv5 = is_discv5;
+  decode_record(tvb_get_ptr(tvb, 0, captured), captured, idx, 0, schema, msg, full);
+  return msg;
+}
 
-  // UDP port.
-  rlp_next(packet_data, rlp->next_offset, rlp);
-  ret.udp_port = tvb_get_guint16(packet_data, rlp->data_offset, ENC_BIG_ENDIAN);
-  proto_tree_add_item(disc_packet, *fields[2], packet_data,
-                      rlp->data_offset, rlp->byte_length, ENC_BIG_ENDIAN);
+/**
+ * Adds a protocol tree item spanning a field of a decoded message, if the field is present.
+ *
+ * @param tree The tree onto which to add the item.
+ * @param hf The field.
+ * @param tvb The buffer representing only the packet payload.
+ * @param f The field of the message.
+ * @param encoding The encoding of the field.
+ * @return The tree item, or NULL if the field is absent.
+ */
+static proto_item *add_field_item(proto_tree *tree, int hf, tvbuff_t *tvb, const ethereum_disc_field_t *f,
+                                  const guint encoding) {
+  if (!f->present) {
+    return NULL;
+  }
+  // RLP encodes 0 as an empty string.
+  if (f->length == 0 && IS_FT_UINT(proto_registrar_get_ftype(hf))) {
+    return proto_tree_add_uint(tree, hf, tvb, f->offset, 0, 0);
+  }
+  return proto_tree_add_item(tree, hf, tvb, f->offset, f->length, encoding);
+}
 
-  // TCP port.
-  rlp_next(packet_data, rlp->next_offset, rlp);
-  if (rlp->byte_length > 0) {
-    ret.tcp_port = tvb_get_guint16(packet_data, rlp->data_offset, ENC_BIG_ENDIAN);
-    proto_tree_add_item(disc_packet, *fields[3], packet_data,
-                        rlp->data_offset, rlp->byte_length, ENC_BIG_ENDIAN);
+/**
+ * Adds the protocol tree items of a decoded message or record, as described by its schema. Node lists are left to
+ * the processors.
+ *
+ * @param tvb The buffer representing only the packet payload.
+ * @param tree The tree onto which to add the items, or NULL if no tree is requested.
+ * @param schema The schema of the message or record.
+ * @param base The decoded message or record.
+ */
+static void add_record_items(tvbuff_t *tvb, proto_tree *tree, const schema_t *schema, gconstpointer base) {
+  const schema_field_t *sf;
+  const ethereum_disc_field_t *f;
+  const ethereum_disc_values_t *values;
+  guint i;
+
+  if (!tree || !schema) {
+    return;
   }
-  return ret;
+  for (sf = schema->fields; sf < schema->fields + schema->count; sf++) {
+    gconstpointer src = (const guint8 *) base + sf->offset;
+    switch (sf->kind) {
+      case FIELD_VALUE:
+        add_field_item(tree, *sf->hf, tvb, (const ethereum_disc_field_t *) src, sf->encoding);
+        break;
+      case FIELD_ADDRESS:
+        f = (const ethereum_disc_field_t *) src;
+        add_field_item(tree, f->length == 4 ? *sf->hf : *sf->hf_ipv6, tvb, f, f->length == 4 ? sf->encoding : ENC_NA);
+        break;
+      case FIELD_LIST:
+        values = (const ethereum_disc_values_t *) src;
+        for (i = 0; values->items && i < values->count; i++) {
+          add_field_item(tree, *sf->hf, tvb, &values->items[i], sf->encoding);
+        }
+        break;
+      case FIELD_RECORD:
+        add_record_items(tvb, tree, sf->record, src);
+        break;
+      case FIELD_NODES:
+        break;
+    }
+  }
+}
+
+/**
+ * Adds the protocol tree items of a decoded message, as described by its schema.
+ *
+ * @param tvb The buffer representing only the packet payload.
+ * @param tree The protocol tree representing the packet, or NULL if no tree is requested.
+ * @param msg The decoded message.
+ */
+static void add_msg_items(tvbuff_t *tvb, proto_tree *tree, const ethereum_disc_msg_t *msg) {
+  add_record_items(tvb, tree, get_schema(msg->type, msg->is_discv5), msg);
+}
+
+/**
+ * Computes the key of a request in the pending request table, from a hash or node ID.
+ *
+ * @param f The field holding the hash or node ID.
+ * @return The key, or 0 if the field is absent or too short.
+ */
+static guint64 pending_key(const ethereum_disc_field_t *f) {
+  guint64 key;
+  if (!f->data || f->length < sizeof(guint64)) {
+    return 0;
+  }
+  key = pntoh64(f->data);
+  // Zero marks a free slot.
+  return key ? key : 1;
+}
+
+/**
+ * Returns a time in nanoseconds since the epoch, as the pending request table holds it.
+ *
+ * @param t The time.
+ * @return The number of nanoseconds.
+ */
+static gint64 nsecs_of(const nstime_t *t) {
+  return (gint64) t->secs * 1000000000 + t->nsecs;
+}
+
+/**
+ * Records a request in the pending request table of a conversation, allocated upon the first request.
+ *
+ * @param conv The conversation.
+ * @param pinfo The packet info of the request.
+ * @param type The request type.
+ * @param key The request key.
+ */
+static void pending_add(ethereum_disc_conv_t *conv, packet_info *pinfo, packet_type_e type, guint64 key) {
+  if (!conv->pending) {
+    conv->pending = wmem_alloc_array0(wmem_file_scope(), ethereum_disc_pending_t, ETHEREUM_DISC_PENDING_SLOTS);
+  }
+  ethereum_disc_pending_add(conv->pending, nsecs_of(&pinfo->abs_ts), pinfo->num, type, key);
+}
+
+/**
+ * Links a response to its request, and computes the response time.
+ *
+ * @param pinfo The packet info of the response.
+ * @param req_frame The frame number of the request.
+ * @param req_time The time of the request, in nanoseconds since the epoch.
+ * @param efdata The enhanced frame data of the response.
+ */
+static void correlate_response(packet_info *pinfo, guint32 req_frame, gint64 req_time,
+                               ethereum_disc_enhanced_data_t *efdata) {
+  gint64 delta = nsecs_of(&pinfo->fd->abs_ts) - req_time;
+  nstime_t rt;
+
+  // In streaming mode, the request was already output and won't be dissected again.
+  if (!ethereum_disc_streaming && !(efdata->flags & ETHEREUM_DISC_FRAME_CONTINUATION)) {
+    get_frame_data(req_frame)->peer_frame = pinfo->num;
+  }
+  efdata->peer_frame = req_frame;
+  rt.secs = (time_t) (delta / 1000000000);
+  rt.nsecs = (int) (delta % 1000000000);
+  efdata_set_rt(efdata, &rt);
+}
+
+/**
+ * Checks whether the dissection of a frame updates the state: the conversation, the correlation and the peer
+ * table are only updated upon the first pass over the first frame carrying a message.
+ *
+ * @param pinfo The packet info.
+ * @param st The statistics struct of the packet.
+ * @return TRUE if the state is to be updated; FALSE otherwise.
+ */
+static gboolean updates_state(packet_info *pinfo, const ethereum_disc_stat_t *st) {
+  return !PINFO_FD_VISITED(pinfo) && !st->duplicate;
 }
 
 /**
  * Processes a PING packet.
  *
  * @param packet_tvb The buffer representing only the packet payload (excluding the message wrapper).
- * @param packet_tree The protocol tree representing the packet.
+ * @param packet_tree The protocol tree representing the packet, or NULL if no tree is requested.
  * @param pinfo Packet
- * @param rlp The RLP element pointing to the list representing the packet.
+ * @param msg The decoded message.
  * @param st A ready-to-use statistics struct to populate.
  * @param conv A ready-to-use conversation struct (retrieved or initialized).
  * @param efdata A ready-to-use enhanced frame data struct.
@@ -265,47 +1028,24 @@ static ethereum_disc_endpoint_t decode_endpoint(tvbuff_t *packet_data,
 static int process_ping_msg(tvbuff_t *packet_tvb,
                             proto_tree *packet_tree,
                             packet_info *pinfo,
-                            rlp_element_t *rlp,
+                            const ethereum_disc_msg_t *msg,
                             ethereum_disc_stat_t *st,
                             ethereum_disc_conv_t *conv,
                             ethereum_disc_enhanced_data_t *efdata) {
   proto_tree *parent;
   proto_item *ti;
-  static const int *sender_endpoint_fields[] = {
-      &hf_ethereum_disc_ping_sender_ipv4,
-      &hf_ethereum_disc_ping_sender_ipv6,
-      &hf_ethereum_disc_ping_sender_udp_port,
-      &hf_ethereum_disc_ping_sender_tcp_port
-  };
-  static const int *recipient_endpoint_fields[] = {
-      &hf_ethereum_disc_ping_recipient_ipv4,
-      &hf_ethereum_disc_ping_recipient_ipv6,
-      &hf_ethereum_disc_ping_recipient_udp_port,
-      &hf_ethereum_disc_ping_recipient_tcp_port
-  };
 
-  // Version.
-  rlp_next(packet_tvb, rlp->data_offset, rlp);
-  proto_tree_add_item(packet_tree, hf_ethereum_disc_ping_version, packet_tvb,
-                      rlp->data_offset, rlp->byte_length, ENC_BIG_ENDIAN);
+  add_msg_items(packet_tvb, packet_tree, msg);
 
-  // Sender endpoint.
-  rlp_next(packet_tvb, rlp->next_offset, rlp);
-  decode_endpoint(packet_tvb, packet_tree, rlp, sender_endpoint_fields);
-
-  // Recipient endpoint.
-  rlp_next(packet_tvb, rlp->next_offset, rlp);
-  decode_endpoint(packet_tvb, packet_tree, rlp, recipient_endpoint_fields);
-
-  // Expiration.
-  rlp_next(packet_tvb, rlp->next_offset, rlp);
-  proto_tree_add_item(packet_tree, hf_ethereum_disc_ping_expiration, packet_tvb,
-                      rlp->data_offset, rlp->byte_length, ENC_TIME_SECS | ENC_BIG_ENDIAN);
-
-  if (!PINFO_FD_VISITED(pinfo)) {
+  if (updates_state(pinfo, st)) {
     efdata->seqtype = ++conv->ping_count;
-    conv->last_ping_frame = pinfo->num;
-    conv->last_ping_time = pinfo->abs_ts;
+    if (st->hash) {
+      guint64 key = pntoh64(st->hash);
+      pending_add(conv, pinfo, PING, key ? key : 1);
+    } else {
+      conv->last_ping_frame = pinfo->num;
+      conv->last_ping_time = nsecs_of(&pinfo->abs_ts);
+    }
   }
 
   // Update conversation.
@@ -314,7 +1054,7 @@ static int process_ping_msg(tvbuff_t *packet_tvb,
   PROTO_ITEM_SET_GENERATED(ti);
 
   // Link to PONG message.
-  guint32 pongref = GPOINTER_TO_UINT(wmem_map_lookup(conv->corr, GUINT_TO_POINTER(pinfo->num)));
+  guint32 pongref = efdata->peer_frame;
   if (pongref) {
     ti = proto_tree_add_uint(parent, hf_ethereum_disc_res_ref, packet_tvb, 0, 0, pongref);
     PROTO_ITEM_SET_GENERATED(ti);
@@ -328,9 +1068,9 @@ static int process_ping_msg(tvbuff_t *packet_tvb,
  * Processes a PONG packet.
  *
  * @param packet_tvb The buffer representing only the packet payload (excluding the message wrapper).
- * @param packet_tree The protocol tree representing the packet.
+ * @param packet_tree The protocol tree representing the packet, or NULL if no tree is requested.
  * @param pinfo Packet
- * @param rlp The RLP element pointing to the list representing the packet.
+ * @param msg The decoded message.
  * @param st A ready-to-use statistics struct to populate.
  * @param conv A ready-to-use conversation struct (retrieved or initialized).
  * @param efdata A ready-to-use enhanced frame data struct.
@@ -338,41 +1078,30 @@ static int process_ping_msg(tvbuff_t *packet_tvb,
  */
 static int process_pong_msg(tvbuff_t *packet_tvb,
                             proto_tree *packet_tree,
-                            packet_info *pinfo _U_,
-                            rlp_element_t *rlp,
-                            ethereum_disc_stat_t *st _U_,
+                            packet_info *pinfo,
+                            const ethereum_disc_msg_t *msg,
+                            ethereum_disc_stat_t *st,
                             ethereum_disc_conv_t *conv,
                             ethereum_disc_enhanced_data_t *efdata) {
   proto_tree *parent;
   proto_item *ti;
-  static const int *recipient_endpoint_fields[] = {
-      &hf_ethereum_disc_pong_recipient_ipv4,
-      &hf_ethereum_disc_pong_recipient_ipv6,
-      &hf_ethereum_disc_pong_recipient_udp_port,
-      &hf_ethereum_disc_pong_recipient_tcp_port
-  };
-
-  // Recipient endpoint.
-  rlp_next(packet_tvb, rlp->data_offset, rlp);
-  decode_endpoint(packet_tvb, packet_tree, rlp, recipient_endpoint_fields);
-
-  // Ping hash.
-  rlp_next(packet_tvb, rlp->next_offset, rlp);
-  proto_tree_add_item(packet_tree, hf_ethereum_disc_pong_ping_hash, packet_tvb,
-                      rlp->data_offset, rlp->byte_length, ENC_BIG_ENDIAN);
+  nstime_t rt;
+  ethereum_disc_pending_t *req;
 
-  // Expiration.
-  rlp_next(packet_tvb, rlp->next_offset, rlp);
-  // Expiration on v5 pong is broken: https://github.com/ethereum/go-ethereum/issues/17468
-  proto_tree_add_item(packet_tree, hf_ethereum_disc_pong_expiration, packet_tvb,
-                      rlp->data_offset, rlp->byte_length, ENC_TIME_SECS | ENC_BIG_ENDIAN);
+  add_msg_items(packet_tvb, packet_tree, msg);
 
-  if (!PINFO_FD_VISITED(pinfo)) {
+  if (updates_state(pinfo, st)) {
     efdata->seqtype = ++conv->pong_count;
-    wmem_map_insert(conv->corr, GUINT_TO_POINTER(conv->last_ping_frame), GUINT_TO_POINTER(pinfo->num));
-    wmem_map_insert(conv->corr, GUINT_TO_POINTER(pinfo->num), GUINT_TO_POINTER(conv->last_ping_frame));
-    nstime_delta(&efdata->rt, &pinfo->fd->abs_ts, &conv->last_ping_time);
-    efdata->rq_time = conv->last_ping_time;
+    // Match the PING by the hash echoed in the PONG; PINGs without a hash fall back to the last one.
+    req = ethereum_disc_pending_find(conv->pending, nsecs_of(&pinfo->abs_ts), PING,
+                                     pending_key(&msg->ping_hash));
+    if (req) {
+      correlate_response(pinfo, req->frame, req->time, efdata);
+      req->key = 0;
+    } else if (conv->last_ping_frame) {
+      correlate_response(pinfo, conv->last_ping_frame, conv->last_ping_time, efdata);
+      conv->last_ping_frame = 0;
+    }
   }
 
   // Sequence number of the message type.
@@ -381,163 +1110,510 @@ static int process_pong_msg(tvbuff_t *packet_tvb,
   PROTO_ITEM_SET_GENERATED(ti);
 
   // Link the PING request.
-  guint32 pingref = GPOINTER_TO_UINT(wmem_map_lookup(conv->corr, GUINT_TO_POINTER(pinfo->num)));
+  guint32 pingref = efdata->peer_frame;
   if (pingref) {
     ti = proto_tree_add_uint(parent, hf_ethereum_disc_req_ref, packet_tvb, 0, 0, pingref);
     PROTO_ITEM_SET_GENERATED(ti);
     st->has_request = TRUE;
+    st->request_type = PING;
   }
 
-  // Response time.
-  if (!nstime_is_unset(&efdata->rt)) {
-    ti = proto_tree_add_time(parent, hf_ethereum_disc_rt, packet_tvb, 0, 0, &efdata->rt);
+  // Response time, and the time of the request it was computed from.
+  if (efdata_get_rt(efdata, &rt)) {
+    ti = proto_tree_add_time(parent, hf_ethereum_disc_rt, packet_tvb, 0, 0, &rt);
     PROTO_ITEM_SET_GENERATED(ti);
+    nstime_delta(&st->rq_time, &pinfo->abs_ts, &rt);
   }
 
   st->is_request = FALSE;
-  st->rq_time = efdata->rq_time;
   return TRUE;
 }
 
-static int process_pong_v5_msg(tvbuff_t *packet_tvb,
-                               proto_tree *packet_tree,
-                               packet_info *pinfo _U_,
-                               rlp_element_t *rlp,
-                               ethereum_disc_stat_t *st _U_,
-                               ethereum_disc_conv_t *conv,
-                               ethereum_disc_enhanced_data_t *efdata) {
-    process_pong_msg(packet_tvb, packet_tree, pinfo, rlp, st, conv, efdata);
-    // TODO: process v5 fields (TopicHash, TicketSerial and WaitPeriods)
-    return TRUE;
+/**
+ * Converts an endpoint into the compact form of the peer table.
+ *
+ * @param ep The endpoint.
+ * @param ret The endpoint in the peer table form.
+ */
+static void to_peer_endpoint(const ethereum_disc_endpoint_t *ep, ethereum_peer_endpoint_t *ret) {
+  memset(ret, 0, sizeof(*ret));
+  if (ep->ip.present && ep->ip.data && ep->ip.length == 16) {
+    memcpy(ret->addr, ep->ip.data, sizeof(ret->addr));
+  } else {
+    // IPv4-mapped IPv6 address.
+    ret->addr[10] = ret->addr[11] = 0xff;
+    if (ep->ip.present && ep->ip.data) {
+      memcpy(ret->addr + 12, ep->ip.data, 4);
+    }
+  }
+  ret->udp_port = (guint16) ep->udp.value;
+  ret->tcp_port = (guint16) ep->tcp.value;
 }
 
 /**
- * Processes a FIND_NODE packet.
+ * Returns the endpoint of the sender or the recipient of a packet, in the peer table form.
  *
- * @param packet_tvb The buffer representing only the packet payload (excluding the message wrapper).
- * @param packet_tree The protocol tree representing the packet.
- * @param pinfo Packet
- * @param rlp The RLP element pointing to the list representing the packet.
- * @param st A ready-to-use statistics struct to populate.
- * @param conv A ready-to-use conversation struct (retrieved or initialized).
- * @param efdata A ready-to-use enhanced frame data struct.
- * @return TRUE if processing was successful; FALSE otherwise.
+ * @param addr The address of the sender or recipient.
+ * @param port The UDP port of the sender or recipient.
+ * @param ret The endpoint.
  */
-static int process_findnode_msg(tvbuff_t *packet_tvb,
-                                proto_tree *packet_tree,
-                                packet_info *pinfo _U_,
-                                rlp_element_t *rlp, ethereum_disc_stat_t *st _U_,
-                                ethereum_disc_conv_t *conv,
-                                ethereum_disc_enhanced_data_t *efdata _U_) {
-  proto_tree *parent;
-  proto_item *ti;
-
-  // Target.
-  rlp_next(packet_tvb, rlp->data_offset, rlp);
-  proto_tree_add_item(packet_tree, hf_ethereum_disc_findnode_target, packet_tvb,
-                      rlp->data_offset, rlp->byte_length, ENC_BIG_ENDIAN);
-
-  // Expiration.
-  rlp_next(packet_tvb, rlp->next_offset, rlp);
-  proto_tree_add_item(packet_tree, hf_ethereum_disc_findnode_expiration, packet_tvb,
-                      rlp->data_offset, rlp->byte_length, ENC_TIME_SECS | ENC_BIG_ENDIAN);
-
-  // Update conversation and enhanced frame data.
-  if (!PINFO_FD_VISITED(pinfo)) {
-    efdata->seqtype = ++conv->findnode_count;
-    conv->last_findnode_frame = pinfo->num;
-    conv->last_findnode_time = pinfo->abs_ts;
+static void address_peer_endpoint(const address *addr, guint32 port, ethereum_peer_endpoint_t *ret) {
+  memset(ret, 0, sizeof(*ret));
+  if (addr->type == AT_IPv6) {
+    memcpy(ret->addr, addr->data, sizeof(ret->addr));
+  } else if (addr->type == AT_IPv4) {
+    ret->addr[10] = ret->addr[11] = 0xff;
+    memcpy(ret->addr + 12, addr->data, 4);
   }
+  ret->udp_port = (guint16) port;
+}
 
-  // Sequence number of the message type.
-  parent = proto_tree_get_parent_tree(packet_tree);
-  ti = proto_tree_add_uint(parent, hf_ethereum_disc_seqtype, packet_tvb, 0, 0, efdata->seqtype);
-  PROTO_ITEM_SET_GENERATED(ti);
+/**
+ * Hashes an endpoint, as a key of the lookup session maps: only the address and UDP port are significant.
+ */
+static guint endpoint_key_hash(gconstpointer key) {
+  const ethereum_peer_endpoint_t *ep = (const ethereum_peer_endpoint_t *) key;
+  return wmem_strong_hash(ep->addr, sizeof(ep->addr)) ^ ep->udp_port;
+}
 
-  // Link the NODES response.
-  parent = proto_tree_get_parent_tree(packet_tree);
-  guint32 nodesref = GPOINTER_TO_UINT(wmem_map_lookup(conv->corr, GUINT_TO_POINTER(pinfo->num)));
-  if (nodesref) {
-    ti = proto_tree_add_uint(parent, hf_ethereum_disc_res_ref, packet_tvb, 0, 0, nodesref);
-    PROTO_ITEM_SET_GENERATED(ti);
-  }
+static gboolean endpoint_key_equal(gconstpointer a, gconstpointer b) {
+  const ethereum_peer_endpoint_t *x = (const ethereum_peer_endpoint_t *) a;
+  const ethereum_peer_endpoint_t *y = (const ethereum_peer_endpoint_t *) b;
+  return memcmp(x->addr, y->addr, sizeof(x->addr)) == 0 && x->udp_port == y->udp_port;
+}
 
-  st->is_request = TRUE;
-  return TRUE;
+/**
+ * Hashes an (originator, target) pair, as a key of the lookup session index. Targets are hashes, so their first
+ * bytes will do.
+ */
+static guint lookup_key_hash(gconstpointer key) {
+  const ethereum_disc_lookup_key_t *k = (const ethereum_disc_lookup_key_t *) key;
+  return pntoh32(k->target) ^ endpoint_key_hash(&k->originator);
 }
 
-static void decode_nodes_list(tvbuff_t *packet_tvb,
-                              proto_tree *packet_tree,
-                              packet_info *pinfo,
-                              rlp_element_t *rlp,
-                              ethereum_disc_stat_t *st,
-                              ethereum_disc_conv_t *conv _U_,
-                              ethereum_disc_enhanced_data_t *efdata _U_) {
-  proto_item *ti;
+static gboolean lookup_key_equal(gconstpointer a, gconstpointer b) {
+  const ethereum_disc_lookup_key_t *x = (const ethereum_disc_lookup_key_t *) a;
+  const ethereum_disc_lookup_key_t *y = (const ethereum_disc_lookup_key_t *) b;
+  return memcmp(x->target, y->target, sizeof(x->target)) == 0 && endpoint_key_equal(&x->originator, &y->originator);
+}
 
-  static const int *recipient_endpoint_fields[] = {
-      &hf_ethereum_disc_nodes_nodes_ipv4,
-      &hf_ethereum_disc_nodes_nodes_ipv6,
-      &hf_ethereum_disc_nodes_nodes_udp_port,
-      &hf_ethereum_disc_nodes_nodes_tcp_port
-  };
+/**
+ * Attaches a FIND_NODE request to the lookup session of its originator and target, starting a new session if
+ * there is none or if it has been idle for longer than the lookup window.
+ *
+ * @param pinfo The packet info of the request.
+ * @param req The request.
+ */
+static void join_lookup(packet_info *pinfo, ethereum_disc_findnode_t *req) {
+  ethereum_disc_lookup_key_t key;
+  ethereum_disc_lookup_t *lookup;
+  ethereum_peer_endpoint_t recipient;
+  nstime_t idle;
+  gpointer hop;
+
+  if (!lookups) {
+    lookups = wmem_map_new(wmem_file_scope(), lookup_key_hash, lookup_key_equal);
+  }
+  memset(&key, 0, sizeof(key));
+  address_peer_endpoint(&pinfo->src, pinfo->srcport, &key.originator);
+  memcpy(key.target, req->target, sizeof(key.target));
 
-  guint i = 0;
-  proto_tree *node_tree;
-  if (rlp->byte_length > 0) {
-    // List is not empty, move into the first element.
-    rlp_next(packet_tvb, rlp->data_offset, rlp);
+  lookup = (ethereum_disc_lookup_t *) wmem_map_lookup(lookups, &key);
+  if (lookup) {
+    nstime_delta(&idle, &pinfo->abs_ts, &lookup->end);
+  }
+  if (!lookup || idle.secs >= ETHEREUM_DISC_LOOKUP_WINDOW) {
+    ethereum_disc_lookup_key_t *k = (ethereum_disc_lookup_key_t *) wmem_memdup(wmem_file_scope(), &key, sizeof(key));
+    lookup = wmem_new0(wmem_file_scope(), ethereum_disc_lookup_t);
+    lookup->number = ++lookup_count;
+    lookup->first_frame = pinfo->num;
+    lookup->start = pinfo->abs_ts;
+    lookup->closest = G_MAXUINT16;
+    lookup->nodes = wmem_map_new(wmem_file_scope(), g_direct_hash, g_direct_equal);
+    lookup->hops_by_endpoint = wmem_map_new(wmem_file_scope(), endpoint_key_hash, endpoint_key_equal);
+    wmem_map_insert(lookups, k, lookup);
   }
-  while (rlp->type == LIST && rlp->byte_length > 0) {
-    i++;
-    ethereum_disc_endpoint_t ep;
 
-    ti = proto_tree_add_string(packet_tree, hf_ethereum_disc_nodes_node, packet_tvb,
-                               rlp->data_offset, rlp->byte_length, "enode://");
+  // The hop of a request is one more than that of the response which returned its recipient; recipients not
+  // returned in the session are the starting points, i.e. the first hop.
+  address_peer_endpoint(&pinfo->dst, pinfo->destport, &recipient);
+  hop = wmem_map_lookup(lookup->hops_by_endpoint, &recipient);
+  req->hop = (guint16) MIN(GPOINTER_TO_UINT(hop) + 1, G_MAXUINT16);
+  req->lookup = lookup;
+  lookup->requests++;
+  lookup->hops = MAX(lookup->hops, req->hop);
+  lookup->end = pinfo->abs_ts;
+}
 
-    node_tree = proto_item_add_subtree(ti, ett_ethereum_disc_nodes);
-    ep = decode_endpoint(packet_tvb, node_tree, rlp, recipient_endpoint_fields);
+/**
+ * Records a FIND_NODE request: the Keccak-256 of its target, i.e. its position in the Kademlia keyspace (FIND_NODEHASH
+ * targets are already hashed), and its lookup session.
+ *
+ * @param pinfo The packet info of the request.
+ * @param target The target of the request.
+ */
+static void add_findnode(packet_info *pinfo, const ethereum_disc_field_t *target) {
+  ethereum_disc_findnode_t *req;
 
-    // Node ID.
-    rlp_next(packet_tvb, rlp->next_offset, rlp);
-    proto_tree_add_item(node_tree, hf_ethereum_disc_nodes_nodes_id, packet_tvb,
-                        rlp->data_offset, rlp->byte_length, ENC_BIG_ENDIAN);
+  if (!target->data || (target->length != ETHEREUM_PEER_ID_LEN && target->length != ETHEREUM_KECCAK256_LEN)) {
+    return;
+  }
+  if (!findnodes) {
+    findnodes = wmem_map_new(wmem_file_scope(), g_direct_hash, g_direct_equal);
+  }
+  req = wmem_new0(wmem_file_scope(), ethereum_disc_findnode_t);
+  if (target->length == ETHEREUM_PEER_ID_LEN) {
+    ethereum_keccak256(target->data, ETHEREUM_PEER_ID_LEN, req->target);
+  } else {
+    memcpy(req->target, target->data, ETHEREUM_KECCAK256_LEN);
+  }
+  join_lookup(pinfo, req);
+  wmem_map_insert(findnodes, GUINT_TO_POINTER(pinfo->num), req);
+}
 
-    proto_item_append_text(ti, "%s", tvb_bytes_to_str(wmem_packet_scope(), packet_tvb, rlp->data_offset, rlp->byte_length));
-    proto_item_append_text(ti, "@");
+/**
+ * Retrieves a FIND_NODE request.
+ *
+ * @param frame The frame number of the request.
+ * @return The request, or NULL if it is unknown.
+ */
+static ethereum_disc_findnode_t *get_findnode(guint32 frame) {
+  if (!findnodes || !frame) {
+    return NULL;
+  }
+  return (ethereum_disc_findnode_t *) wmem_map_lookup(findnodes, GUINT_TO_POINTER(frame));
+}
 
-    if (ep.ipv6_addr) {
-      address addr = ADDRESS_INIT(AT_IPv6, 16, &ep.ipv6_addr->bytes);
-      proto_item_append_text(ti, "%s", address_to_str(wmem_packet_scope(), &addr));
-    } else {
-      address addr = ADDRESS_INIT(AT_IPv4, 4, &ep.ipv4_addr);
-      proto_item_append_text(ti, "%s", address_to_str(wmem_packet_scope(), &addr));
-    }
+/**
+ * Adds the lookup session of a FIND_NODE request or its NODES response.
+ *
+ * @param tree The tree of the message.
+ * @param tvb The buffer.
+ * @param req The request.
+ */
+static void add_lookup_info(proto_tree *tree, tvbuff_t *tvb, const ethereum_disc_findnode_t *req) {
+  const ethereum_disc_lookup_t *lookup = req->lookup;
+  proto_item *ti;
+  nstime_t duration;
 
-    proto_item_append_text(ti, ":");
+  if (!tree || !lookup) {
+    return;
+  }
+  ti = proto_tree_add_uint(tree, hf_ethereum_disc_lookup, tvb, 0, 0, lookup->number);
+  PROTO_ITEM_SET_GENERATED(ti);
+  tree = proto_item_add_subtree(ti, ett_ethereum_disc_lookup);
+  ti = proto_tree_add_uint(tree, hf_ethereum_disc_lookup_first_frame, tvb, 0, 0, lookup->first_frame);
+  PROTO_ITEM_SET_GENERATED(ti);
+  ti = proto_tree_add_uint(tree, hf_ethereum_disc_lookup_hop, tvb, 0, 0, req->hop);
+  PROTO_ITEM_SET_GENERATED(ti);
+  ti = proto_tree_add_uint(tree, hf_ethereum_disc_lookup_hops, tvb, 0, 0, lookup->hops);
+  PROTO_ITEM_SET_GENERATED(ti);
+  ti = proto_tree_add_uint(tree, hf_ethereum_disc_lookup_requests, tvb, 0, 0, lookup->requests);
+  PROTO_ITEM_SET_GENERATED(ti);
+  nstime_delta(&duration, &lookup->end, &lookup->start);
+  ti = proto_tree_add_time(tree, hf_ethereum_disc_lookup_duration, tvb, 0, 0, &duration);
+  PROTO_ITEM_SET_GENERATED(ti);
+  ti = proto_tree_add_uint(tree, hf_ethereum_disc_lookup_unique_nodes, tvb, 0, 0, lookup->unique_nodes);
+  PROTO_ITEM_SET_GENERATED(ti);
+  if (lookup->closest != G_MAXUINT16) {
+    ti = proto_tree_add_uint(tree, hf_ethereum_disc_lookup_closest, tvb, 0, 0, lookup->closest);
+    PROTO_ITEM_SET_GENERATED(ti);
+  }
+}
+
+/**
+ * Accounts for a node returned in response to a FIND_NODE request in its lookup session, during the first pass.
+ *
+ * @param pinfo The packet info of the response.
+ * @param req The request.
+ * @param peer The record of the node.
+ * @param distance The log distance of the node to the target.
+ */
+static void update_lookup(packet_info *pinfo, const ethereum_disc_findnode_t *req, ethereum_peer_t *peer,
+                          guint16 distance) {
+  ethereum_disc_lookup_t *lookup = req->lookup;
+
+  if (!wmem_map_contains(lookup->nodes, peer)) {
+    wmem_map_insert(lookup->nodes, peer, peer);
+    lookup->unique_nodes++;
+  }
+  // The endpoint of the record changes with later advertisements, hence the copy.
+  if (!wmem_map_contains(lookup->hops_by_endpoint, &peer->endpoints[0])) {
+    wmem_map_insert(lookup->hops_by_endpoint,
+                    wmem_memdup(wmem_file_scope(), &peer->endpoints[0], sizeof(ethereum_peer_endpoint_t)),
+                    GUINT_TO_POINTER((guint) req->hop));
+  }
+  lookup->closest = MIN(lookup->closest, distance);
+  if (nstime_cmp(&pinfo->abs_ts, &lookup->end) > 0) {
+    lookup->end = pinfo->abs_ts;
+  }
+}
+
+/**
+ * Processes a FIND_NODE packet.
+ *
+ * @param packet_tvb The buffer representing only the packet payload (excluding the message wrapper).
+ * @param packet_tree The protocol tree representing the packet, or NULL if no tree is requested.
+ * @param pinfo Packet
+ * @param msg The decoded message.
+ * @param st A ready-to-use statistics struct to populate.
+ * @param conv A ready-to-use conversation struct (retrieved or initialized).
+ * @param efdata A ready-to-use enhanced frame data struct.
+ * @return TRUE if processing was successful; FALSE otherwise.
+ */
+static int process_findnode_msg(tvbuff_t *packet_tvb,
+                                proto_tree *packet_tree,
+                                packet_info *pinfo,
+                                const ethereum_disc_msg_t *msg,
+                                ethereum_disc_stat_t *st,
+                                ethereum_disc_conv_t *conv,
+                                ethereum_disc_enhanced_data_t *efdata) {
+  proto_tree *parent;
+  proto_item *ti;
+  guint64 key;
+
+  add_msg_items(packet_tvb, packet_tree, msg);
+
+  // Update conversation and enhanced frame data.
+  if (updates_state(pinfo, st)) {
+    efdata->seqtype = ++conv->findnode_count;
+    // FIND_NODE and FIND_NODEHASH are both answered by NODES; a retransmission replaces the request.
+    key = pending_key(&msg->target);
+    pending_add(conv, pinfo, st->packet_type, key ? key : 1);
+    if (!ethereum_disc_streaming) {
+      add_findnode(pinfo, &msg->target);
+    }
+  }
+
+  // Sequence number of the message type.
+  parent = proto_tree_get_parent_tree(packet_tree);
+  ti = proto_tree_add_uint(parent, hf_ethereum_disc_seqtype, packet_tvb, 0, 0, efdata->seqtype);
+  PROTO_ITEM_SET_GENERATED(ti);
+
+  // Link the NODES response.
+  parent = proto_tree_get_parent_tree(packet_tree);
+  guint32 nodesref = efdata->peer_frame;
+  if (nodesref) {
+    ti = proto_tree_add_uint(parent, hf_ethereum_disc_res_ref, packet_tvb, 0, 0, nodesref);
+    PROTO_ITEM_SET_GENERATED(ti);
+  }
+
+  // Lookup session.
+  if (parent) {
+    const ethereum_disc_findnode_t *req = get_findnode(pinfo->num);
+    if (req) {
+      add_lookup_info(parent, packet_tvb, req);
+    }
+  }
+
+  st->is_request = TRUE;
+  return TRUE;
+}
+
+/**
+ * Adds the record of a node in the peer table, i.e. what the whole capture tells about it.
+ *
+ * @param tree The tree to add the record to.
+ * @param tvb The buffer holding the node ID.
+ * @param offset The offset of the node ID.
+ * @param peer The record of the node.
+ */
+static void add_peer_info(proto_tree *tree, tvbuff_t *tvb, gint offset, const ethereum_peer_t *peer) {
+  proto_item *ti;
+
+  ti = proto_tree_add_item(tree, hf_ethereum_disc_peer, tvb, offset, ETHEREUM_PEER_ID_LEN, ENC_NA);
+  PROTO_ITEM_SET_GENERATED(ti);
+  tree = proto_item_add_subtree(ti, ett_ethereum_disc_peer);
+  ti = proto_tree_add_uint(tree, hf_ethereum_disc_peer_first_frame, tvb, 0, 0, peer->first_frame);
+  PROTO_ITEM_SET_GENERATED(ti);
+  ti = proto_tree_add_time(tree, hf_ethereum_disc_peer_first_seen, tvb, 0, 0, &peer->first_seen);
+  PROTO_ITEM_SET_GENERATED(ti);
+  ti = proto_tree_add_uint(tree, hf_ethereum_disc_peer_last_frame, tvb, 0, 0, peer->last_frame);
+  PROTO_ITEM_SET_GENERATED(ti);
+  ti = proto_tree_add_time(tree, hf_ethereum_disc_peer_last_seen, tvb, 0, 0, &peer->last_seen);
+  PROTO_ITEM_SET_GENERATED(ti);
+  ti = proto_tree_add_uint(tree, hf_ethereum_disc_peer_advertised, tvb, 0, 0, peer->advertised);
+  PROTO_ITEM_SET_GENERATED(ti);
+  ti = proto_tree_add_uint(tree, hf_ethereum_disc_peer_advertisers, tvb, 0, 0, ethereum_peer_advertisers(peer));
+  PROTO_ITEM_SET_GENERATED(ti);
+  ti = proto_tree_add_uint(tree, hf_ethereum_disc_peer_endpoints, tvb, 0, 0, peer->endpoint_count);
+  PROTO_ITEM_SET_GENERATED(ti);
+}
+
+/**
+ * Records a node advertised in a NODES packet in the peer table during the first pass, and looks it up in
+ * later passes and for duplicates, counting it in the tap data if the packet first advertised it or moved it to another
+ * endpoint.
+ *
+ * @param pinfo The packet info.
+ * @param node The advertised node.
+ * @param st The statistics struct of the packet.
+ * @return The record of the node, or NULL if the node ID is malformed.
+ */
+static ethereum_peer_t *track_peer(packet_info *pinfo, const ethereum_disc_node_t *node, ethereum_disc_stat_t *st) {
+  ethereum_peer_endpoint_t endpoint, advertiser;
+  ethereum_peer_t *peer;
+  const guint8 *id_bytes = node->id.data;
+  guint i;
+
+  if (!id_bytes || node->id.length != ETHEREUM_PEER_ID_LEN) {
+    return NULL;
+  }
+  if (updates_state(pinfo, st)) {
+    to_peer_endpoint(&node->endpoint, &endpoint);
+    address_peer_endpoint(&pinfo->src, pinfo->srcport, &advertiser);
+    peer = ethereum_peer_table_advertise(&peer_table, id_bytes, pinfo->num, &pinfo->abs_ts, &endpoint, &advertiser);
+  } else {
+    peer = ethereum_peer_table_lookup(&peer_table, id_bytes);
+  }
+  if (!peer) {
+    return NULL;
+  }
+  if (peer->first_frame == pinfo->num) {
+    st->new_nodes++;
+  } else {
+    for (i = 0; i < ETHEREUM_PEER_ENDPOINTS; i++) {
+      if (peer->endpoints[i].first_frame == pinfo->num) {
+        st->moved_nodes++;
+        break;
+      }
+    }
+  }
+  return peer;
+}
+
+/**
+ * Computes the Kademlia log distance between two keys, i.e. the bit length of their XOR.
+ *
+ * @param a The 32 bytes of the first key.
+ * @param b The 32 bytes of the second key.
+ * @return The distance, from 0 (same key) to 256.
+ */
+static guint16 log_distance(const guint8 *a, const guint8 *b) {
+  guint i;
+  for (i = 0; i < ETHEREUM_KECCAK256_LEN; i++) {
+    guint8 x = a[i] ^ b[i];
+    if (x) {
+      guint16 bits = 8 * (ETHEREUM_KECCAK256_LEN - i);
+      while (!(x & 0x80)) {
+        x <<= 1;
+        bits--;
+      }
+      return bits;
+    }
+  }
+  return 0;
+}
+
+/**
+ * Processes the list of nodes of a NODES or TOPIC_NODES packet.
+ *
+ * @param packet_tvb The buffer representing only the packet payload.
+ * @param packet_tree The protocol tree representing the packet, or NULL if no tree is requested.
+ * @param pinfo The packet info.
+ * @param msg The decoded message.
+ * @param req The FIND_NODE request answered, or NULL.
+ * @param st A ready-to-use statistics struct to populate.
+ */
+static void process_nodes_list(tvbuff_t *packet_tvb,
+                               proto_tree *packet_tree,
+                               packet_info *pinfo,
+                               const ethereum_disc_msg_t *msg,
+                               const ethereum_disc_findnode_t *req,
+                               ethereum_disc_stat_t *st) {
+  proto_item *ti;
+  guint i;
+  proto_tree *node_tree;
+  ethereum_peer_t *peer;
+  guint8 id_hash[ETHEREUM_KECCAK256_LEN];
+  guint16 *distances = NULL;
+  // The peer table is filled in during the first pass, and looked up in later passes and for duplicates, for the
+  // tree and the taps.
+  gboolean track = !ethereum_disc_streaming && (updates_state(pinfo, st) || have_tap_listener(ethereum_tap));
+
+  // The distances are needed for the tree and the taps, and in the first pass for the lookup session.
+  const guint8 *target = NULL;
+  gboolean update_lookup_session = req && req->lookup && updates_state(pinfo, st);
+
+  if (req && msg->node_count > 0 && (packet_tree || have_tap_listener(ethereum_tap) || update_lookup_session)) {
+    target = req->target;
+    distances = (guint16 *) wmem_alloc(wmem_packet_scope(), msg->node_count * sizeof(*distances));
+    st->distances = distances;
+  }
+
+  for (i = 0; i < msg->node_count && (packet_tree || track); i++) {
+    const ethereum_disc_node_t *node = &msg->nodes[i];
+    const ethereum_disc_endpoint_t *ep = &node->endpoint;
+
+    ti = proto_tree_add_string(packet_tree, hf_ethereum_disc_nodes_node, packet_tvb,
+                               node->record.offset, node->record.length, "enode://");
+
+    node_tree = proto_item_add_subtree(ti, ett_ethereum_disc_nodes);
+    add_record_items(packet_tvb, node_tree, &node_schema, node);
+
+    // Node ID.
+    if (node->id.present) {
+      gboolean has_distance = target && node->id.data && node->id.length == ETHEREUM_PEER_ID_LEN;
+      peer = ethereum_disc_streaming ? NULL : track_peer(pinfo, node, st);
+      // Distance to the target; node IDs are hashed once per file, in the peer table.
+      if (has_distance) {
+        if (!peer) {
+          ethereum_keccak256(node->id.data, ETHEREUM_PEER_ID_LEN, id_hash);
+        }
+        distances[st->distance_count] = log_distance(target, peer ? ethereum_peer_id_hash(peer) : id_hash);
+        if (update_lookup_session && peer) {
+          update_lookup(pinfo, req, peer, distances[st->distance_count]);
+        }
+      }
+      if (packet_tree) {
+        if (has_distance) {
+          proto_item *dti = proto_tree_add_uint(node_tree, hf_ethereum_disc_nodes_nodes_distance, packet_tvb,
+                                                node->id.offset, node->id.length,
+                                                distances[st->distance_count]);
+          PROTO_ITEM_SET_GENERATED(dti);
+        }
+        if (peer) {
+          add_peer_info(node_tree, packet_tvb, node->id.offset, peer);
+        }
+        proto_item_append_text(ti, "%s", tvb_bytes_to_str(wmem_packet_scope(), packet_tvb, node->id.offset,
+                                                          node->id.length));
+      }
+      if (has_distance) {
+        st->distance_count++;
+      }
+    }
+    if (!packet_tree) {
+      continue;
+    }
+    proto_item_append_text(ti, "@");
 
-    if (ep.tcp_port) {
-      proto_item_append_text(ti, "%d", ep.tcp_port);
+    if (ep->ip.present && ep->ip.data && ep->ip.length == 16) {
+      address addr = ADDRESS_INIT(AT_IPv6, 16, ep->ip.data);
+      proto_item_append_text(ti, "%s", address_to_str(wmem_packet_scope(), &addr));
+    } else {
+      static const guint8 unspecified[4];
+      address addr = ADDRESS_INIT(AT_IPv4, 4, ep->ip.present && ep->ip.data ? ep->ip.data : unspecified);
+      proto_item_append_text(ti, "%s", address_to_str(wmem_packet_scope(), &addr));
     }
 
-    if (ep.tcp_port != ep.udp_port) {
-      proto_item_append_text(ti, "?discport=%d", ep.udp_port);
+    proto_item_append_text(ti, ":");
+
+    if (ep->tcp.value) {
+      proto_item_append_text(ti, "%d", (guint16) ep->tcp.value);
     }
 
-    if (rlp->next_offset == 0) {
-      break;
+    if (ep->tcp.value != ep->udp.value) {
+      proto_item_append_text(ti, "?discport=%d", (guint16) ep->udp.value);
     }
-    // Onto the next element.
-    rlp_next(packet_tvb, rlp->next_offset, rlp);
   }
 
   // Enhance packet info with # of nodes.
   char more_info[64];
-  g_snprintf(more_info, sizeof(more_info), " (%d nodes)", i);
+  g_snprintf(more_info, sizeof(more_info), " (%d nodes)", msg->node_count);
   col_append_str(pinfo->cinfo, COL_INFO, more_info);
 
   // Update stats with node count.
-  st->node_count = i;
+  st->node_count = msg->node_count;
 }
 
 
@@ -545,9 +1621,9 @@ static void decode_nodes_list(tvbuff_t *packet_tvb,
  * Processes a NODES packet.
  *
  * @param packet_tvb The buffer representing only the packet payload (excluding the message wrapper).
- * @param packet_tree The protocol tree representing the packet.
+ * @param packet_tree The protocol tree representing the packet, or NULL if no tree is requested.
  * @param pinfo Packet
- * @param rlp The RLP element pointing to the list representing the packet.
+ * @param msg The decoded message.
  * @param st A ready-to-use statistics struct to populate.
  * @param conv A ready-to-use conversation struct (retrieved or initialized).
  * @param efdata A ready-to-use enhanced frame data struct.
@@ -556,27 +1632,38 @@ static void decode_nodes_list(tvbuff_t *packet_tvb,
 static int process_nodes_msg(tvbuff_t *packet_tvb,
                              proto_tree *packet_tree,
                              packet_info *pinfo,
-                             rlp_element_t *rlp,
+                             const ethereum_disc_msg_t *msg,
                              ethereum_disc_stat_t *st,
                              ethereum_disc_conv_t *conv,
                              ethereum_disc_enhanced_data_t *efdata) {
   proto_tree *parent;
   proto_item *ti;
+  nstime_t rt;
+  ethereum_disc_pending_t *req = NULL;
+  const ethereum_disc_findnode_t *findnode;
 
-  // Node list.
-  rlp_next(packet_tvb, rlp->data_offset, rlp);
-  decode_nodes_list(packet_tvb, packet_tree, pinfo, rlp, st, conv, efdata);
+  // Link the request first, so the nodes can be measured against its target.
+  if (updates_state(pinfo, st)) {
+    efdata->seqtype = ++conv->nodes_count;
+    req = ethereum_disc_pending_find_findnode(conv->pending, nsecs_of(&pinfo->abs_ts));
+    if (req) {
+      if (req->nodes > 0) {
+        efdata->flags |= ETHEREUM_DISC_FRAME_CONTINUATION;
+      }
+      if (req->type == FIND_NODEHASH) {
+        efdata->flags |= ETHEREUM_DISC_FRAME_FIND_NODEHASH;
+      }
+      correlate_response(pinfo, req->frame, req->time, efdata);
+    }
+  }
 
-  // Expiration
-  proto_tree_add_item(packet_tree, hf_ethereum_disc_nodes_expiration, packet_tvb,
-                      rlp->data_offset, rlp->byte_length, ENC_TIME_SECS | ENC_BIG_ENDIAN);
+  // Node list.
+  findnode = get_findnode(efdata->peer_frame);
+  process_nodes_list(packet_tvb, packet_tree, pinfo, msg, findnode, st);
+  add_msg_items(packet_tvb, packet_tree, msg);
 
-  if (!PINFO_FD_VISITED(pinfo)) {
-    efdata->seqtype = ++conv->nodes_count;
-    wmem_map_insert(conv->corr, GUINT_TO_POINTER(conv->last_findnode_frame), GUINT_TO_POINTER(pinfo->num));
-    wmem_map_insert(conv->corr, GUINT_TO_POINTER(pinfo->num), GUINT_TO_POINTER(conv->last_findnode_frame));
-    nstime_delta(&efdata->rt, &pinfo->fd->abs_ts, &conv->last_findnode_time);
-    efdata->rq_time = conv->last_findnode_time;
+  if (req) {
+    ethereum_disc_pending_add_nodes(req, st->node_count);
   }
 
   // Sequence number of the message type.
@@ -585,62 +1672,48 @@ static int process_nodes_msg(tvbuff_t *packet_tvb,
   PROTO_ITEM_SET_GENERATED(ti);
 
   // Link the FIND_NODE request.
-  guint32 findnodesref = GPOINTER_TO_UINT(wmem_map_lookup(conv->corr, GUINT_TO_POINTER(pinfo->num)));
+  guint32 findnodesref = efdata->peer_frame;
   if (findnodesref) {
     ti = proto_tree_add_uint(parent, hf_ethereum_disc_req_ref, packet_tvb, 0, 0, findnodesref);
     PROTO_ITEM_SET_GENERATED(ti);
-    st->has_request = TRUE;
+    // Only the first packet of a response yields a response time sample.
+    st->has_request = !(efdata->flags & ETHEREUM_DISC_FRAME_CONTINUATION);
+    st->request_type = (efdata->flags & ETHEREUM_DISC_FRAME_FIND_NODEHASH) ? FIND_NODEHASH : FIND_NODE;
   }
 
-  // Response time.
-  if (!nstime_is_unset(&efdata->rt)) {
-    ti = proto_tree_add_time(parent, hf_ethereum_disc_rt, packet_tvb, 0, 0, &efdata->rt);
+  // Response time, and the time of the request it was computed from.
+  if (efdata_get_rt(efdata, &rt)) {
+    ti = proto_tree_add_time(parent, hf_ethereum_disc_rt, packet_tvb, 0, 0, &rt);
     PROTO_ITEM_SET_GENERATED(ti);
+    nstime_delta(&st->rq_time, &pinfo->abs_ts, &rt);
   }
 
-  st->is_request = FALSE;
-  st->rq_time = efdata->rq_time;
-  return TRUE;
-}
+  // Lookup session of the request.
+  if (findnode) {
+    add_lookup_info(parent, packet_tvb, findnode);
+  }
 
-static int process_ping_v5_msg(tvbuff_t *packet_tvb,
-                               proto_tree *packet_tree,
-                               packet_info *pinfo,
-                               rlp_element_t *rlp,
-                               ethereum_disc_stat_t *st,
-                               ethereum_disc_conv_t *conv,
-                               ethereum_disc_enhanced_data_t *efdata) {
-  process_ping_msg(packet_tvb, packet_tree, pinfo, rlp, st, conv, efdata);
-  // TODO: Read topic list
+  st->is_request = FALSE;
   return TRUE;
 }
 
 static int process_topic_query_msg(tvbuff_t *packet_tvb,
                                    proto_tree *packet_tree,
-                                   packet_info *pinfo _U_,
-                                   rlp_element_t *rlp,
-                                   ethereum_disc_stat_t *st _U_,
-                                   ethereum_disc_conv_t *conv _U_,
-                                   ethereum_disc_enhanced_data_t *efdata _U_) {
+                                   packet_info *pinfo,
+                                   const ethereum_disc_msg_t *msg,
+                                   ethereum_disc_stat_t *st,
+                                   ethereum_disc_conv_t *conv,
+                                   ethereum_disc_enhanced_data_t *efdata) {
   proto_tree *parent;
   proto_item *ti;
 
-  rlp_next(packet_tvb, rlp->data_offset, rlp);
-  proto_tree_add_item(packet_tree, hf_ethereum_disc_topic_query_topic, packet_tvb,
-                      rlp->data_offset, rlp->byte_length, ENC_ASCII);
-
-  // Expiration (optional)
-  rlp_next(packet_tvb, rlp->next_offset, rlp);
-  if (rlp->byte_length > 0) {
-    proto_tree_add_item(packet_tree, hf_ethereum_disc_topic_query_expiration, packet_tvb,
-                        rlp->data_offset, rlp->byte_length, ENC_TIME_SECS | ENC_BIG_ENDIAN);
-  }
+  add_msg_items(packet_tvb, packet_tree, msg);
 
   // Update conversation and enhanced frame data.
-  if (!PINFO_FD_VISITED(pinfo)) {
+  if (updates_state(pinfo, st)) {
     efdata->seqtype = ++conv->topicquery_count;
     conv->last_topicquery_frame = pinfo->num;
-    conv->last_topicquery_time = pinfo->abs_ts;
+    conv->last_topicquery_time = nsecs_of(&pinfo->abs_ts);
   }
 
   // Sequence number of the message type.
@@ -650,7 +1723,7 @@ static int process_topic_query_msg(tvbuff_t *packet_tvb,
 
   // Link the TOPIC_QUERY response.
   parent = proto_tree_get_parent_tree(packet_tree);
-  guint32 queryref = GPOINTER_TO_UINT(wmem_map_lookup(conv->corr, GUINT_TO_POINTER(pinfo->num)));
+  guint32 queryref = efdata->peer_frame;
   if (queryref) {
     ti = proto_tree_add_uint(parent, hf_ethereum_disc_res_ref, packet_tvb, 0, 0, queryref);
     PROTO_ITEM_SET_GENERATED(ti);
@@ -663,26 +1736,22 @@ static int process_topic_query_msg(tvbuff_t *packet_tvb,
 static int process_topic_nodes_msg(tvbuff_t *packet_tvb,
                                    proto_tree *packet_tree,
                                    packet_info *pinfo,
-                                   rlp_element_t *rlp,
+                                   const ethereum_disc_msg_t *msg,
                                    ethereum_disc_stat_t *st,
                                    ethereum_disc_conv_t *conv,
-                                   ethereum_disc_enhanced_data_t *efdata _U_) {
+                                   ethereum_disc_enhanced_data_t *efdata) {
   proto_tree *parent;
   proto_item *ti;
+  nstime_t rt;
 
-  rlp_next(packet_tvb, rlp->data_offset, rlp);
-  proto_tree_add_item(packet_tree, hf_ethereum_disc_topic_nodes_echo, packet_tvb,
-                      rlp->data_offset, rlp->byte_length, ENC_BIG_ENDIAN);
-
-  rlp_next(packet_tvb, rlp->next_offset, rlp);
-  decode_nodes_list(packet_tvb, packet_tree, pinfo, rlp, st, conv, efdata);
+  add_msg_items(packet_tvb, packet_tree, msg);
+  process_nodes_list(packet_tvb, packet_tree, pinfo, msg, NULL, st);
 
-  if (!PINFO_FD_VISITED(pinfo)) {
+  if (updates_state(pinfo, st)) {
     efdata->seqtype = ++conv->nodes_count;
-    wmem_map_insert(conv->corr, GUINT_TO_POINTER(conv->last_topicquery_frame), GUINT_TO_POINTER(pinfo->num));
-    wmem_map_insert(conv->corr, GUINT_TO_POINTER(pinfo->num), GUINT_TO_POINTER(conv->last_topicquery_frame));
-    nstime_delta(&efdata->rt, &pinfo->fd->abs_ts, &conv->last_topicquery_time);
-    efdata->rq_time = conv->last_topicquery_time;
+    if (conv->last_topicquery_frame) {
+      correlate_response(pinfo, conv->last_topicquery_frame, conv->last_topicquery_time, efdata);
+    }
   }
 
   // Sequence number of the message type.
@@ -691,94 +1760,101 @@ static int process_topic_nodes_msg(tvbuff_t *packet_tvb,
   PROTO_ITEM_SET_GENERATED(ti);
 
   // Link the TOPIC_QUERY request.
-  guint32 topicqueryref = GPOINTER_TO_UINT(wmem_map_lookup(conv->corr, GUINT_TO_POINTER(pinfo->num)));
+  guint32 topicqueryref = efdata->peer_frame;
   if (topicqueryref) {
     ti = proto_tree_add_uint(parent, hf_ethereum_disc_req_ref, packet_tvb, 0, 0, topicqueryref);
     PROTO_ITEM_SET_GENERATED(ti);
     st->has_request = TRUE;
+    st->request_type = TOPIC_QUERY;
   }
 
-  // Response time.
-  if (!nstime_is_unset(&efdata->rt)) {
-    ti = proto_tree_add_time(parent, hf_ethereum_disc_rt, packet_tvb, 0, 0, &efdata->rt);
+  // Response time, and the time of the request it was computed from.
+  if (efdata_get_rt(efdata, &rt)) {
+    ti = proto_tree_add_time(parent, hf_ethereum_disc_rt, packet_tvb, 0, 0, &rt);
     PROTO_ITEM_SET_GENERATED(ti);
+    nstime_delta(&st->rq_time, &pinfo->abs_ts, &rt);
   }
 
   st->is_request = FALSE;
-  st->rq_time = efdata->rq_time;
   return TRUE;
 }
 
 static int process_topic_register_msg(tvbuff_t *packet_tvb,
                                       proto_tree *packet_tree,
-                                      packet_info *pinfo _U_,
-                                      rlp_element_t *rlp,
+                                      packet_info *pinfo,
+                                      const ethereum_disc_msg_t *msg,
                                       ethereum_disc_stat_t *st _U_,
                                       ethereum_disc_conv_t *conv _U_,
                                       ethereum_disc_enhanced_data_t *efdata _U_) {
-
-  // Move to Topic List
-  rlp_next(packet_tvb, rlp->data_offset, rlp);
-
-  guint i = 0;
-  guint topic_list_end = rlp->data_offset + rlp->byte_length;
-  if (rlp->byte_length > 0) {
-    // List is not empty, move into the first element.
-    rlp_next(packet_tvb, rlp->data_offset, rlp);
-  }
-  while (rlp->data_offset < topic_list_end) {
-    i++;
-    proto_tree_add_item(packet_tree, hf_ethereum_disc_topic_register_topic, packet_tvb,
-                        rlp->data_offset, rlp->byte_length, ENC_ASCII);
-    // Onto the next element.
-    rlp_next(packet_tvb, rlp->next_offset, rlp);
-  }
-
-  // Idx.
-  proto_tree_add_item(packet_tree, hf_ethereum_disc_topic_register_idx, packet_tvb,
-                      rlp->data_offset, rlp->byte_length, ENC_BIG_ENDIAN);
-
-  // Pong
-  rlp_next(packet_tvb, rlp->next_offset, rlp);
-  proto_tree_add_item(packet_tree, hf_ethereum_disc_topic_register_pong, packet_tvb,
-                      rlp->data_offset, rlp->byte_length, ENC_BIG_ENDIAN);
+  add_msg_items(packet_tvb, packet_tree, msg);
 
   // Enhance packet info with # of topics.
   char more_info[64];
-  g_snprintf(more_info, sizeof(more_info), " (%d topics)", i);
+  g_snprintf(more_info, sizeof(more_info), " (%d topics)", msg->topics.count);
   col_append_str(pinfo->cinfo, COL_INFO, more_info);
 
   return TRUE;
 }
 
 /**
- * Retrieves an existing conversation for this packet, or initialises a new one (and saves it).
+ * Releases the state of a conversation evicted from the stream LRU.
+ *
+ * @param entry The LRU entry of the state.
+ */
+static void free_stream_conversation(ethereum_lru_entry_t *entry) {
+  g_free(entry);
+}
+
+/**
+ * Initialises the Ethereum state of a conversation.
+ *
+ * @param ret The state to initialise.
+ */
+static void init_conversation(ethereum_disc_conv_t *ret) {
+  ret->total_count = 0;
+  ret->ping_count = 0;
+  ret->pong_count = 0;
+  ret->findnode_count = 0;
+  ret->topicquery_count = 0;
+  ret->nodes_count = 0;
+  ret->last_ping_frame = 0;
+  ret->last_ping_time = 0;
+  ret->last_topicquery_frame = 0;
+  ret->last_topicquery_time = 0;
+  ret->pending = NULL;
+}
+
+/**
+ * Retrieves the Ethereum state of a conversation, or initialises it (and saves it).
+ * In streaming mode, the state is looked up in the stream LRU, and may have been evicted since the last
+ * packet of the conversation, in which case it starts over.
  *
- * @param pinfo The packet.
+ * @param pinfo The packet info.
+ * @param conversation The conversation this packet belongs to.
  * @return A ready-to-use conversation struct.
  */
-static ethereum_disc_conv_t *get_conversation(packet_info *pinfo) {
-  conversation_t *conversation;
+static ethereum_disc_conv_t *get_conversation(packet_info *pinfo, conversation_t *conversation) {
   ethereum_disc_conv_t *ret;
 
-  conversation = find_or_create_conversation(pinfo);
+  if (ethereum_disc_streaming) {
+    ethereum_disc_stream_conv_t *sc;
+    sc = (ethereum_disc_stream_conv_t *) ethereum_lru_lookup(&stream_convs, &conversation->conv_index,
+                                                             &pinfo->abs_ts);
+    if (!sc) {
+      sc = g_new0(ethereum_disc_stream_conv_t, 1);
+      sc->conv_index = conversation->conv_index;
+      init_conversation(&sc->conv);
+      sc->conv.pending = sc->pending;
+      ethereum_lru_insert(&stream_convs, &sc->lru, &sc->conv_index, sizeof(*sc), &pinfo->abs_ts);
+    }
+    return &sc->conv;
+  }
+
   ret = (ethereum_disc_conv_t *) conversation_get_proto_data(conversation, proto_ethereum);
 
   if (!ret) {
     ret = wmem_new(wmem_file_scope(), ethereum_disc_conv_t);
-    ret->total_count = 0;
-    ret->ping_count = 0;
-    ret->pong_count = 0;
-    ret->findnode_count = 0;
-    ret->topicquery_count = 0;
-    ret->nodes_count = 0;
-    ret->last_ping_frame = 0;
-    ret->last_ping_time = unset_time;
-    ret->last_findnode_frame = 0;
-    ret->last_findnode_time = unset_time;
-    ret->last_topicquery_frame = 0;
-    ret->last_topicquery_time = unset_time;
-    ret->corr = wmem_map_new(wmem_file_scope(), g_direct_hash, g_direct_equal);
+    init_conversation(ret);
     conversation_add_proto_data(conversation, proto_ethereum, ret);
   }
   return ret;
@@ -792,254 +1868,1847 @@ static ethereum_disc_stat_t *init_disc_stat(void) {
   st->packet_type = UNKNOWN;
   st->rq_time = unset_time;
   st->node_count = 0;
+  st->hash = NULL;
+  st->evicted = 0;
+  st->new_nodes = 0;
+  st->moved_nodes = 0;
+  st->sender_id = NULL;
+  st->distances = NULL;
+  st->distance_count = 0;
+  st->duplicate = FALSE;
+  st->seq = 0;
+  st->seqtype = 0;
+  st->request_type = UNKNOWN;
+  st->msg = NULL;
   return st;
 }
 
 /**
- * Performs the dissection of a discovery packet.
+ * Opens the sidecar of the capture file upon the first discovery v4 packet of the first pass. The capture
+ * file is identified by the Keccak-256 of that packet, along with its frame number and timestamp; each
+ * record is further checked against the message hash of its frame.
  *
  * @param tvb The buffer containing the UDP datagram.
  * @param pinfo The packet info.
- * @param tree The protocol tree to populate.
- * @param data Extra data.
- * @return TRUE if successful, FALSE otherwise.
  */
-static int dissect_ethereum(tvbuff_t *tvb,
-                            packet_info *pinfo,
-                            proto_tree *tree,
-                            void *data _U_) {
-  proto_tree *ethereum_tree, *packet_tree;
-  proto_item *ti;
-  tvbuff_t *packet_tvb;
-  ethereum_disc_stat_t *st;
-  ethereum_disc_conv_t *conv;
-  ethereum_disc_enhanced_data_t *efdata;
-  const gchar *packet_type_desc;
-  rlp_element_t rlp;
+static void open_sidecar(tvbuff_t *tvb, packet_info *pinfo) {
+  guint8 identity[ETHEREUM_KECCAK256_LEN];
+  guint len = tvb_captured_length(tvb);
+  guint8 *buf;
+
+  // In streaming mode, frames are not dissected again, and live captures are not reopened.
+  if (sidecar_opened || PINFO_FD_VISITED(pinfo) || ethereum_disc_streaming ||
+      !ethereum_disc_sidecar_dir || !*ethereum_disc_sidecar_dir) {
+    return;
+  }
+  sidecar_opened = TRUE;
+  buf = (guint8 *) wmem_alloc(wmem_packet_scope(), 16 + len);
+  phton32(buf, pinfo->num);
+  phton64(buf + 4, (guint64) pinfo->abs_ts.secs);
+  phton32(buf + 12, (guint32) pinfo->abs_ts.nsecs);
+  tvb_memcpy(tvb, buf + 16, 0, len);
+  ethereum_keccak256(buf, 16 + len, identity);
+  sidecar = ethereum_sidecar_open(ethereum_disc_sidecar_dir, identity);
+}
 
-  static packet_processor *processors[] = {
-      [PING] = &process_ping_msg,
-      [PONG] = &process_pong_msg,
-      [FIND_NODE] = &process_findnode_msg,
-      [NODES] = &process_nodes_msg
-  };
+/**
+ * Retrieves the sidecar record of a discovery v4 packet.
+ *
+ * @param tvb The buffer containing the UDP datagram.
+ * @param pinfo The packet info.
+ * @return The record, or NULL if there is none or sidecar files are disabled.
+ */
+static const ethereum_sidecar_record_t *get_sidecar_record(tvbuff_t *tvb, packet_info *pinfo) {
+  if (!sidecar) {
+    return NULL;
+  }
+  return ethereum_sidecar_lookup(sidecar, pinfo->num, tvb_get_ptr(tvb, 0, ETHEREUM_SIDECAR_CHECK_LEN));
+}
 
-  st = init_disc_stat();
-  conv = get_conversation(pinfo);
+/**
+ * Records the results of the cryptographic checks of a discovery v4 packet in the sidecar, if any.
+ *
+ * @param tvb The buffer containing the UDP datagram.
+ * @param pinfo The packet info.
+ * @param flags The ETHEREUM_SIDECAR_* flags of the results.
+ * @param sender_id The recovered node ID, if any.
+ */
+static void add_sidecar_record(tvbuff_t *tvb, packet_info *pinfo, guint32 flags, const guint8 *sender_id) {
+  if (sidecar) {
+    ethereum_sidecar_add(sidecar, pinfo->num, tvb_get_ptr(tvb, 0, ETHEREUM_SIDECAR_CHECK_LEN), flags, sender_id);
+  }
+}
 
-  col_set_str(pinfo->cinfo, COL_PROTOCOL, "Ethereum");
-  col_clear(pinfo->cinfo, COL_INFO);
+/**
+ * Runs a job on a crypto worker thread.
+ *
+ * @param data The job.
+ * @param user_data Unused.
+ */
+static void run_crypto_job(gpointer data, gpointer user_data _U_) {
+  ethereum_disc_crypto_job_t *job = (ethereum_disc_crypto_job_t *) data;
+  ethereum_disc_crypto_result_t *result = job->result;
+  guint8 digest[ETHEREUM_KECCAK256_LEN];
+
+  if (g_atomic_int_get(&crypto_cancelled)) {
+    g_free(job);
+    return;
+  }
+  if (job->verify_hash) {
+    ethereum_keccak256(job->data + ETHEREUM_DISC_HASH_LEN, job->len - ETHEREUM_DISC_HASH_LEN, digest);
+    result->hash_valid = memcmp(digest, job->data, ETHEREUM_DISC_HASH_LEN) == 0;
+  }
+  if (job->recover_sender) {
+    ethereum_keccak256(job->data + ETHEREUM_DISC_PACKET_TYPE_IDX, job->len - ETHEREUM_DISC_PACKET_TYPE_IDX, digest);
+    result->sender_valid = ethereum_secp256k1_recover(digest, job->data + ETHEREUM_DISC_HASH_LEN,
+                                                      result->sender_id);
+  }
+  g_atomic_int_set(&result->ready, 1);
+  g_free(job);
+}
+
+/**
+ * Retrieves the crypto result of a frame.
+ *
+ * @param frame The frame number.
+ * @param create TRUE to allocate the result if needed (dissector thread only).
+ * @return The result, or NULL if it doesn't exist and create is FALSE.
+ */
+static ethereum_disc_crypto_result_t *get_crypto_result(guint32 frame, gboolean create) {
+  guint chunk = frame >> ETHEREUM_DISC_FRAME_CHUNK_BITS;
+
+  if (chunk >= crypto_chunks_len) {
+    guint len;
+    if (!create) {
+      return NULL;
+    }
+    len = MAX(MAX(crypto_chunks_len * 2, chunk + 1), 64);
+    crypto_chunks = (ethereum_disc_crypto_result_t **) g_realloc(crypto_chunks, len * sizeof(*crypto_chunks));
+    memset(crypto_chunks + crypto_chunks_len, 0, (len - crypto_chunks_len) * sizeof(*crypto_chunks));
+    crypto_chunks_len = len;
+  }
+  if (!crypto_chunks[chunk]) {
+    if (!create) {
+      return NULL;
+    }
+    crypto_chunks[chunk] = g_new0(ethereum_disc_crypto_result_t, ETHEREUM_DISC_FRAME_CHUNK_SIZE);
+  }
+  return &crypto_chunks[chunk][frame & (ETHEREUM_DISC_FRAME_CHUNK_SIZE - 1)];
+}
+
+/**
+ * Retrieves the crypto result of a frame, if a job was submitted for it.
+ *
+ * @param frame The frame number.
+ * @param ready Set to TRUE if the result is ready; FALSE if the job is still pending.
+ * @return The result, or NULL if no job was submitted for the frame.
+ */
+static const ethereum_disc_crypto_result_t *lookup_crypto_result(guint32 frame, gboolean *ready) {
+  const ethereum_disc_crypto_result_t *result = get_crypto_result(frame, FALSE);
+
+  if (!result || !result->submitted) {
+    return NULL;
+  }
+  *ready = g_atomic_int_get(&result->ready) != 0;
+  return result;
+}
+
+/**
+ * Hands the cryptographic checks of a discovery v4 packet over to the crypto workers, during the first pass.
+ * Later passes pick the result up from the result table, without waiting for it. Only the checks whose results
+ * are consumed are submitted, under the same conditions as the inline ones.
+ *
+ * @param tvb The buffer containing the UDP datagram.
+ * @param pinfo The packet info.
+ * @param tree The protocol tree, or NULL if none is built.
+ */
+static void submit_crypto_job(tvbuff_t *tvb, packet_info *pinfo, proto_tree *tree) {
+  const ethereum_sidecar_record_t *record;
+  ethereum_disc_crypto_result_t *result;
+  ethereum_disc_crypto_job_t *job;
+  guint len = tvb_captured_length(tvb);
+  gboolean verify_hash, recover_sender;
+
+  // Truncated datagrams can't be checked; in streaming mode, frames are not dissected again.
+  if (ethereum_disc_crypto_workers == 0 || ethereum_disc_streaming ||
+      (!ethereum_disc_verify_hash && !ethereum_disc_recover_sender) ||
+      PINFO_FD_VISITED(pinfo) || len != tvb_reported_length(tvb)) {
+    return;
+  }
+  // Checks found in the sidecar needn't run again.
+  record = get_sidecar_record(tvb, pinfo);
+  verify_hash = ethereum_disc_verify_hash && (tree || have_tap_listener(expert_tap)) &&
+                !(record && (record->flags & ETHEREUM_SIDECAR_HASH_CHECKED));
+  recover_sender = ethereum_disc_recover_sender &&
+                   ((tree && proto_field_is_referenced(tree, hf_ethereum_disc_sender_id)) ||
+                    (graph_taps > 0 && tvb_get_guint8(tvb, ETHEREUM_DISC_PACKET_TYPE_IDX) == NODES)) &&
+                   !(record && (record->flags & ETHEREUM_SIDECAR_SENDER_CHECKED));
+  if (!verify_hash && !recover_sender) {
+    return;
+  }
+  if (!crypto_pool) {
+    crypto_pool = g_thread_pool_new(run_crypto_job, NULL, (gint) ethereum_disc_crypto_workers, FALSE, NULL);
+    if (!crypto_pool) {
+      return;
+    }
+  }
+  result = get_crypto_result(pinfo->num, TRUE);
+  if (result->submitted) {
+    return;
+  }
+
+  job = (ethereum_disc_crypto_job_t *) g_malloc(sizeof(*job) + len);
+  job->result = result;
+  job->verify_hash = verify_hash;
+  job->recover_sender = recover_sender;
+  job->len = len;
+  tvb_memcpy(tvb, job->data, 0, len);
+  result->submitted = TRUE;
+  g_thread_pool_push(crypto_pool, job, NULL);
+}
+
+/**
+ * Stops the crypto workers, dropping the queued jobs, and releases the result table.
+ */
+static void reset_crypto_workers(void) {
+  guint i;
+
+  if (crypto_pool) {
+    g_atomic_int_set(&crypto_cancelled, 1);
+    g_thread_pool_free(crypto_pool, FALSE, TRUE);
+    g_atomic_int_set(&crypto_cancelled, 0);
+    crypto_pool = NULL;
+  }
+  for (i = 0; i < crypto_chunks_len; i++) {
+    g_free(crypto_chunks[i]);
+  }
+  g_free(crypto_chunks);
+  crypto_chunks = NULL;
+  crypto_chunks_len = 0;
+}
+
+/**
+ * Verifies the message hash of a discovery v4 packet, i.e. the Keccak-256 of the rest of the datagram
+ * (signature, packet type and packet data), and reports the result. The result is cached in the frame
+ * record, so the digest is computed at most once per frame, and in the sidecar, if any, so it is not
+ * computed again when the capture file is reopened.
+ *
+ * @param tvb The buffer containing the UDP datagram.
+ * @param pinfo The packet info.
+ * @param hash_item The tree item of the message hash.
+ * @param efdata The enhanced frame data of the packet.
+ */
+static void verify_msg_hash(tvbuff_t *tvb, packet_info *pinfo, proto_item *hash_item,
+                            ethereum_disc_enhanced_data_t *efdata) {
+  const ethereum_sidecar_record_t *record;
+  const ethereum_disc_crypto_result_t *result;
+  guint8 digest[ETHEREUM_KECCAK256_LEN];
+  guint len = tvb_captured_length(tvb);
+  proto_item *ti;
+  gboolean valid, ready;
+
+  if (!(efdata->flags & ETHEREUM_DISC_FRAME_HASH_CHECKED)) {
+    // Datagrams truncated by the capture can't be verified.
+    if (len != tvb_reported_length(tvb)) {
+      return;
+    }
+    record = get_sidecar_record(tvb, pinfo);
+    if (record && (record->flags & ETHEREUM_SIDECAR_HASH_CHECKED)) {
+      valid = (record->flags & ETHEREUM_SIDECAR_HASH_VALID) != 0;
+    } else {
+      result = lookup_crypto_result(pinfo->num, &ready);
+      if (result && !ready) {
+        return;
+      }
+      if (result) {
+        valid = result->hash_valid;
+      } else {
+        ethereum_keccak256(tvb_get_ptr(tvb, ETHEREUM_DISC_HASH_LEN, len - ETHEREUM_DISC_HASH_LEN),
+                           len - ETHEREUM_DISC_HASH_LEN, digest);
+        valid = tvb_memeql(tvb, 0, digest, ETHEREUM_DISC_HASH_LEN) == 0;
+      }
+      add_sidecar_record(tvb, pinfo, ETHEREUM_SIDECAR_HASH_CHECKED | (valid ? ETHEREUM_SIDECAR_HASH_VALID : 0),
+                         NULL);
+    }
+    if (valid) {
+      efdata->flags |= ETHEREUM_DISC_FRAME_HASH_VALID;
+    }
+    efdata->flags |= ETHEREUM_DISC_FRAME_HASH_CHECKED;
+  }
+
+  valid = (efdata->flags & ETHEREUM_DISC_FRAME_HASH_VALID) != 0;
+  ti = proto_tree_add_boolean(proto_item_add_subtree(hash_item, ett_ethereum_disc_hash),
+                              hf_ethereum_disc_msg_hash_valid, tvb, 0, ETHEREUM_DISC_HASH_LEN, valid);
+  PROTO_ITEM_SET_GENERATED(ti);
+  if (!valid) {
+    expert_add_info(pinfo, hash_item, &ei_ethereum_disc_hash_mismatch);
+  }
+}
+
+/**
+ * Hashes a key of the sender recovery cache. Digests are uniformly distributed, so their first bytes will do.
+ */
+static guint sender_hash_func(gconstpointer key) {
+  return pntoh32(key);
+}
+
+/**
+ * Compares two keys of the sender recovery cache.
+ */
+static gboolean sender_equal_func(gconstpointer a, gconstpointer b) {
+  return memcmp(a, b, sizeof(((ethereum_disc_sender_t *) NULL)->key)) == 0;
+}
+
+/**
+ * Releases a sender evicted from the sender recovery cache.
+ *
+ * @param entry The LRU entry of the sender.
+ */
+static void free_sender(ethereum_lru_entry_t *entry) {
+  g_free(entry);
+}
+
+/**
+ * Recovers the sender of a discovery v4 packet from its signature over the Keccak-256 of the packet type
+ * and data. ECDSA recovery is costly, so the senders are cached by signed digest and signature, which spares
+ * the recovery upon redissections and retransmissions. The message hash isn't used as the key: it is not
+ * covered by the signature, so a forged packet could reuse the hash of another one to be attributed its sender.
+ *
+ * @param tvb The buffer containing the UDP datagram.
+ * @param pinfo The packet info.
+ * @return The sender, or NULL if the datagram was truncated by the capture.
+ */
+static const ethereum_disc_sender_t *recover_sender(tvbuff_t *tvb, packet_info *pinfo) {
+  guint8 key[ETHEREUM_KECCAK256_LEN + ETHEREUM_DISC_SIGNATURE_LEN];
+  guint len = tvb_captured_length(tvb);
+  ethereum_disc_sender_t *sender;
+
+  if (len != tvb_reported_length(tvb)) {
+    return NULL;
+  }
+  ethereum_keccak256(tvb_get_ptr(tvb, ETHEREUM_DISC_PACKET_TYPE_IDX, len - ETHEREUM_DISC_PACKET_TYPE_IDX),
+                     len - ETHEREUM_DISC_PACKET_TYPE_IDX, key);
+  tvb_memcpy(tvb, key + ETHEREUM_KECCAK256_LEN, ETHEREUM_DISC_HASH_LEN, ETHEREUM_DISC_SIGNATURE_LEN);
+  sender = (ethereum_disc_sender_t *) ethereum_lru_lookup(&sender_cache, key, &pinfo->abs_ts);
+  if (!sender) {
+    sender = g_new0(ethereum_disc_sender_t, 1);
+    memcpy(sender->key, key, sizeof(key));
+    sender->valid = ethereum_secp256k1_recover(key, key + ETHEREUM_KECCAK256_LEN, sender->id);
+    ethereum_lru_insert(&sender_cache, &sender->lru, sender->key, sizeof(*sender), &pinfo->abs_ts);
+  }
+  return sender;
+}
+
+/**
+ * Retrieves the node ID of the sender of a discovery v4 packet, from the sidecar, the crypto workers or the
+ * sender recovery cache, recovering it if needed.
+ *
+ * @param tvb The buffer containing the UDP datagram.
+ * @param pinfo The packet info.
+ * @param wait TRUE to recover the sender inline if the crypto workers are not done with it yet.
+ * @param valid Set to FALSE if no node ID could be recovered from the signature.
+ * @return The node ID (meaningless unless valid), or NULL if it is pending or the datagram was truncated.
+ */
+static const guint8 *get_sender_id(tvbuff_t *tvb, packet_info *pinfo, gboolean wait, gboolean *valid) {
+  const ethereum_sidecar_record_t *record;
+  const ethereum_disc_crypto_result_t *result;
+  const ethereum_disc_sender_t *sender;
+  const guint8 *id;
+  gboolean ready;
+
+  // A sender found in the sidecar or recovered by the crypto workers, if any, saves the lookup in the cache.
+  record = get_sidecar_record(tvb, pinfo);
+  if (record && (record->flags & ETHEREUM_SIDECAR_SENDER_CHECKED)) {
+    *valid = (record->flags & ETHEREUM_SIDECAR_SENDER_VALID) != 0;
+    return record->sender_id;
+  }
+  result = lookup_crypto_result(pinfo->num, &ready);
+  if (result && !ready && !wait) {
+    return NULL;
+  }
+  if (result && ready) {
+    *valid = result->sender_valid;
+    id = result->sender_id;
+  } else {
+    sender = recover_sender(tvb, pinfo);
+    if (!sender) {
+      return NULL;
+    }
+    *valid = sender->valid;
+    id = sender->id;
+  }
+  add_sidecar_record(tvb, pinfo, ETHEREUM_SIDECAR_SENDER_CHECKED | (*valid ? ETHEREUM_SIDECAR_SENDER_VALID : 0),
+                     *valid ? id : NULL);
+  return id;
+}
+
+/**
+ * Adds the node ID of the sender of a discovery v4 packet, if it is displayed or filtered on.
+ *
+ * @param tvb The buffer containing the UDP datagram.
+ * @param pinfo The packet info.
+ * @param tree The tree of the message.
+ * @param sig_item The tree item of the signature.
+ */
+static void add_sender_id(tvbuff_t *tvb, packet_info *pinfo, proto_tree *tree, proto_item *sig_item) {
+  const ethereum_peer_t *peer;
+  const guint8 *id;
+  gboolean valid;
+  proto_item *ti;
+
+  if (!tree || !proto_field_is_referenced(tree, hf_ethereum_disc_sender_id)) {
+    return;
+  }
+  id = get_sender_id(tvb, pinfo, FALSE, &valid);
+  if (!id) {
+    return;
+  }
+  if (!valid) {
+    expert_add_info(pinfo, sig_item, &ei_ethereum_disc_bad_signature);
+    return;
+  }
+  ti = proto_tree_add_bytes(tree, hf_ethereum_disc_sender_id, tvb, ETHEREUM_DISC_HASH_LEN,
+                            ETHEREUM_DISC_SIGNATURE_LEN, id);
+  PROTO_ITEM_SET_GENERATED(ti);
+
+  // What the NODES packets of the capture tell about the sender, whatever its current address.
+  peer = ethereum_peer_table_lookup(&peer_table, id);
+  if (peer) {
+    add_peer_info(proto_item_add_subtree(ti, ett_ethereum_disc_peer), tvb, ETHEREUM_DISC_HASH_LEN, peer);
+  }
+}
+
+// The wire format of a version of the discovery protocol.
+typedef struct _ethereum_disc_version {
+  gboolean is_discv5;
+  const gchar *info;  // The prefix of the info column.
+  guint sig_offset;   // The offset of the signature.
+  guint type_idx;     // The offset of the packet type.
+  guint data_start;   // The offset of the packet payload.
+} ethereum_disc_version_t;
+
+static const ethereum_disc_version_t discv4 = {
+    FALSE, "Discovery v4 message: ", ETHEREUM_DISC_HASH_LEN, ETHEREUM_DISC_PACKET_TYPE_IDX,
+    ETHEREUM_DISC_PACKET_DATA_START
+};
+
+static const ethereum_disc_version_t discv5 = {
+    TRUE, "Discovery v5 message: ", sizeof(ETHEREUM_DISCV5_ID_STR) - 1, ETHEREUM_DISCV5_PACKET_TYPE_IDX,
+    ETHEREUM_DISCV5_PACKET_DATA_START
+};
+
+/**
+ * Performs the dissection of a discovery packet.
+ *
+ * @param tvb The buffer containing the UDP datagram.
+ * @param pinfo The packet info.
+ * @param tree The protocol tree to populate.
+ * @param conversation The conversation this packet belongs to.
+ * @param version The version of the discovery protocol.
+ * @return TRUE if successful, FALSE otherwise.
+ */
+static int dissect_ethereum(tvbuff_t *tvb,
+                            packet_info *pinfo,
+                            proto_tree *tree,
+                            conversation_t *conversation,
+                            const ethereum_disc_version_t *version) {
+  proto_tree *ethereum_tree, *packet_tree;
+  proto_item *ti, *hash_item = NULL, *sig_item;
+  tvbuff_t *packet_tvb;
+  ethereum_disc_stat_t *st;
+  ethereum_disc_conv_t *conv;
+  ethereum_disc_enhanced_data_t *efdata;
+  const gchar *packet_type_desc;
+  const schema_t *schema;
+  guint32 original_frame;
+  rlp_index_t idx;
+  const ethereum_disc_msg_t *msg = NULL;
+  gboolean full;
+
+  // The message schemas tell which packet types each version has.
+  static packet_processor *processors[] = {
+      [PING] = &process_ping_msg,
+      [PONG] = &process_pong_msg,
+      [FIND_NODE] = &process_findnode_msg,
+      [NODES] = &process_nodes_msg,
+      // By using process_findnode_msg for FIND_NODEHASH, we avoid duplication and get correctly linking of
+      // either of them to the NODES response.
+      [FIND_NODEHASH] = &process_findnode_msg,
+      [TOPIC_REGISTER] = &process_topic_register_msg,
+      [TOPIC_QUERY] = &process_topic_query_msg,
+      [TOPIC_NODES] = &process_topic_nodes_msg,
+  };
+
+  st = init_disc_stat();
+  conv = get_conversation(pinfo, conversation);
+
+  col_set_str(pinfo->cinfo, COL_PROTOCOL, "Ethereum");
+  col_clear(pinfo->cinfo, COL_INFO);
+
+  // Build the protocol tree.
+  tree = proto_tree_add_item(tree, proto_ethereum, tvb, 0, -1, ENC_NA);
+  ethereum_tree = proto_item_add_subtree(tree, ett_ethereum_disc_toplevel);
+
+  // Message hash (discovery v4 only) and signature.
+  if (!version->is_discv5) {
+    hash_item = proto_tree_add_item(ethereum_tree, hf_ethereum_disc_msg_hash, tvb, 0, ETHEREUM_DISC_HASH_LEN,
+                                    ENC_BIG_ENDIAN);
+  }
+  sig_item = proto_tree_add_item(ethereum_tree, hf_ethereum_disc_msg_sig, tvb, version->sig_offset,
+                                 ETHEREUM_DISC_SIGNATURE_LEN, ENC_BIG_ENDIAN);
+
+  // Cryptographic checks run in the background during the first pass when crypto workers are enabled;
+  // until they're done, the frame is marked as pending. Those of earlier openings are in the sidecar.
+  if (!version->is_discv5) {
+    open_sidecar(tvb, pinfo);
+    submit_crypto_job(tvb, pinfo, tree);
+    if (crypto_chunks) {
+      gboolean ready;
+      if (lookup_crypto_result(pinfo->num, &ready) && !ready) {
+        ti = proto_tree_add_boolean(ethereum_tree, hf_ethereum_disc_crypto_pending, tvb, 0, 0, TRUE);
+        PROTO_ITEM_SET_GENERATED(ti);
+      }
+    }
+    if (ethereum_disc_recover_sender) {
+      add_sender_id(tvb, pinfo, ethereum_tree, sig_item);
+    }
+  }
+
+  // Packet type.
+  guint packet_type = tvb_get_guint8(tvb, version->type_idx);
+  proto_tree_add_item(ethereum_tree, hf_ethereum_disc_packet_type, tvb, version->type_idx, 1, ENC_BIG_ENDIAN);
+  st->packet_type = (packet_type_e) packet_type;
+
+  if (!version->is_discv5) {
+    st->hash = tvb_get_ptr(tvb, 0, ETHEREUM_DISC_HASH_LEN);
+
+    // A message already carried by an earlier frame (mirrored ports, merged captures, retransmitted datagrams)
+    // is flagged, and otherwise ignored: it doesn't update the state, and isn't counted in the statistics.
+    original_frame = get_original_frame(st->hash, pinfo->num, !PINFO_FD_VISITED(pinfo));
+    st->duplicate = original_frame && original_frame != pinfo->num;
+    if (st->duplicate) {
+      ti = proto_tree_add_uint(ethereum_tree, hf_ethereum_disc_duplicate_of, tvb, 0, ETHEREUM_DISC_HASH_LEN,
+                               original_frame);
+      PROTO_ITEM_SET_GENERATED(ti);
+      expert_add_info_format(pinfo, ti, &ei_ethereum_disc_duplicate, "Duplicate of frame %u", original_frame);
+    }
+
+    // Graph taps link NODES packets to their sender, identified by node ID where it can be recovered.
+    if (graph_taps > 0 && packet_type == NODES && ethereum_disc_recover_sender && !st->duplicate) {
+      gboolean valid;
+      const guint8 *id = get_sender_id(tvb, pinfo, TRUE, &valid);
+      st->sender_id = id && valid ? id : NULL;
+    }
+  }
+
+  // Packet subtree, until the end.
+  packet_type_desc = val_to_str(packet_type, packet_type_names, "(Unknown packet ID: %d)");
+  ti = proto_tree_add_string(ethereum_tree, hf_ethereum_disc_packet, tvb,
+                             version->data_start, -1, packet_type_desc);
+  packet_tree = proto_item_add_subtree(ti, ett_ethereum_disc_packetdata);
+
+  packet_tvb = tvb_new_subset_remaining(tvb, version->data_start);
+
+  // Index the whole payload in one pass, and assert we have a top level RLP list.
+  if (!rlp_index_build(wmem_packet_scope(), packet_tvb, 0, &idx) || idx.entries[0].type != LIST) {
+    return FALSE;
+  }
+
+  col_append_str(pinfo->cinfo, COL_INFO, version->info);
+  col_append_str(pinfo->cinfo, COL_INFO, packet_type_desc);
+  if (st->duplicate) {
+    col_append_str(pinfo->cinfo, COL_INFO, " [Duplicate]");
+  }
+
+  // Sanity check.
+  schema = get_schema(packet_type, version->is_discv5);
+  if (!schema || packet_type >= G_N_ELEMENTS(processors) || processors[packet_type] == NULL) {
+    return FALSE;
+  }
+
+  // Decode the message once; the tree, the correlation and the taps all work off it. Without a tree nor a tap,
+  // the correlation only needs the values, and the node records are only decoded for the peer table during the
+  // first pass. The processors don't run on duplicates then.
+  if (!st->duplicate || ethereum_tree) {
+    full = ethereum_tree || have_tap_listener(ethereum_tap) ||
+           (!ethereum_disc_streaming && updates_state(pinfo, st) &&
+            (packet_type == NODES || packet_type == TOPIC_NODES));
+    msg = decode_msg(packet_tvb, &idx, st->packet_type, version->is_discv5, schema, full);
+    st->msg = msg;
+  }
+
+  // Fill in the frame record upon the first dissection of the frame. In streaming mode, frames are
+  // dissected once, so the record doesn't outlive the packet.
+  efdata = ethereum_disc_streaming ? wmem_new0(wmem_packet_scope(), ethereum_disc_enhanced_data_t)
+                                   : get_frame_data(pinfo->num);
+  if (!st->duplicate) {
+    if (!efdata->seq && !PINFO_FD_VISITED(pinfo)) {
+      efdata->seq = ++conv->total_count;
+    }
+    ti = proto_tree_add_uint(proto_tree_get_parent_tree(packet_tree), hf_ethereum_disc_seq,
+                             packet_tvb, 0, 0, efdata->seq);
+    PROTO_ITEM_SET_GENERATED(ti);
+  }
+
+  if (ethereum_disc_streaming) {
+    st->evicted = (guint) MIN(stream_convs.evicted, G_MAXUINT32);
+    ti = proto_tree_add_uint(proto_tree_get_parent_tree(packet_tree), hf_ethereum_disc_evicted,
+                             packet_tvb, 0, 0, st->evicted);
+    PROTO_ITEM_SET_GENERATED(ti);
+  }
+
+  // The message hash is only displayed, filtered on and reported as expert info, so it isn't verified when none of
+  // those is wanted (e.g. tshark running taps only).
+  if (!version->is_discv5 && ethereum_disc_verify_hash && (tree || have_tap_listener(expert_tap))) {
+    verify_msg_hash(tvb, pinfo, hash_item, efdata);
+  }
+
+  // Without a tree (first pass, tshark without -V, taps only), the processors only update the
+  // conversation state, the correlation and the tap data. Duplicates leave the state alone, so their
+  // payload is only decoded for display.
+  if (msg) {
+    processors[packet_type](packet_tvb, packet_tree, pinfo, msg, st, conv, efdata);
+  }
+  st->seq = efdata->seq;
+  st->seqtype = efdata->seqtype;
+  tap_queue_packet(ethereum_tap, pinfo, st);
+  return TRUE;
+}
+
+/**
+ * Checks that the payload of a discovery packet is well-formed, as ethereum_disc_valid_payload(). Only the
+ * captured part of datagrams truncated by the capture is checked, as ethereum_disc_valid_truncated_payload(); their
+ * dissection stops with the usual exception where the data runs out.
+ *
+ * @param tvb The buffer containing the UDP datagram.
+ * @param offset The offset at which the packet payload starts.
+ * @return TRUE if the payload is valid; FALSE otherwise.
+ */
+static gboolean is_valid_packet_payload(tvbuff_t *tvb, guint offset) {
+  guint len = tvb_captured_length(tvb);
+  guint reported_len = tvb_reported_length(tvb);
+
+  if (len != reported_len) {
+    return ethereum_disc_valid_truncated_payload(tvb_get_ptr(tvb, 0, len), len, reported_len, offset);
+  }
+  return ethereum_disc_valid_payload(tvb_get_ptr(tvb, 0, len), len, offset);
+}
+
+/**
+ * Performs the cheap checks on a datagram, as ethereum_disc_check_header().
+ *
+ * @param tvb The buffer containing the UDP datagram.
+ * @param is_discv5 Set to TRUE if this is a discovery v5 datagram.
+ * @return TRUE if the datagram passes the checks; FALSE otherwise.
+ */
+static gboolean check_packet_header(tvbuff_t *tvb, gboolean *is_discv5) {
+  guint len = tvb_captured_length(tvb);
+
+  if (len < MIN_ETHDEVP2PDISCO_LEN || len > MAX_ETHDEVP2PDISCO_LEN) {
+    return FALSE;
+  }
+  // The header is captured; the length bounds apply to the datagram as it was sent.
+  return ethereum_disc_check_header(tvb_get_ptr(tvb, 0, len), tvb_reported_length(tvb), is_discv5);
+}
+
+/**
+ * Dissects a datagram already identified as discovery traffic, catching any exception along the way.
+ *
+ * @param tvb The buffer containing the UDP datagram.
+ * @param pinfo The packet info.
+ * @param tree The protocol tree to populate.
+ * @param conversation The conversation this packet belongs to.
+ * @param is_discv5 TRUE if this is a discovery v5 datagram.
+ */
+static void dissect_ethereum_safe(tvbuff_t *tvb, packet_info *pinfo, proto_tree *tree,
+                                  conversation_t *conversation, gboolean is_discv5) {
+  TRY {
+        dissect_ethereum(tvb, pinfo, tree, conversation, is_discv5 ? &discv5 : &discv4);
+      }
+      CATCH_NONFATAL_ERRORS {
+        show_exception(tvb, pinfo, tree, EXCEPT_CODE, GET_MESSAGE);
+      }
+  ENDTRY;
+}
+
+/**
+ * Computes the key of the UDP flow of a packet in the negative heuristics cache. The key is the same
+ * for both directions of the flow.
+ *
+ * @param pinfo The packet info.
+ * @return The flow key.
+ */
+static guint32 neg_cache_flow_key(packet_info *pinfo) {
+  guint32 src = add_address_to_hash(pinfo->srcport, &pinfo->src);
+  guint32 dst = add_address_to_hash(pinfo->destport, &pinfo->dst);
+  // Zero marks an empty slot.
+  return ((src ^ dst) * 0x9e3779b1) | 1;
+}
+
+/**
+ * Dissects a datagram on a conversation that was previously identified as discovery traffic. The
+ * structural heuristics are skipped; only the cheap header checks remain, so that other traffic on
+ * the same ports still falls through to other dissectors.
+ *
+ * @param tvb The buffer containing the UDP datagram.
+ * @param pinfo The packet info.
+ * @param tree The protocol tree to populate.
+ * @param data Extra data.
+ * @return The number of bytes consumed, or 0 if this is not a discovery datagram.
+ */
+static int dissect_ethereum_pinned(tvbuff_t *tvb, packet_info *pinfo, proto_tree *tree, void *data _U_) {
+  gboolean is_discv5;
+
+  if (!check_packet_header(tvb, &is_discv5)) {
+    return 0;
+  }
+  dissect_ethereum_safe(tvb, pinfo, tree, find_or_create_conversation(pinfo), is_discv5);
+  return tvb_captured_length(tvb);
+}
+
+/**
+ * Evaluates heuristics on a frame and performs the dissection only if there's a high probability
+ * that this is an Ethereum discovery message. Upon a positive match the conversation is pinned to
+ * this dissector, so that later packets of the flow skip the heuristics. Flows that repeatedly fail
+ * the heuristics are remembered in a bounded negative cache, and skipped from then on.
+ *
+ * @param tvb The buffer containing the UDP datagram.
+ * @param pinfo The packet info.
+ * @param tree The protocol tree to populate.
+ * @param data Extra data.
+ * @return TRUE if successful, FALSE otherwise.
+ */
+static gboolean dissect_ethereum_heur(tvbuff_t *tvb, packet_info *pinfo, proto_tree *tree, void *data _U_) {
+  conversation_t *conversation;
+  gboolean is_discv5;
+  guint32 flow_key;
+
+  // The length check is cheaper than the cache lookup.
+  if (tvb_captured_length(tvb) < MIN_ETHDEVP2PDISCO_LEN || tvb_captured_length(tvb) > MAX_ETHDEVP2PDISCO_LEN) {
+    return FALSE;
+  }
+
+  flow_key = neg_cache_flow_key(pinfo);
+  if (ethereum_disc_neg_cache_skip(neg_cache, flow_key)) {
+    return FALSE;
+  }
+
+  if (!check_packet_header(tvb, &is_discv5) ||
+      !is_valid_packet_payload(tvb, is_discv5 ? ETHEREUM_DISCV5_PACKET_DATA_START : ETHEREUM_DISC_PACKET_DATA_START)) {
+    // A datagram truncated by the capture tells little about its flow.
+    if (tvb_captured_length(tvb) == tvb_reported_length(tvb)) {
+      ethereum_disc_neg_cache_update(neg_cache, flow_key, TRUE);
+    }
+    return FALSE;
+  }
+  ethereum_disc_neg_cache_update(neg_cache, flow_key, FALSE);
+
+  // Attach ourselves to the conversation from this frame onwards.
+  conversation = find_or_create_conversation(pinfo);
+  conversation_set_dissector_from_frame_number(conversation, pinfo->num, ethereum_disc_dtor_handle);
+
+  dissect_ethereum_safe(tvb, pinfo, tree, conversation, is_discv5);
+  return TRUE;
+}
+
+/**
+ * Resets the dissector state whenever a capture file is opened or redissected.
+ */
+static void ethereum_disc_init(void) {
+  memset(neg_cache, 0, sizeof(neg_cache));
+  // The chunks and the targets were released along with the file scope.
+  frame_chunks = NULL;
+  frame_chunks_len = 0;
+  findnodes = NULL;
+  lookups = NULL;
+  lookup_count = 0;
+  ethereum_lru_clear(&stream_convs);
+  ethereum_lru_clear(&sender_cache);
+  reset_crypto_workers();
+  reset_dup_set();
+  sidecar_opened = FALSE;
+}
+
+/**
+ * Writes the sidecar out, if any, stops the crypto workers and releases the peer table and the duplicate
+ * detection set whenever a capture file is closed or redissected.
+ */
+static void ethereum_disc_cleanup(void) {
+  if (sidecar) {
+    ethereum_sidecar_close(sidecar);
+    sidecar = NULL;
+  }
+  ethereum_peer_table_clear(&peer_table);
+  reset_crypto_workers();
+  reset_dup_set();
+}
+
+/**
+ * Applies the preferences.
+ */
+static void ethereum_disc_prefs_apply(void) {
+  // Resize the running crypto workers; with 0 workers, no further jobs are submitted.
+  if (crypto_pool) {
+    g_thread_pool_set_max_threads(crypto_pool, (gint) MAX(ethereum_disc_crypto_workers, 1), NULL);
+  }
+  ethereum_lru_configure(&stream_convs, (gsize) ethereum_disc_streaming_budget * 1024 * 1024,
+                         ethereum_disc_streaming_ttl);
+}
+
+/**
+ * Returns the request/response pair of a response.
+ *
+ * @param request_type The type of the request answered by the response.
+ * @return The pair, or RT_PAIRS if the request type has no response.
+ */
+static rt_pair_e rt_pair_of(packet_type_e request_type) {
+  switch (request_type) {
+    case PING:
+      return RT_PING_PONG;
+    case FIND_NODE:
+      return RT_FIND_NODE_NODES;
+    case FIND_NODEHASH:
+      return RT_FIND_NODEHASH_NODES;
+    case TOPIC_QUERY:
+      return RT_TOPIC_QUERY_TOPIC_NODES;
+    default:
+      return RT_PAIRS;
+  }
+}
+
+/**
+ * Returns the response time of a response in microseconds.
+ *
+ * @param pinfo The packet info of the response.
+ * @param stat The statistics struct of the response.
+ * @return The response time, or 0 if the response predates the request.
+ */
+static guint64 rt_usecs(const packet_info *pinfo, const ethereum_disc_stat_t *stat) {
+  nstime_t rt;
+  nstime_delta(&rt, &pinfo->abs_ts, &stat->rq_time);
+  return rt.secs < 0 ? 0 : (guint64) rt.secs * 1000000 + (guint64) (rt.nsecs / 1000);
+}
+
+/**
+ * Formats the name of the peer that sent a response, i.e. its address and port.
+ *
+ * @param pinfo The packet info of the response.
+ * @param buf The buffer to format the name into.
+ * @param len The size of the buffer.
+ */
+static void rt_peer_name(packet_info *pinfo, gchar *buf, gsize len) {
+  g_snprintf(buf, (gulong) len, "%s:%u", address_to_str(wmem_packet_scope(), &pinfo->src), pinfo->srcport);
+}
+
+/**
+ * Initializes the statistics trees.
+ *
+ * @param st Statistics tree.
+ */
+static void ethereum_discovery_stats_tree_init(stats_tree *st) {
+  gchar name[16];
+  guint i;
+
+  st_node_packets = stats_tree_create_node(st, st_str_packets, 0, TRUE);
+  st_node_packet_types = stats_tree_create_pivot(st, st_str_packet_types, st_node_packets);
+  st_node_packet_nodes_count = stats_tree_create_range_node(st, st_str_packet_nodecount, 0,
+                                                            "0-5", "6-10", "11-", NULL);
+  st_node_rt_percentiles = stats_tree_create_node(st, st_str_rt_percentiles, 0, TRUE);
+  st_node_rt_peers = stats_tree_create_node(st, st_str_rt_peers, st_node_rt_percentiles, TRUE);
+
+  g_free(rt_hists);
+  g_free(rt_peers);
+  if (rt_peer_counts) {
+    g_hash_table_destroy(rt_peer_counts);
+  }
+  rt_hists = g_new0(ethereum_hist_t, RT_PAIRS);
+  rt_peers = g_new0(ethereum_disc_rt_peer_t, ETHEREUM_DISC_RT_PEERS);
+  rt_peer_counts = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+  for (i = 0; i < ETHEREUM_DISC_RT_PEERS; i++) {
+    g_snprintf(name, sizeof(name), "peer %u", i + 1);
+    rt_peers[i].node = stats_tree_create_node(st, name, st_node_rt_peers, TRUE);
+  }
+}
+
+/**
+ * Releases the response time histograms of the statistics tree.
+ *
+ * @param st Statistics tree.
+ */
+static void ethereum_discovery_stats_tree_cleanup(stats_tree *st _U_) {
+  g_free(rt_hists);
+  g_free(rt_peers);
+  if (rt_peer_counts) {
+    g_hash_table_destroy(rt_peer_counts);
+  }
+  rt_hists = NULL;
+  rt_peers = NULL;
+  rt_peer_counts = NULL;
+}
+
+/**
+ * Reports the count and the percentiles of a response time histogram under a node of the statistics tree.
+ *
+ * @param st The statistics tree.
+ * @param parent The parent node.
+ * @param pair The request/response pair of the histogram.
+ * @param hist The histogram.
+ */
+static void report_rt_percentiles(stats_tree *st, int parent, rt_pair_e pair, const ethereum_hist_t *hist) {
+  guint64 values[G_N_ELEMENTS(rt_percentiles)];
+  guint i;
+  int node;
+
+  node = stat_node_set(st, rt_pair_names[pair], parent, TRUE, (gint) MIN(hist->count, G_MAXINT32));
+  ethereum_hist_percentiles(hist, rt_percentiles, G_N_ELEMENTS(rt_percentiles), values);
+  for (i = 0; i < G_N_ELEMENTS(rt_percentiles); i++) {
+    stat_node_set(st, rt_percentile_names[i], node, FALSE, (gint) MIN(values[i], G_MAXINT32));
+  }
+}
+
+/**
+ * Counts a response of a peer, and finds its slot among the busiest peers. A peer takes a free slot, or the slot of
+ * the peer with the fewest responses once it has more responses than it, so the slots hold the peers with the most
+ * responses. The stats_tree API can't rename or remove a node, so the slots are fixed nodes, under which the address
+ * of the peer holding the slot carries its number of responses; that of the peer giving the slot up is zeroed, and
+ * the percentiles start over.
+ *
+ * @param st The statistics tree.
+ * @param name The address and port of the peer.
+ * @return The slot of the peer, or NULL if it isn't among the busiest peers.
+ */
+static ethereum_disc_rt_peer_t *get_rt_peer(stats_tree *st, const gchar *name) {
+  ethereum_disc_rt_peer_t *victim = NULL;
+  guint64 *count;
+  guint i;
+
+  count = (guint64 *) g_hash_table_lookup(rt_peer_counts, name);
+  if (!count) {
+    count = g_new0(guint64, 1);
+    g_hash_table_insert(rt_peer_counts, g_strdup(name), count);
+  }
+  (*count)++;
+
+  for (i = 0; i < ETHEREUM_DISC_RT_PEERS; i++) {
+    ethereum_disc_rt_peer_t *peer = &rt_peers[i];
+    if (strcmp(peer->name, name) == 0) {
+      peer->samples = *count;
+      return peer;
+    }
+    if (!victim || peer->samples < victim->samples) {
+      victim = peer;
+    }
+  }
+  if (victim->name[0] && victim->samples >= *count) {
+    return NULL;
+  }
+
+  if (victim->name[0]) {
+    memset(victim->hists, 0, sizeof(victim->hists));
+    for (i = 0; i < RT_PAIRS; i++) {
+      report_rt_percentiles(st, victim->node, (rt_pair_e) i, &victim->hists[i]);
+    }
+    stat_node_set(st, victim->name, victim->node, FALSE, 0);
+  }
+  g_strlcpy(victim->name, name, sizeof(victim->name));
+  victim->samples = *count;
+  return victim;
+}
+
+/**
+ * Records the response time of a response in the histograms of the statistics tree, and updates the affected
+ * percentiles.
+ *
+ * @param st The statistics tree.
+ * @param pinfo The packet info of the response.
+ * @param stat The statistics struct of the response.
+ */
+static void add_rt_sample(stats_tree *st, packet_info *pinfo, const ethereum_disc_stat_t *stat) {
+  ethereum_disc_rt_peer_t *peer;
+  gchar name[64], slot[16];
+  guint64 usecs;
+  rt_pair_e pair;
+
+  pair = rt_pair_of(stat->request_type);
+  if (pair == RT_PAIRS) {
+    return;
+  }
+  usecs = rt_usecs(pinfo, stat);
+
+  ethereum_hist_add(&rt_hists[pair], usecs);
+  report_rt_percentiles(st, st_node_rt_percentiles, pair, &rt_hists[pair]);
+
+  rt_peer_name(pinfo, name, sizeof(name));
+  peer = get_rt_peer(st, name);
+  if (!peer) {
+    return;
+  }
+  ethereum_hist_add(&peer->hists[pair], usecs);
+  g_snprintf(slot, sizeof(slot), "peer %u", (guint) (peer - rt_peers) + 1);
+  stat_node_set(st, slot, st_node_rt_peers, TRUE, (gint) MIN(peer->samples, G_MAXINT32));
+  stat_node_set(st, peer->name, peer->node, FALSE, (gint) MIN(peer->samples, G_MAXINT32));
+  report_rt_percentiles(st, peer->node, pair, &peer->hists[pair]);
+}
+
+/**
+ * Callback called by Wireshark whenever a stat is published on the tap.
+ *
+ * @param st The statistics tree.
+ * @param pinfo The packet info.
+ * @param edt Data about the dissection.
+ * @param p A pointer to the statistics struct.
+ * @return TRUE if successful; FALSE otherwise.
+ */
+static int ethereum_discovery_stats_tree_packet(stats_tree *st,
+                                                packet_info *pinfo,
+                                                epan_dissect_t *edt _U_,
+                                                const void *p) {
+  ethereum_disc_stat_t *stat = (ethereum_disc_stat_t *) p;
+  if (stat->duplicate) {
+    tick_stat_node(st, st_str_duplicates, 0, FALSE);
+    return TRUE;
+  }
+  tick_stat_node(st, st_str_packets, 0, FALSE);
+  stats_tree_tick_pivot(st, st_node_packet_types,
+                        val_to_str(stat->packet_type, packet_type_names, "Unknown packet type (%d)"));
+  if (stat->packet_type == NODES) {
+    stats_tree_tick_range(st, st_str_packet_nodecount, 0, stat->node_count);
+  }
+  if (ethereum_disc_streaming) {
+    stat_node_set(st, st_str_evicted, 0, FALSE, (gint) MIN(stat->evicted, G_MAXINT32));
+  }
+  if (!stat->is_request && stat->has_request && rt_hists) {
+    add_rt_sample(st, pinfo, stat);
+  }
+  return TRUE;
+}
+
+/**
+ * Initializes the per-peer response times statistics tree.
+ *
+ * @param st Statistics tree.
+ */
+static void ethereum_discovery_peer_rt_tree_init(stats_tree *st) {
+  st_node_peer_rt = stats_tree_create_node(st, st_str_peer_rt, 0, TRUE);
+}
+
+/**
+ * Callback called by Wireshark whenever a stat is published on the tap, to break the response times down
+ * per responding peer. Every update is a lookup by name in the children of a node, so the cost per packet
+ * doesn't depend on the number of peers.
+ *
+ * @param st The statistics tree.
+ * @param pinfo The packet info.
+ * @param edt Data about the dissection.
+ * @param p A pointer to the statistics struct.
+ * @return TRUE if successful; FALSE otherwise.
+ */
+static int ethereum_discovery_peer_rt_tree_packet(stats_tree *st,
+                                                  packet_info *pinfo,
+                                                  epan_dissect_t *edt _U_,
+                                                  const void *p) {
+  const ethereum_disc_stat_t *stat = (const ethereum_disc_stat_t *) p;
+  gchar name[64];
+  rt_pair_e pair;
+  int node;
+
+  if (stat->is_request || !stat->has_request || stat->duplicate) {
+    return FALSE;
+  }
+  pair = rt_pair_of(stat->request_type);
+  if (pair == RT_PAIRS) {
+    return FALSE;
+  }
+  rt_peer_name(pinfo, name, sizeof(name));
+  node = tick_stat_node(st, name, st_node_peer_rt, TRUE);
+  avg_stat_node_add_value(st, rt_pair_names[pair], node, FALSE, (gint) MIN(rt_usecs(pinfo, stat), G_MAXINT32));
+  return TRUE;
+}
+
+/**
+ * Initializes the node table statistics tree.
+ *
+ * @param st Statistics tree.
+ */
+static void ethereum_discovery_node_tree_init(stats_tree *st) {
+  st_node_node_ads = stats_tree_create_node(st, st_str_node_ads, 0, TRUE);
+}
+
+/**
+ * Callback called by Wireshark whenever a stat is published on the tap, to count the nodes advertised in
+ * NODES packets, as tracked by the peer table.
+ *
+ * @param st The statistics tree.
+ * @param pinfo The packet info.
+ * @param edt Data about the dissection.
+ * @param p A pointer to the statistics struct.
+ * @return TRUE if successful; FALSE otherwise.
+ */
+static int ethereum_discovery_node_tree_packet(stats_tree *st,
+                                               packet_info *pinfo _U_,
+                                               epan_dissect_t *edt _U_,
+                                               const void *p) {
+  const ethereum_disc_stat_t *stat = (const ethereum_disc_stat_t *) p;
+
+  if (stat->packet_type != NODES || ethereum_disc_streaming || stat->duplicate) {
+    return FALSE;
+  }
+  increase_stat_node(st, st_str_node_ads, 0, TRUE, (gint) stat->node_count);
+  increase_stat_node(st, st_str_node_ids, st_node_node_ads, FALSE, (gint) stat->new_nodes);
+  increase_stat_node(st, st_str_node_moves, st_node_node_ads, FALSE, (gint) stat->moved_nodes);
+  return TRUE;
+}
+
+// The state of a graph tap.
+typedef struct _ethereum_disc_graph_tap {
+  ethereum_graph_t graph;
+  ethereum_graph_format_e format;
+  gchar *filename;                 // The file to write the graph to, or NULL for the standard output.
+} ethereum_disc_graph_tap_t;
+
+/**
+ * Resets a graph tap whenever the packets are tapped again.
+ *
+ * @param tapdata The graph tap.
+ */
+static void ethereum_graph_tap_reset(void *tapdata) {
+  ethereum_disc_graph_tap_t *gt = (ethereum_disc_graph_tap_t *) tapdata;
+  ethereum_graph_clear(&gt->graph);
+}
+
+/**
+ * Records the edges from the sender of a NODES packet to the nodes it advertised. The sender is identified by
+ * its node ID if it was recovered, and by its endpoint otherwise.
+ *
+ * @param tapdata The graph tap.
+ * @param pinfo The packet info.
+ * @param edt Data about the dissection.
+ * @param p A pointer to the statistics struct.
+ * @return TRUE if the graph changed; FALSE otherwise.
+ */
+static gboolean ethereum_graph_tap_packet(void *tapdata, packet_info *pinfo, epan_dissect_t *edt _U_,
+                                          const void *p) {
+  ethereum_disc_graph_tap_t *gt = (ethereum_disc_graph_tap_t *) tapdata;
+  const ethereum_disc_stat_t *stat = (const ethereum_disc_stat_t *) p;
+  ethereum_peer_endpoint_t endpoint;
+  ethereum_peer_t *peer;
+  guint8 key[ETHEREUM_GRAPH_ENDPOINT_LEN];
+  guint32 src;
+  guint i;
+
+  if (stat->packet_type != NODES || !stat->msg || stat->msg->node_count == 0 || stat->duplicate) {
+    return FALSE;
+  }
+  address_peer_endpoint(&pinfo->src, pinfo->srcport, &endpoint);
+  // Without the recovered sender, the node advertised at the source endpoint of the packet is taken as the sender;
+  // the endpoint itself only stands for senders no NODES packet advertised so far.
+  peer = stat->sender_id ? NULL : ethereum_peer_table_lookup_endpoint(&peer_table, &endpoint);
+  if (stat->sender_id || peer) {
+    src = ethereum_graph_vertex(&gt->graph, stat->sender_id ? stat->sender_id : peer->id, ETHEREUM_GRAPH_NODE_ID_LEN);
+  } else {
+    memcpy(key, endpoint.addr, sizeof(endpoint.addr));
+    phton16(key + sizeof(endpoint.addr), endpoint.udp_port);
+    src = ethereum_graph_vertex(&gt->graph, key, ETHEREUM_GRAPH_ENDPOINT_LEN);
+  }
+  for (i = 0; i < stat->msg->node_count; i++) {
+    const ethereum_disc_field_t *id = &stat->msg->nodes[i].id;
+    if (id->data && id->length == ETHEREUM_GRAPH_NODE_ID_LEN) {
+      ethereum_graph_add_edge(&gt->graph, src, ethereum_graph_vertex(&gt->graph, id->data, ETHEREUM_GRAPH_NODE_ID_LEN),
+                              &pinfo->abs_ts);
+    }
+  }
+  return TRUE;
+}
+
+/**
+ * Writes the graph out at the end of the capture.
+ *
+ * @param tapdata The graph tap.
+ */
+static void ethereum_graph_tap_draw(void *tapdata) {
+  ethereum_disc_graph_tap_t *gt = (ethereum_disc_graph_tap_t *) tapdata;
+  FILE *out = stdout;
+
+  if (gt->filename) {
+    out = ws_fopen(gt->filename, "w");
+    if (!out) {
+      fprintf(stderr, "ethereum,graph: can't open %s for writing\n", gt->filename);
+      return;
+    }
+  }
+  ethereum_graph_write(&gt->graph, out, gt->format);
+  if (out != stdout) {
+    fclose(out);
+  } else {
+    fflush(out);
+  }
+}
+
+/**
+ * Sets a graph tap up from the command line, i.e. -z ethereum,graph[,edgelist|graphml[,<file>]].
+ *
+ * @param opt_arg The option argument.
+ * @param userdata Unused.
+ */
+static void ethereum_graph_tap_init(const char *opt_arg, void *userdata _U_) {
+  ethereum_disc_graph_tap_t *gt;
+  gchar **args = g_strsplit(opt_arg, ",", 4);
+  GString *error;
+
+  if (args[0] && args[1] && args[2] && strcmp(args[2], "edgelist") != 0 && strcmp(args[2], "graphml") != 0) {
+    fprintf(stderr, "ethereum,graph: usage: -z ethereum,graph[,edgelist|graphml[,<file>]]\n");
+    g_strfreev(args);
+    return;
+  }
 
-  // Build the protocol tree.
-  tree = proto_tree_add_item(tree, proto_ethereum, tvb, 0, -1, ENC_NA);
-  ethereum_tree = proto_item_add_subtree(tree, ett_ethereum_disc_toplevel);
+  gt = g_new0(ethereum_disc_graph_tap_t, 1);
+  ethereum_graph_init(&gt->graph);
+  gt->format = ETHEREUM_GRAPH_EDGE_LIST;
+  if (args[0] && args[1] && args[2]) {
+    if (strcmp(args[2], "graphml") == 0) {
+      gt->format = ETHEREUM_GRAPH_GRAPHML;
+    }
+    if (args[3] && *args[3]) {
+      gt->filename = g_strdup(args[3]);
+    }
+  }
+  g_strfreev(args);
+
+  error = register_tap_listener("ethereum", gt, NULL, TL_REQUIRES_NOTHING, ethereum_graph_tap_reset,
+                                ethereum_graph_tap_packet, ethereum_graph_tap_draw);
+  if (error) {
+    fprintf(stderr, "ethereum,graph: couldn't register the tap: %s\n", error->str);
+    g_string_free(error, TRUE);
+    ethereum_graph_clear(&gt->graph);
+    g_free(gt->filename);
+    g_free(gt);
+    return;
+  }
+  graph_taps++;
+}
 
-  // Message hash and signature.
-  proto_tree_add_item(ethereum_tree, hf_ethereum_disc_msg_hash, tvb, 0, ETHEREUM_DISC_HASH_LEN, ENC_BIG_ENDIAN);
-  proto_tree_add_item(ethereum_tree, hf_ethereum_disc_msg_sig, tvb, ETHEREUM_DISC_HASH_LEN,
-                      ETHEREUM_DISC_SIGNATURE_LEN, ENC_BIG_ENDIAN);
+static stat_tap_ui ethereum_graph_ui = {
+    REGISTER_STAT_GROUP_GENERIC,
+    "Ethereum discovery graph",
+    "ethereum,graph",
+    ethereum_graph_tap_init,
+    -1,
+    0,
+    NULL
+};
 
-  // Packet type.
-  guint packet_type = tvb_get_guint8(tvb, ETHEREUM_DISC_PACKET_TYPE_IDX);
-  proto_tree_add_item(ethereum_tree, hf_ethereum_disc_packet_type, tvb,
-                      ETHEREUM_DISC_PACKET_TYPE_IDX, 1, ENC_BIG_ENDIAN);
-  st->packet_type = (packet_type_e) packet_type;
+// The state of a hash index tap.
+typedef struct _ethereum_disc_hashindex_tap {
+  ethereum_hashindex_writer_t writer;
+  gchar *filename;
+  guint run_records;
+  gboolean failed;      // A write failed; the index is incomplete.
+} ethereum_disc_hashindex_tap_t;
 
-  // Packet subtree, until the end.
-  packet_type_desc = val_to_str(packet_type, packet_type_names, "(Unknown packet ID: %d)");
-  ti = proto_tree_add_string(ethereum_tree, hf_ethereum_disc_packet, tvb,
-                             ETHEREUM_DISC_PACKET_DATA_START, -1, packet_type_desc);
-  packet_tree = proto_item_add_subtree(ti, ett_ethereum_disc_packetdata);
+/**
+ * Starts the index over whenever the packets are tapped again.
+ *
+ * @param tapdata The hash index tap.
+ */
+static void ethereum_hashindex_tap_reset(void *tapdata) {
+  ethereum_disc_hashindex_tap_t *ht = (ethereum_disc_hashindex_tap_t *) tapdata;
 
-  packet_tvb = tvb_new_subset_remaining(tvb, ETHEREUM_DISC_PACKET_DATA_START);
+  if (ht->writer.records == 0 && !ht->failed) {
+    return;
+  }
+  ethereum_hashindex_writer_close(&ht->writer);
+  ht->failed = !ethereum_hashindex_writer_open(&ht->writer, ht->filename, ht->run_records);
+}
 
-  rlp_next(packet_tvb, 0, &rlp);
-  // Assert we have a top level RLP list.
-  if (rlp.type != LIST) {
+/**
+ * Records the hash, time and endpoints of a discovery v4 message. Duplicates within the capture are left out,
+ * as only the first sighting of a message at a vantage point matters.
+ *
+ * @param tapdata The hash index tap.
+ * @param pinfo The packet info.
+ * @param edt Data about the dissection.
+ * @param p A pointer to the statistics struct.
+ * @return FALSE, as there's nothing to draw until the end of the capture.
+ */
+static gboolean ethereum_hashindex_tap_packet(void *tapdata, packet_info *pinfo, epan_dissect_t *edt _U_,
+                                              const void *p) {
+  ethereum_disc_hashindex_tap_t *ht = (ethereum_disc_hashindex_tap_t *) tapdata;
+  const ethereum_disc_stat_t *stat = (const ethereum_disc_stat_t *) p;
+  ethereum_hashindex_record_t record;
+  ethereum_peer_endpoint_t endpoint;
+
+  if (!stat->hash || stat->duplicate || ht->failed) {
     return FALSE;
   }
+  memcpy(record.key, stat->hash, ETHEREUM_HASHINDEX_KEY_LEN);
+  record.ts = pinfo->abs_ts.secs < 0 ? 0 : (guint64) pinfo->abs_ts.secs * 1000000000 + (guint64) pinfo->abs_ts.nsecs;
+  address_peer_endpoint(&pinfo->src, pinfo->srcport, &endpoint);
+  memcpy(record.src_addr, endpoint.addr, ETHEREUM_HASHINDEX_ADDR_LEN);
+  record.src_port = endpoint.udp_port;
+  address_peer_endpoint(&pinfo->dst, pinfo->destport, &endpoint);
+  memcpy(record.dst_addr, endpoint.addr, ETHEREUM_HASHINDEX_ADDR_LEN);
+  record.dst_port = endpoint.udp_port;
+  record.type = (guint8) stat->packet_type;
+  if (!ethereum_hashindex_writer_add(&ht->writer, &record)) {
+    fprintf(stderr, "ethereum,hashindex: can't write to %s\n", ht->filename);
+    ht->failed = TRUE;
+  }
+  return FALSE;
+}
 
-  col_append_str(pinfo->cinfo, COL_INFO, "Discovery v4 message: ");
-  col_append_str(pinfo->cinfo, COL_INFO, packet_type_desc);
+/**
+ * Completes the index at the end of the capture.
+ *
+ * @param tapdata The hash index tap.
+ */
+static void ethereum_hashindex_tap_draw(void *tapdata) {
+  ethereum_disc_hashindex_tap_t *ht = (ethereum_disc_hashindex_tap_t *) tapdata;
+  guint64 records = ht->writer.records;
 
-  // Sanity check.
-  if (packet_type >= G_N_ELEMENTS(processors) || processors[packet_type] == NULL) {
-    return FALSE;
+  if (!ht->writer.file) {
+    return;
   }
+  if (!ethereum_hashindex_writer_close(&ht->writer) || ht->failed) {
+    fprintf(stderr, "ethereum,hashindex: %s is incomplete\n", ht->filename);
+    return;
+  }
+  printf("ethereum,hashindex: %" G_GINT64_MODIFIER "u messages indexed in %s\n", records, ht->filename);
+}
 
-  // Create a new enhanced frame if it doesn't exist.
-  efdata = (ethereum_disc_enhanced_data_t *) p_get_proto_data(wmem_file_scope(), pinfo, proto_ethereum, 0);
-  if (!efdata) {
-    efdata = wmem_new(wmem_file_scope(), ethereum_disc_enhanced_data_t);
-    efdata->seq = ++conv->total_count;
-    efdata->seqtype = 0;
-    efdata->rt = unset_time;
-    efdata->rq_time = unset_time;
-    p_add_proto_data(wmem_file_scope(), pinfo, proto_ethereum, 0, efdata);
+/**
+ * Sets a hash index tap up from the command line, i.e. -z ethereum,hashindex,<file>[,<records per run>].
+ *
+ * @param opt_arg The option argument.
+ * @param userdata Unused.
+ */
+static void ethereum_hashindex_tap_init(const char *opt_arg, void *userdata _U_) {
+  ethereum_disc_hashindex_tap_t *ht;
+  gchar **args = g_strsplit(opt_arg, ",", 4);
+  GString *error;
+
+  if (!args[0] || !args[1] || !args[2] || !*args[2]) {
+    fprintf(stderr, "ethereum,hashindex: usage: -z ethereum,hashindex,<file>[,<records per run>]\n");
+    g_strfreev(args);
+    return;
+  }
+  ht = g_new0(ethereum_disc_hashindex_tap_t, 1);
+  ht->filename = g_strdup(args[2]);
+  ht->run_records = args[3] ? (guint) g_ascii_strtoull(args[3], NULL, 10) : 0;
+  g_strfreev(args);
+
+  if (!ethereum_hashindex_writer_open(&ht->writer, ht->filename, ht->run_records)) {
+    fprintf(stderr, "ethereum,hashindex: can't open %s for writing\n", ht->filename);
+    g_free(ht->filename);
+    g_free(ht);
+    return;
   }
+  error = register_tap_listener("ethereum", ht, NULL, TL_REQUIRES_NOTHING, ethereum_hashindex_tap_reset,
+                                ethereum_hashindex_tap_packet, ethereum_hashindex_tap_draw);
+  if (error) {
+    fprintf(stderr, "ethereum,hashindex: couldn't register the tap: %s\n", error->str);
+    g_string_free(error, TRUE);
+    ethereum_hashindex_writer_close(&ht->writer);
+    g_free(ht->filename);
+    g_free(ht);
+  }
+}
 
-  ti = proto_tree_add_uint(proto_tree_get_parent_tree(packet_tree), hf_ethereum_disc_seq,
-                           packet_tvb, 0, 0, efdata->seq);
-  PROTO_ITEM_SET_GENERATED(ti);
+static stat_tap_ui ethereum_hashindex_ui = {
+    REGISTER_STAT_GROUP_GENERIC,
+    "Ethereum discovery hash index",
+    "ethereum,hashindex",
+    ethereum_hashindex_tap_init,
+    -1,
+    0,
+    NULL
+};
 
-  processors[packet_type](packet_tvb, packet_tree, pinfo, &rlp, st, conv, efdata);
-  tap_queue_packet(ethereum_tap, pinfo, st);
-  return TRUE;
-}
+// The state of a columnar export tap.
+typedef struct _ethereum_disc_columnar_tap {
+  ethereum_columnar_writer_t writer;
+  gchar *filename;
+  guint group_rows;
+  gboolean failed;      // A write failed; the export is incomplete.
+} ethereum_disc_columnar_tap_t;
 
-static int dissect_ethereum_discv5(tvbuff_t *tvb,
-                                   packet_info *pinfo,
-                                   proto_tree *tree,
-                                   void *data _U_) {
-  proto_tree *ethereum_tree, *packet_tree;
-  proto_item *ti;
-  tvbuff_t *packet_tvb;
-  ethereum_disc_stat_t *st;
-  ethereum_disc_conv_t *conv;
-  ethereum_disc_enhanced_data_t *efdata;
-  const gchar *packet_type_desc;
-  rlp_element_t rlp;
+/**
+ * Starts the export over whenever the packets are tapped again.
+ *
+ * @param tapdata The columnar export tap.
+ */
+static void ethereum_columnar_tap_reset(void *tapdata) {
+  ethereum_disc_columnar_tap_t *ct = (ethereum_disc_columnar_tap_t *) tapdata;
 
-  static packet_processor *processors[] = {
-      [PING] = &process_ping_v5_msg,
-      [PONG] = &process_pong_v5_msg,
-      [FIND_NODE] = &process_findnode_msg,
-      [NODES] = &process_nodes_msg,
-      // FIND_NODEHASH is identical to FIND_NODE, except the length of their target field is
-      // different (64 for the former and 32 for the latter). By using process_findnode_msg for
-      // both, we avoid duplication and get correctly linking of either of them to the NODES
-      // response.
-      [FIND_NODEHASH] = &process_findnode_msg,
-      [TOPIC_REGISTER] = &process_topic_register_msg,
-      [TOPIC_QUERY] = &process_topic_query_msg,
-      [TOPIC_NODES] = &process_topic_nodes_msg,
-  };
+  if (ct->writer.rows == 0 && !ct->failed) {
+    return;
+  }
+  ethereum_columnar_writer_close(&ct->writer);
+  ct->failed = !ethereum_columnar_writer_open(&ct->writer, ct->filename, ct->group_rows);
+}
 
-  st = init_disc_stat();
-  conv = get_conversation(pinfo);
+/**
+ * Adds a row for a discovery message to the export. Duplicates within the capture are left out, as they
+ * carry no sequence number and would skew the response times.
+ *
+ * @param tapdata The columnar export tap.
+ * @param pinfo The packet info.
+ * @param edt Data about the dissection.
+ * @param p A pointer to the statistics struct.
+ * @return FALSE, as there's nothing to draw until the end of the capture.
+ */
+static gboolean ethereum_columnar_tap_packet(void *tapdata, packet_info *pinfo, epan_dissect_t *edt _U_,
+                                             const void *p) {
+  ethereum_disc_columnar_tap_t *ct = (ethereum_disc_columnar_tap_t *) tapdata;
+  const ethereum_disc_stat_t *stat = (const ethereum_disc_stat_t *) p;
+  ethereum_columnar_row_t row;
+  ethereum_peer_endpoint_t endpoint;
+  nstime_t rt;
 
-  col_set_str(pinfo->cinfo, COL_PROTOCOL, "Ethereum");
-  col_clear(pinfo->cinfo, COL_INFO);
+  if (stat->duplicate || ct->failed) {
+    return FALSE;
+  }
+  row.frame = pinfo->num;
+  row.ts = (gint64) pinfo->abs_ts.secs * 1000000000 + pinfo->abs_ts.nsecs;
+  address_peer_endpoint(&pinfo->src, pinfo->srcport, &endpoint);
+  memcpy(row.src_addr, endpoint.addr, ETHEREUM_COLUMNAR_ADDR_LEN);
+  row.src_port = endpoint.udp_port;
+  address_peer_endpoint(&pinfo->dst, pinfo->destport, &endpoint);
+  memcpy(row.dst_addr, endpoint.addr, ETHEREUM_COLUMNAR_ADDR_LEN);
+  row.dst_port = endpoint.udp_port;
+  row.type = (guint8) stat->packet_type;
+  row.seq = stat->seq;
+  row.seqtype = stat->seqtype;
+  row.rt = -1;
+  if (!nstime_is_unset(&stat->rq_time)) {
+    nstime_delta(&rt, &pinfo->abs_ts, &stat->rq_time);
+    row.rt = (gint64) rt.secs * 1000000000 + rt.nsecs;
+  }
+  row.node_count = stat->node_count;
+  if (!ethereum_columnar_writer_add(&ct->writer, &row)) {
+    fprintf(stderr, "ethereum,columnar: can't write to %s\n", ct->filename);
+    ct->failed = TRUE;
+  }
+  return FALSE;
+}
 
-  // Build the protocol tree.
-  tree = proto_tree_add_item(tree, proto_ethereum, tvb, 0, -1, ENC_NA);
-  ethereum_tree = proto_item_add_subtree(tree, ett_ethereum_disc_toplevel);
+/**
+ * Writes the last row group and completes the export at the end of the capture.
+ *
+ * @param tapdata The columnar export tap.
+ */
+static void ethereum_columnar_tap_draw(void *tapdata) {
+  ethereum_disc_columnar_tap_t *ct = (ethereum_disc_columnar_tap_t *) tapdata;
+  guint64 rows = ct->writer.rows;
 
-  // Message hash and signature.
-  proto_tree_add_item(ethereum_tree, hf_ethereum_disc_msg_sig, tvb, strlen(ETHEREUM_DISCV5_ID_STR),
-                      ETHEREUM_DISC_SIGNATURE_LEN, ENC_BIG_ENDIAN);
+  if (!ct->writer.file) {
+    return;
+  }
+  if (!ethereum_columnar_writer_close(&ct->writer) || ct->failed) {
+    fprintf(stderr, "ethereum,columnar: %s is incomplete\n", ct->filename);
+    return;
+  }
+  // The export may go to the standard output; keep it clean.
+  fprintf(stderr, "ethereum,columnar: %" G_GINT64_MODIFIER "u messages exported to %s\n", rows, ct->filename);
+}
 
-  // Packet type.
-  guint packet_type = tvb_get_guint8(tvb, ETHEREUM_DISCV5_PACKET_TYPE_IDX);
-  proto_tree_add_item(ethereum_tree, hf_ethereum_disc_packet_type, tvb,
-                      ETHEREUM_DISCV5_PACKET_TYPE_IDX, 1, ENC_BIG_ENDIAN);
-  st->packet_type = (packet_type_e) packet_type;
+/**
+ * Sets a columnar export tap up from the command line, i.e. -z ethereum,columnar,<file>[,<rows per group>].
+ * The file may be "-" for the standard output.
+ *
+ * @param opt_arg The option argument.
+ * @param userdata Unused.
+ */
+static void ethereum_columnar_tap_init(const char *opt_arg, void *userdata _U_) {
+  ethereum_disc_columnar_tap_t *ct;
+  gchar **args = g_strsplit(opt_arg, ",", 4);
+  GString *error;
+
+  if (!args[0] || !args[1] || !args[2] || !*args[2]) {
+    fprintf(stderr, "ethereum,columnar: usage: -z ethereum,columnar,<file>[,<rows per group>]\n");
+    g_strfreev(args);
+    return;
+  }
+  ct = g_new0(ethereum_disc_columnar_tap_t, 1);
+  ct->filename = g_strdup(args[2]);
+  ct->group_rows = args[3] ? (guint) g_ascii_strtoull(args[3], NULL, 10) : 0;
+  g_strfreev(args);
+
+  if (!ethereum_columnar_writer_open(&ct->writer, ct->filename, ct->group_rows)) {
+    fprintf(stderr, "ethereum,columnar: can't open %s for writing\n", ct->filename);
+    g_free(ct->filename);
+    g_free(ct);
+    return;
+  }
+  error = register_tap_listener("ethereum", ct, NULL, TL_REQUIRES_NOTHING, ethereum_columnar_tap_reset,
+                                ethereum_columnar_tap_packet, ethereum_columnar_tap_draw);
+  if (error) {
+    fprintf(stderr, "ethereum,columnar: couldn't register the tap: %s\n", error->str);
+    g_string_free(error, TRUE);
+    ethereum_columnar_writer_close(&ct->writer);
+    g_free(ct->filename);
+    g_free(ct);
+  }
+}
 
-  // Packet subtree, until the end.
-  packet_type_desc = val_to_str(packet_type, packet_type_names, "(Unknown packet ID: %d)");
-  ti = proto_tree_add_string(ethereum_tree, hf_ethereum_disc_packet, tvb,
-                             ETHEREUM_DISCV5_PACKET_DATA_START, -1, packet_type_desc);
-  packet_tree = proto_item_add_subtree(ti, ett_ethereum_disc_packetdata);
+static stat_tap_ui ethereum_columnar_ui = {
+    REGISTER_STAT_GROUP_GENERIC,
+    "Ethereum discovery columnar export",
+    "ethereum,columnar",
+    ethereum_columnar_tap_init,
+    -1,
+    0,
+    NULL
+};
 
-  packet_tvb = tvb_new_subset_remaining(tvb, ETHEREUM_DISCV5_PACKET_DATA_START);
+// Number of bits of the linear counting bitmap of the active peers of an interval. Estimates stay within a few
+// percent up to about ETHEREUM_DISC_INTERVAL_PEER_BITS * 4 peers.
+#define ETHEREUM_DISC_INTERVAL_PEER_BITS 16384
+
+// Maximum number of empty intervals emitted at once; longer gaps in the capture are reported and skipped.
+#define ETHEREUM_DISC_INTERVAL_MAX_EMPTY 100000
+
+// Microseconds of wall clock time an interval is given past its end for late packets, before the timer emits it.
+#define ETHEREUM_DISC_INTERVAL_GRACE 1000000
+
+// Seconds within which the capture time of a packet is to be from the wall clock time for the capture to be taken
+// as live, i.e. for the timer to run.
+#define ETHEREUM_DISC_INTERVAL_LIVE_SKEW 60
+
+// The counters of an interval tap, for the interval in progress. They have a fixed size, and are zeroed at
+// the start of every interval: nothing is kept about individual frames or peers. During a live capture, the
+// timer thread emits the intervals that elapse without any packet; the mutex guards the whole state against it.
+// Capture files are packet-driven only, so their output doesn't depend on the speed of the machine.
+typedef struct _ethereum_disc_interval_tap {
+  gint64 length;                       // The length of an interval, in nanoseconds.
+  gint64 start;                        // The start of the interval in progress, in nanoseconds since the epoch.
+  gboolean started;                    // A packet was seen, i.e. start is set.
+  gint64 last_ts;                      // The capture time of the last packet, in nanoseconds since the epoch.
+  gint64 last_wall;                    // The monotonic time at which the last packet was tapped, in microseconds.
+  GMutex lock;
+  GCond stop_cond;
+  gboolean stop;                       // The timer thread is to exit.
+  GThread *timer;                      // The timer thread, started upon the first packet of a live capture.
+  guint64 packets[TOPIC_NODES + 1];    // The messages of each packet type.
+  guint64 duplicates;
+  guint64 nodes_ranges[3];             // The NODES messages with 0-5, 6-10 and 11- nodes.
+  guint64 nodes_total;                 // The nodes advertised in NODES messages.
+  ethereum_hist_t rt_hists[RT_PAIRS];  // The response times, in microseconds.
+  guint32 peers[ETHEREUM_DISC_INTERVAL_PEER_BITS / 32];  // The linear counting bitmap of the message senders.
+} ethereum_disc_interval_tap_t;
 
-  rlp_next(packet_tvb, 0, &rlp);
-  // Assert we have a top level RLP list.
-  if (rlp.type != LIST) {
-    return FALSE;
+/**
+ * Zeroes the counters of an interval tap, for the interval starting at the given time.
+ *
+ * @param it The interval tap.
+ * @param start The start of the interval, in nanoseconds since the epoch.
+ */
+static void interval_tap_clear(ethereum_disc_interval_tap_t *it, gint64 start) {
+  guint i;
+
+  it->start = start;
+  memset(it->packets, 0, sizeof(it->packets));
+  it->duplicates = 0;
+  memset(it->nodes_ranges, 0, sizeof(it->nodes_ranges));
+  it->nodes_total = 0;
+  for (i = 0; i < RT_PAIRS; i++) {
+    ethereum_hist_reset(&it->rt_hists[i]);
   }
+  memset(it->peers, 0, sizeof(it->peers));
+}
 
-  col_append_str(pinfo->cinfo, COL_INFO, "Discovery v5 message: ");
-  col_append_str(pinfo->cinfo, COL_INFO, packet_type_desc);
+/**
+ * Estimates the number of distinct senders of an interval from its linear counting bitmap.
+ *
+ * @param it The interval tap.
+ * @return The estimate; once the bitmap is full, the largest value it can tell apart.
+ */
+static guint64 interval_tap_active_peers(const ethereum_disc_interval_tap_t *it) {
+  const gdouble bits = ETHEREUM_DISC_INTERVAL_PEER_BITS;
+  guint zeros = ETHEREUM_DISC_INTERVAL_PEER_BITS;
+  guint i;
+  guint32 v;
+
+  for (i = 0; i < G_N_ELEMENTS(it->peers); i++) {
+    for (v = it->peers[i]; v; v &= v - 1) {
+      zeros--;
+    }
+  }
+  return (guint64) floor(-bits * log((gdouble) MAX(zeros, 1) / bits) + 0.5);
+}
 
-  // Sanity check.
-  if (packet_type >= G_N_ELEMENTS(processors) || processors[packet_type] == NULL) {
-    return FALSE;
+/**
+ * Prints the counters of the interval in progress as a single line of key=value pairs, and flushes it out
+ * straight away for the consumers of a live capture. Rates are per second, and response times in microseconds.
+ *
+ * @param it The interval tap.
+ */
+static void interval_tap_emit(const ethereum_disc_interval_tap_t *it) {
+  guint64 values[G_N_ELEMENTS(rt_percentiles)];
+  gdouble secs = (gdouble) it->length / 1e9;
+  guint64 total = 0;
+  guint i, j;
+
+  for (i = PING; i <= TOPIC_NODES; i++) {
+    total += it->packets[i];
+  }
+  printf("ethereum,interval: start=%" G_GINT64_MODIFIER "d.%09" G_GINT64_MODIFIER "d duration=%g packets=%"
+         G_GINT64_MODIFIER "u duplicates=%" G_GINT64_MODIFIER "u",
+         it->start / 1000000000, it->start % 1000000000, secs, total, it->duplicates);
+  for (i = PING; i <= TOPIC_NODES; i++) {
+    printf(" rate.%s=%.3f", val_to_str_const(i, packet_type_names, "?"), (gdouble) it->packets[i] / secs);
+  }
+  printf(" nodes.0-5=%" G_GINT64_MODIFIER "u nodes.6-10=%" G_GINT64_MODIFIER "u nodes.11-=%" G_GINT64_MODIFIER
+         "u nodes.avg=%.2f", it->nodes_ranges[0], it->nodes_ranges[1], it->nodes_ranges[2],
+         it->packets[NODES] ? (gdouble) it->nodes_total / (gdouble) it->packets[NODES] : 0.0);
+  for (i = 0; i < RT_PAIRS; i++) {
+    ethereum_hist_percentiles(&it->rt_hists[i], rt_percentiles, G_N_ELEMENTS(rt_percentiles), values);
+    printf(" rt.%s.count=%" G_GINT64_MODIFIER "u", rt_pair_names[i], it->rt_hists[i].count);
+    for (j = 0; j < G_N_ELEMENTS(rt_percentiles); j++) {
+      printf(" rt.%s.%s=%" G_GINT64_MODIFIER "u", rt_pair_names[i], rt_percentile_names[j], values[j]);
+    }
+  }
+  printf(" peers=%" G_GINT64_MODIFIER "u\n", interval_tap_active_peers(it));
+  fflush(stdout);
+}
+
+/**
+ * Emits the interval in progress and the empty intervals that elapsed since, up to the one starting at the
+ * given time, which becomes the interval in progress. Long gaps are skipped rather than filled in.
+ *
+ * @param it The interval tap.
+ * @param start The start of the new interval in progress, in nanoseconds since the epoch.
+ */
+static void interval_tap_advance(ethereum_disc_interval_tap_t *it, gint64 start) {
+  gint64 empty = (start - it->start) / it->length - 1;
+
+  interval_tap_emit(it);
+  if (empty > ETHEREUM_DISC_INTERVAL_MAX_EMPTY) {
+    fprintf(stderr, "ethereum,interval: skipping %" G_GINT64_MODIFIER "d empty intervals\n", empty);
+    interval_tap_clear(it, start);
+    return;
   }
+  interval_tap_clear(it, it->start + it->length);
+  while (it->start < start) {
+    interval_tap_emit(it);
+    interval_tap_clear(it, it->start + it->length);
+  }
+}
 
-  // Create a new enhanced frame if it doesn't exist.
-  efdata = (ethereum_disc_enhanced_data_t *) p_get_proto_data(wmem_file_scope(), pinfo, proto_ethereum, 0);
-  if (!efdata) {
-    efdata = wmem_new(wmem_file_scope(), ethereum_disc_enhanced_data_t);
-    efdata->seq = ++conv->total_count;
-    efdata->seqtype = 0;
-    efdata->rt = unset_time;
-    efdata->rq_time = unset_time;
-    p_add_proto_data(wmem_file_scope(), pinfo, proto_ethereum, 0, efdata);
+/**
+ * Emits the intervals that elapse without any packet during a live capture. The capture time is estimated from
+ * that of the last packet and the wall clock time since, and an interval is given a grace period for the
+ * packets still in flight.
+ *
+ * @param data The interval tap.
+ * @return NULL.
+ */
+static gpointer interval_tap_timer(gpointer data) {
+  ethereum_disc_interval_tap_t *it = (ethereum_disc_interval_tap_t *) data;
+  gint64 period = MAX(MIN(it->length / 1000, G_USEC_PER_SEC), 1000);
+  gint64 now, end;
+
+  g_mutex_lock(&it->lock);
+  while (!it->stop) {
+    g_cond_wait_until(&it->stop_cond, &it->lock, g_get_monotonic_time() + period);
+    if (it->stop || !it->started) {
+      continue;
+    }
+    now = it->last_ts + (g_get_monotonic_time() - it->last_wall - ETHEREUM_DISC_INTERVAL_GRACE) * 1000;
+    end = it->start + it->length;
+    if (now >= end) {
+      interval_tap_advance(it, now - ((now % it->length) + it->length) % it->length);
+    }
   }
+  g_mutex_unlock(&it->lock);
+  return NULL;
+}
 
-  ti = proto_tree_add_uint(proto_tree_get_parent_tree(packet_tree), hf_ethereum_disc_seq,
-                           packet_tvb, 0, 0, efdata->seq);
-  PROTO_ITEM_SET_GENERATED(ti);
+/**
+ * Starts the intervals over whenever the packets are tapped again.
+ *
+ * @param tapdata The interval tap.
+ */
+static void ethereum_interval_tap_reset(void *tapdata) {
+  ethereum_disc_interval_tap_t *it = (ethereum_disc_interval_tap_t *) tapdata;
 
-  processors[packet_type](packet_tvb, packet_tree, pinfo, &rlp, st, conv, efdata);
-  tap_queue_packet(ethereum_tap, pinfo, st);
-  return TRUE;
+  g_mutex_lock(&it->lock);
+  it->started = FALSE;
+  if (!it->timer) {
+    it->stop = FALSE;
+  }
+  interval_tap_clear(it, 0);
+  g_mutex_unlock(&it->lock);
 }
 
 /**
- * Evaluates heuristics on a frame and performs the dissection only if there's a high probability
- * that this is an Ethereum discovery message.
+ * Tells whether a packet belongs to a live capture, i.e. was captured about now. There is no way to tell a live
+ * capture from a capture file from a tap, but the packets of a capture file are rarely that recent.
  *
- * @param tvb The buffer containing the UDP datagram.
+ * @param ts The capture time of the packet, in nanoseconds since the epoch.
+ * @return TRUE if the capture is live; FALSE otherwise.
+ */
+static gboolean interval_tap_is_live(gint64 ts) {
+  gint64 skew = g_get_real_time() - ts / 1000;
+  return ABS(skew) < (gint64) ETHEREUM_DISC_INTERVAL_LIVE_SKEW * G_USEC_PER_SEC;
+}
+
+/**
+ * Counts a discovery message in the interval in progress. The first message past the end of the interval
+ * emits it, along with the empty intervals since, and starts the one the message falls in; intervals are
+ * aligned on the epoch. Messages whose time goes backwards are counted in the interval in progress. The first
+ * message of a live capture starts the timer.
+ *
+ * @param tapdata The interval tap.
  * @param pinfo The packet info.
- * @param tree The protocol tree to populate.
- * @param data Extra data.
- * @return TRUE if successful, FALSE otherwise.
+ * @param edt Data about the dissection.
+ * @param p A pointer to the statistics struct.
+ * @return FALSE, as the intervals are emitted as they complete rather than drawn.
  */
-static gboolean dissect_ethereum_heur(tvbuff_t *tvb, packet_info *pinfo, proto_tree *tree, void *data _U_) {
-  // Check length.
-  if (tvb_captured_length(tvb) < MIN_ETHDEVP2PDISCO_LEN || tvb_captured_length(tvb) > MAX_ETHDEVP2PDISCO_LEN) {
+static gboolean ethereum_interval_tap_packet(void *tapdata, packet_info *pinfo, epan_dissect_t *edt _U_,
+                                             const void *p) {
+  ethereum_disc_interval_tap_t *it = (ethereum_disc_interval_tap_t *) tapdata;
+  const ethereum_disc_stat_t *stat = (const ethereum_disc_stat_t *) p;
+  ethereum_peer_endpoint_t endpoint;
+  gint64 ts = (gint64) pinfo->abs_ts.secs * 1000000000 + pinfo->abs_ts.nsecs;
+  gint64 start = ts - ((ts % it->length) + it->length) % it->length;
+  guint32 h = 2166136261U;
+  rt_pair_e pair;
+  guint i;
+
+  g_mutex_lock(&it->lock);
+  if (!it->started) {
+    it->started = TRUE;
+    interval_tap_clear(it, start);
+    if (!it->timer && !it->stop && interval_tap_is_live(ts)) {
+      it->timer = g_thread_new("ethereum,interval", interval_tap_timer, it);
+    }
+  } else if (start > it->start) {
+    interval_tap_advance(it, start);
+  }
+  it->last_ts = MAX(it->last_ts, ts);
+  it->last_wall = g_get_monotonic_time();
+
+  if (stat->duplicate) {
+    it->duplicates++;
+    g_mutex_unlock(&it->lock);
     return FALSE;
   }
+  if (stat->packet_type <= TOPIC_NODES) {
+    it->packets[stat->packet_type]++;
+  }
+  if (stat->packet_type == NODES) {
+    it->nodes_ranges[stat->node_count <= 5 ? 0 : stat->node_count <= 10 ? 1 : 2]++;
+    it->nodes_total += stat->node_count;
+  }
+  if (!stat->is_request && stat->has_request && !nstime_is_unset(&stat->rq_time)) {
+    pair = rt_pair_of(stat->request_type);
+    if (pair != RT_PAIRS) {
+      ethereum_hist_add(&it->rt_hists[pair], rt_usecs(pinfo, stat));
+    }
+  }
 
-  // https://github.com/ethereum/go-ethereum/blob/c4712bf96bc1bae4a5ad4600e9719e4a74bde7d5/p2p/discv5/udp.go#L149
-  gboolean is_discv5 = FALSE;
-  const gchar *version_prefix = tvb_get_string_enc(wmem_packet_scope(), tvb, 0, strlen(ETHEREUM_DISCV5_ID_STR), ENC_ASCII);
-  if (strcmp(version_prefix, ETHEREUM_DISCV5_ID_STR) == 0) {
-      is_discv5 = TRUE;
-  } else {
-      guint packet_type = tvb_get_guint8(tvb, ETHEREUM_DISC_PACKET_TYPE_IDX);
-      if (packet_type > NODES) {
-        return FALSE;
-      }
+  // Mark the sender in the bitmap (FNV-1a of its address and port).
+  address_peer_endpoint(&pinfo->src, pinfo->srcport, &endpoint);
+  for (i = 0; i < sizeof(endpoint.addr); i++) {
+    h = (h ^ endpoint.addr[i]) * 16777619U;
+  }
+  h = (h ^ (endpoint.udp_port & 0xff)) * 16777619U;
+  h = (h ^ (endpoint.udp_port >> 8)) * 16777619U;
+  h %= ETHEREUM_DISC_INTERVAL_PEER_BITS;
+  it->peers[h / 32] |= 1U << (h % 32);
+  g_mutex_unlock(&it->lock);
+  return FALSE;
+}
 
-      rlp_element_t rlp;
-      // Check if the packet contains a top-level RLP list that spans the entire packet.
-      // Next offset should be zero, to mark the end of the packet.
-      if (!rlp_next(tvb, ETHEREUM_DISC_PACKET_DATA_START, &rlp) || rlp.type != LIST || rlp.next_offset > 0) {
-        return FALSE;
-      };
+/**
+ * Stops the timer, and emits the last interval, which may be partial, at the end of the capture.
+ *
+ * @param tapdata The interval tap.
+ */
+static void ethereum_interval_tap_draw(void *tapdata) {
+  ethereum_disc_interval_tap_t *it = (ethereum_disc_interval_tap_t *) tapdata;
+
+  g_mutex_lock(&it->lock);
+  it->stop = TRUE;
+  g_cond_signal(&it->stop_cond);
+  g_mutex_unlock(&it->lock);
+  if (it->timer) {
+    g_thread_join(it->timer);
+    it->timer = NULL;
   }
+  if (it->started) {
+    interval_tap_emit(it);
+    it->started = FALSE;
+  }
+}
 
-  TRY {
-        if (is_discv5 == TRUE) {
-          dissect_ethereum_discv5(tvb, pinfo, tree, data);
-        } else {
-          dissect_ethereum(tvb, pinfo, tree, data);
-        }
-      }
-      CATCH_NONFATAL_ERRORS {
-        show_exception(tvb, pinfo, tree, EXCEPT_CODE, GET_MESSAGE);
-      }
-  ENDTRY;
-  return TRUE;
+/**
+ * Sets an interval tap up from the command line, i.e. -z ethereum,interval,<seconds>. The intervals are printed
+ * on the standard output as they complete, so tshark is to be run with -q not to mix them with the packets.
+ *
+ * @param opt_arg The option argument.
+ * @param userdata Unused.
+ */
+static void ethereum_interval_tap_init(const char *opt_arg, void *userdata _U_) {
+  ethereum_disc_interval_tap_t *it;
+  gchar **args = g_strsplit(opt_arg, ",", 3);
+  gdouble secs = 0.0;
+  GString *error;
+
+  if (args[0] && args[1] && args[2]) {
+    secs = g_ascii_strtod(args[2], NULL);
+  }
+  g_strfreev(args);
+  if (!(secs >= 0.001 && secs <= 86400.0 * 365)) {
+    fprintf(stderr, "ethereum,interval: usage: -z ethereum,interval,<seconds>\n");
+    return;
+  }
+  it = g_new0(ethereum_disc_interval_tap_t, 1);
+  it->length = (gint64) (secs * 1e9 + 0.5);
+  g_mutex_init(&it->lock);
+  g_cond_init(&it->stop_cond);
+  ethereum_interval_tap_reset(it);
+
+  error = register_tap_listener("ethereum", it, NULL, TL_REQUIRES_NOTHING, ethereum_interval_tap_reset,
+                                ethereum_interval_tap_packet, ethereum_interval_tap_draw);
+  if (error) {
+    fprintf(stderr, "ethereum,interval: couldn't register the tap: %s\n", error->str);
+    g_string_free(error, TRUE);
+    g_mutex_clear(&it->lock);
+    g_cond_clear(&it->stop_cond);
+    g_free(it);
+    return;
+  }
 }
 
+static stat_tap_ui ethereum_interval_ui = {
+    REGISTER_STAT_GROUP_GENERIC,
+    "Ethereum discovery interval statistics",
+    "ethereum,interval",
+    ethereum_interval_tap_init,
+    -1,
+    0,
+    NULL
+};
+
 /**
- * Initializes the statistics trees.
+ * Initializes the distance statistics tree.
  *
  * @param st Statistics tree.
  */
-static void ethereum_discovery_stats_tree_init(stats_tree *st) {
-  st_node_packets = stats_tree_create_node(st, st_str_packets, 0, TRUE);
-  st_node_packet_types = stats_tree_create_pivot(st, st_str_packet_types, st_node_packets);
-  st_node_packet_nodes_count = stats_tree_create_range_node(st, st_str_packet_nodecount, 0,
-                                                            "0-5", "6-10", "11-", NULL);
+static void ethereum_discovery_distance_tree_init(stats_tree *st) {
+  guint i;
+
+  st_node_distances = stats_tree_create_node(st, st_str_distances, 0, TRUE);
+  for (i = 0; i < G_N_ELEMENTS(distance_bucket_names); i++) {
+    stats_tree_create_node(st, distance_bucket_names[i], st_node_distances, FALSE);
+  }
+  st_node_distance_peers = stats_tree_create_node(st, st_str_distance_peers, st_node_distances, TRUE);
 }
 
 /**
- * Callback called by Wireshark whenever a stat is published on the tap.
+ * Callback called by Wireshark whenever a stat is published on the tap, to count the log distances of the
+ * nodes returned in NODES packets to the target of their FIND_NODE request, overall and per responder.
  *
  * @param st The statistics tree.
  * @param pinfo The packet info.
@@ -1047,16 +3716,26 @@ static void ethereum_discovery_stats_tree_init(stats_tree *st) {
  * @param p A pointer to the statistics struct.
  * @return TRUE if successful; FALSE otherwise.
  */
-static int ethereum_discovery_stats_tree_packet(stats_tree *st,
-                                                packet_info *pinfo _U_,
-                                                epan_dissect_t *edt _U_,
-                                                const void *p) {
-  ethereum_disc_stat_t *stat = (ethereum_disc_stat_t *) p;
-  tick_stat_node(st, st_str_packets, 0, FALSE);
-  stats_tree_tick_pivot(st, st_node_packet_types,
-                        val_to_str(stat->packet_type, packet_type_names, "Unknown packet type (%d)"));
-  if (stat->packet_type == NODES) {
-    stats_tree_tick_range(st, st_str_packet_nodecount, 0, stat->node_count);
+static int ethereum_discovery_distance_tree_packet(stats_tree *st,
+                                                   packet_info *pinfo,
+                                                   epan_dissect_t *edt _U_,
+                                                   const void *p) {
+  const ethereum_disc_stat_t *stat = (const ethereum_disc_stat_t *) p;
+  gchar name[64];
+  int peer;
+  guint i, b;
+
+  if (stat->distance_count == 0 || stat->duplicate) {
+    return FALSE;
+  }
+  rt_peer_name(pinfo, name, sizeof(name));
+  peer = tick_stat_node(st, name, st_node_distance_peers, TRUE);
+  for (i = 0; i < stat->distance_count; i++) {
+    for (b = G_N_ELEMENTS(distance_bucket_bounds) - 1; stat->distances[i] < distance_bucket_bounds[b]; b--) {
+    }
+    tick_stat_node(st, st_str_distances, 0, TRUE);
+    tick_stat_node(st, distance_bucket_names[b], st_node_distances, FALSE);
+    tick_stat_node(st, distance_bucket_names[b], peer, FALSE);
   }
   return TRUE;
 }
@@ -1066,7 +3745,14 @@ static int ethereum_discovery_stats_tree_packet(stats_tree *st,
  */
 static void register_ethereum_stat_trees(void) {
   stats_tree_register_plugin("ethereum", "ETH", "Ethereum/Discovery protocol stats", 0,
-                             ethereum_discovery_stats_tree_packet, ethereum_discovery_stats_tree_init, NULL);
+                             ethereum_discovery_stats_tree_packet, ethereum_discovery_stats_tree_init,
+                             ethereum_discovery_stats_tree_cleanup);
+  stats_tree_register_plugin("ethereum", "ETH_peers", "Ethereum/Discovery response times per peer", 0,
+                             ethereum_discovery_peer_rt_tree_packet, ethereum_discovery_peer_rt_tree_init, NULL);
+  stats_tree_register_plugin("ethereum", "ETH_nodes", "Ethereum/Discovery node table", 0,
+                             ethereum_discovery_node_tree_packet, ethereum_discovery_node_tree_init, NULL);
+  stats_tree_register_plugin("ethereum", "ETH_distances", "Ethereum/Discovery FIND_NODE result distances", 0,
+                             ethereum_discovery_distance_tree_packet, ethereum_discovery_distance_tree_init, NULL);
 }
 
 /**
@@ -1080,10 +3766,15 @@ static void register_ethereum_stat_trees(void) {
 static void ethereum_srt_table_init(struct register_srt *srt _U_, GArray *srt_array,
                                     srt_gui_init_cb gui_callback, void *gui_data) {
   srt_stat_table *eth_srt_table;
-  eth_srt_table = init_srt_table("Ethereum discovery packets", NULL, srt_array, 2,
+  gchar row_name[64];
+  guint i;
+
+  eth_srt_table = init_srt_table("Ethereum discovery packets", NULL, srt_array, RT_PAIRS,
                                  NULL, NULL, gui_callback, gui_data, NULL);
-  init_srt_table_row(eth_srt_table, 0, "PING->PONG response time");
-  init_srt_table_row(eth_srt_table, 1, "FIND_NODE->NODES response time");
+  for (i = 0; i < RT_PAIRS; i++) {
+    g_snprintf(row_name, sizeof(row_name), "%s response time", rt_pair_names[i]);
+    init_srt_table_row(eth_srt_table, i, row_name);
+  }
 }
 
 /**
@@ -1103,11 +3794,16 @@ static int ethereum_srt_table_packet(void *pss,
   srt_stat_table *eth_srt_table;
   srt_data_t *data = (srt_data_t *) pss;
   const ethereum_disc_stat_t *stat = (const ethereum_disc_stat_t *) prv;
-  if (!stat || stat->is_request || !(stat->has_request)) {
+  rt_pair_e pair;
+  if (!stat || stat->is_request || !(stat->has_request) || stat->duplicate) {
+    return FALSE;
+  }
+  pair = rt_pair_of(stat->request_type);
+  if (pair == RT_PAIRS) {
     return FALSE;
   }
   eth_srt_table = g_array_index(data->srt_array, srt_stat_table*, 0);
-  add_srt_table_data(eth_srt_table, (stat->packet_type - 1) / 2, &stat->rq_time, pinfo);
+  add_srt_table_data(eth_srt_table, pair, &stat->rq_time, pinfo);
   return TRUE;
 }
 
@@ -1122,16 +3818,100 @@ static void register_ethereum_srt_table(void) {
  * Registers the protocol with Wireshark.
  */
 void proto_register_ethereum(void) {
+  module_t *ethereum_module;
+  expert_module_t *expert_ethereum;
+
   static hf_register_info hf[] = {
 
       {&hf_ethereum_disc_msg_hash,
        {"Message hash", "ethereum.disc.hash", FT_BYTES, BASE_NONE,
         NULL, 0x0, NULL, HFILL}},
 
+      {&hf_ethereum_disc_msg_hash_valid,
+       {"Message hash valid", "ethereum.disc.hash_valid", FT_BOOLEAN, BASE_NONE,
+        NULL, 0x0, "Whether the message hash matches the Keccak-256 of the message", HFILL}},
+
       {&hf_ethereum_disc_msg_sig,
        {"Message signature", "ethereum.disc.signature", FT_BYTES, BASE_NONE,
         NULL, 0x0, NULL, HFILL}},
 
+      {&hf_ethereum_disc_sender_id,
+       {"Sender node ID", "ethereum.disc.sender_id", FT_BYTES, BASE_NONE,
+        NULL, 0x0, "Node ID (public key) of the sender, recovered from the message signature", HFILL}},
+
+      {&hf_ethereum_disc_crypto_pending,
+       {"Cryptographic checks pending", "ethereum.disc.crypto_pending", FT_BOOLEAN, BASE_NONE,
+        NULL, 0x0, "The hash verification and sender recovery are still running in the background", HFILL}},
+
+      {&hf_ethereum_disc_duplicate_of,
+       {"Duplicate of", "ethereum.disc.duplicate_of", FT_FRAMENUM, BASE_NONE,
+        FRAMENUM_TYPE(FT_FRAMENUM_DUP_ACK), 0x0,
+        "The message hash was first seen in the indicated frame", HFILL}},
+
+      {&hf_ethereum_disc_peer,
+       {"Node record", "ethereum.disc.peer", FT_BYTES, BASE_NONE,
+        NULL, 0x0, "What the NODES packets of the whole capture tell about the node", HFILL}},
+
+      {&hf_ethereum_disc_peer_first_frame,
+       {"First advertised in", "ethereum.disc.peer.first_frame", FT_FRAMENUM, BASE_NONE,
+        NULL, 0x0, NULL, HFILL}},
+
+      {&hf_ethereum_disc_peer_first_seen,
+       {"First advertised at", "ethereum.disc.peer.first_seen", FT_ABSOLUTE_TIME, ABSOLUTE_TIME_LOCAL,
+        NULL, 0x0, NULL, HFILL}},
+
+      {&hf_ethereum_disc_peer_last_frame,
+       {"Last advertised in", "ethereum.disc.peer.last_frame", FT_FRAMENUM, BASE_NONE,
+        NULL, 0x0, NULL, HFILL}},
+
+      {&hf_ethereum_disc_peer_last_seen,
+       {"Last advertised at", "ethereum.disc.peer.last_seen", FT_ABSOLUTE_TIME, ABSOLUTE_TIME_LOCAL,
+        NULL, 0x0, NULL, HFILL}},
+
+      {&hf_ethereum_disc_peer_advertised,
+       {"Times advertised", "ethereum.disc.peer.advertised", FT_UINT32, BASE_DEC,
+        NULL, 0x0, "Number of NODES entries advertising the node", HFILL}},
+
+      {&hf_ethereum_disc_peer_advertisers,
+       {"Distinct advertisers (estimate)", "ethereum.disc.peer.advertisers", FT_UINT32, BASE_DEC,
+        NULL, 0x0, "Estimated number of distinct endpoints that advertised the node", HFILL}},
+
+      {&hf_ethereum_disc_peer_endpoints,
+       {"Endpoints", "ethereum.disc.peer.endpoints", FT_UINT32, BASE_DEC,
+        NULL, 0x0, "Number of endpoints the node was advertised with, counting each change of endpoint", HFILL}},
+
+      {&hf_ethereum_disc_lookup,
+       {"Lookup session", "ethereum.disc.lookup", FT_UINT32, BASE_DEC,
+        NULL, 0x0, "Number of the lookup session, i.e. the FIND_NODE requests of an originator for a target", HFILL}},
+
+      {&hf_ethereum_disc_lookup_first_frame,
+       {"Started in", "ethereum.disc.lookup.first_frame", FT_FRAMENUM, BASE_NONE,
+        NULL, 0x0, NULL, HFILL}},
+
+      {&hf_ethereum_disc_lookup_hop,
+       {"Hop of this request", "ethereum.disc.lookup.hop", FT_UINT16, BASE_DEC,
+        NULL, 0x0, "1 for a request to a starting node, n + 1 for a request to a node returned at hop n", HFILL}},
+
+      {&hf_ethereum_disc_lookup_hops,
+       {"Hops", "ethereum.disc.lookup.hops", FT_UINT16, BASE_DEC,
+        NULL, 0x0, "Number of hops of the lookup session", HFILL}},
+
+      {&hf_ethereum_disc_lookup_requests,
+       {"Requests", "ethereum.disc.lookup.requests", FT_UINT32, BASE_DEC,
+        NULL, 0x0, "Number of FIND_NODE requests of the lookup session", HFILL}},
+
+      {&hf_ethereum_disc_lookup_duration,
+       {"Duration", "ethereum.disc.lookup.duration", FT_RELATIVE_TIME, BASE_NONE,
+        NULL, 0x0, "Time between the first request and the last request or response of the lookup session", HFILL}},
+
+      {&hf_ethereum_disc_lookup_unique_nodes,
+       {"Unique nodes discovered", "ethereum.disc.lookup.unique_nodes", FT_UINT32, BASE_DEC,
+        NULL, 0x0, NULL, HFILL}},
+
+      {&hf_ethereum_disc_lookup_closest,
+       {"Closest log distance reached", "ethereum.disc.lookup.closest", FT_UINT16, BASE_DEC,
+        NULL, 0x0, NULL, HFILL}},
+
       {&hf_ethereum_disc_packet_type,
        {"Packet type", "ethereum.disc.packet_type", FT_UINT8, BASE_DEC,
         VALS(packet_type_names), 0x0, NULL, HFILL}},
@@ -1164,6 +3944,10 @@ void proto_register_ethereum(void) {
        {"Response time", "ethereum.disc.packet.rt", FT_RELATIVE_TIME, BASE_NONE,
         NULL, 0X0, "Response time", HFILL}},
 
+      {&hf_ethereum_disc_evicted,
+       {"Evicted conversation states", "ethereum.disc.evicted", FT_UINT32, BASE_DEC,
+        NULL, 0X0, "Number of conversation states evicted so far in streaming mode", HFILL}},
+
       {&hf_ethereum_disc_ping_version,
        {"(PING) Protocol version", "ethereum.disc.packet.ping.version", FT_UINT8, BASE_DEC,
         NULL, 0x0, NULL, HFILL}},
@@ -1232,6 +4016,18 @@ void proto_register_ethereum(void) {
        {"(PONG) Expiration", "ethereum.disc.packet.pong.expiration", FT_ABSOLUTE_TIME, ABSOLUTE_TIME_LOCAL,
         NULL, 0X0, NULL, HFILL}},
 
+      {&hf_ethereum_disc_pong_topic_hash,
+       {"(PONG) Topic hash", "ethereum.disc.packet.pong.topic_hash", FT_BYTES, BASE_NONE,
+        NULL, 0X0, NULL, HFILL}},
+
+      {&hf_ethereum_disc_pong_ticket_serial,
+       {"(PONG) Ticket serial", "ethereum.disc.packet.pong.ticket_serial", FT_UINT32, BASE_DEC,
+        NULL, 0X0, NULL, HFILL}},
+
+      {&hf_ethereum_disc_pong_wait_period,
+       {"(PONG) Wait period", "ethereum.disc.packet.pong.wait_period", FT_UINT32, BASE_DEC,
+        NULL, 0X0, "Seconds to wait before registering the topic", HFILL}},
+
       {&hf_ethereum_disc_findnode_target,
        {"(FIND_NODE) Target", "ethereum.disc.packet.find_node.target", FT_BYTES, BASE_NONE,
         NULL, 0X0, NULL, HFILL}},
@@ -1265,6 +4061,10 @@ void proto_register_ethereum(void) {
        {"(NODES) Node ID", "ethereum.disc.packet.nodes.node.id", FT_BYTES, BASE_NONE,
         NULL, 0X0, NULL, HFILL}},
 
+      {&hf_ethereum_disc_nodes_nodes_distance,
+       {"(NODES) Log distance to target", "ethereum.disc.packet.nodes.node.distance", FT_UINT16, BASE_DEC,
+        NULL, 0X0, "Kademlia log2 distance between the Keccak-256 of the node ID and of the FIND_NODE target", HFILL}},
+
       {&hf_ethereum_disc_nodes_expiration,
        {"(NODES) Expiration", "ethereum.disc.packet.nodes.expiration", FT_ABSOLUTE_TIME, ABSOLUTE_TIME_LOCAL,
         NULL, 0X0, NULL, HFILL}},
@@ -1305,19 +4105,78 @@ void proto_register_ethereum(void) {
   static gint *ett[] = {
       &ett_ethereum_disc_toplevel,
       &ett_ethereum_disc_packetdata,
-      &ett_ethereum_disc_nodes
+      &ett_ethereum_disc_nodes,
+      &ett_ethereum_disc_hash,
+      &ett_ethereum_disc_peer,
+      &ett_ethereum_disc_lookup
+  };
+
+  static ei_register_info ei[] = {
+      {&ei_ethereum_disc_hash_mismatch,
+       {"ethereum.disc.hash.mismatch", PI_CHECKSUM, PI_ERROR,
+        "Message hash doesn't match the message (corrupted or spoofed)", EXPFILL}},
+      {&ei_ethereum_disc_bad_signature,
+       {"ethereum.disc.signature.invalid", PI_PROTOCOL, PI_WARN,
+        "No sender can be recovered from the message signature", EXPFILL}},
+      {&ei_ethereum_disc_duplicate,
+       {"ethereum.disc.duplicate", PI_SEQUENCE, PI_NOTE,
+        "Duplicate of an earlier message", EXPFILL}}
   };
 
   proto_ethereum = proto_register_protocol("Ethereum discovery protocol", "ETH discovery", "ethereum.disc");
 
   // Register dissector.
-  ethereum_disc_dtor_handle = create_dissector_handle(dissect_ethereum_heur, proto_ethereum);
+  ethereum_disc_dtor_handle = create_dissector_handle(dissect_ethereum_pinned, proto_ethereum);
   proto_register_field_array(proto_ethereum, hf, array_length(hf));
   proto_register_subtree_array(ett, array_length(ett));
+  expert_ethereum = expert_register_protocol(proto_ethereum);
+  expert_register_field_array(expert_ethereum, ei, array_length(ei));
+  register_init_routine(ethereum_disc_init);
+  register_cleanup_routine(ethereum_disc_cleanup);
+
+  // Register preferences.
+  ethereum_module = prefs_register_protocol(proto_ethereum, ethereum_disc_prefs_apply);
+  prefs_register_bool_preference(ethereum_module, "streaming", "Streaming mode",
+                                 "Single-pass mode for long-running live captures: per-conversation state "
+                                 "is evicted to stay within a memory budget, and requests are not linked to "
+                                 "their responses",
+                                 &ethereum_disc_streaming);
+  prefs_register_uint_preference(ethereum_module, "streaming_budget", "Streaming mode memory budget (MB)",
+                                 "Maximum memory used by per-conversation state in streaming mode",
+                                 10, &ethereum_disc_streaming_budget);
+  prefs_register_uint_preference(ethereum_module, "streaming_ttl", "Streaming mode state TTL (s)",
+                                 "Seconds after which the state of an idle conversation is evicted in "
+                                 "streaming mode (0 to disable)",
+                                 10, &ethereum_disc_streaming_ttl);
+  prefs_register_bool_preference(ethereum_module, "verify_hash", "Verify message hashes",
+                                 "Check the message hash of discovery v4 packets against the Keccak-256 of the "
+                                 "message, to spot corrupted or spoofed packets",
+                                 &ethereum_disc_verify_hash);
+  prefs_register_bool_preference(ethereum_module, "recover_sender", "Recover sender node IDs",
+                                 "Recover the node ID of the sender of discovery v4 packets from their signature, "
+                                 "when it is displayed or filtered on",
+                                 &ethereum_disc_recover_sender);
+  prefs_register_uint_preference(ethereum_module, "crypto_workers", "Crypto worker threads",
+                                 "Number of background threads verifying hashes and recovering senders during "
+                                 "the first pass (0 to run them inline, upon display)",
+                                 10, &ethereum_disc_crypto_workers);
+  prefs_register_directory_preference(ethereum_module, "sidecar_dir", "Sidecar directory",
+                                      "Directory of the sidecar files keeping the hash verifications and sender "
+                                      "recoveries of capture files, so they are not computed again when a capture "
+                                      "file is reopened (empty to disable)",
+                                      &ethereum_disc_sidecar_dir);
+  ethereum_lru_init(&sender_cache, sender_hash_func, sender_equal_func, free_sender);
+  ethereum_lru_configure(&sender_cache, ETHEREUM_DISC_SENDER_CACHE_BUDGET, 0);
+  ethereum_lru_init(&stream_convs, g_int_hash, g_int_equal, free_stream_conversation);
+  ethereum_disc_prefs_apply();
 
   // Register statistics-related features.
   ethereum_tap = register_tap("ethereum");
   register_ethereum_stat_trees();
+  register_stat_tap_ui(&ethereum_graph_ui, NULL);
+  register_stat_tap_ui(&ethereum_hashindex_ui, NULL);
+  register_stat_tap_ui(&ethereum_columnar_ui, NULL);
+  register_stat_tap_ui(&ethereum_interval_ui, NULL);
   register_ethereum_srt_table();
 }
 
@@ -1327,4 +4186,5 @@ void proto_register_ethereum(void) {
 void proto_reg_handoff_ethereum(void) {
   heur_dissector_add("udp", dissect_ethereum_heur, "Ethereum (devp2p) discovery", "ETH discovery",
                      proto_ethereum, HEURISTIC_ENABLE);
+  expert_tap = find_tap_id("expert");
 }
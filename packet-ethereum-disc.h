@@ -0,0 +1,106 @@
+/* packet-ethereum-disc.h
+ * Decoded discovery messages, as handed to the consumers of the Ethereum discovery tap.
+ * Copyright 2018, ConsenSys AG.
+ *
+ * Wireshark - Network traffic analyzer
+ * By Gerald Combs <gerald@wireshark.org>
+ * Copyright 1998, Gerald Combs.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __PACKET_ETHEREUM_DISC_H__
+#define __PACKET_ETHEREUM_DISC_H__
+
+#include <epan/packet.h>
+
+#include "ethereum-disc-core.h"
+
+// A field of a decoded message. The bytes point into the packet data, and are only valid during the
+// dissection of the packet.
+typedef struct _ethereum_disc_field {
+  const guint8 *data;  // The bytes of the field, or NULL if the field is absent or wasn't captured.
+  guint64 value;       // The big-endian value of fields of up to 8 bytes; 0 otherwise.
+  guint32 offset;      // The offset of the field in the packet payload.
+  guint32 length;      // The length of the field.
+  gboolean present;    // The field is in the message.
+} ethereum_disc_field_t;
+
+// A peer endpoint of a decoded message.
+typedef struct _endpoint {
+  ethereum_disc_field_t ip;       // The address, only present with 4 (IPv4) or 16 (IPv6) bytes.
+  ethereum_disc_field_t udp;
+  ethereum_disc_field_t tcp;      // Optional; only present if non-empty.
+} ethereum_disc_endpoint_t;
+
+// A value, or a list of values, of a decoded message.
+typedef struct _ethereum_disc_values {
+  ethereum_disc_field_t *items;
+  guint count;
+} ethereum_disc_values_t;
+
+// A node advertised in a NODES or TOPIC_NODES message.
+typedef struct _ethereum_disc_node {
+  ethereum_disc_field_t record;   // The whole record of the node.
+  ethereum_disc_endpoint_t endpoint;
+  ethereum_disc_field_t id;
+} ethereum_disc_node_t;
+
+// A discovery message, decoded once per dissection of a frame. The protocol tree, the correlation and the taps
+// all work off it rather than the packet bytes. Fields that don't apply to the message type are absent.
+typedef struct _ethereum_disc_msg {
+  packet_type_e type;
+  gboolean is_discv5;
+  ethereum_disc_field_t version;     // PING.
+  ethereum_disc_endpoint_t from;     // PING.
+  ethereum_disc_endpoint_t to;       // PING, PONG.
+  ethereum_disc_field_t ping_hash;   // PONG.
+  ethereum_disc_field_t target;      // FIND_NODE, FIND_NODEHASH.
+  ethereum_disc_field_t echo;        // TOPIC_NODES.
+  ethereum_disc_node_t *nodes;       // NODES, TOPIC_NODES; up to the first malformed record.
+  guint node_count;
+  ethereum_disc_values_t topics;     // PING (discovery v5), TOPIC_QUERY (a single topic), TOPIC_REGISTER.
+  ethereum_disc_field_t topic_idx;   // TOPIC_REGISTER.
+  ethereum_disc_field_t topic_pong;  // TOPIC_REGISTER.
+  ethereum_disc_field_t expiration;  // All but TOPIC_REGISTER and TOPIC_NODES; optional in TOPIC_QUERY.
+  // The ticket of a PONG (discovery v5).
+  ethereum_disc_field_t topic_hash;
+  ethereum_disc_field_t ticket_serial;
+  ethereum_disc_values_t wait_periods;
+} ethereum_disc_msg_t;
+
+// The statistics struct handled by the Ethereum discovery tap.
+// Exportable as other dissectors can consume from our tap.
+typedef struct _ethereum_disc_stat {
+  gboolean is_request;
+  gboolean has_request;
+  packet_type_e packet_type;
+  guint node_count;
+  nstime_t rq_time;
+  const guint8 *hash;  // The message hash (discovery v4 only), or NULL.
+  guint evicted;       // The number of conversation states evicted so far (streaming mode only).
+  guint new_nodes;     // The number of nodes advertised for the first time in the capture (NODES only).
+  guint moved_nodes;   // The number of nodes advertised with another endpoint than before (NODES only).
+  const guint8 *sender_id;    // The node ID of the sender, if recovered (NODES only, with a graph tap).
+  const guint16 *distances;   // The log distances of the advertised nodes to the FIND_NODE target (NODES only).
+  guint distance_count;
+  packet_type_e request_type;  // The type of the request answered by a response (with has_request).
+  gboolean duplicate;          // The message hash was seen in an earlier frame (discovery v4 only).
+  guint32 seq;                 // The sequence number of the message in its conversation, or 0 for duplicates.
+  guint32 seqtype;             // The sequence number among the messages of its type in the conversation.
+  const ethereum_disc_msg_t *msg;  // The decoded message, or NULL if the payload couldn't be decoded.
+} ethereum_disc_stat_t;
+
+#endif //__PACKET_ETHEREUM_DISC_H__
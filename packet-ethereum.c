@@ -26,44 +26,152 @@
 #include "packet-ethereum.h"
 
 int rlp_next(tvbuff_t *tvb, guint offset, rlp_element_t *rlp) {
-  guint8 prefix = tvb_get_guint8(tvb, offset);
-  if (prefix <= 0x7f) {
-    // The value is itself.
-    rlp->type = VALUE;
-    rlp->data_offset = offset;
-    rlp->byte_length = 1;
-  } else if (prefix >= 0x80 && prefix <= 0xb7) {
-    // A value whose length is less or equal to 55 bytes.
-    rlp->type = VALUE;
-    rlp->data_offset = offset + 1;
-    rlp->byte_length = prefix - (guint8) 0x80;
-  } else if (prefix >= 0xb8 && prefix <= 0xbf) {
-    // A value whose length is larger than 55 bytes (recursive length).
-    rlp->type = VALUE;
-    guint l = prefix - (guint8) 0xb7;
-    if (l > 4) {
-      // We do not support lengths longer than 32 bits (i.e. max supported length is 2**32, 4Gb).
-      return FALSE;
-    }
-    rlp->data_offset = offset + 1 + l;
-    rlp->byte_length = tvb_get_bits32(tvb, (offset + 1) * 8, l * 8, ENC_BIG_ENDIAN);
-  } else if (prefix >= 0xc0 && prefix <= 0xf7) {
-    // A list whose byte length is less than 55 bytes.
-    rlp->type = LIST;
-    rlp->data_offset = offset + 1;
-    rlp->byte_length = prefix - (guint8) 0xc0;
-  } else if (prefix >= 0xf8) {
-    // A longer list.
-    rlp->type = LIST;
-    guint l = prefix - (guint8) 0xf7;
-    if (l > 4) {
-      // We do not support lengths longer than 32 bits (i.e. max supported length is 2**32, 4Gb).
-      return FALSE;
-    }
-    rlp->data_offset = offset + 1 + l;
-    rlp->byte_length = tvb_get_bits32(tvb, (offset + 1) * 8, l * 8, ENC_BIG_ENDIAN);
+  const rlp_prefix_info_t *info = &rlp_prefix_table[tvb_get_guint8(tvb, offset)];
+  if (info->len_of_len > 4) {
+    // We do not support lengths longer than 32 bits (i.e. max supported length is 2**32, 4Gb).
+    return FALSE;
   }
+  rlp->type = (rlp_type_t) info->type;
+  rlp->data_offset = offset + info->header_len;
+  rlp->byte_length = info->len_of_len == 0 ? info->short_len :
+                     tvb_get_bits32(tvb, (offset + 1) * 8, info->len_of_len * 8, ENC_BIG_ENDIAN);
   rlp->next_offset = tvb_captured_length_remaining(tvb, rlp->data_offset + rlp->byte_length) > 0 ?
                      rlp->data_offset + rlp->byte_length : 0;
   return TRUE;
 }
+
+/**
+ * Decodes an RLP element through the tvb accessors, for rlp_index_walk().
+ *
+ * @param data The buffer.
+ * @param offset The offset of the element.
+ * @param rlp The RLP element struct to update with the metadata.
+ * @return TRUE if the RLP introspection succeeded; FALSE otherwise.
+ */
+static gboolean rlp_next_tvb(gpointer data, guint offset, rlp_element_t *rlp) {
+  return rlp_next((tvbuff_t *) data, offset, rlp);
+}
+
+gboolean rlp_index_build(wmem_allocator_t *scope, tvbuff_t *tvb, guint offset, rlp_index_t *idx) {
+  guint end = tvb_reported_length(tvb);
+  const guint8 *buf = NULL;
+  guint capacity;
+
+  idx->count = 0;
+  idx->entries = NULL;
+  if (offset >= end) {
+    return FALSE;
+  }
+
+  // Grab the payload once and parse it from memory. Only truncated captures, where part of the
+  // payload is missing, go through the tvb accessors so that the usual exceptions are raised.
+  if (tvb_captured_length(tvb) == end) {
+    buf = tvb_get_ptr(tvb, 0, end);
+  }
+
+  // Every element takes at least one byte, so this bounds the number of entries.
+  capacity = MIN(end - offset, RLP_INDEX_MAX_ELEMENTS);
+  idx->entries = wmem_alloc_array(scope, rlp_index_entry_t, capacity);
+  return rlp_index_walk(buf, rlp_next_tvb, tvb, end, offset, capacity, idx);
+}
+
+gboolean rlp_index_build_ptr(wmem_allocator_t *scope, const guint8 *buf, guint len, guint offset, rlp_index_t *idx) {
+  guint capacity;
+
+  idx->count = 0;
+  idx->entries = NULL;
+  if (offset >= len) {
+    return FALSE;
+  }
+  capacity = MIN(len - offset, RLP_INDEX_MAX_ELEMENTS);
+  idx->entries = wmem_alloc_array(scope, rlp_index_entry_t, capacity);
+  return rlp_index_walk(buf, NULL, NULL, len, offset, capacity, idx);
+}
+
+void ethereum_lru_init(ethereum_lru_t *lru, GHashFunc hash_func, GEqualFunc equal_func,
+                       ethereum_lru_free_func free_func) {
+  lru->map = g_hash_table_new(hash_func, equal_func);
+  g_queue_init(&lru->order);
+  lru->size = 0;
+  lru->budget = 0;
+  lru->ttl = 0;
+  lru->evicted = 0;
+  lru->free_func = free_func;
+}
+
+void ethereum_lru_configure(ethereum_lru_t *lru, gsize budget, guint ttl) {
+  lru->budget = budget;
+  lru->ttl = ttl;
+}
+
+/**
+ * Evicts the least recently used entry of an LRU cache.
+ *
+ * @param lru The cache.
+ */
+static void ethereum_lru_evict_oldest(ethereum_lru_t *lru) {
+  ethereum_lru_entry_t *entry = (ethereum_lru_entry_t *) g_queue_pop_tail_link(&lru->order)->data;
+
+  g_hash_table_remove(lru->map, entry->key);
+  lru->size -= entry->size;
+  lru->evicted++;
+  lru->free_func(entry);
+}
+
+/**
+ * Evicts the entries of an LRU cache that were not used for longer than its TTL.
+ *
+ * @param lru The cache.
+ * @param now The current time.
+ */
+static void ethereum_lru_expire(ethereum_lru_t *lru, const nstime_t *now) {
+  GList *tail;
+
+  if (lru->ttl == 0) {
+    return;
+  }
+  while ((tail = g_queue_peek_tail_link(&lru->order)) != NULL) {
+    const ethereum_lru_entry_t *entry = (const ethereum_lru_entry_t *) tail->data;
+    if (now->secs - entry->last_used.secs <= (time_t) lru->ttl) {
+      break;
+    }
+    ethereum_lru_evict_oldest(lru);
+  }
+}
+
+ethereum_lru_entry_t *ethereum_lru_lookup(ethereum_lru_t *lru, gconstpointer key, const nstime_t *now) {
+  ethereum_lru_entry_t *entry;
+
+  ethereum_lru_expire(lru, now);
+  entry = (ethereum_lru_entry_t *) g_hash_table_lookup(lru->map, key);
+  if (entry) {
+    g_queue_unlink(&lru->order, &entry->link);
+    g_queue_push_head_link(&lru->order, &entry->link);
+    entry->last_used = *now;
+  }
+  return entry;
+}
+
+void ethereum_lru_insert(ethereum_lru_t *lru, ethereum_lru_entry_t *entry, gconstpointer key, gsize size,
+                         const nstime_t *now) {
+  ethereum_lru_expire(lru, now);
+  while (lru->budget && lru->size + size > lru->budget && lru->order.length > 0) {
+    ethereum_lru_evict_oldest(lru);
+  }
+
+  entry->link.data = entry;
+  entry->link.prev = entry->link.next = NULL;
+  entry->key = key;
+  entry->size = size;
+  entry->last_used = *now;
+  g_queue_push_head_link(&lru->order, &entry->link);
+  g_hash_table_insert(lru->map, (gpointer) key, entry);
+  lru->size += size;
+}
+
+void ethereum_lru_clear(ethereum_lru_t *lru) {
+  while (lru->order.length > 0) {
+    ethereum_lru_evict_oldest(lru);
+  }
+  lru->evicted = 0;
+}
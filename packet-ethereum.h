@@ -26,19 +26,7 @@
 
 #include <epan/packet.h>
 
-// RLP element types.
-typedef enum rlp_type {
-  VALUE,
-  LIST
-} rlp_type_t;
-
-// A struct that stores metadata about an RLP element
-typedef struct rlp_element {
-  rlp_type_t type;    // The element type
-  guint byte_length;  // The length in bytes of the payload of this element.
-  guint data_offset;  // The absolute offset in the buffer where the data actually starts within this element.
-  guint next_offset;  // The absolute offset in the buffer of the next element, or 0 iff end of buffer.
-} rlp_element_t;
+#include "ethereum-rlp.h"
 
 /**
  * Introspects an RLP element starting at the position in the buffer designated by offset.
@@ -52,4 +40,101 @@ typedef struct rlp_element {
  */
 int rlp_next(tvbuff_t *tvb, guint offset, rlp_element_t *rlp);
 
+/**
+ * Decodes all RLP elements from the offset until the end of the buffer, in one pass, into a flat index.
+ * Every element is checked to lie within the bounds of its enclosing list and of the buffer.
+ *
+ * @param scope The allocator from which to allocate the index entries.
+ * @param tvb The buffer.
+ * @param offset The offset of the first element to index.
+ * @param idx The index to populate.
+ * @return TRUE if the whole payload was indexed; FALSE if it is not well-formed RLP.
+ */
+gboolean rlp_index_build(wmem_allocator_t *scope, tvbuff_t *tvb, guint offset, rlp_index_t *idx);
+
+/**
+ * Same as rlp_index_build(), over a contiguous buffer.
+ *
+ * @param scope The allocator from which to allocate the index entries.
+ * @param buf The buffer.
+ * @param len The length of the buffer.
+ * @param offset The offset of the first element to index.
+ * @param idx The index to populate.
+ * @return TRUE if the whole payload was indexed; FALSE if it is not well-formed RLP.
+ */
+gboolean rlp_index_build_ptr(wmem_allocator_t *scope, const guint8 *buf, guint len, guint offset, rlp_index_t *idx);
+
+// An entry of an LRU cache, embedded in the struct holding the cached state.
+typedef struct ethereum_lru_entry {
+  GList link;            // The link in the recency list of the cache.
+  gconstpointer key;     // The key of the entry, owned by the cached state.
+  gsize size;            // The number of bytes accounted to the entry.
+  nstime_t last_used;    // The time of the last lookup or insertion of the entry.
+} ethereum_lru_entry_t;
+
+// Releases the state holding an entry evicted from an LRU cache.
+typedef void (*ethereum_lru_free_func)(ethereum_lru_entry_t *entry);
+
+// A cache of state bounded in memory (by evicting the least recently used entries) and in time (by expiring
+// the entries that were not used for a while).
+typedef struct ethereum_lru {
+  GHashTable *map;                   // Key => entry.
+  GQueue order;                      // Entries from the most recently used to the least recently used.
+  gsize size;                        // The number of bytes accounted to the entries.
+  gsize budget;                      // The maximum number of bytes accounted to the entries; 0 for no limit.
+  guint ttl;                         // Seconds after which an unused entry expires; 0 for no expiration.
+  guint64 evicted;                   // The number of entries evicted or expired so far.
+  ethereum_lru_free_func free_func;
+} ethereum_lru_t;
+
+/**
+ * Initializes an empty LRU cache, without limits.
+ *
+ * @param lru The cache.
+ * @param hash_func The hash function of the keys.
+ * @param equal_func The equality function of the keys.
+ * @param free_func The function releasing the state of evicted entries.
+ */
+void ethereum_lru_init(ethereum_lru_t *lru, GHashFunc hash_func, GEqualFunc equal_func,
+                       ethereum_lru_free_func free_func);
+
+/**
+ * Sets the limits of an LRU cache. They are enforced upon the next insertion.
+ *
+ * @param lru The cache.
+ * @param budget The maximum number of bytes accounted to the entries; 0 for no limit.
+ * @param ttl Seconds after which an unused entry expires; 0 for no expiration.
+ */
+void ethereum_lru_configure(ethereum_lru_t *lru, gsize budget, guint ttl);
+
+/**
+ * Looks up an entry in an LRU cache, and marks it as the most recently used. Expired entries are evicted first.
+ *
+ * @param lru The cache.
+ * @param key The key.
+ * @param now The current time.
+ * @return The entry, or NULL if it is not cached.
+ */
+ethereum_lru_entry_t *ethereum_lru_lookup(ethereum_lru_t *lru, gconstpointer key, const nstime_t *now);
+
+/**
+ * Inserts an entry in an LRU cache, and evicts the least recently used entries until the cache fits its budget.
+ * The entry itself is never evicted upon its insertion.
+ *
+ * @param lru The cache.
+ * @param entry The entry, embedded in the cached state.
+ * @param key The key, owned by the cached state.
+ * @param size The number of bytes to account to the entry.
+ * @param now The current time.
+ */
+void ethereum_lru_insert(ethereum_lru_t *lru, ethereum_lru_entry_t *entry, gconstpointer key, gsize size,
+                         const nstime_t *now);
+
+/**
+ * Evicts all the entries of an LRU cache. The eviction counter is reset too.
+ *
+ * @param lru The cache.
+ */
+void ethereum_lru_clear(ethereum_lru_t *lru);
+
 #endif //__PACKET_ETHEREUM_H__
@@ -3,8 +3,14 @@
 
 import itertools
 import json
+import os
+import re
+import shutil
+import struct
 import subprocess
+import tempfile
 import unittest
+from xml.etree import ElementTree
 
 class EthereumDiscoveryDissectorTest(unittest.TestCase):
 
@@ -12,6 +18,9 @@ class EthereumDiscoveryDissectorTest(unittest.TestCase):
         output = subprocess.check_output(["../wireshark-ninja/run/tshark", "-r", "./test/test.pcapng", "-T", "json"])
         self.pcap_output = json.loads(output)
 
+    def tshark(self, *args):
+        return subprocess.check_output(["../wireshark-ninja/run/tshark", "-r", "./test/test.pcapng"] + list(args))
+
     def filter_by_type(self, packet_type):
         predicate = lambda frame: frame.get("_source", {}).get("layers", {}).get("ethereum.disc", {}).get("ethereum.disc.packet", "") == packet_type;
         extractor = lambda frame: frame["_source"]["layers"]["ethereum.disc"]
@@ -74,6 +83,437 @@ class EthereumDiscoveryDissectorTest(unittest.TestCase):
                 self.fail()
         self.assertEqual(nodes_cnt, 144)
 
+    def test_node_records(self):
+        # Node records are decoded by the schema of their fields; the TCP port is optional.
+        fields = ["id", "ipv4", "udp_port", "tcp_port"]
+        args = ["-Y", "ethereum.disc.packet == \"NODES\"", "-T", "fields"]
+        for field in fields:
+            args += ["-e", "ethereum.disc.packet.nodes.node." + field]
+        counts = dict((field, 0) for field in fields)
+        lines = self.tshark(*args).splitlines()
+        for line in lines:
+            values = line.split("\t")
+            for field, value in zip(fields, values):
+                counts[field] += len(value.split(",")) if value else 0
+            self.assertTrue(all(len(node_id.replace(":", "")) == 128 for node_id in values[0].split(",") if values[0]))
+        self.assertEqual(len(lines), 144)
+        self.assertEqual(counts, {"id": 1152, "ipv4": 1152, "udp_port": 1152, "tcp_port": 1151})
+
+    def test_duplicates(self):
+        payload_fields = {
+            "PING": "ethereum.disc.packet.ping.recipient.udp_port",
+            "PONG": "ethereum.disc.packet.pong.ping_hash",
+            "FIND_NODE": "ethereum.disc.packet.find_node.target",
+        }
+        duplicate_cnt = {}
+        for i in self.pcap_output:
+            layers = i["_source"]["layers"]
+            frame = layers.get("ethereum.disc", {})
+            if "ethereum.disc.duplicate_of" not in frame:
+                continue
+            packet_type = frame["ethereum.disc.packet"]
+            duplicate_cnt[packet_type] = duplicate_cnt.get(packet_type, 0) + 1
+            # Duplicates are rendered in full, but don't update the state.
+            self.assertLess(int(frame["ethereum.disc.duplicate_of"]), int(layers["frame"]["frame.number"]))
+            self.assertIn(payload_fields[packet_type], frame["ethereum.disc.packet_tree"])
+            self.assertNotIn("ethereum.disc.packet.seq", frame)
+        self.assertEqual(duplicate_cnt, {"PING": 34, "PONG": 19, "FIND_NODE": 50})
+
+    def test_lazy_decoding(self):
+        # Without a tree, only the node counts of NODES are decoded, for the Info column.
+        node_counts = [int(m.group(1)) for m in re.finditer(r"NODES \((\d+) nodes\)", self.tshark())]
+        self.assertEqual(len(node_counts), 144)
+        self.assertEqual(sum(node_counts), 1152)
+
+        # The first of two passes has no tree either, and correlates off the values only.
+        reqrefs = {}
+        for i in self.pcap_output:
+            layers = i["_source"]["layers"]
+            if "ethereum.disc.packet.reqref" in layers.get("ethereum.disc", {}):
+                reqrefs[layers["frame"]["frame.number"]] = layers["ethereum.disc"]["ethereum.disc.packet.reqref"]
+        lines = self.tshark("-2", "-T", "fields", "-e", "frame.number", "-e", "ethereum.disc.packet.reqref")
+        two_pass = dict(line.split("\t") for line in lines.splitlines() if line.split("\t")[1])
+        self.assertEqual(two_pass, reqrefs)
+
+    def stats_tree_counts(self, output):
+        # The count of each item of the last statistics tree of the output, by name (first occurrence).
+        counts = {}
+        for line in output[output.rfind("Topic / Item"):].splitlines()[1:]:
+            m = re.match(r"^\s*(\S.*?)\s{2,}(\d+)(\s|$)", line)
+            if m and m.group(1) not in counts:
+                counts[m.group(1)] = int(m.group(2))
+        return counts
+
+    def test_tree_less_stats(self):
+        # Tapping without a tree counts the same as with the packet details.
+        tree_less = self.stats_tree_counts(self.tshark("-q", "-z", "ETH,tree"))
+        self.assertEqual(self.stats_tree_counts(self.tshark("-V", "-z", "ETH,tree")), tree_less)
+        self.assertEqual(tree_less["Total packets"], 1491)
+        self.assertEqual(tree_less["Duplicate packets (not counted)"], 103)
+        self.assertEqual(tree_less["NODES"], 144)
+
+    def stats_tree_children(self, output, name):
+        # The children of a node are indented one more space than the node.
+        children, indent = [], None
+        for line in output.splitlines():
+            depth = len(line) - len(line.lstrip(" "))
+            if indent is None:
+                if line.strip().startswith(name + "  "):
+                    indent = depth
+            elif depth <= indent or not line.strip():
+                break
+            elif depth == indent + 1:
+                children.append(line.strip())
+        return children
+
+    def test_top_peers(self):
+        # Of the 177 peers responding in the capture, the 16 slots hold those with the most responses, as counted
+        # by the per-peer tree; the peers that gave a slot up are zeroed.
+        output = self.tshark("-q", "-z", "ETH,tree", "-z", "ETH_peers,tree")
+        counts = dict((peer.split()[0], int(peer.split()[1]))
+                      for peer in self.stats_tree_children(output, "Response times per peer (us)"))
+        self.assertEqual(len(counts), 177)
+        slots = self.stats_tree_children(output, "Top peers")
+        self.assertEqual([slot.split()[0] + " " + slot.split()[1] for slot in slots],
+                         ["peer %d" % i for i in range(1, 17)])
+        top = {}
+        for i in range(1, 17):
+            for child in self.stats_tree_children(output, "peer %d" % i):
+                name, count = child.split()[:2]
+                if ":" in name and count != "0":
+                    top[name] = int(count)
+        self.assertEqual(len(top), 16)
+        for name, count in top.items():
+            self.assertEqual(count, counts[name])
+        others = [count for name, count in counts.items() if name not in top]
+        self.assertGreaterEqual(min(top.values()), max(others))
+
+    def test_node_table(self):
+        # The node table counts, and the peer subtree of each advertised node, match a replay of the advertisements
+        # in capture order; the distinct advertisers are estimated, and exact for nodes advertised by one peer.
+        output = self.tshark("-n", "-T", "pdml", "-Y", "ethereum.disc.packet == \"NODES\"")
+        peers = {}
+        ads = new = moved = exact_sum = estimate_sum = 0
+        for packet in ElementTree.fromstring(output).iter("packet"):
+            fields = dict((field.get("name"), field.get("show")) for field in packet.iter("field"))
+            frame = int(fields["frame.number"])
+            advertiser = (fields.get("ip.src", fields.get("ipv6.src")), fields["udp.srcport"])
+            for node in packet.iter("field"):
+                if node.get("name") != "ethereum.disc.packet.nodes.node":
+                    continue
+                values = dict((field.get("name").split(".")[-1], field.get("show")) for field in node.iter("field"))
+                node_id = [field.get("value") for field in node.iter("field")
+                           if field.get("name") == "ethereum.disc.packet.nodes.node.id"][0]
+                endpoint = (values.get("ipv4", values.get("ipv6")), values["udp_port"], values.get("tcp_port", "0"))
+                peer = peers.get(node_id)
+                if not peer:
+                    peer = peers[node_id] = {"first": frame, "endpoints": [(endpoint, frame)], "count": 1,
+                                             "advertisers": set()}
+                elif peer["endpoints"][0][0] != endpoint:
+                    peer["endpoints"] = [(endpoint, frame)] + peer["endpoints"][:1]
+                    peer["count"] += 1
+                peer["advertisers"].add(advertiser)
+                ads += 1
+                if peer["first"] == frame:
+                    new += 1
+                elif any(first == frame for _, first in peer["endpoints"]):
+                    moved += 1
+
+                self.assertEqual(int(values["endpoints"]), peer["count"])
+                estimate, exact = int(values["advertisers"]), len(peer["advertisers"])
+                self.assertLessEqual(estimate, int(values["advertised"]))
+                if exact == 1:
+                    self.assertEqual(estimate, 1)
+                exact_sum += exact
+                estimate_sum += estimate
+        self.assertEqual(ads, 1152)
+        self.assertLessEqual(abs(estimate_sum - exact_sum), exact_sum / 10)
+
+        counts = self.stats_tree_counts(self.tshark("-q", "-z", "ETH_nodes,tree"))
+        self.assertEqual(counts["Node advertisements"], ads)
+        self.assertEqual(counts["Distinct node IDs"], new)
+        self.assertEqual(counts.get("Advertised with a new endpoint", 0), moved)
+
+    def test_distances(self):
+        # The distance tree buckets the log distances shown for the nodes returned to FIND_NODE requests, and counts
+        # the NODES packets of each responder.
+        lines = self.tshark("-T", "fields", "-e", "ip.src", "-e", "udp.srcport", "-e",
+                            "ethereum.disc.packet.nodes.node.distance", "-Y",
+                            "ethereum.disc.packet.nodes.node.distance && !ethereum.disc.duplicate_of").splitlines()
+        bounds = [(0, "< 240"), (240, "240-243"), (244, "244-247"), (248, "248-251"), (252, "252-255"), (256, "256")]
+        buckets, responders = {}, {}
+        for line in lines:
+            src, port, distances = line.split("\t")
+            responders[src + ":" + port] = responders.get(src + ":" + port, 0) + 1
+            for distance in map(int, distances.split(",")):
+                self.assertLessEqual(distance, 256)
+                name = [name for bound, name in bounds if distance >= bound][-1]
+                buckets[name] = buckets.get(name, 0) + 1
+        self.assertTrue(lines)
+
+        output = self.tshark("-q", "-z", "ETH_distances,tree")
+        counts = self.stats_tree_counts(output)
+        self.assertEqual(counts["Log distances of returned nodes to the FIND_NODE target"], sum(buckets.values()))
+        for bound, name in bounds:
+            self.assertEqual(counts[name], buckets.get(name, 0))
+        per_responder = dict((child.split()[0], int(child.split()[1]))
+                             for child in self.stats_tree_children(output, "Per responder"))
+        self.assertEqual(per_responder, responders)
+
+    def test_lookup_sessions(self):
+        # Each session groups the FIND_NODE requests of an originator for a target, and sums up the requests and the
+        # NODES responses shown with it, once the whole capture is read.
+        names = ["frame", "packet", "src", "port", "target", "lookup", "first_frame", "hop", "hops", "requests",
+                 "unique_nodes", "closest", "ids", "distances"]
+        fields = ["frame.number", "ethereum.disc.packet", "ip.src", "udp.srcport",
+                  "ethereum.disc.packet.find_node.target", "ethereum.disc.lookup", "ethereum.disc.lookup.first_frame",
+                  "ethereum.disc.lookup.hop", "ethereum.disc.lookup.hops", "ethereum.disc.lookup.requests",
+                  "ethereum.disc.lookup.unique_nodes", "ethereum.disc.lookup.closest",
+                  "ethereum.disc.packet.nodes.node.id", "ethereum.disc.packet.nodes.node.distance"]
+        args = ["-2", "-T", "fields", "-Y", "ethereum.disc.lookup"]
+        for field in fields:
+            args += ["-e", field]
+        sessions = {}
+        for line in self.tshark(*args).splitlines():
+            row = dict(zip(names, line.split("\t")))
+            session = sessions.setdefault(int(row["lookup"]), {"requests": [], "ids": set(), "distances": [],
+                                                               "summaries": set()})
+            session["summaries"].add((row["first_frame"], row["hops"], row["requests"], row["unique_nodes"],
+                                      row["closest"]))
+            if row["packet"] == "FIND_NODE":
+                session["requests"].append((int(row["frame"]), row["src"], row["port"], row["target"],
+                                            int(row["hop"])))
+            elif row["ids"]:
+                session["ids"].update(row["ids"].split(","))
+                session["distances"] += map(int, row["distances"].split(","))
+
+        self.assertTrue(sessions)
+        self.assertEqual(sorted(sessions), range(1, len(sessions) + 1))
+        self.assertEqual(sum(len(session["requests"]) for session in sessions.values()),
+                         len(self.tshark("-Y", "ethereum.disc.packet == \"FIND_NODE\" && !ethereum.disc.duplicate_of")
+                             .splitlines()))
+        first_frames = []
+        for number, session in sorted(sessions.items()):
+            requests = session["requests"]
+            self.assertEqual(len(session["summaries"]), 1)
+            first_frame, hops, request_count, unique_nodes, closest = session["summaries"].pop()
+            self.assertEqual(len(set(request[1:4] for request in requests)), 1)
+            self.assertEqual(int(first_frame), requests[0][0])
+            self.assertEqual(int(request_count), len(requests))
+            self.assertEqual(int(hops), max(request[4] for request in requests))
+            self.assertEqual(requests[0][4], 1)
+            self.assertEqual(int(unique_nodes), len(session["ids"]))
+            self.assertEqual(closest, str(min(session["distances"])) if session["distances"] else "")
+            first_frames.append(requests[0][0])
+        self.assertEqual(first_frames, sorted(first_frames))
+
+    def test_interval(self):
+        # The capture spans 54 seconds, 20 of which without any packet.
+        lines = self.tshark("-q", "-z", "ethereum,interval,1").splitlines()
+        intervals = [dict(pair.split("=", 1) for pair in line.split()[1:])
+                     for line in lines if line.startswith("ethereum,interval: ")]
+        starts = [int(float(interval["start"])) for interval in intervals]
+        self.assertEqual(len(intervals), 54)
+        self.assertEqual(starts, range(starts[0], starts[0] + 54))
+        self.assertEqual(len([interval for interval in intervals if interval["packets"] == "0"]), 20)
+        self.assertEqual(sum(int(interval["packets"]) for interval in intervals), 1491)
+        self.assertEqual(sum(int(interval["duplicates"]) for interval in intervals), 103)
+
+    def test_analyzer(self):
+        # The standalone analyzer counts the same messages as the ETH stats tree, whatever the number of threads.
+        counts = []
+        for threads in ("1", "4"):
+            output = subprocess.check_output(["../wireshark-ninja/run/ethereum-analyzer", "-j", threads,
+                                              "./test/test.pcapng"])
+            counts.append(dict((m.group(1).strip(), int(m.group(2)))
+                               for m in re.finditer(r"^ *(\S.*?) +(\d+) +[\d.]+%$", output, re.M)))
+        self.assertEqual(counts[0], counts[1])
+        tshark = self.stats_tree_counts(self.tshark("-q", "-z", "ETH,tree"))
+        for item in ("Total packets", "PING", "PONG", "FIND_NODE", "NODES", "Duplicate packets (not counted)"):
+            self.assertEqual(counts[0][item], tshark[item])
+        self.assertEqual(counts[0]["Total packets"], 1491)
+        self.assertEqual(counts[0]["Duplicate packets (not counted)"], 103)
+        self.assertEqual(counts[0]["NODES"], 144)
+
+    def test_columnar(self):
+        # The export reads back as one row per non-duplicate message, in capture order.
+        expected = []
+        for i in self.pcap_output:
+            layers = i["_source"]["layers"]
+            frame = layers.get("ethereum.disc")
+            if frame and "ethereum.disc.duplicate_of" not in frame:
+                expected.append([layers["frame"]["frame.number"], frame["ethereum.disc.packet"]])
+        export = tempfile.NamedTemporaryFile(suffix=".col")
+        self.tshark("-q", "-z", "ethereum,columnar," + export.name)
+        output = subprocess.check_output(["../wireshark-ninja/run/ethereum-columnar-dump", export.name])
+        rows = [line.split(",") for line in output.splitlines()]
+        self.assertEqual(rows[0][0], "frame")
+        self.assertEqual([[row[0], row[6]] for row in rows[1:]], expected)
+        self.assertEqual(len(expected), 1491)
+
+    def test_streaming(self):
+        # Within the budget, the conversation states of the streaming mode correlate as the regular ones do.
+        fields = ["-T", "fields", "-E", "separator=,", "-e", "frame.number", "-e", "ethereum.disc.packet.reqref",
+                  "-e", "ethereum.disc.packet.rt", "-Y", "ethereum.disc"]
+        regular = self.tshark(*fields).splitlines()
+        streaming = self.tshark(*(fields + ["-e", "ethereum.disc.evicted", "-o", "ethereum.disc.streaming:TRUE"]))
+        streaming = [line.split(",") for line in streaming.splitlines()]
+        self.assertEqual([",".join(line[:3]) for line in streaming], regular)
+        self.assertEqual(set(line[3] for line in streaming), set(["0"]))
+        self.assertTrue(any(line.split(",")[1] for line in regular))
+
+    def test_sender_id(self):
+        # Every signature yields a sender, and the duplicates served from the cache keep the sender of the original.
+        output = self.tshark("-T", "fields", "-E", "separator=,", "-e", "frame.number", "-e",
+                             "ethereum.disc.duplicate_of", "-e", "ethereum.disc.sender_id", "-Y", "ethereum.disc")
+        senders = {}
+        duplicates = 0
+        for line in output.splitlines():
+            frame, duplicate_of, sender_id = line.split(",")
+            self.assertRegexpMatches(sender_id.replace(":", ""), r"^[0-9a-f]{128}$")
+            senders[frame] = sender_id
+            if duplicate_of:
+                self.assertEqual(sender_id, senders[duplicate_of])
+                duplicates += 1
+        self.assertEqual(len(senders), 1594)
+        self.assertEqual(duplicates, 103)
+
+    def test_hash_valid(self):
+        # Every discovery v4 message hash is verified once a field is wanted, and matches.
+        output = self.tshark("-T", "fields", "-e", "ethereum.disc.hash_valid", "-Y", "ethereum.disc")
+        self.assertEqual(output.splitlines(), ["1"] * 1594)
+        output = self.tshark("-Y", "ethereum.disc.hash_valid == 0")
+        self.assertEqual(output, "")
+
+    def test_crypto_workers(self):
+        # The checks run by the crypto workers during the first pass match the inline ones. The read filter builds
+        # a tree referencing the sender ID in the first pass, so that the jobs get submitted.
+        fields = ("-T", "fields", "-E", "separator=,", "-e", "frame.number", "-e", "ethereum.disc.hash_valid", "-e",
+                  "ethereum.disc.sender_id", "-e", "ethereum.disc.crypto_pending")
+        read_filter = ("-2", "-R", "ethereum.disc || ethereum.disc.sender_id")
+        inline = self.tshark(*(fields + read_filter)).splitlines()
+        background = self.tshark(*(fields + read_filter + ("-o", "ethereum.disc.crypto_workers:4"))).splitlines()
+        self.assertEqual(len(inline), 1594)
+        self.assertEqual(len(background), 1594)
+        ready = 0
+        for expected, actual in zip(inline, background):
+            frame, hash_valid, sender_id, pending = actual.split(",")
+            self.assertTrue(expected.startswith(frame + ","))
+            if pending:
+                continue
+            self.assertEqual(actual, expected)
+            ready += 1
+        self.assertGreater(ready, 0)
+
+    def graph_edges(self, *args):
+        output = self.tshark(*(args + ("-q", "-z", "ethereum,graph")))
+        return [line.split() for line in output.splitlines() if line and not line.startswith("#")]
+
+    def test_graph(self):
+        # Without sender recovery, senders are resolved through the endpoints advertised in earlier NODES packets.
+        recovered = self.graph_edges()
+        resolved = self.graph_edges("-o", "ethereum.disc.recover_sender:FALSE")
+        node_id = re.compile(r"^[0-9a-f]{128}$")
+        for edges in (recovered, resolved):
+            self.assertTrue(all(node_id.match(edge[1]) for edge in edges))
+            self.assertEqual(sum(int(edge[2]) for edge in edges), 1152)
+        resolved_ids = set(edge[0] for edge in resolved if node_id.match(edge[0]))
+        self.assertTrue(resolved_ids)
+        self.assertTrue(resolved_ids <= set(edge[0] for edge in recovered))
+
+        # An unknown format is a usage error, and no graph is written.
+        process = subprocess.Popen(["../wireshark-ninja/run/tshark", "-r", "./test/test.pcapng", "-q", "-z",
+                                    "ethereum,graph,dot"], stdout=subprocess.PIPE, stderr=subprocess.PIPE)
+        output, error = process.communicate()
+        self.assertIn("ethereum,graph: usage: ", error)
+        self.assertNotIn("# source", output)
+
+    def test_sidecar(self):
+        # The hash verifications are written to a sidecar file, and read back when the capture is opened again,
+        # unless the file was written by another build.
+        sidecar_dir = tempfile.mkdtemp()
+        args = ["-o", "ethereum.disc.sidecar_dir:" + sidecar_dir, "-T", "fields", "-e", "ethereum.disc.hash_valid",
+                "-Y", "ethereum.disc"]
+        self.assertEqual(self.tshark(*args).splitlines(), ["1"] * 1594)
+        names = os.listdir(sidecar_dir)
+        self.assertEqual(len(names), 1)
+        path = os.path.join(sidecar_dir, names[0])
+        with open(path, "rb") as f:
+            contents = bytearray(f.read())
+        header_len, record_len = 88, 80
+        count = struct.unpack_from("=I", contents, header_len - 8)[0]
+        self.assertEqual(count, 1594)
+        self.assertEqual(len(contents), header_len + count * record_len)
+
+        # Records claiming the hashes are invalid are trusted from the same build...
+        for i in range(count):
+            struct.pack_into("=I", contents, header_len + i * record_len + 4, 0x01)
+        with open(path, "wb") as f:
+            f.write(contents)
+        self.assertEqual(self.tshark(*args).splitlines(), ["0"] * 1594)
+
+        # ... but not from another one.
+        contents[32:80] = b"0.0.0-stale".ljust(48, b"\0")
+        for i in range(count):
+            struct.pack_into("=I", contents, header_len + i * record_len + 4, 0x01)
+        with open(path, "wb") as f:
+            f.write(contents)
+        self.assertEqual(self.tshark(*args).splitlines(), ["1"] * 1594)
+        shutil.rmtree(sidecar_dir)
+
+    def test_hashindex(self):
+        # The capture is correlated with itself, as if it had also been taken at its busiest peer: every message
+        # between the two hosts is received, with no latency, whether the index is written in one run or several.
+        lines = self.tshark("-T", "fields", "-e", "ip.src", "-e", "ip.dst", "-e", "ethereum.disc.packet", "-Y",
+                            "ethereum.disc && !ethereum.disc.duplicate_of").splitlines()
+        messages = [line.split("\t") for line in lines]
+        hosts = {}
+        for src, dst, packet_type in messages:
+            for addr in (src, dst):
+                hosts[addr] = hosts.get(addr, 0) + 1
+        local = max(hosts, key=hosts.get)
+        peers = {}
+        for src, dst, packet_type in messages:
+            if local in (src, dst):
+                peer = dst if src == local else src
+                peers[peer] = peers.get(peer, 0) + 1
+        peer = max(peers, key=peers.get)
+        expected = {}
+        for src, dst, packet_type in messages:
+            if sorted((src, dst)) == sorted((local, peer)):
+                expected[packet_type] = expected.get(packet_type, 0) + 1
+
+        index_dir = tempfile.mkdtemp()
+        whole = os.path.join(index_dir, "whole.idx")
+        runs = os.path.join(index_dir, "runs.idx")
+        output = self.tshark("-q", "-z", "ethereum,hashindex," + whole, "-z", "ethereum,hashindex," + runs + ",100")
+        self.assertIn("ethereum,hashindex: 1491 messages indexed in " + whole, output)
+        self.assertIn("ethereum,hashindex: 1491 messages indexed in " + runs, output)
+        report = subprocess.check_output(["../wireshark-ninja/run/ethereum-xcorr", whole + "=" + local,
+                                          runs + "=" + peer])
+        shutil.rmtree(index_dir)
+
+        self.assertIn("1491 distinct messages, %d not between captured hosts" % (1491 - sum(expected.values())),
+                      report)
+        types = {}
+        for line in report[report.index("Per message type:"):report.index("Per peer pair")].splitlines()[2:]:
+            if line:
+                types[line.split()[0]] = line.split()[1:]
+        self.assertEqual(sorted(types), sorted(expected))
+        for packet_type, count in expected.items():
+            sent, received, lost, loss, unmatched, skewed = types[packet_type][:6]
+            self.assertEqual([int(sent), int(received), int(lost), int(unmatched), int(skewed)],
+                             [count, count, 0, 0, 0])
+            self.assertEqual(types[packet_type][-1], "0")
+
+    def test_snaplen(self):
+        # Datagrams truncated by the capture are still recognized, and dissected as far as they were captured.
+        truncated = tempfile.NamedTemporaryFile(suffix=".pcapng")
+        subprocess.check_call(["../wireshark-ninja/run/editcap", "-s", "200", "./test/test.pcapng", truncated.name])
+        output = subprocess.check_output(["../wireshark-ninja/run/tshark", "-r", truncated.name, "-T", "fields",
+                                          "-e", "ethereum.disc.packet", "-Y", "ethereum.disc"])
+        self.assertEqual(len(output.splitlines()), 1594)
+
     def test_error(self):
         error = 0
         for i in self.pcap_output:
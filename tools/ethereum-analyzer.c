@@ -0,0 +1,988 @@
+/* ethereum-analyzer.c
+ * Standalone analyzer of the discovery traffic of capture files: reads pcap/pcapng files directly, and computes
+ * the statistics of the ETH stats tree and of the SRT table on several threads.
+ * Copyright 2018, ConsenSys AG.
+ *
+ * Wireshark - Network traffic analyzer
+ * By Gerald Combs <gerald@wireshark.org>
+ * Copyright 1998, Gerald Combs.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Usage: ethereum-analyzer [-j <threads>] <capture> [<capture>...]
+ *
+ * The captures are read in order on the main thread, which only decodes the link, IP and UDP headers, and detects
+ * the duplicate messages, which cross conversations when a node sends the same message to several peers. Datagrams
+ * that may be discovery messages are handed over in batches to worker threads, sharded by conversation (the
+ * address/port pair, whatever the direction), so that each conversation is processed in capture order by a single
+ * worker, without any locking. The workers apply the heuristics of the dissector, index the payload with the RLP
+ * core of the plugin (ethereum-rlp.c), and correlate requests and responses with the protocol core shared with
+ * the dissector (ethereum-disc-core.c). Their counters and histograms are merged once all captures are read.
+ *
+ * The reading is not parallelized: wiretap reads a capture sequentially, and the main thread decodes the headers,
+ * looks up the message hash and copies each datagram into a batch. On a synthetic capture of 426000 discovery
+ * datagrams (164 MB), this takes about 0.36 us per datagram on the main thread, excluding wiretap, against 0.82 us
+ * per datagram on the workers (measured from the CPU time of each thread): whatever the number of threads, the
+ * reader caps the speedup over -j 1 at about 3.3. Moving that work to the workers wouldn't lift the cap: the reader
+ * has to decode the headers to shard by conversation, and to look up the hashes in capture order to detect the
+ * duplicates across conversations, and wiretap reuses its buffer for the next record. The time spent reading, and
+ * the part of it spent waiting for the workers, is printed on stderr; a reader that rarely waits is the bottleneck,
+ * and more threads won't help.
+ *
+ * The memory footprint is bounded by the number of batches in flight and by the conversations active within the
+ * last ANALYZER_FLOW_IDLE seconds, whatever the size of the captures. As in the streaming mode of the dissector,
+ * duplicate messages are only detected among the last ANALYZER_DUP_MAX messages.
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <glib.h>
+
+#include <wiretap/wtap.h>
+#include <wsutil/pint.h>
+
+#include "ethereum-disc-core.h"
+#include "ethereum-rlp.h"
+#include "ethereum-histogram.h"
+
+// Number of recent messages among which duplicates are detected (the bound of the streaming mode of the dissector),
+// and the number of slots of the set (a power of 2).
+#define ANALYZER_DUP_MAX (1 << 18)
+#define ANALYZER_DUP_SLOTS (1 << 19)
+
+// Seconds of inactivity after which the state of a conversation is dropped, and seconds of capture time between
+// two sweeps of the idle conversations of a worker.
+#define ANALYZER_FLOW_IDLE 300
+#define ANALYZER_SWEEP_INTERVAL 60
+
+// Number of datagrams per batch, and number of batches per worker: the reader blocks once they are all in flight.
+#define ANALYZER_BATCH_PACKETS 1024
+#define ANALYZER_BATCHES 4
+
+// Maximum number of worker threads.
+#define ANALYZER_MAX_THREADS 256
+
+// Length of an endpoint (an IPv6 or IPv4-mapped address, and a port in network byte order), and of the key of a
+// conversation, i.e. its two endpoints in ascending order.
+#define ANALYZER_ENDPOINT_LEN 18
+#define ANALYZER_FLOW_KEY_LEN (2 * ANALYZER_ENDPOINT_LEN)
+
+#define NSECS_PER_SEC G_GUINT64_CONSTANT(1000000000)
+
+// The number of packet types.
+#define PACKET_TYPES (TOPIC_NODES + 1)
+
+static const gchar *packet_type_names[PACKET_TYPES] = {
+    [UNKNOWN] = "(Unknown)",
+    [PING] = "PING",
+    [PONG] = "PONG",
+    [FIND_NODE] = "FIND_NODE",
+    [NODES] = "NODES",
+    [FIND_NODEHASH] = "FIND_NODEHASH",
+    [TOPIC_REGISTER] = "TOPIC_REGISTER",
+    [TOPIC_QUERY] = "TOPIC_QUERY",
+    [TOPIC_NODES] = "TOPIC_NODES"
+};
+
+// Request/response pairs, as in the SRT table.
+typedef enum rt_pair {
+  RT_PING_PONG,
+  RT_FIND_NODE_NODES,
+  RT_FIND_NODEHASH_NODES,
+  RT_TOPIC_QUERY_TOPIC_NODES,
+  RT_PAIRS
+} rt_pair_e;
+
+static const gchar *rt_pair_names[RT_PAIRS] = {
+    [RT_PING_PONG] = "PING->PONG",
+    [RT_FIND_NODE_NODES] = "FIND_NODE->NODES",
+    [RT_FIND_NODEHASH_NODES] = "FIND_NODEHASH->NODES",
+    [RT_TOPIC_QUERY_TOPIC_NODES] = "TOPIC_QUERY->TOPIC_NODES",
+};
+
+// Ranges of the number of nodes returned in NODES, as in the stats tree.
+static const struct {
+  guint min;
+  guint max;
+  const gchar *name;
+} node_ranges[] = {
+    {0, 5, "0-5"},
+    {6, 10, "6-10"},
+    {11, G_MAXUINT, "11-"}
+};
+
+static const gdouble percentiles[] = {50.0, 90.0, 99.0, 99.9};
+static const gchar *percentile_names[] = {"p50", "p90", "p99", "p99.9"};
+
+// A datagram handed over to a worker.
+typedef struct analyzer_packet {
+  guint64 ts;                            // The capture time, in nanoseconds since the epoch.
+  guint32 hash;                          // The hash of the conversation.
+  guint32 offset;                        // The offset of the UDP payload in the data of the batch.
+  guint16 len;                           // The length of the UDP payload.
+  guint8 duplicate;                      // TRUE if this is a discovery v4 message already seen.
+  guint8 key[ANALYZER_FLOW_KEY_LEN];     // The key of the conversation.
+} analyzer_packet_t;
+
+// A batch of datagrams, going back and forth between the reader and a worker.
+typedef struct analyzer_batch {
+  guint count;
+  guint used;                            // The number of bytes of data used.
+  analyzer_packet_t packets[ANALYZER_BATCH_PACKETS];
+  guint8 data[ANALYZER_BATCH_PACKETS * MAX_ETHDEVP2PDISCO_LEN];
+} analyzer_batch_t;
+
+// The state of a conversation, i.e. of a pinned flow.
+typedef struct analyzer_flow {
+  guint8 key[ANALYZER_FLOW_KEY_LEN];
+  guint32 hash;
+  guint64 last_seen;
+  gboolean has_last_ping;                // Last PING without a hash (discovery v5).
+  guint64 last_ping_time;
+  gboolean has_last_topicquery;
+  guint64 last_topicquery_time;
+  ethereum_disc_pending_t *pending;      // Pending requests, allocated upon the first request.
+} analyzer_flow_t;
+
+// The response times of a request/response pair, as in the SRT table and the percentiles of the stats tree.
+typedef struct analyzer_srt {
+  guint64 count;
+  guint64 min;                           // In microseconds.
+  guint64 max;
+  guint64 sum;
+  ethereum_hist_t hist;
+} analyzer_srt_t;
+
+// The statistics computed by a worker, or merged over all of them.
+typedef struct analyzer_stats {
+  guint64 packets;
+  guint64 types[PACKET_TYPES];
+  guint64 node_ranges[G_N_ELEMENTS(node_ranges)];
+  guint64 duplicates;
+  guint64 flows;                         // The number of conversations pinned.
+  analyzer_srt_t srt[RT_PAIRS];
+} analyzer_stats_t;
+
+// A worker thread, and the conversations it owns.
+typedef struct analyzer_worker {
+  GThread *thread;
+  GAsyncQueue *full;                     // Batches to process.
+  GAsyncQueue *free;                     // Processed batches, to be filled again by the reader.
+  analyzer_batch_t *current;             // The batch being filled by the reader.
+  GHashTable *flows;                     // analyzer_flow_t => itself.
+  guint64 next_sweep;
+  ethereum_disc_neg_entry_t neg_cache[ETHEREUM_DISC_NEG_CACHE_SIZE];
+  rlp_index_entry_t entries[MAX_ETHDEVP2PDISCO_LEN];  // Every element takes at least one byte.
+  analyzer_stats_t stats;
+} analyzer_worker_t;
+
+// Marks the end of the captures in the queue of a worker.
+static analyzer_batch_t *end_of_captures;
+
+static analyzer_worker_t *workers;
+static guint worker_count;
+
+// Counters of the reader.
+static guint64 frames;
+static guint64 datagrams;                // UDP datagrams of the length of discovery messages.
+static guint64 truncated;                // Datagrams cut short by the snapshot length.
+static guint64 fragments;                // IP fragments, which aren't reassembled.
+static gint64 reader_wait;               // Microseconds the reader spent waiting for a free batch.
+static guint64 *dup_keys;                // The set of recent message hash prefixes; 0 marks free slots.
+static guint dup_count;
+
+/**
+ * Returns the pair of a request type.
+ *
+ * @param request_type The type of the request.
+ * @return The pair, or RT_PAIRS if the request type has no response.
+ */
+static rt_pair_e rt_pair_of(packet_type_e request_type) {
+  switch (request_type) {
+    case PING:
+      return RT_PING_PONG;
+    case FIND_NODE:
+      return RT_FIND_NODE_NODES;
+    case FIND_NODEHASH:
+      return RT_FIND_NODEHASH_NODES;
+    case TOPIC_QUERY:
+      return RT_TOPIC_QUERY_TOPIC_NODES;
+    default:
+      return RT_PAIRS;
+  }
+}
+
+static guint flow_hash(gconstpointer key) {
+  return ((const analyzer_flow_t *) key)->hash;
+}
+
+static gboolean flow_equal(gconstpointer a, gconstpointer b) {
+  return memcmp(((const analyzer_flow_t *) a)->key, ((const analyzer_flow_t *) b)->key, ANALYZER_FLOW_KEY_LEN) == 0;
+}
+
+static void flow_free(gpointer data) {
+  analyzer_flow_t *flow = (analyzer_flow_t *) data;
+  g_free(flow->pending);
+  g_free(flow);
+}
+
+/**
+ * Checks whether a request was issued more than the given number of seconds ago.
+ */
+static gboolean older_than(guint64 time, guint64 now, guint secs) {
+  return now > time && now - time > secs * NSECS_PER_SEC;
+}
+
+/**
+ * Records a request in the pending request table of a conversation, allocated upon the first request.
+ *
+ * @param flow The conversation.
+ * @param now The time of the request.
+ * @param type The request type.
+ * @param key The request key.
+ */
+static void pending_add(analyzer_flow_t *flow, guint64 now, packet_type_e type, guint64 key) {
+  if (!flow->pending) {
+    flow->pending = g_new0(ethereum_disc_pending_t, ETHEREUM_DISC_PENDING_SLOTS);
+  }
+  ethereum_disc_pending_add(flow->pending, (gint64) now, 0, type, key);
+}
+
+/**
+ * Computes the key of a request in the pending request table, from a hash or node ID.
+ *
+ * @param buf The payload.
+ * @param idx The RLP index of the payload.
+ * @param el The index of the element holding the hash or node ID, or RLP_INDEX_NONE.
+ * @return The key, or 0 if the element doesn't exist or is too short.
+ */
+static guint64 pending_key(const guint8 *buf, const rlp_index_t *idx, guint el) {
+  guint64 key;
+  if (el == RLP_INDEX_NONE || idx->entries[el].byte_length < sizeof(guint64)) {
+    return 0;
+  }
+  key = pntoh64(buf + idx->entries[el].data_offset);
+  // Zero marks a free slot.
+  return key ? key : 1;
+}
+
+/**
+ * Records the response time of a response.
+ *
+ * @param stats The statistics of the worker.
+ * @param request_type The type of the request.
+ * @param request_time The time of the request.
+ * @param now The time of the response.
+ */
+static void add_rt_sample(analyzer_stats_t *stats, packet_type_e request_type, guint64 request_time, guint64 now) {
+  rt_pair_e pair = rt_pair_of(request_type);
+  analyzer_srt_t *srt;
+  guint64 usecs;
+
+  if (pair == RT_PAIRS) {
+    return;
+  }
+  usecs = now > request_time ? (now - request_time) / 1000 : 0;
+  srt = &stats->srt[pair];
+  srt->min = srt->count == 0 ? usecs : MIN(srt->min, usecs);
+  srt->max = MAX(srt->max, usecs);
+  srt->sum += usecs;
+  srt->count++;
+  ethereum_hist_add(&srt->hist, usecs);
+}
+
+/**
+ * Counts the nodes of a node list, as decode_nodes_list() in packet-ethereum-disc.c.
+ *
+ * @param idx The RLP index of the payload.
+ * @param list The index of the node list.
+ * @return The number of nodes.
+ */
+static guint count_nodes(const rlp_index_t *idx, guint list) {
+  guint node, count = 0;
+  for (node = rlp_index_first_child(idx, list); node != RLP_INDEX_NONE; node = rlp_index_next_sibling(idx, node)) {
+    if (idx->entries[node].type != LIST || idx->entries[node].byte_length == 0) {
+      break;
+    }
+    count++;
+  }
+  return count;
+}
+
+/**
+ * Checks whether a message was already seen, and remembers it otherwise. The set is bounded in memory by starting
+ * over, so only nearby duplicates are detected. Called by the reader only.
+ *
+ * @param key The prefix of the message hash.
+ * @return TRUE if the message is a duplicate; FALSE otherwise.
+ */
+static gboolean is_duplicate(guint64 key) {
+  guint i;
+
+  key = key ? key : 1;
+  for (i = (guint) key & (ANALYZER_DUP_SLOTS - 1); dup_keys[i]; i = (i + 1) & (ANALYZER_DUP_SLOTS - 1)) {
+    if (dup_keys[i] == key) {
+      return TRUE;
+    }
+  }
+  if (dup_count >= ANALYZER_DUP_MAX) {
+    memset(dup_keys, 0, ANALYZER_DUP_SLOTS * sizeof(*dup_keys));
+    dup_count = 0;
+    i = (guint) key & (ANALYZER_DUP_SLOTS - 1);
+  }
+  dup_keys[i] = key;
+  dup_count++;
+  return FALSE;
+}
+
+/**
+ * Looks up the state of the conversation of a datagram, evaluating the heuristics of the dissector on datagrams
+ * of conversations not pinned yet.
+ *
+ * @param worker The worker.
+ * @param packet The datagram.
+ * @param buf The UDP payload.
+ * @param is_discv5 Set to TRUE if this is a discovery v5 datagram.
+ * @return The conversation, or NULL if the datagram isn't a discovery message.
+ */
+static analyzer_flow_t *get_flow(analyzer_worker_t *worker, const analyzer_packet_t *packet, const guint8 *buf,
+                                 gboolean *is_discv5) {
+  analyzer_flow_t lookup, *flow;
+  guint32 neg_key;
+
+  memcpy(lookup.key, packet->key, ANALYZER_FLOW_KEY_LEN);
+  lookup.hash = packet->hash;
+  flow = (analyzer_flow_t *) g_hash_table_lookup(worker->flows, &lookup);
+  if (flow) {
+    // Pinned conversations skip the structural heuristics.
+    return ethereum_disc_check_header(buf, packet->len, is_discv5) ? flow : NULL;
+  }
+
+  // Zero marks an empty slot.
+  neg_key = (packet->hash * 0x9e3779b1) | 1;
+  if (ethereum_disc_neg_cache_skip(worker->neg_cache, neg_key)) {
+    return NULL;
+  }
+  if (!ethereum_disc_check_header(buf, packet->len, is_discv5) ||
+      !ethereum_disc_valid_payload(buf, packet->len,
+                                   *is_discv5 ? ETHEREUM_DISCV5_PACKET_DATA_START : ETHEREUM_DISC_PACKET_DATA_START)) {
+    ethereum_disc_neg_cache_update(worker->neg_cache, neg_key, TRUE);
+    return NULL;
+  }
+  ethereum_disc_neg_cache_update(worker->neg_cache, neg_key, FALSE);
+
+  flow = g_new0(analyzer_flow_t, 1);
+  memcpy(flow->key, packet->key, ANALYZER_FLOW_KEY_LEN);
+  flow->hash = packet->hash;
+  g_hash_table_add(worker->flows, flow);
+  worker->stats.flows++;
+  return flow;
+}
+
+static gboolean flow_is_idle(gpointer key, gpointer value _U_, gpointer user_data) {
+  return older_than(((const analyzer_flow_t *) key)->last_seen, *(const guint64 *) user_data, ANALYZER_FLOW_IDLE);
+}
+
+/**
+ * Processes a datagram, as dissect_ethereum() and dissect_ethereum_discv5() followed by the stats tree and SRT
+ * taps of packet-ethereum-disc.c.
+ *
+ * @param worker The worker.
+ * @param packet The datagram.
+ * @param buf The UDP payload.
+ */
+static void analyze_packet(analyzer_worker_t *worker, const analyzer_packet_t *packet, const guint8 *buf) {
+  analyzer_stats_t *stats = &worker->stats;
+  analyzer_flow_t *flow;
+  ethereum_disc_pending_t *req;
+  gboolean is_discv5, duplicate = FALSE;
+  guint64 hash_key = 0, now = packet->ts;
+  packet_type_e type;
+  guint start, list, nodes;
+  rlp_index_t idx;
+
+  // Drop the idle conversations from time to time.
+  if (now >= worker->next_sweep) {
+    g_hash_table_foreach_remove(worker->flows, flow_is_idle, &now);
+    worker->next_sweep = now + ANALYZER_SWEEP_INTERVAL * NSECS_PER_SEC;
+  }
+
+  flow = get_flow(worker, packet, buf, &is_discv5);
+  if (!flow) {
+    return;
+  }
+  flow->last_seen = now;
+  type = (packet_type_e) buf[is_discv5 ? ETHEREUM_DISCV5_PACKET_TYPE_IDX : ETHEREUM_DISC_PACKET_TYPE_IDX];
+  start = is_discv5 ? ETHEREUM_DISCV5_PACKET_DATA_START : ETHEREUM_DISC_PACKET_DATA_START;
+
+  // Discovery v4 messages are identified by their hash.
+  if (!is_discv5) {
+    hash_key = pntoh64(buf);
+    duplicate = packet->duplicate;
+    hash_key = hash_key ? hash_key : 1;
+  }
+
+  // Index the whole payload in one pass, and assert we have a top level RLP list.
+  if (!rlp_index_build_buf(buf + start, packet->len - start, 0, worker->entries, G_N_ELEMENTS(worker->entries),
+                           &idx) || idx.entries[0].type != LIST) {
+    return;
+  }
+  if (duplicate) {
+    stats->duplicates++;
+    return;
+  }
+
+  stats->packets++;
+  stats->types[type]++;
+  list = 0;
+  buf += start;
+  switch (type) {
+    case PING:
+      if (!is_discv5) {
+        pending_add(flow, now, PING, hash_key);
+      } else {
+        flow->has_last_ping = TRUE;
+        flow->last_ping_time = now;
+      }
+      break;
+
+    case PONG:
+      // Match the PING by the hash echoed in the PONG; PINGs without a hash fall back to the last one.
+      req = ethereum_disc_pending_find(flow->pending, (gint64) now, PING,
+                                       pending_key(buf, &idx, rlp_index_child(&idx, list, 1)));
+      if (req) {
+        add_rt_sample(stats, PING, (guint64) req->time, now);
+        req->key = 0;
+      } else if (flow->has_last_ping) {
+        add_rt_sample(stats, PING, flow->last_ping_time, now);
+        flow->has_last_ping = FALSE;
+      }
+      break;
+
+    case FIND_NODE:
+    case FIND_NODEHASH:
+      hash_key = pending_key(buf, &idx, rlp_index_first_child(&idx, list));
+      pending_add(flow, now, type, hash_key ? hash_key : 1);
+      break;
+
+    case NODES:
+      nodes = count_nodes(&idx, rlp_index_first_child(&idx, list));
+      for (guint i = 0; i < G_N_ELEMENTS(node_ranges); i++) {
+        if (nodes >= node_ranges[i].min && nodes <= node_ranges[i].max) {
+          stats->node_ranges[i]++;
+        }
+      }
+      req = ethereum_disc_pending_find_findnode(flow->pending, (gint64) now);
+      if (req) {
+        // Only the first packet of a response yields a response time sample.
+        if (req->nodes == 0) {
+          add_rt_sample(stats, (packet_type_e) req->type, (guint64) req->time, now);
+        }
+        ethereum_disc_pending_add_nodes(req, nodes);
+      }
+      break;
+
+    case TOPIC_QUERY:
+      flow->has_last_topicquery = TRUE;
+      flow->last_topicquery_time = now;
+      break;
+
+    case TOPIC_NODES:
+      if (flow->has_last_topicquery) {
+        add_rt_sample(stats, TOPIC_QUERY, flow->last_topicquery_time, now);
+      }
+      break;
+
+    default:
+      break;
+  }
+}
+
+/**
+ * Processes the batches of a worker until the end of the captures.
+ *
+ * @param data The worker.
+ * @return NULL.
+ */
+static gpointer worker_main(gpointer data) {
+  analyzer_worker_t *worker = (analyzer_worker_t *) data;
+  analyzer_batch_t *batch;
+  guint i;
+
+  while ((batch = (analyzer_batch_t *) g_async_queue_pop(worker->full)) != end_of_captures) {
+    for (i = 0; i < batch->count; i++) {
+      const analyzer_packet_t *packet = &batch->packets[i];
+      analyze_packet(worker, packet, batch->data + packet->offset);
+    }
+    batch->count = 0;
+    batch->used = 0;
+    g_async_queue_push(worker->free, batch);
+  }
+  return NULL;
+}
+
+/**
+ * Computes the hash of an endpoint (FNV-1a).
+ */
+static guint32 endpoint_hash(const guint8 *endpoint) {
+  guint32 hash = 2166136261U;
+  guint i;
+  for (i = 0; i < ANALYZER_ENDPOINT_LEN; i++) {
+    hash = (hash ^ endpoint[i]) * 16777619U;
+  }
+  return hash;
+}
+
+/**
+ * Hands a UDP datagram over to the worker that owns its conversation.
+ *
+ * @param ts The capture time, in nanoseconds since the epoch.
+ * @param src The source endpoint.
+ * @param dst The destination endpoint.
+ * @param payload The UDP payload.
+ * @param len The length of the payload.
+ */
+static void dispatch(guint64 ts, const guint8 *src, const guint8 *dst, const guint8 *payload, guint len) {
+  analyzer_worker_t *worker;
+  analyzer_batch_t *batch;
+  analyzer_packet_t *packet;
+  gboolean is_discv5;
+  gboolean ordered = memcmp(src, dst, ANALYZER_ENDPOINT_LEN) <= 0;
+  // The same for both directions of the conversation.
+  guint32 hash = (endpoint_hash(src) ^ endpoint_hash(dst)) * 0x9e3779b1;
+
+  worker = &workers[(guint) (((guint64) hash * worker_count) >> 32)];
+  if (!worker->current) {
+    worker->current = (analyzer_batch_t *) g_async_queue_try_pop(worker->free);
+    if (!worker->current) {
+      // All the batches of the worker are in flight: the workers, not the reader, are the bottleneck.
+      gint64 start = g_get_monotonic_time();
+      worker->current = (analyzer_batch_t *) g_async_queue_pop(worker->free);
+      reader_wait += g_get_monotonic_time() - start;
+    }
+  }
+  batch = worker->current;
+  packet = &batch->packets[batch->count++];
+  packet->ts = ts;
+  packet->hash = hash;
+  packet->offset = batch->used;
+  packet->len = (guint16) len;
+  // Discovery v4 messages are identified by their hash, whatever the conversation. Datagrams failing the header
+  // checks are rejected by the worker, and mustn't enter the duplicate detection set.
+  packet->duplicate = ethereum_disc_check_header(payload, len, &is_discv5) && !is_discv5 &&
+                      is_duplicate(pntoh64(payload));
+  memcpy(packet->key, ordered ? src : dst, ANALYZER_ENDPOINT_LEN);
+  memcpy(packet->key + ANALYZER_ENDPOINT_LEN, ordered ? dst : src, ANALYZER_ENDPOINT_LEN);
+  memcpy(batch->data + batch->used, payload, len);
+  batch->used += len;
+
+  if (batch->count == ANALYZER_BATCH_PACKETS) {
+    g_async_queue_push(worker->full, batch);
+    worker->current = NULL;
+  }
+}
+
+/**
+ * Decodes the UDP header of an IP datagram.
+ *
+ * @param ts The capture time, in nanoseconds since the epoch.
+ * @param src The source endpoint, whose address is filled in.
+ * @param dst The destination endpoint, whose address is filled in.
+ * @param buf The UDP header and payload, as captured.
+ * @param caplen The captured length.
+ * @param len The length of the UDP header and payload, per the IP header.
+ */
+static void decode_udp(guint64 ts, guint8 *src, guint8 *dst, const guint8 *buf, guint caplen, guint len) {
+  guint udp_len;
+
+  if (caplen < 8) {
+    return;
+  }
+  udp_len = pntoh16(buf + 4);
+  if (udp_len < 8 || udp_len > len) {
+    return;
+  }
+  udp_len -= 8;
+  // The length check is the first of the heuristics of the dissector.
+  if (udp_len < MIN_ETHDEVP2PDISCO_LEN || udp_len > MAX_ETHDEVP2PDISCO_LEN) {
+    return;
+  }
+  datagrams++;
+  if (udp_len > caplen - 8) {
+    truncated++;
+    return;
+  }
+  memcpy(src + 16, buf, 2);
+  memcpy(dst + 16, buf + 2, 2);
+  dispatch(ts, src, dst, buf + 8, udp_len);
+}
+
+/**
+ * Decodes an IPv4 or IPv6 packet.
+ *
+ * @param ts The capture time, in nanoseconds since the epoch.
+ * @param buf The IP packet, as captured.
+ * @param caplen The captured length.
+ */
+static void decode_ip(guint64 ts, const guint8 *buf, guint caplen) {
+  guint8 src[ANALYZER_ENDPOINT_LEN], dst[ANALYZER_ENDPOINT_LEN];
+  guint hdr_len, len, next;
+
+  if (caplen < 1) {
+    return;
+  }
+  memset(src, 0, sizeof(src));
+  memset(dst, 0, sizeof(dst));
+  switch (buf[0] >> 4) {
+    case 4:
+      hdr_len = (buf[0] & 0x0f) * 4;
+      if (caplen < 20 || hdr_len < 20 || caplen < hdr_len || buf[9] != 17) {
+        return;
+      }
+      len = pntoh16(buf + 2);
+      if (len < hdr_len) {
+        return;
+      }
+      if (pntoh16(buf + 6) & 0x3fff) {
+        // More fragments, or a fragment offset.
+        fragments++;
+        return;
+      }
+      // IPv4-mapped IPv6 addresses.
+      src[10] = src[11] = dst[10] = dst[11] = 0xff;
+      memcpy(src + 12, buf + 12, 4);
+      memcpy(dst + 12, buf + 16, 4);
+      decode_udp(ts, src, dst, buf + hdr_len, caplen - hdr_len, len - hdr_len);
+      break;
+
+    case 6:
+      if (caplen < 40) {
+        return;
+      }
+      len = pntoh16(buf + 4);
+      next = buf[6];
+      memcpy(src, buf + 8, 16);
+      memcpy(dst, buf + 24, 16);
+      buf += 40;
+      caplen -= 40;
+      // Skip the hop-by-hop, routing and destination options headers.
+      while (next == 0 || next == 43 || next == 60) {
+        if (caplen < 8) {
+          return;
+        }
+        hdr_len = (buf[1] + 1) * 8;
+        if (caplen < hdr_len || len < hdr_len) {
+          return;
+        }
+        next = buf[0];
+        buf += hdr_len;
+        caplen -= hdr_len;
+        len -= hdr_len;
+      }
+      if (next == 44) {
+        fragments++;
+        return;
+      }
+      if (next == 17) {
+        decode_udp(ts, src, dst, buf, caplen, len);
+      }
+      break;
+
+    default:
+      break;
+  }
+}
+
+/**
+ * Decodes the link layer header of a frame.
+ *
+ * @param ts The capture time, in nanoseconds since the epoch.
+ * @param encap The link layer encapsulation (WTAP_ENCAP_*).
+ * @param buf The frame, as captured.
+ * @param caplen The captured length.
+ */
+static void decode_frame(guint64 ts, int encap, const guint8 *buf, guint caplen) {
+  guint offset, ethertype;
+
+  switch (encap) {
+    case WTAP_ENCAP_ETHERNET:
+      if (caplen < 14) {
+        return;
+      }
+      offset = 14;
+      ethertype = pntoh16(buf + 12);
+      // 802.1Q and 802.1ad tags.
+      while ((ethertype == 0x8100 || ethertype == 0x88a8 || ethertype == 0x9100) && caplen >= offset + 4) {
+        ethertype = pntoh16(buf + offset + 2);
+        offset += 4;
+      }
+      if (ethertype == 0x0800 || ethertype == 0x86dd) {
+        decode_ip(ts, buf + offset, caplen - offset);
+      }
+      break;
+
+    case WTAP_ENCAP_SLL:
+      if (caplen < 16) {
+        return;
+      }
+      ethertype = pntoh16(buf + 14);
+      if (ethertype == 0x0800 || ethertype == 0x86dd) {
+        decode_ip(ts, buf + 16, caplen - 16);
+      }
+      break;
+
+    case WTAP_ENCAP_NULL:
+    case WTAP_ENCAP_LOOP:
+      // The address family is in host or network byte order; the IP version tells the protocol anyway.
+      if (caplen > 4) {
+        decode_ip(ts, buf + 4, caplen - 4);
+      }
+      break;
+
+    case WTAP_ENCAP_RAW_IP:
+    case WTAP_ENCAP_RAW_IP4:
+    case WTAP_ENCAP_RAW_IP6:
+      decode_ip(ts, buf, caplen);
+      break;
+
+    default:
+      break;
+  }
+}
+
+/**
+ * Reads a capture file, handing its discovery datagrams over to the workers.
+ *
+ * @param path The path of the capture file.
+ * @return TRUE if the whole file was read; FALSE otherwise.
+ */
+static gboolean read_capture(const gchar *path) {
+  wtap *wth;
+  int err = 0;
+  gchar *err_info = NULL;
+  gint64 data_offset;
+
+  wth = wtap_open_offline(path, WTAP_TYPE_AUTO, &err, &err_info, FALSE);
+  if (!wth) {
+    fprintf(stderr, "ethereum-analyzer: can't open %s: %s\n", path, wtap_strerror(err));
+    g_free(err_info);
+    return FALSE;
+  }
+  while (wtap_read(wth, &err, &err_info, &data_offset)) {
+    struct wtap_pkthdr *phdr = wtap_phdr(wth);
+    guint64 ts;
+    if (phdr->rec_type != REC_TYPE_PACKET) {
+      continue;
+    }
+    frames++;
+    ts = phdr->ts.secs < 0 ? 0 : (guint64) phdr->ts.secs * NSECS_PER_SEC + (guint64) phdr->ts.nsecs;
+    decode_frame(ts, phdr->pkt_encap, wtap_buf_ptr(wth), phdr->caplen);
+  }
+  wtap_close(wth);
+  if (err != 0) {
+    fprintf(stderr, "ethereum-analyzer: error reading %s: %s%s%s\n", path, wtap_strerror(err),
+            err_info ? ": " : "", err_info ? err_info : "");
+    g_free(err_info);
+    return FALSE;
+  }
+  return TRUE;
+}
+
+/**
+ * Adds the statistics of a worker to the overall statistics.
+ *
+ * @param total The overall statistics.
+ * @param stats The statistics of the worker.
+ */
+static void merge_stats(analyzer_stats_t *total, const analyzer_stats_t *stats) {
+  guint i;
+
+  total->packets += stats->packets;
+  for (i = 0; i < PACKET_TYPES; i++) {
+    total->types[i] += stats->types[i];
+  }
+  for (i = 0; i < G_N_ELEMENTS(node_ranges); i++) {
+    total->node_ranges[i] += stats->node_ranges[i];
+  }
+  total->duplicates += stats->duplicates;
+  total->flows += stats->flows;
+  for (i = 0; i < RT_PAIRS; i++) {
+    analyzer_srt_t *srt = &total->srt[i];
+    const analyzer_srt_t *other = &stats->srt[i];
+    if (other->count == 0) {
+      continue;
+    }
+    srt->min = srt->count == 0 ? other->min : MIN(srt->min, other->min);
+    srt->max = MAX(srt->max, other->max);
+    srt->sum += other->sum;
+    srt->count += other->count;
+    ethereum_hist_merge(&srt->hist, &other->hist);
+  }
+}
+
+/**
+ * Prints a count and its share of a total.
+ */
+static void print_count(const gchar *indent, const gchar *name, guint64 count, guint64 total) {
+  gchar label[64];
+  g_snprintf(label, sizeof(label), "%s%s", indent, name);
+  printf("%-40s %14" G_GUINT64_FORMAT " %9.2f%%\n", label, count,
+         total ? 100.0 * (gdouble) count / (gdouble) total : 0.0);
+}
+
+/**
+ * Prints the statistics in the layout of the ETH stats tree and of the SRT table.
+ *
+ * @param stats The overall statistics.
+ */
+static void report(const analyzer_stats_t *stats) {
+  guint64 nodes_packets = 0, values[G_N_ELEMENTS(percentiles)];
+  guint i, j;
+
+  printf("%" G_GUINT64_FORMAT " frames, %" G_GUINT64_FORMAT " UDP datagrams of discovery length (%"
+         G_GUINT64_FORMAT " truncated), %" G_GUINT64_FORMAT " IP fragments skipped, %" G_GUINT64_FORMAT
+         " discovery conversations\n\n", frames, datagrams, truncated, fragments, stats->flows);
+
+  printf("Ethereum discovery statistics:\n");
+  printf("%-40s %14s %10s\n", "Topic / Item", "Count", "Percent");
+  print_count("", "Total packets", stats->packets, stats->packets);
+  printf("  Packet types\n");
+  for (i = PING; i < PACKET_TYPES; i++) {
+    if (stats->types[i] > 0) {
+      print_count("    ", packet_type_names[i], stats->types[i], stats->packets);
+    }
+  }
+  for (i = 0; i < G_N_ELEMENTS(node_ranges); i++) {
+    nodes_packets += stats->node_ranges[i];
+  }
+  print_count("", "# of nodes returned in NODES", nodes_packets, nodes_packets);
+  for (i = 0; i < G_N_ELEMENTS(node_ranges); i++) {
+    print_count("  ", node_ranges[i].name, stats->node_ranges[i], nodes_packets);
+  }
+  if (stats->duplicates > 0) {
+    print_count("", "Duplicate packets (not counted)", stats->duplicates, stats->duplicates);
+  }
+
+  printf("\nResponse time percentiles (us):\n");
+  printf("%-40s %14s", "Pair", "Count");
+  for (j = 0; j < G_N_ELEMENTS(percentiles); j++) {
+    printf(" %10s", percentile_names[j]);
+  }
+  printf("\n");
+  for (i = 0; i < RT_PAIRS; i++) {
+    printf("%-40s %14" G_GUINT64_FORMAT, rt_pair_names[i], stats->srt[i].count);
+    ethereum_hist_percentiles(&stats->srt[i].hist, percentiles, G_N_ELEMENTS(percentiles), values);
+    for (j = 0; j < G_N_ELEMENTS(percentiles); j++) {
+      printf(" %10" G_GUINT64_FORMAT, values[j]);
+    }
+    printf("\n");
+  }
+
+  printf("\nEthereum discovery packets SRT statistics:\n");
+  printf("%-5s %-40s %10s %12s %12s %12s %14s\n", "Index", "Procedure", "Calls", "Min SRT (s)", "Max SRT (s)",
+         "Avg SRT (s)", "Sum SRT (s)");
+  for (i = 0; i < RT_PAIRS; i++) {
+    const analyzer_srt_t *srt = &stats->srt[i];
+    gchar name[64];
+    g_snprintf(name, sizeof(name), "%s response time", rt_pair_names[i]);
+    printf("%5u %-40s %10" G_GUINT64_FORMAT " %12.6f %12.6f %12.6f %14.6f\n", i, name, srt->count,
+           (gdouble) srt->min / 1e6, (gdouble) srt->max / 1e6,
+           srt->count ? (gdouble) srt->sum / (gdouble) srt->count / 1e6 : 0.0, (gdouble) srt->sum / 1e6);
+  }
+}
+
+static void usage(void) {
+  fprintf(stderr, "Usage: ethereum-analyzer [-j <threads>] <capture> [<capture>...]\n"
+                  "\n"
+                  "Reads pcap/pcapng captures and reports the statistics of the Ethereum discovery traffic, as\n"
+                  "tshark -z ethereum,tree -z srt,ethereum would, processing the conversations on several threads.\n"
+                  "  -j <threads>  number of worker threads (default: the number of processors)\n");
+}
+
+int main(int argc, char *argv[]) {
+  analyzer_stats_t *total;
+  analyzer_batch_t end_marker;
+  gint64 read_start;
+  int first = 1, ret = EXIT_SUCCESS;
+  guint i, j;
+
+  worker_count = (guint) g_get_num_processors();
+  if (argc > 2 && strcmp(argv[1], "-j") == 0) {
+    worker_count = (guint) strtoul(argv[2], NULL, 10);
+    first = 3;
+  }
+  if (argc - first < 1 || worker_count == 0 || worker_count > ANALYZER_MAX_THREADS) {
+    usage();
+    return EXIT_FAILURE;
+  }
+
+  wtap_init();
+
+  end_of_captures = &end_marker;
+  dup_keys = g_new0(guint64, ANALYZER_DUP_SLOTS);
+  workers = g_new0(analyzer_worker_t, worker_count);
+  for (i = 0; i < worker_count; i++) {
+    analyzer_worker_t *worker = &workers[i];
+    worker->full = g_async_queue_new();
+    worker->free = g_async_queue_new();
+    for (j = 0; j < ANALYZER_BATCHES; j++) {
+      g_async_queue_push(worker->free, g_new0(analyzer_batch_t, 1));
+    }
+    worker->flows = g_hash_table_new_full(flow_hash, flow_equal, flow_free, NULL);
+    worker->thread = g_thread_new("ethereum-analyzer", worker_main, worker);
+  }
+
+  // The captures are read in order, so that every conversation is processed in capture order.
+  read_start = g_get_monotonic_time();
+  for (i = (guint) first; i < (guint) argc; i++) {
+    if (!read_capture(argv[i])) {
+      ret = EXIT_FAILURE;
+    }
+  }
+  fprintf(stderr, "ethereum-analyzer: read in %.3f s, of which %.3f s waiting for %u worker(s)\n",
+          (g_get_monotonic_time() - read_start) / 1e6, reader_wait / 1e6, worker_count);
+
+  total = g_new0(analyzer_stats_t, 1);
+  for (i = 0; i < worker_count; i++) {
+    analyzer_worker_t *worker = &workers[i];
+    analyzer_batch_t *batch;
+    if (worker->current) {
+      g_async_queue_push(worker->full, worker->current);
+    }
+    g_async_queue_push(worker->full, end_of_captures);
+    g_thread_join(worker->thread);
+    merge_stats(total, &worker->stats);
+
+    while ((batch = (analyzer_batch_t *) g_async_queue_try_pop(worker->free)) != NULL) {
+      g_free(batch);
+    }
+    g_async_queue_unref(worker->full);
+    g_async_queue_unref(worker->free);
+    g_hash_table_destroy(worker->flows);
+  }
+  report(total);
+
+  g_free(total);
+  g_free(dup_keys);
+  g_free(workers);
+  wtap_cleanup();
+  return ret;
+}
@@ -0,0 +1,137 @@
+/* ethereum-columnar-dump.c
+ * Dumps the export files written by the ethereum,columnar tap as CSV, one line per discovery message.
+ * Copyright 2018, ConsenSys AG.
+ *
+ * Wireshark - Network traffic analyzer
+ * By Gerald Combs <gerald@wireshark.org>
+ * Copyright 1998, Gerald Combs.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Usage: ethereum-columnar-dump <file>
+ *
+ * Each file is written by tshark -r <capture> -q -z ethereum,columnar,<file>. The row groups are decoded one at a
+ * time, so the memory footprint only depends on the number of rows per group. Timestamps are printed in seconds
+ * since the epoch, and response times in nanoseconds (empty if unknown).
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <glib.h>
+
+#include <wsutil/inet_addr.h>
+
+#include "ethereum-disc-core.h"
+#include "ethereum-columnar.h"
+
+static const gchar *packet_type_names[] = {
+    [UNKNOWN] = "(Unknown)",
+    [PING] = "PING",
+    [PONG] = "PONG",
+    [FIND_NODE] = "FIND_NODE",
+    [NODES] = "NODES",
+    [FIND_NODEHASH] = "FIND_NODEHASH",
+    [TOPIC_REGISTER] = "TOPIC_REGISTER",
+    [TOPIC_QUERY] = "TOPIC_QUERY",
+    [TOPIC_NODES] = "TOPIC_NODES"
+};
+
+/**
+ * Formats an IPv6 or IPv4-mapped address.
+ */
+static void format_addr(const guint8 *addr, gchar *buf, guint size) {
+  static const guint8 v4_mapped[12] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xff, 0xff};
+
+  if (memcmp(addr, v4_mapped, sizeof(v4_mapped)) == 0) {
+    ws_inet_ntop4(addr + 12, buf, size);
+  } else {
+    ws_inet_ntop6(addr, buf, size);
+  }
+}
+
+/**
+ * Prints a row.
+ *
+ * @param row The row.
+ */
+static void print_row(const ethereum_columnar_row_t *row) {
+  gchar src[WS_INET6_ADDRSTRLEN], dst[WS_INET6_ADDRSTRLEN];
+
+  format_addr(row->src_addr, src, sizeof(src));
+  format_addr(row->dst_addr, dst, sizeof(dst));
+  printf("%u,%" G_GINT64_FORMAT ".%09d,%s,%u,%s,%u,", row->frame, row->ts / 1000000000, (int) (row->ts % 1000000000),
+         src, row->src_port, dst, row->dst_port);
+  if (row->type < G_N_ELEMENTS(packet_type_names) && packet_type_names[row->type]) {
+    printf("%s", packet_type_names[row->type]);
+  } else {
+    printf("%u", row->type);
+  }
+  printf(",%u,%u,", row->seq, row->seqtype);
+  if (row->rt >= 0) {
+    printf("%" G_GINT64_FORMAT, row->rt);
+  }
+  printf(",%u\n", row->node_count);
+}
+
+static void usage(void) {
+  fprintf(stderr, "Usage: ethereum-columnar-dump <file>\n"
+                  "\n"
+                  "Prints the messages of an export file written by tshark -z ethereum,columnar,<file> as CSV.\n");
+}
+
+int main(int argc, char *argv[]) {
+  ethereum_columnar_reader_t reader;
+  GArray *rows;
+  guint64 count = 0;
+  guint i;
+  int ret = EXIT_SUCCESS;
+
+  if (argc != 2) {
+    usage();
+    return EXIT_FAILURE;
+  }
+  if (!ethereum_columnar_reader_open(&reader, argv[1])) {
+    fprintf(stderr, "ethereum-columnar-dump: %s is not an export file\n", argv[1]);
+    return EXIT_FAILURE;
+  }
+
+  printf("frame,ts,src_addr,src_port,dst_addr,dst_port,type,seq,seqtype,rt,node_count\n");
+  rows = g_array_new(FALSE, FALSE, sizeof(ethereum_columnar_row_t));
+  while (ethereum_columnar_reader_next(&reader, rows)) {
+    for (i = 0; i < rows->len; i++) {
+      print_row(&g_array_index(rows, ethereum_columnar_row_t, i));
+    }
+    count += rows->len;
+  }
+  // The trailer tells whether the export was complete.
+  if (!reader.done) {
+    fprintf(stderr, "ethereum-columnar-dump: %s is truncated or corrupt\n", argv[1]);
+    ret = EXIT_FAILURE;
+  } else if (count != reader.rows) {
+    fprintf(stderr, "ethereum-columnar-dump: %s has %" G_GUINT64_FORMAT " rows, but its trailer says %"
+            G_GUINT64_FORMAT "\n", argv[1], count, reader.rows);
+    ret = EXIT_FAILURE;
+  }
+
+  g_array_free(rows, TRUE);
+  ethereum_columnar_reader_close(&reader);
+  return ret;
+}
@@ -0,0 +1,491 @@
+/* ethereum-xcorr.c
+ * Correlates the discovery messages seen at several vantage points, from the index files written by the
+ * ethereum,hashindex tap, and reports one-way latencies and losses per message type and per peer pair.
+ * Copyright 2018, ConsenSys AG.
+ *
+ * Wireshark - Network traffic analyzer
+ * By Gerald Combs <gerald@wireshark.org>
+ * Copyright 1998, Gerald Combs.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Usage: ethereum-xcorr [-n <pairs>] <index>[=<address>] <index>[=<address>]...
+ *
+ * Each index is written by tshark -r <capture> -q -z ethereum,hashindex,<index> at one vantage point. The address
+ * of the capturing host is inferred from the capture, unless given after the index.
+ *
+ * All the runs of all the indexes are merged in a single streaming pass, so the memory footprint only depends on
+ * the number of runs and peer pairs, not on the number of messages. A message is sent by the capture whose host
+ * is its source, and received by the capture whose host is its destination: the one-way latency is the difference
+ * between the two capture times (so it includes the clock offset between the hosts), and a message seen by the
+ * sender but not by the receiver is lost. Messages whose ends aren't both captured are left out.
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <glib.h>
+
+#include <wsutil/inet_addr.h>
+
+#include "ethereum-hashindex.h"
+#include "ethereum-histogram.h"
+
+// Number of peer pairs reported by default.
+#define XCORR_PAIRS 20
+
+// A capture, i.e. an index file and the address of its host.
+typedef struct xcorr_capture {
+  const gchar *path;
+  ethereum_hashindex_t index;
+  guint8 addr[ETHEREUM_HASHINDEX_ADDR_LEN];
+  gboolean seen;                          // The current message was seen in this capture.
+  ethereum_hashindex_record_t first;      // The first record of the current message in this capture.
+} xcorr_capture_t;
+
+// A run being merged.
+typedef struct xcorr_source {
+  ethereum_hashindex_cursor_t cursor;
+  guint capture;
+} xcorr_source_t;
+
+// Counters of messages between captured hosts.
+typedef struct xcorr_counts {
+  guint64 sent;        // Seen by the sender.
+  guint64 received;    // Seen by both the sender and the receiver.
+  guint64 lost;        // Seen by the sender only.
+  guint64 unmatched;   // Seen by the receiver only.
+  guint64 skewed;      // Received before being sent, per the clocks of the hosts.
+  guint64 latency_sum; // In microseconds.
+  guint64 latency_max;
+} xcorr_counts_t;
+
+// The counters of a message type.
+typedef struct xcorr_type {
+  xcorr_counts_t counts;
+  ethereum_hist_t hist;   // Latencies in microseconds.
+} xcorr_type_t;
+
+// The counters of a peer pair, keyed by source and destination endpoints.
+typedef struct xcorr_pair {
+  guint8 key[2 * (ETHEREUM_HASHINDEX_ADDR_LEN + 2)];
+  xcorr_counts_t counts;
+} xcorr_pair_t;
+
+static const gchar *type_names[] = {NULL, "PING", "PONG", "FIND_NODE", "NODES"};
+
+static const gdouble percentiles[] = {50.0, 90.0, 99.0};
+
+static xcorr_capture_t *captures;
+static guint capture_count;
+static xcorr_type_t *types;         // Indexed by packet type.
+static GHashTable *pairs;           // Key => xcorr_pair_t.
+static guint64 messages;
+static guint64 uncorrelated;
+
+static guint pair_hash(gconstpointer key) {
+  const guint8 *p = (const guint8 *) key;
+  guint32 h = 2166136261U;
+  guint i;
+
+  for (i = 0; i < sizeof(((xcorr_pair_t *) 0)->key); i++) {
+    h = (h ^ p[i]) * 16777619U;
+  }
+  return h;
+}
+
+static gboolean pair_equal(gconstpointer a, gconstpointer b) {
+  return memcmp(a, b, sizeof(((xcorr_pair_t *) 0)->key)) == 0;
+}
+
+/**
+ * Formats an address, unmapping IPv4 addresses.
+ */
+static void format_addr(const guint8 *addr, gchar *buf, guint size) {
+  static const guint8 v4_mapped[12] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xff, 0xff};
+
+  if (memcmp(addr, v4_mapped, sizeof(v4_mapped)) == 0) {
+    ws_inet_ntop4(addr + 12, buf, size);
+  } else {
+    ws_inet_ntop6(addr, buf, size);
+  }
+}
+
+/**
+ * Parses an address given on the command line into an IPv6 or IPv4-mapped address.
+ */
+static gboolean parse_addr(const gchar *str, guint8 *addr) {
+  memset(addr, 0, ETHEREUM_HASHINDEX_ADDR_LEN);
+  if (ws_inet_pton4(str, (guint32 *) (void *) (addr + 12))) {
+    addr[10] = addr[11] = 0xff;
+    return TRUE;
+  }
+  return ws_inet_pton6(str, (ws_in6_addr *) (void *) addr);
+}
+
+/**
+ * Returns the capture whose host has an address, if any.
+ */
+static gint capture_of(const guint8 *addr) {
+  guint i;
+
+  for (i = 0; i < capture_count; i++) {
+    if (memcmp(captures[i].addr, addr, ETHEREUM_HASHINDEX_ADDR_LEN) == 0) {
+      return (gint) i;
+    }
+  }
+  return -1;
+}
+
+/**
+ * Counts a message in a set of counters.
+ */
+static void count(xcorr_counts_t *counts, gboolean sent, gboolean received, gint64 latency) {
+  if (!sent) {
+    counts->unmatched++;
+    return;
+  }
+  counts->sent++;
+  if (!received) {
+    counts->lost++;
+    return;
+  }
+  counts->received++;
+  if (latency < 0) {
+    counts->skewed++;
+    return;
+  }
+  counts->latency_sum += (guint64) latency;
+  counts->latency_max = MAX(counts->latency_max, (guint64) latency);
+}
+
+/**
+ * Accounts for the current message, given where it was seen.
+ */
+static void process_message(void) {
+  const ethereum_hashindex_record_t *sent = NULL, *received = NULL, *ref;
+  gint sender = -1, receiver = -1;
+  xcorr_pair_t *pair;
+  guint8 key[sizeof(pair->key)];
+  gint64 latency = 0;
+  guint i;
+
+  messages++;
+
+  // Each capture tells whether its host sent or received the message; both ends are as seen by the sender if
+  // it's captured, so that address translation on the path doesn't matter.
+  for (i = 0; i < capture_count; i++) {
+    if (!captures[i].seen) {
+      continue;
+    }
+    if (memcmp(captures[i].first.src_addr, captures[i].addr, ETHEREUM_HASHINDEX_ADDR_LEN) == 0) {
+      sender = (gint) i;
+      sent = &captures[i].first;
+    } else if (memcmp(captures[i].first.dst_addr, captures[i].addr, ETHEREUM_HASHINDEX_ADDR_LEN) == 0) {
+      receiver = (gint) i;
+      received = &captures[i].first;
+    }
+  }
+  if (sent && !received) {
+    receiver = capture_of(sent->dst_addr);
+  } else if (received && !sent) {
+    sender = capture_of(received->src_addr);
+  }
+  if (sender < 0 || receiver < 0 || sender == receiver) {
+    uncorrelated++;
+    return;
+  }
+
+  if (sent && received) {
+    latency = ((gint64) received->ts - (gint64) sent->ts) / 1000;
+    if (latency >= 0) {
+      ethereum_hist_add(&types[sent->type].hist, (guint64) latency);
+    }
+  }
+  ref = sent ? sent : received;
+  count(&types[ref->type].counts, sent != NULL, received != NULL, latency);
+
+  memcpy(key, ref->src_addr, ETHEREUM_HASHINDEX_ADDR_LEN);
+  key[ETHEREUM_HASHINDEX_ADDR_LEN] = (guint8) (ref->src_port >> 8);
+  key[ETHEREUM_HASHINDEX_ADDR_LEN + 1] = (guint8) ref->src_port;
+  memcpy(key + ETHEREUM_HASHINDEX_ADDR_LEN + 2, ref->dst_addr, ETHEREUM_HASHINDEX_ADDR_LEN);
+  key[2 * ETHEREUM_HASHINDEX_ADDR_LEN + 2] = (guint8) (ref->dst_port >> 8);
+  key[2 * ETHEREUM_HASHINDEX_ADDR_LEN + 3] = (guint8) ref->dst_port;
+  pair = (xcorr_pair_t *) g_hash_table_lookup(pairs, key);
+  if (!pair) {
+    pair = g_new0(xcorr_pair_t, 1);
+    memcpy(pair->key, key, sizeof(key));
+    g_hash_table_insert(pairs, pair->key, pair);
+  }
+  count(&pair->counts, sent != NULL, received != NULL, latency);
+}
+
+/**
+ * Compares the current records of two sources, by key, time, then capture.
+ */
+static int compare_sources(xcorr_source_t *a, xcorr_source_t *b) {
+  int c = memcmp(ethereum_hashindex_cursor_peek(&a->cursor), ethereum_hashindex_cursor_peek(&b->cursor),
+                 ETHEREUM_HASHINDEX_SORT_LEN);
+  return c ? c : (int) a->capture - (int) b->capture;
+}
+
+/**
+ * Restores the heap property from a position downwards.
+ */
+static void sift_down(xcorr_source_t **heap, guint len, guint i) {
+  for (;;) {
+    guint min = i, l = 2 * i + 1, r = l + 1;
+    xcorr_source_t *tmp;
+
+    if (l < len && compare_sources(heap[l], heap[min]) < 0) {
+      min = l;
+    }
+    if (r < len && compare_sources(heap[r], heap[min]) < 0) {
+      min = r;
+    }
+    if (min == i) {
+      return;
+    }
+    tmp = heap[i];
+    heap[i] = heap[min];
+    heap[min] = tmp;
+    i = min;
+  }
+}
+
+/**
+ * Merges all the runs of all the captures, by message key.
+ */
+static void merge(void) {
+  xcorr_source_t *sources, **heap;
+  ethereum_hashindex_record_t record;
+  guint8 current[ETHEREUM_HASHINDEX_KEY_LEN];
+  gboolean has_current = FALSE;
+  guint len = 0, total = 0, i, j;
+
+  for (i = 0; i < capture_count; i++) {
+    total += captures[i].index.runs->len;
+  }
+  sources = g_new0(xcorr_source_t, total);
+  heap = g_new(xcorr_source_t *, total);
+  for (i = 0; i < capture_count; i++) {
+    for (j = 0; j < captures[i].index.runs->len; j++) {
+      xcorr_source_t *source = &sources[len];
+      ethereum_hashindex_cursor_init(&source->cursor, &captures[i].index, j);
+      source->capture = i;
+      if (ethereum_hashindex_cursor_peek(&source->cursor)) {
+        heap[len++] = source;
+      } else {
+        ethereum_hashindex_cursor_clear(&source->cursor);
+      }
+    }
+  }
+  for (i = len / 2; i-- > 0;) {
+    sift_down(heap, len, i);
+  }
+
+  while (len > 0) {
+    xcorr_source_t *source = heap[0];
+    xcorr_capture_t *capture = &captures[source->capture];
+
+    ethereum_hashindex_decode(ethereum_hashindex_cursor_peek(&source->cursor), &record);
+    if (!has_current || memcmp(current, record.key, sizeof(current)) != 0) {
+      if (has_current) {
+        process_message();
+      }
+      for (i = 0; i < capture_count; i++) {
+        captures[i].seen = FALSE;
+      }
+      memcpy(current, record.key, sizeof(current));
+      has_current = TRUE;
+    }
+    // Records come by time within a message, so the first one of each capture is kept.
+    if (!capture->seen) {
+      capture->first = record;
+      capture->seen = TRUE;
+    }
+
+    ethereum_hashindex_cursor_next(&source->cursor);
+    if (!ethereum_hashindex_cursor_peek(&source->cursor)) {
+      ethereum_hashindex_cursor_clear(&source->cursor);
+      heap[0] = heap[--len];
+    }
+    sift_down(heap, len, 0);
+  }
+  if (has_current) {
+    process_message();
+  }
+  g_free(heap);
+  g_free(sources);
+}
+
+static void print_counts_header(const gchar *first) {
+  printf("%-44s %12s %12s %12s %8s %12s %10s", first, "Sent", "Received", "Lost", "Loss %", "Unmatched",
+         "Skewed");
+}
+
+static void print_counts(const xcorr_counts_t *counts) {
+  gdouble loss = counts->sent ? 100.0 * (gdouble) counts->lost / (gdouble) counts->sent : 0.0;
+  printf(" %12" G_GUINT64_FORMAT " %12" G_GUINT64_FORMAT " %12" G_GUINT64_FORMAT " %8.2f %12" G_GUINT64_FORMAT
+         " %10" G_GUINT64_FORMAT, counts->sent, counts->received, counts->lost, loss, counts->unmatched,
+         counts->skewed);
+}
+
+static gint compare_pairs(gconstpointer a, gconstpointer b) {
+  const xcorr_pair_t *x = *(const xcorr_pair_t *const *) a;
+  const xcorr_pair_t *y = *(const xcorr_pair_t *const *) b;
+  guint64 nx = x->counts.sent + x->counts.unmatched;
+  guint64 ny = y->counts.sent + y->counts.unmatched;
+  return nx < ny ? 1 : nx > ny ? -1 : 0;
+}
+
+/**
+ * Writes the report out.
+ */
+static void report(guint max_pairs) {
+  gchar addr[WS_INET6_ADDRSTRLEN], name[128];
+  GPtrArray *sorted;
+  GHashTableIter iter;
+  gpointer value;
+  guint64 values[G_N_ELEMENTS(percentiles)];
+  guint i;
+
+  printf("Captures:\n");
+  for (i = 0; i < capture_count; i++) {
+    format_addr(captures[i].addr, addr, sizeof(addr));
+    printf("  %-40s %14" G_GUINT64_FORMAT " records  %s\n", addr, captures[i].index.records, captures[i].path);
+  }
+  printf("\n%" G_GUINT64_FORMAT " distinct messages, %" G_GUINT64_FORMAT " not between captured hosts\n\n",
+         messages, uncorrelated);
+
+  printf("Per message type:\n");
+  print_counts_header("Type");
+  printf(" %10s %10s %10s %10s %10s\n", "Avg (us)", "p50 (us)", "p90 (us)", "p99 (us)", "Max (us)");
+  for (i = 0; i <= G_MAXUINT8; i++) {
+    const xcorr_type_t *type = &types[i];
+    guint64 latencies = type->counts.received - type->counts.skewed;
+    if (type->counts.sent == 0 && type->counts.unmatched == 0) {
+      continue;
+    }
+    if (i < G_N_ELEMENTS(type_names) && type_names[i]) {
+      g_snprintf(name, sizeof(name), "%s", type_names[i]);
+    } else {
+      g_snprintf(name, sizeof(name), "Type %u", i);
+    }
+    printf("%-44s", name);
+    print_counts(&type->counts);
+    ethereum_hist_percentiles(&type->hist, percentiles, G_N_ELEMENTS(percentiles), values);
+    printf(" %10" G_GUINT64_FORMAT " %10" G_GUINT64_FORMAT " %10" G_GUINT64_FORMAT " %10" G_GUINT64_FORMAT
+           " %10" G_GUINT64_FORMAT "\n", latencies ? type->counts.latency_sum / latencies : 0, values[0],
+           values[1], values[2], type->counts.latency_max);
+  }
+
+  sorted = g_ptr_array_new();
+  g_hash_table_iter_init(&iter, pairs);
+  while (g_hash_table_iter_next(&iter, NULL, &value)) {
+    g_ptr_array_add(sorted, value);
+  }
+  g_ptr_array_sort(sorted, compare_pairs);
+  printf("\nPer peer pair (%u of %u, by number of messages):\n", MIN(sorted->len, max_pairs), sorted->len);
+  print_counts_header("Source -> Destination");
+  printf(" %10s %10s\n", "Avg (us)", "Max (us)");
+  for (i = 0; i < sorted->len && i < max_pairs; i++) {
+    const xcorr_pair_t *pair = (const xcorr_pair_t *) g_ptr_array_index(sorted, i);
+    const guint8 *dst = pair->key + ETHEREUM_HASHINDEX_ADDR_LEN + 2;
+    guint64 latencies = pair->counts.received - pair->counts.skewed;
+    gchar dst_addr[WS_INET6_ADDRSTRLEN];
+
+    format_addr(pair->key, addr, sizeof(addr));
+    format_addr(dst, dst_addr, sizeof(dst_addr));
+    g_snprintf(name, sizeof(name), "%s:%u -> %s:%u", addr,
+               (pair->key[ETHEREUM_HASHINDEX_ADDR_LEN] << 8) | pair->key[ETHEREUM_HASHINDEX_ADDR_LEN + 1],
+               dst_addr, (dst[ETHEREUM_HASHINDEX_ADDR_LEN] << 8) | dst[ETHEREUM_HASHINDEX_ADDR_LEN + 1]);
+    printf("%-44s", name);
+    print_counts(&pair->counts);
+    printf(" %10" G_GUINT64_FORMAT " %10" G_GUINT64_FORMAT "\n",
+           latencies ? pair->counts.latency_sum / latencies : 0, pair->counts.latency_max);
+  }
+  g_ptr_array_free(sorted, TRUE);
+}
+
+static void usage(void) {
+  fprintf(stderr, "Usage: ethereum-xcorr [-n <pairs>] <index>[=<address>] <index>[=<address>]...\n"
+                  "\n"
+                  "Correlates the indexes written by tshark -z ethereum,hashindex,<index> at several vantage\n"
+                  "points, and reports one-way latencies and losses per message type and per peer pair.\n"
+                  "  -n <pairs>  number of peer pairs to report (default: %u)\n", XCORR_PAIRS);
+}
+
+int main(int argc, char *argv[]) {
+  guint max_pairs = XCORR_PAIRS;
+  int first = 1, ret = EXIT_SUCCESS;
+  guint i;
+
+  if (argc > 2 && strcmp(argv[1], "-n") == 0) {
+    max_pairs = (guint) strtoul(argv[2], NULL, 10);
+    first = 3;
+  }
+  if (argc - first < 2) {
+    usage();
+    return EXIT_FAILURE;
+  }
+
+  capture_count = (guint) (argc - first);
+  captures = g_new0(xcorr_capture_t, capture_count);
+  for (i = 0; i < capture_count; i++) {
+    gchar *arg = g_strdup(argv[first + i]);
+    gchar *addr = strrchr(arg, '=');
+    xcorr_capture_t *capture = &captures[i];
+
+    if (addr) {
+      *addr++ = '\0';
+    }
+    capture->path = arg;
+    if (!ethereum_hashindex_open(&capture->index, arg)) {
+      fprintf(stderr, "ethereum-xcorr: %s is not a complete index file\n", arg);
+      ret = EXIT_FAILURE;
+    } else if (addr && !parse_addr(addr, capture->addr)) {
+      fprintf(stderr, "ethereum-xcorr: invalid address %s\n", addr);
+      ret = EXIT_FAILURE;
+    } else if (!addr && !capture->index.has_local_addr) {
+      fprintf(stderr, "ethereum-xcorr: can't tell the address of the host of %s; give it as %s=<address>\n",
+              arg, arg);
+      ret = EXIT_FAILURE;
+    } else if (!addr) {
+      memcpy(capture->addr, capture->index.local_addr, ETHEREUM_HASHINDEX_ADDR_LEN);
+    }
+  }
+
+  if (ret == EXIT_SUCCESS) {
+    types = g_new0(xcorr_type_t, G_MAXUINT8 + 1);
+    pairs = g_hash_table_new_full(pair_hash, pair_equal, NULL, g_free);
+    merge();
+    report(max_pairs);
+    g_hash_table_destroy(pairs);
+    g_free(types);
+  }
+
+  for (i = 0; i < capture_count; i++) {
+    ethereum_hashindex_close(&captures[i].index);
+    g_free((gchar *) captures[i].path);
+  }
+  g_free(captures);
+  return ret;
+}